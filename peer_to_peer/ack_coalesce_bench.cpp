@@ -0,0 +1,309 @@
+/**
+ * Purpose:
+ *  Measure the reverse channel cost of acknowledging artifacts one by one
+ *  and with ackCoalescer.
+ *
+ *  Two radios are connected through a linkEmulator with latency and loss.
+ *  The sender transmits artifact messages at a fixed interval and runs
+ *  message900 retransmission scans. The receiver sends a robot position back
+ *  every pose_millis, the reverse direction data ACKs can ride along with.
+ *
+ *  PER_MESSAGE - one ack_message_t per artifact, as rxspeed does
+ *  COALESCED   - ackCoalescer, flushed on its timer or piggybacked on the
+ *                robot positions, released with one pass over the wait list
+ *
+ *  For each mode the program reports the reverse channel ACK bytes and serial
+ *  writes per 1000 artifacts, retransmissions and the delivery latency.
+ *
+ * Optional Command line arguments
+ *  argv[1] - number of messages
+ *  argv[2] - milliseconds between messages
+ *  argv[3] - one way latency, milliseconds
+ *  argv[4] - loss probability per chunk
+ *  argv[5] - milliseconds between robot positions from the receiver
+ *
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>                  // atoi, atof
+#include <cstring>                  // memcpy
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "ack_coalescer.h"
+#include "link_emulator.h"
+#include "message900.h"
+#include "rfd900_modem.h"
+#include "simulation_constants.h"
+#include "sim_artifact_message.h"
+
+
+using rfd900sim::SimConstants;
+using steady = std::chrono::steady_clock;
+
+constexpr size_t SERIAL_RX_BUFFER_LENGTH = 256;
+constexpr long POLL_TIMEOUT = 5000L;            // units, microseconds
+
+enum class ackMode{
+    PER_MESSAGE,
+    COALESCED
+};
+
+struct reverse_stats_t{
+    uint64_t ack_bytes;
+    uint64_t ack_writes;                        // serial writes that carried only ACKs
+    uint64_t data_writes;
+};
+
+static std::atomic<bool> receiverRunning;
+
+
+static size_t framed(size_t length)
+{
+    return length + SimConstants::MESSAGE_900_START_INDICATOR_LENGTH + SimConstants::MESSAGE_900_END_INDICATOR_LENGTH;
+}
+
+
+static void receiver(rfd900comm::rfd900Modem* radio, ackMode mode, int pose_millis, reverse_stats_t* stats)
+{
+    const uint8_t myCommId = SimConstants::BASE_STATION;
+    const uint8_t peer = SimConstants::AERIAL01;
+
+    rfd900sim::ackCoalescer coalescer(myCommId);
+    uint8_t serial_rx_buffer[SERIAL_RX_BUFFER_LENGTH];
+    uint8_t serial_tx_buffer[SERIAL_RX_BUFFER_LENGTH];
+    std::string temp_rx_storage;
+    std::string extracted_rx_data;
+
+    auto next_pose = steady::now() + std::chrono::milliseconds(pose_millis);
+    uint32_t pose_stamp = 0;
+
+    while(receiverRunning){
+        long timeout = POLL_TIMEOUT;
+        if(mode == ackMode::COALESCED){
+            auto delay = std::chrono::duration_cast<std::chrono::microseconds>(coalescer.next_flush_delay(steady::now()));
+            timeout = std::max(0L, std::min(timeout, static_cast<long>(delay.count())));
+        }
+
+        ssize_t bytesRead = radio->read_serial(serial_rx_buffer, SERIAL_RX_BUFFER_LENGTH, timeout);
+        if(bytesRead > 0){
+            temp_rx_storage.append((const char*)serial_rx_buffer, bytesRead);
+        }
+
+        while(rfd900sim::extract_rx_message(temp_rx_storage, extracted_rx_data)){
+            rfd900sim::ack_message_t ackmsg;
+            if(rfd900sim::process_rx_message(extracted_rx_data, &ackmsg, true) != SimConstants::SEND_ACK){
+                continue;
+            }
+
+            if(mode == ackMode::COALESCED && coalescer.record(ackmsg.dest_id, ackmsg.msg_id, &ackmsg) != SimConstants::SEND_ACK){
+                continue;
+            }
+
+            size_t length = framed(sizeof(rfd900sim::ack_message_t));
+            rfd900sim::serialize_acknowledgement_for_900MHz(&ackmsg, serial_tx_buffer, length);
+            radio->send_message((const char*)serial_tx_buffer, length);
+            stats->ack_bytes += length;
+            ++stats->ack_writes;
+        }
+
+        auto now = steady::now();
+        rfd900sim::ack_bitmap_message_t bitmap;
+        const size_t bitmap_length = framed(sizeof(bitmap));
+
+        if(now >= next_pose){
+            rfd900sim::robot_position_message_t pos;
+            rfd900sim::simulate_robot_position_message(&pos, peer, myCommId, pose_stamp);
+            pose_stamp += pose_millis * 1000;
+            next_pose += std::chrono::milliseconds(pose_millis);
+
+            size_t length = framed(sizeof(pos));
+            rfd900sim::serialize_robot_position_for_900MHz(&pos, serial_tx_buffer, length);
+
+            // the pending ACK shares the position's serial write
+            if(mode == ackMode::COALESCED && coalescer.piggyback(peer, &bitmap) == 0){
+                rfd900sim::serialize_ack_bitmap_for_900MHz(&bitmap, serial_tx_buffer + length, bitmap_length);
+                length += bitmap_length;
+                stats->ack_bytes += bitmap_length;
+            }
+
+            radio->send_message((const char*)serial_tx_buffer, length);
+            ++stats->data_writes;
+        }
+
+        if(mode == ackMode::COALESCED){
+            while(coalescer.flush(now, &bitmap) == 0){
+                rfd900sim::serialize_ack_bitmap_for_900MHz(&bitmap, serial_tx_buffer, bitmap_length);
+                radio->send_message((const char*)serial_tx_buffer, bitmap_length);
+                stats->ack_bytes += bitmap_length;
+                ++stats->ack_writes;
+            }
+        }
+    }
+}
+
+
+static int run_mode(ackMode mode, const rfd900comm::linkEmulatorConfig& config,
+            int messageCount, int tx_millis, int pose_millis)
+{
+    const size_t SERIAL_ARTIFACT_BUFFER_LENGTH = framed(sizeof(rfd900sim::artifact_message_t));
+
+    rfd900comm::linkEmulator emulator;
+    rfd900comm::rfd900Modem tx_radio;
+    rfd900comm::rfd900Modem rx_radio;
+    rfd900comm::message900 msg900;
+
+    std::vector<uint8_t> serial_tx_buffer(SERIAL_ARTIFACT_BUFFER_LENGTH);
+    uint8_t serial_rx_buffer[SERIAL_RX_BUFFER_LENGTH];
+    std::string temp_rx_storage;
+    std::string extracted_rx_data;
+
+    std::unordered_map<uint16_t, steady::time_point> first_tx;
+    std::vector<double> delivery_ms;
+    size_t retransmissions = 0;
+    reverse_stats_t reverse{};
+
+    if(emulator.start(config) != 0){
+        return -1;
+    }
+
+    if(tx_radio.init(emulator.port_name(0)) != 0 || rx_radio.init(emulator.port_name(1)) != 0){
+        fprintf(stderr, "error, %s radio init failure\n", __func__);
+        return -1;
+    }
+
+    receiverRunning = true;
+    std::thread rx_thread(receiver, &rx_radio, mode, pose_millis, &reverse);
+
+    auto retransmit = [&](const rfd900comm::message900_t& msg){
+        tx_radio.send_message((const char*)msg.data, msg.data_length);
+    };
+
+    // released entries are the ids no longer in the wait list
+    auto record_delivered = [&](){
+        auto now = steady::now();
+        for(auto it = first_tx.begin(); it != first_tx.end();){
+            if(msg900.in_ack_wait_list(SimConstants::BASE_STATION, it->first)){
+                ++it;
+                continue;
+            }
+            delivery_ms.push_back(std::chrono::duration<double, std::milli>(now - it->second).count());
+            it = first_tx.erase(it);
+        }
+    };
+
+    int txcount = 0;
+    auto next_tx = steady::now();
+    auto give_up = steady::time_point::max();
+
+    while(txcount < messageCount || (msg900.ack_wait_list_size() > 0 && steady::now() < give_up)){
+
+        if(txcount < messageCount && steady::now() >= next_tx){
+            rfd900sim::artifact_message_t artmsg;
+            rfd900sim::simulate_artifact_message(&artmsg, SimConstants::BASE_STATION, SimConstants::AERIAL01);
+            rfd900sim::serialize_artifact_for_900MHz(&artmsg, serial_tx_buffer.data(), SERIAL_ARTIFACT_BUFFER_LENGTH);
+
+            tx_radio.send_message((const char*)serial_tx_buffer.data(), SERIAL_ARTIFACT_BUFFER_LENGTH);
+            msg900.add_to_ack_wait_list(artmsg.dest_id, artmsg.msg_id, artmsg.msg_type,
+                        serial_tx_buffer.data(), SERIAL_ARTIFACT_BUFFER_LENGTH);
+            first_tx[artmsg.msg_id] = steady::now();
+
+            ++txcount;
+            next_tx += std::chrono::milliseconds(tx_millis);
+            if(txcount == messageCount){
+                give_up = steady::now() + std::chrono::seconds(30);
+            }
+        }
+
+        ssize_t bytesRead = tx_radio.read_serial(serial_rx_buffer, SERIAL_RX_BUFFER_LENGTH, 1000L);
+        if(bytesRead > 0){
+            temp_rx_storage.append((const char*)serial_rx_buffer, bytesRead);
+            while(rfd900sim::extract_rx_message(temp_rx_storage, extracted_rx_data)){
+                rfd900sim::ack_message_t ack;
+                if(rfd900sim::process_rx_message(extracted_rx_data, &ack) != SimConstants::PROCESS_ACK){
+                    continue;                           // robot positions
+                }
+
+                if(extracted_rx_data[2] == SimConstants::ACK_BITMAP){
+                    rfd900sim::ack_bitmap_message_t bitmap;
+                    memcpy(&bitmap, extracted_rx_data.data(), sizeof(bitmap));
+                    if(msg900.process_received_ack_bitmap(bitmap.src_id, bitmap.cumulative, bitmap.run, bitmap.bitmap) > 0){
+                        record_delivered();
+                    }
+                }
+                else{
+                    memcpy(&ack, extracted_rx_data.data(), sizeof(ack));
+                    if(msg900.process_received_ack(ack.src_id, ack.msg_id) == 0){
+                        record_delivered();
+                    }
+                }
+            }
+        }
+
+        retransmissions += msg900.scan_list_for_retransmission(retransmit);
+    }
+
+    receiverRunning = false;
+    rx_thread.join();
+
+    std::sort(delivery_ms.begin(), delivery_ms.end());
+    size_t n = delivery_ms.size();
+    double per_1000 = 1000.0 / messageCount;
+
+    fprintf(stdout, "%s\n", mode == ackMode::PER_MESSAGE ? "per message ACKs" : "coalesced ACKs");
+    fprintf(stdout, "    reverse ACK bytes per 1000 artifacts: %8.0f  ACK only writes: %6.0f  position writes: %6.0f\n",
+                reverse.ack_bytes * per_1000, reverse.ack_writes * per_1000, reverse.data_writes * per_1000);
+    fprintf(stdout, "    retransmissions: %lu  undelivered: %lu", retransmissions, msg900.ack_wait_list_size());
+    if(n > 0){
+        fprintf(stdout, "  delivery p50: %.1f ms  p95: %.1f ms", delivery_ms[n / 2], delivery_ms[(n * 95) / 100]);
+    }
+    fprintf(stdout, "\n");
+
+    return 0;
+}
+
+
+int main(int argc, char **argv)
+{
+    int messageCount = 1000;
+    int tx_millis = 10;
+    int pose_millis = 100;
+    rfd900comm::linkEmulatorConfig config;
+    config.latency = std::chrono::milliseconds(30);
+    config.loss_probability = 0.05;
+
+    if(argc > 1){
+        messageCount = atoi(argv[1]);
+    }
+    if(argc > 2){
+        tx_millis = atoi(argv[2]);
+    }
+    if(argc > 3){
+        config.latency = std::chrono::milliseconds(atoi(argv[3]));
+    }
+    if(argc > 4){
+        config.loss_probability = atof(argv[4]);
+    }
+    if(argc > 5){
+        pose_millis = atoi(argv[5]);
+    }
+
+    fprintf(stdout, "messages: %d, interval: %d ms, one way latency: %ld ms, loss: %.2f, positions every %d ms\n",
+                messageCount, tx_millis, (long)std::chrono::duration_cast<std::chrono::milliseconds>(config.latency).count(),
+                config.loss_probability, pose_millis);
+    fprintf(stdout, "framed ACK: %lu bytes, framed bitmap ACK: %lu bytes\n",
+                framed(sizeof(rfd900sim::ack_message_t)), framed(sizeof(rfd900sim::ack_bitmap_message_t)));
+
+    if(run_mode(ackMode::PER_MESSAGE, config, messageCount, tx_millis, pose_millis) != 0){
+        return 1;
+    }
+    if(run_mode(ackMode::COALESCED, config, messageCount, tx_millis, pose_millis) != 0){
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,158 @@
+/**
+ * @brief ackCoalescer class function definitions.
+ *
+ */
+
+#include <cstring>                  // memset
+
+#include "ack_coalescer.h"
+#include "simulation_constants.h"
+#include "virtual_clock.h"
+
+
+namespace rfd900sim
+{
+    ackCoalescer::ackCoalescer(uint8_t my_id, clock::duration flush_delay, int flush_count) :
+        myId(my_id), flushDelay(flush_delay), flushCount(flush_count),
+        coalescedCount(0), singleCount(0)
+    {
+        // intentionally blank
+    }
+
+
+    // moves cumulative forward by shift ids, bits shifted out extend or end the run
+    void ackCoalescer::advance(window_t* w, uint32_t shift)
+    {
+        while(shift > 0){
+            if(w->bitmap & 1){
+                if(w->run < ACK_MAX_RUN){
+                    ++w->run;
+                }
+            }
+            else{
+                w->run = 0;
+            }
+            w->bitmap >>= 1;
+            ++w->cumulative;
+            --shift;
+
+            // nothing received further ahead
+            if(w->bitmap == 0 && shift > 0){
+                w->cumulative += shift;
+                w->run = 0;
+                shift = 0;
+            }
+        }
+    }
+
+
+    int ackCoalescer::record(uint8_t src_id, uint16_t msg_id, ack_message_t* single)
+    {
+        auto inserted = windows.try_emplace(src_id);
+        window_t& w = inserted.first->second;
+
+        if(inserted.second){
+            w.cumulative = msg_id;
+            w.run = 1;
+            w.bitmap = 0;
+            w.pending = 0;
+        }
+        else{
+            int16_t ahead = static_cast<int16_t>(msg_id - w.cumulative);
+
+            if(ahead == 0 && w.run == 0){
+                w.run = 1;                                  // the window slid past it before it arrived
+            }
+            else if(ahead <= 0){
+                if(-ahead >= w.run){
+                    populate_ack_message(single, src_id, myId, msg_id);
+                    ++singleCount;
+                    return SimConstants::SEND_ACK;
+                }
+                // duplicate, the ACK that covered it was lost, cover it again
+            }
+            else{
+                if(ahead > ACK_BITMAP_WINDOW){
+                    advance(&w, ahead - ACK_BITMAP_WINDOW);
+                    ahead = ACK_BITMAP_WINDOW;
+                }
+
+                w.bitmap |= 1ULL << (ahead - 1);
+                while(w.bitmap & 1){
+                    advance(&w, 1);
+                }
+            }
+        }
+
+        if(w.pending == 0){
+            w.first_pending = rfd900comm::clock_now();
+        }
+        ++w.pending;
+        return 0;
+    }
+
+
+    void ackCoalescer::fill(uint8_t dest_id, window_t* w, ack_bitmap_message_t* ack)
+    {
+        memset(ack, 0, sizeof(ack_bitmap_message_t));     // no stray padding bytes on the air
+        ack->dest_id = dest_id;
+        ack->src_id = myId;
+        ack->msg_type = SimConstants::ACK_BITMAP;
+        ack->cumulative = w->cumulative;
+        ack->run = w->run;
+        ack->bitmap = w->bitmap;
+
+        w->pending = 0;
+        ++coalescedCount;
+    }
+
+
+    int ackCoalescer::piggyback(uint8_t dest_id, ack_bitmap_message_t* ack)
+    {
+        auto it = windows.find(dest_id);
+        if(it == windows.end() || it->second.pending == 0){
+            return -1;
+        }
+
+        fill(dest_id, &it->second, ack);
+        return 0;
+    }
+
+
+    int ackCoalescer::flush(clock::time_point now, ack_bitmap_message_t* ack)
+    {
+        for(auto& entry : windows){
+            window_t& w = entry.second;
+            if(w.pending > 0 && (w.pending >= flushCount || now - w.first_pending >= flushDelay)){
+                fill(entry.first, &w, ack);
+                return 0;
+            }
+        }
+
+        return -1;
+    }
+
+
+    ackCoalescer::clock::duration ackCoalescer::next_flush_delay(clock::time_point now) const
+    {
+        clock::duration delay = clock::duration::max();
+
+        for(const auto& entry : windows){
+            const window_t& w = entry.second;
+            if(w.pending == 0){
+                continue;
+            }
+            if(w.pending >= flushCount){
+                return clock::duration::zero();
+            }
+
+            clock::duration remaining = w.first_pending + flushDelay - now;
+            if(remaining < delay){
+                delay = remaining < clock::duration::zero() ? clock::duration::zero() : remaining;
+            }
+        }
+
+        return delay;
+    }
+
+}
@@ -0,0 +1,93 @@
+/**
+ * @brief Declares ackCoalescer, receiver side delayed and aggregated ACKs
+ *
+ * Acknowledging every artifact with its own ack_message_t costs a reverse
+ * direction frame per data frame, and on the half-duplex radio every one of
+ * them turns the channel around. ackCoalescer records the received msg_ids per
+ * source and answers with one ack_bitmap_message_t covering
+ *      a contiguous run of ids ending at cumulative
+ *      the ACK_BITMAP_WINDOW ids after cumulative, one bit each
+ *
+ * The coalesced ACK goes out
+ *      when flush_delay has passed since the first unacknowledged id
+ *      when flush_count ids are waiting
+ *      with outgoing data to the source (piggyback), written in the same
+ *      serial write so it shares the data's radio packet
+ *
+ * An id too old for the window (a retransmission that arrives after the
+ * window moved past it) is acknowledged at once with a single ack_message_t.
+ *
+ */
+
+#ifndef ACK_COALESCER_INCLUDED_H
+#define ACK_COALESCER_INCLUDED_H
+
+#include <chrono>
+#include <cstdint>
+#include <unordered_map>
+
+#include "sim_artifact_message.h"
+
+
+namespace rfd900sim
+{
+    constexpr int ACK_BITMAP_WINDOW = 64;
+    constexpr uint16_t ACK_MAX_RUN = 0x7FFF;            // half the 16 bit id space, serial arithmetic stays unambiguous
+
+    class ackCoalescer{
+
+        public:
+
+        using clock = std::chrono::steady_clock;
+
+        static constexpr auto DEFAULT_FLUSH_DELAY = std::chrono::milliseconds(20);
+        static constexpr int DEFAULT_FLUSH_COUNT = 16;
+
+        ackCoalescer(uint8_t my_id, clock::duration flush_delay = DEFAULT_FLUSH_DELAY, int flush_count = DEFAULT_FLUSH_COUNT);
+
+        /**
+         * Records msg_id received from src_id.
+         * returns SimConstants::SEND_ACK when single must be sent now, 0 otherwise
+         */
+        int record(uint8_t src_id, uint16_t msg_id, ack_message_t* single);
+
+        // coalesced ACK to send with outgoing data to dest_id, -1 when nothing is pending
+        int piggyback(uint8_t dest_id, ack_bitmap_message_t* ack);
+
+        // coalesced ACK for the next source that is due, -1 when none is
+        int flush(clock::time_point now, ack_bitmap_message_t* ack);
+
+        // time until the next flush is due, clock::duration::max() when nothing is pending
+        clock::duration next_flush_delay(clock::time_point now) const;
+
+        uint64_t coalesced_acks() const { return coalescedCount; }
+        uint64_t single_acks() const { return singleCount; }
+
+
+        private:
+
+        struct window_t{
+            uint16_t cumulative;
+            uint16_t run;                   // ids received ending at cumulative, 0 when cumulative was not
+            uint64_t bitmap;                // bit i, cumulative + 1 + i received
+            int pending;                    // ids received since the last ACK
+            clock::time_point first_pending;
+        };
+
+        uint8_t myId;
+        clock::duration flushDelay;
+        int flushCount;
+
+        std::unordered_map<uint8_t, window_t> windows;
+
+        uint64_t coalescedCount;
+        uint64_t singleCount;
+
+        static void advance(window_t* w, uint32_t shift);
+        void fill(uint8_t dest_id, window_t* w, ack_bitmap_message_t* ack);
+    };
+
+}
+
+
+#endif
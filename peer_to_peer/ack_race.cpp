@@ -0,0 +1,255 @@
+/**
+ * Purpose:
+ *  Deliver an ACK in the same event loop pass as its timeout and check
+ *  that reliableSender resumes the waiting sender exactly once, no radio
+ *  needed.
+ *
+ *  The program plays the remote radio on the master side of a pseudo
+ *  terminal. For each round it reads the frame sent by send_acked and
+ *  writes the ACK just before the ACK timeout. It then wakes in the same
+ *  pass as the reader and blocks past the deadline. The reader queues the
+ *  ACK for the dispatcher, then the timer fires, and the dispatcher finds
+ *  a waiter whose timer is already gone. Every round must end with
+ *  send_acked returning true once and no timer left behind.
+ *
+ *  Next three messages are answered by one coalesced ACK, as an
+ *  ackCoalescer sends, covering the first by its run and the others by
+ *  bitmap bits. All three must come back true well before their timeout.
+ *
+ *  Then nothing is acknowledged and the message TTL runs out before the
+ *  attempts do. Two messages are sent through a one frame send window.
+ *  Both must come back false, reported expired rather than delivered. The
+ *  second must be released from the window by the first one's expiry.
+ *
+ * Optional Command line arguments
+ *  argv[1] - rounds, default 10
+ *  argv[2] - ack timeout, milliseconds, default 50
+ *
+ */
+
+#include <cstdio>
+#include <cstdlib>                  // atoi, posix_openpt, grantpt, unlockpt, ptsname
+#include <cstring>                  // memcpy, memset
+#include <fcntl.h>
+#include <unistd.h>                 // read, write, usleep
+
+#include <chrono>
+#include <string>
+#include <thread>                   // sleep_until
+
+#include "async_radio.h"
+#include "event_loop.h"
+#include "message900.h"
+#include "rfd900_modem.h"
+#include "simulation_constants.h"
+#include "sim_artifact_message.h"
+
+
+constexpr uint8_t MY_ID = 1;
+constexpr int COALESCED = 3;
+
+static int completions = 0;
+static int acked = 0;
+static int leftover_timers = 0;
+static int expiry_done = 0;
+static int coalesced_done = 0;
+static int coalesced_acked = 0;
+static int expiry_acked = 0;
+
+
+static std::string artifact_frame()
+{
+    const size_t length = sizeof(rfd900sim::artifact_message_t)
+                        + rfd900sim::SimConstants::MESSAGE_900_START_INDICATOR_LENGTH
+                        + rfd900sim::SimConstants::MESSAGE_900_END_INDICATOR_LENGTH;
+
+    std::string frame(length, '\0');
+    rfd900sim::artifact_message_t artmsg;
+    rfd900sim::simulate_artifact_message(&artmsg, rfd900sim::SimConstants::BASE_STATION, MY_ID);
+    rfd900sim::serialize_artifact_for_900MHz(&artmsg, (uint8_t*)frame.data(), length);
+    return frame;
+}
+
+
+// the remote radio, acknowledges one frame so the ACK and the timeout land in one pass
+static rfd900comm::task<void> remote(rfd900comm::eventLoop& loop, int master, int modem_fd, uint16_t msg_id,
+            std::chrono::milliseconds timeout)
+{
+    uint8_t buffer[256];
+
+    co_await loop.readable(master);
+    auto sent = rfd900comm::eventLoop::clock::now();
+    while(read(master, buffer, sizeof(buffer)) > 0){
+        // intentionally blank, the frame content does not matter
+    }
+
+    co_await loop.sleep_for(timeout - std::chrono::milliseconds(10));
+
+    const size_t length = sizeof(rfd900sim::ack_message_t)
+                        + rfd900sim::SimConstants::MESSAGE_900_START_INDICATOR_LENGTH
+                        + rfd900sim::SimConstants::MESSAGE_900_END_INDICATOR_LENGTH;
+    std::string ack_frame(length, '\0');
+    rfd900sim::ack_message_t ack;
+    rfd900sim::populate_ack_message(&ack, MY_ID, rfd900sim::SimConstants::BASE_STATION, msg_id);
+    rfd900sim::serialize_acknowledgement_for_900MHz(&ack, (uint8_t*)ack_frame.data(), length);
+    if(write(master, ack_frame.data(), length) != static_cast<ssize_t>(length)){
+        fprintf(stderr, "error, %s, ACK write failed\n", __func__);
+    }
+
+    // woken with the reader, then held past the deadline before the timers are checked
+    co_await loop.readable(modem_fd);
+    std::this_thread::sleep_until(sent + timeout + std::chrono::milliseconds(10));
+}
+
+
+// one transmission, acknowledged only by the coalesced ACK
+static rfd900comm::task<void> coalesced(rfd900comm::reliableSender& reliable, uint8_t dest_id, uint16_t msg_id,
+            std::string frame, std::chrono::milliseconds timeout)
+{
+    bool ok = co_await reliable.send_acked(dest_id, msg_id, std::move(frame), timeout, 1);
+    if(ok){
+        ++coalesced_acked;
+    }
+    ++coalesced_done;
+}
+
+
+// never acknowledged, returns once the TTL or the attempts run out
+static rfd900comm::task<void> expiring(rfd900comm::reliableSender& reliable, std::chrono::milliseconds timeout)
+{
+    std::string frame = artifact_frame();
+    rfd900sim::artifact_message_t artmsg;
+    memcpy(&artmsg, frame.data() + rfd900sim::SimConstants::MESSAGE_900_START_INDICATOR_LENGTH, sizeof(artmsg));
+
+    if(co_await reliable.send_acked(artmsg.dest_id, artmsg.msg_id, std::move(frame), timeout, 10)){
+        ++expiry_acked;
+    }
+    ++expiry_done;
+}
+
+
+// one coalesced ACK for three messages, the first by its run, the others by the bitmap
+static rfd900comm::task<void> coalesced_ack(rfd900comm::reliableSender& reliable, rfd900comm::eventLoop& loop, int master,
+            std::chrono::milliseconds timeout)
+{
+    uint16_t ids[COALESCED];
+    for(int i = 0; i < COALESCED; ++i){
+        std::string frame = artifact_frame();
+        rfd900sim::artifact_message_t artmsg;
+        memcpy(&artmsg, frame.data() + rfd900sim::SimConstants::MESSAGE_900_START_INDICATOR_LENGTH, sizeof(artmsg));
+        ids[i] = artmsg.msg_id;
+        loop.spawn(coalesced(reliable, artmsg.dest_id, artmsg.msg_id, std::move(frame), timeout * 4));
+    }
+    co_await loop.sleep_for(timeout / 2);
+
+    uint8_t buffer[256];
+    while(read(master, buffer, sizeof(buffer)) > 0){
+        // intentionally blank, the frames are not checked
+    }
+
+    rfd900sim::ack_bitmap_message_t bitmap;
+    memset(&bitmap, 0, sizeof(bitmap));
+    bitmap.dest_id = MY_ID;
+    bitmap.src_id = rfd900sim::SimConstants::BASE_STATION;
+    bitmap.msg_type = rfd900sim::SimConstants::ACK_BITMAP;
+    bitmap.cumulative = ids[0];
+    bitmap.run = 1;
+    for(int i = 1; i < COALESCED; ++i){
+        bitmap.bitmap |= uint64_t(1) << static_cast<uint16_t>(ids[i] - ids[0] - 1);
+    }
+
+    const size_t bitmap_length = sizeof(rfd900sim::ack_bitmap_message_t)
+                        + rfd900sim::SimConstants::MESSAGE_900_START_INDICATOR_LENGTH
+                        + rfd900sim::SimConstants::MESSAGE_900_END_INDICATOR_LENGTH;
+    std::string bitmap_frame(bitmap_length, '\0');
+    rfd900sim::serialize_ack_bitmap_for_900MHz(&bitmap, (uint8_t*)bitmap_frame.data(), bitmap_length);
+    if(write(master, bitmap_frame.data(), bitmap_length) != static_cast<ssize_t>(bitmap_length)){
+        fprintf(stderr, "error, %s, coalesced ACK write failed\n", __func__);
+    }
+
+    // well before the timeout, a sender that only a timer resumed is not done yet
+    co_await loop.sleep_for(timeout);
+}
+
+
+static rfd900comm::task<void> sender(rfd900comm::reliableSender& reliable, rfd900comm::message900& msg900,
+            rfd900comm::eventLoop& loop, int master, int modem_fd, int rounds, std::chrono::milliseconds timeout)
+{
+    for(int i = 0; i < rounds; ++i){
+        std::string frame = artifact_frame();
+        rfd900sim::artifact_message_t artmsg;
+        memcpy(&artmsg, frame.data() + rfd900sim::SimConstants::MESSAGE_900_START_INDICATOR_LENGTH, sizeof(artmsg));
+
+        loop.spawn(remote(loop, master, modem_fd, artmsg.msg_id, timeout));
+        bool ok = co_await reliable.send_acked(artmsg.dest_id, artmsg.msg_id, std::move(frame), timeout, 1);
+        ++completions;
+        if(ok){
+            ++acked;
+        }
+
+        // a second resume would land here, let it run before counting timers
+        co_await loop.sleep_for(timeout);
+        leftover_timers += static_cast<int>(loop.timer_count());
+    }
+
+    co_await coalesced_ack(reliable, loop, master, timeout);
+
+    // expires after the second retransmission
+    msg900.set_message_ttl(rfd900sim::SimConstants::ARTIFACT_POSITION, timeout * 5 / 2);
+    msg900.set_send_window(1, SIZE_MAX);
+    loop.spawn(expiring(reliable, timeout));
+    loop.spawn(expiring(reliable, timeout));
+
+    auto give_up = rfd900comm::eventLoop::clock::now() + timeout * 20;
+    while(expiry_done < 2 && rfd900comm::eventLoop::clock::now() < give_up){
+        co_await loop.sleep_for(timeout);
+    }
+    loop.stop();
+}
+
+
+int main(int argc, char **argv)
+{
+    int rounds = argc > 1 ? atoi(argv[1]) : 10;
+    std::chrono::milliseconds timeout(argc > 2 ? atoi(argv[2]) : 50);
+
+    int master = posix_openpt(O_RDWR | O_NOCTTY | O_NONBLOCK);
+    if(master < 0 || grantpt(master) != 0 || unlockpt(master) != 0){
+        fprintf(stderr, "error, %s, pseudo terminal unavailable\n", __func__);
+        return 1;
+    }
+
+    rfd900comm::rfd900Modem radio;
+    if(radio.init(ptsname(master)) != 0){
+        fprintf(stderr, "error, %s radio init failure\n", __func__);
+        return 1;
+    }
+
+    rfd900comm::eventLoop loop;
+    rfd900comm::asyncRadio async_radio(loop, radio);
+    rfd900comm::message900 msg900;
+    rfd900comm::reliableSender reliable(async_radio, msg900);
+
+    async_radio.start();
+    reliable.start();
+    loop.spawn(sender(reliable, msg900, loop, master, radio.get_fd(), rounds, timeout));
+    loop.run();
+
+    bool ok = completions == rounds && acked == rounds && leftover_timers == 0;
+    fprintf(stdout, "rounds %d, send_acked returned %d times, acknowledged %d, timers left %d: %s\n",
+                rounds, completions, acked, leftover_timers, ok ? "pass" : "FAIL");
+
+    bool coalesced_ok = coalesced_done == COALESCED && coalesced_acked == COALESCED;
+    fprintf(stdout, "coalesced ACK: %d of %d returned, %d acknowledged: %s\n",
+                coalesced_done, COALESCED, coalesced_acked, coalesced_ok ? "pass" : "FAIL");
+
+    uint64_t expired = msg900.expired(rfd900sim::SimConstants::ARTIFACT_POSITION);
+    bool expiry_ok = expiry_done == 2 && expiry_acked == 0 && expired == 2 && reliable.window_stalls() == 1;
+    fprintf(stdout, "expiry: %d of 2 returned, %d reported acknowledged, %lu expired, %lu window stalls: %s\n",
+                expiry_done, expiry_acked, expired, reliable.window_stalls(), expiry_ok ? "pass" : "FAIL");
+
+    ok = ok && coalesced_ok && expiry_ok && reliable.outstanding() == 0;
+
+    close(master);
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,52 @@
+/**
+ * @brief ack_responder function definitions.
+ *
+ */
+
+#include <string>
+
+#include "ack_responder.h"
+#include "simulation_constants.h"
+#include "sim_artifact_message.h"
+
+
+namespace rfd900comm{
+
+    namespace{
+
+        constexpr size_t SERIAL_RX_BUFFER_LENGTH = 256;
+        constexpr long POLL_TIMEOUT = 5000L;        // units, microseconds, how soon running is seen cleared
+
+    }
+
+
+    void ack_responder(rfd900Modem* radio, const std::atomic<bool>* running)
+    {
+        const size_t SERIAL_ACK_BUFFER_LENGTH = sizeof(rfd900sim::ack_message_t)
+                            + rfd900sim::SimConstants::MESSAGE_900_START_INDICATOR_LENGTH
+                            + rfd900sim::SimConstants::MESSAGE_900_END_INDICATOR_LENGTH;
+
+        std::string serial_ack_buffer(SERIAL_ACK_BUFFER_LENGTH, '\0');
+        uint8_t serial_rx_buffer[SERIAL_RX_BUFFER_LENGTH];
+        std::string temp_rx_storage;
+        std::string extracted_rx_data;
+
+        while(*running){
+            ssize_t bytesRead = radio->read_serial(serial_rx_buffer, SERIAL_RX_BUFFER_LENGTH, POLL_TIMEOUT);
+            if(bytesRead <= 0){
+                continue;
+            }
+
+            temp_rx_storage.append((const char*)serial_rx_buffer, bytesRead);
+            while(rfd900sim::extract_rx_message(temp_rx_storage, extracted_rx_data)){
+                rfd900sim::ack_message_t ackmsg;
+                if(rfd900sim::process_rx_message(extracted_rx_data, &ackmsg, true) == rfd900sim::SimConstants::SEND_ACK){
+                    rfd900sim::serialize_acknowledgement_for_900MHz(&ackmsg, (uint8_t*)&serial_ack_buffer[0],
+                                SERIAL_ACK_BUFFER_LENGTH);
+                    radio->send_message(serial_ack_buffer.data(), SERIAL_ACK_BUFFER_LENGTH);
+                }
+            }
+        }
+    }
+
+}
@@ -0,0 +1,29 @@
+/**
+ * @brief Declares ack_responder, the acknowledging end of a link for the benches
+ *
+ * Stands in for a base station on the far side of a linkEmulator port. It
+ * reads frames from the radio and answers each one process_rx_message asks
+ * to acknowledge with an ACK, until running is cleared. Run it on its own
+ * thread:
+ *
+ *      std::atomic<bool> running(true);
+ *      std::thread rx_thread(rfd900comm::ack_responder, &rx_radio, &running);
+ *
+ */
+
+#ifndef ACK_RESPONDER_INCLUDED_H
+#define ACK_RESPONDER_INCLUDED_H
+
+#include <atomic>
+
+#include "rfd900_modem.h"
+
+
+namespace rfd900comm{
+
+    void ack_responder(rfd900Modem* radio, const std::atomic<bool>* running);
+
+}
+
+
+#endif
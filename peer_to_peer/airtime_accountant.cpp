@@ -0,0 +1,162 @@
+/**
+ * @brief airtimeAccountant class function definitions.
+ *
+ */
+
+#include <cmath>                        // exp
+
+#include "airtime_accountant.h"
+#include "link_stats.h"
+#include "virtual_clock.h"
+
+namespace rfd900comm{
+
+    airtimeAccountant::airtimeAccountant(const airtimeConfig& config) :
+        cfg(config), usage(), heard(0.0), lastDecay(clock_now()), degradedCount(), rejectedCount()
+    {
+        if(cfg.air_speed_kbps == 0){
+            cfg.air_speed_kbps = airtimeConfig().air_speed_kbps;
+        }
+        if(cfg.max_packet_bytes == 0){
+            cfg.max_packet_bytes = airtimeConfig().max_packet_bytes;
+        }
+        if(cfg.window_ms == 0){
+            cfg.window_ms = airtimeConfig().window_ms;
+        }
+        airBytesPerSec = cfg.air_speed_kbps * 1000.0 / 8.0;
+        windowSeconds = cfg.window_ms / 1000.0;
+    }
+
+
+    void airtimeAccountant::set_radio(uint32_t air_speed_kbps, bool ecc)
+    {
+        if(air_speed_kbps > 0){
+            cfg.air_speed_kbps = air_speed_kbps;
+            airBytesPerSec = cfg.air_speed_kbps * 1000.0 / 8.0;
+        }
+        cfg.ecc = ecc;
+    }
+
+
+    double airtimeAccountant::airtime_s(size_t length, bool acked) const
+    {
+        size_t packets = (length + cfg.max_packet_bytes - 1) / cfg.max_packet_bytes;
+        double bytes = static_cast<double>(length + packets * cfg.packet_overhead_bytes);
+        if(acked){
+            bytes += cfg.ack_frame_bytes + cfg.packet_overhead_bytes;
+        }
+        if(cfg.ecc){
+            bytes *= 2.0;
+        }
+        return bytes / airBytesPerSec;
+    }
+
+
+    double airtimeAccountant::max_frames_per_second(size_t length, bool acked) const
+    {
+        double seconds = airtime_s(length, acked);
+        return seconds > 0.0 ? 1.0 / seconds : 0.0;
+    }
+
+
+    void airtimeAccountant::decay()
+    {
+        steady::time_point now = clock_now();
+        double elapsed = std::chrono::duration<double>(now - lastDecay).count();
+        if(elapsed <= 0.0){
+            return;
+        }
+
+        double factor = std::exp(-elapsed / windowSeconds);
+        for(double& u : usage){
+            u *= factor;
+        }
+        heard *= factor;
+        lastDecay = now;
+    }
+
+
+    double airtimeAccountant::total() const
+    {
+        double sum = heard;
+        for(double u : usage){
+            sum += u;
+        }
+        return sum;
+    }
+
+
+    airtimeAdmission airtimeAccountant::admit(txPriority priority, size_t length)
+    {
+        int p = static_cast<int>(priority);
+        if(priority == txPriority::CONTROL){
+            return airtimeAdmission::ADMIT;
+        }
+
+        decay();
+        const airtimeClassBudget& b = cfg.classes[p];
+        double cost = airtime_s(length, b.acked);
+        double projected = (total() + cost) / windowSeconds;
+        double share = (usage[p] + cost) / windowSeconds;
+
+        if(projected > cfg.budget * b.reject_at || share > cfg.budget * b.max_share){
+            ++rejectedCount[p];
+            linkStats::add(link_stats().admission_rejected);
+            return airtimeAdmission::REJECT;
+        }
+        if(projected > cfg.budget * b.degrade_at){
+            ++degradedCount[p];
+            linkStats::add(link_stats().admission_degraded);
+            return airtimeAdmission::DEGRADE;
+        }
+        return airtimeAdmission::ADMIT;
+    }
+
+
+    void airtimeAccountant::charge(txPriority priority, size_t length)
+    {
+        int p = static_cast<int>(priority);
+        decay();
+        usage[p] += airtime_s(length, cfg.classes[p].acked);
+        publish();
+    }
+
+
+    airtimeAdmission airtimeAccountant::admit_and_charge(txPriority priority, size_t length)
+    {
+        airtimeAdmission admission = admit(priority, length);
+        if(admission != airtimeAdmission::REJECT){
+            charge(priority, length);
+        }
+        return admission;
+    }
+
+
+    void airtimeAccountant::charge_heard(size_t length)
+    {
+        decay();
+        heard += airtime_s(length);
+        publish();
+    }
+
+
+    double airtimeAccountant::utilization()
+    {
+        decay();
+        return total() / windowSeconds;
+    }
+
+
+    double airtimeAccountant::utilization(txPriority priority)
+    {
+        decay();
+        return usage[static_cast<int>(priority)] / windowSeconds;
+    }
+
+
+    void airtimeAccountant::publish() const
+    {
+        linkStats::set(link_stats().air_utilization_permille, static_cast<uint64_t>(total() / windowSeconds * 1000.0 + 0.5));
+    }
+
+}
@@ -0,0 +1,139 @@
+/**
+ * @brief Declares airtimeAccountant, channel utilization and admission control per traffic class
+ *
+ * The serial baud rate says little about what the link carries. The radio
+ * sends at its air speed (the AIR_SPEED parameter, kbit/s), splits the
+ * serial stream into packets of at most max_packet_bytes, adds a preamble,
+ * sync word, header and CRC to every packet, doubles every byte with ECC on,
+ * and the channel also carries the ACKs that come back. airtime_s converts
+ * serial bytes to seconds on the air with that model.
+ *
+ * The accountant charges the airtime of every frame sent to its traffic
+ * class, and of every packet heard from other radios to the channel, in
+ * exponentially decaying sums with a time constant of window_ms. A sum over
+ * the window divided by the window is the utilization: the fraction of the
+ * channel in use, 1 at saturation.
+ *
+ * Admission: budget is the utilization the link is run at, below saturation
+ * where queues and latency grow without bound. Each class has thresholds as
+ * fractions of the budget. A frame that would take total utilization past
+ * degrade_at is admitted as DEGRADE, the sender should thin the stream,
+ * past reject_at it is refused, as is a frame that would take the class
+ * itself past max_share. The defaults refuse BULK first, then NORMAL, so
+ * the channel stays open for artifact reports; CONTROL frames, the ACKs and
+ * status that keep the link working, are never refused.
+ *
+ * txScheduler::set_airtime_accountant applies admission at enqueue.
+ * utilization() is also published as linkStats::air_utilization_permille.
+ *
+ */
+
+#ifndef AIRTIME_ACCOUNTANT_INCLUDED_H
+#define AIRTIME_ACCOUNTANT_INCLUDED_H
+
+#include <chrono>
+#include <cstdint>
+
+#include "tx_scheduler.h"
+
+
+namespace rfd900comm{
+
+    enum class airtimeAdmission{
+        ADMIT = 0,
+        DEGRADE,
+        REJECT
+    };
+
+    struct airtimeClassBudget{
+        double degrade_at;                      // fraction of the budget, total utilization
+        double reject_at;                       // fraction of the budget, total utilization
+        double max_share;                       // fraction of the budget, this class alone
+        bool acked;                             // each frame draws an ACK back over the air
+    };
+
+    struct airtimeConfig{
+        uint32_t air_speed_kbps = 64;                       // the radio's AIR_SPEED
+        bool ecc = false;                                   // the radio's ECC, doubles every byte on the air
+        size_t max_packet_bytes = 252;                      // serial bytes in one air packet
+        size_t packet_overhead_bytes = 13;                  // preamble, sync word, header and CRC per packet
+        size_t ack_frame_bytes = 11;                        // a framed ack_message_t
+        uint32_t window_ms = 2000;
+        double budget = 0.8;
+        airtimeClassBudget classes[NUM_TX_PRIORITIES] = {
+            {1.0, 1.0, 1.0, false},                         // CONTROL, never refused
+            {0.9, 1.0, 1.0, true},                          // HIGH
+            {0.7, 0.9, 1.0, false},                         // NORMAL
+            {0.5, 0.75, 0.5, false}                         // BULK
+        };
+    };
+
+
+    class airtimeAccountant{
+
+        public:
+
+        explicit airtimeAccountant(const airtimeConfig& config = airtimeConfig());
+
+        // disable copy constructor
+        airtimeAccountant(const airtimeAccountant&) = delete;
+
+        // disable assignment
+        airtimeAccountant& operator=(const airtimeAccountant&) = delete;
+
+        // seconds on the air for a frame of length serial bytes, and its ACK when acked
+        double airtime_s(size_t length, bool acked = false) const;
+
+        // frames of length bytes per second the channel carries at full utilization
+        double max_frames_per_second(size_t length, bool acked = false) const;
+
+        // decides on a frame without charging it
+        airtimeAdmission admit(txPriority priority, size_t length);
+
+        // charges a frame that is being sent
+        void charge(txPriority priority, size_t length);
+
+        // admit, then charge unless refused
+        airtimeAdmission admit_and_charge(txPriority priority, size_t length);
+
+        // charges a packet of length serial bytes another radio sent, heard on the channel
+        void charge_heard(size_t length);
+
+        // fraction of the channel in use over the window, all traffic or one class
+        double utilization();
+        double utilization(txPriority priority);
+
+        uint64_t degraded(txPriority priority) const { return degradedCount[static_cast<int>(priority)]; }
+        uint64_t rejected(txPriority priority) const { return rejectedCount[static_cast<int>(priority)]; }
+
+        const airtimeConfig& config() const { return cfg; }
+
+        // the radio's AIR_SPEED and ECC, as read from its registers
+        void set_radio(uint32_t air_speed_kbps, bool ecc);
+
+
+        private:
+
+        using steady = std::chrono::steady_clock;
+
+        airtimeConfig cfg;
+        double airBytesPerSec;
+        double windowSeconds;
+
+        // decaying airtime sums, seconds: one per class and one for heard traffic
+        double usage[NUM_TX_PRIORITIES];
+        double heard;
+        steady::time_point lastDecay;
+
+        uint64_t degradedCount[NUM_TX_PRIORITIES];
+        uint64_t rejectedCount[NUM_TX_PRIORITIES];
+
+        void decay();
+        double total() const;
+        void publish() const;
+    };
+
+}
+
+
+#endif
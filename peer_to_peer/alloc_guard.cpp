@@ -0,0 +1,112 @@
+/**
+ * @brief allocation guard function definitions.
+ *
+ */
+
+#include <errno.h>
+#include <atomic>
+#include <cstdlib>                  // abort
+#include <unistd.h>                 // write
+
+#include "alloc_guard.h"
+
+
+// the glibc allocator behind the replacements
+extern "C" {
+    void* __libc_malloc(size_t size);
+    void* __libc_calloc(size_t count, size_t size);
+    void* __libc_realloc(void* ptr, size_t size);
+    void* __libc_memalign(size_t alignment, size_t size);
+}
+
+
+namespace{
+
+    thread_local bool armed = false;
+    bool abortOnAllocation = false;
+    std::atomic<uint64_t> allocations(0);
+
+    void check_allocation()
+    {
+        if(!armed){
+            return;
+        }
+
+        allocations.fetch_add(1, std::memory_order_relaxed);
+        if(abortOnAllocation){
+            // no fprintf, it may allocate
+            static const char message[] = "error, allocation after startup with the allocation guard armed\n";
+            ssize_t ignored = write(STDERR_FILENO, message, sizeof(message) - 1);
+            (void)ignored;
+            abort();
+        }
+    }
+
+}
+
+
+extern "C" {
+
+    void* malloc(size_t size)
+    {
+        check_allocation();
+        return __libc_malloc(size);
+    }
+
+    void* calloc(size_t count, size_t size)
+    {
+        check_allocation();
+        return __libc_calloc(count, size);
+    }
+
+    void* realloc(void* ptr, size_t size)
+    {
+        check_allocation();
+        return __libc_realloc(ptr, size);
+    }
+
+    void* aligned_alloc(size_t alignment, size_t size)
+    {
+        check_allocation();
+        return __libc_memalign(alignment, size);
+    }
+
+    int posix_memalign(void** ptr, size_t alignment, size_t size)
+    {
+        if(alignment % sizeof(void*) != 0 || (alignment & (alignment - 1)) != 0){
+            return EINVAL;
+        }
+
+        check_allocation();
+        void* p = __libc_memalign(alignment, size);
+        if(p == nullptr && size != 0){
+            return ENOMEM;
+        }
+        *ptr = p;
+        return 0;
+    }
+
+}
+
+
+namespace rfd900comm{
+
+    void alloc_guard_arm(bool abort_on_allocation)
+    {
+        abortOnAllocation = abort_on_allocation;
+        armed = true;
+    }
+
+
+    void alloc_guard_disarm()
+    {
+        armed = false;
+    }
+
+
+    uint64_t alloc_guard_count()
+    {
+        return allocations.load(std::memory_order_relaxed);
+    }
+
+}
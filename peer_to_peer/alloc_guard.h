@@ -0,0 +1,36 @@
+/**
+ * @brief Declares the allocation guard, a test hook for the RFD900_EMBEDDED build
+ *
+ * Linking the allocguard library replaces malloc, calloc, realloc and the
+ * aligned allocators for the whole program. The replacements forward to the
+ * glibc allocator and, on threads that have armed the guard, count the call.
+ * operator new allocates through malloc, so it is counted as well.
+ *
+ * A program sizes its buffers and queues at startup, calls
+ * alloc_guard_arm, and from then on every allocation on that thread is a
+ * failure: it is counted, or with abort_on_allocation the program reports it
+ * and aborts, so a debugger or core file shows the allocating call.
+ *
+ * Other threads, such as a linkEmulator, are not affected.
+ *
+ */
+
+#ifndef ALLOC_GUARD_INCLUDED_H
+#define ALLOC_GUARD_INCLUDED_H
+
+#include <cstdint>
+
+
+namespace rfd900comm{
+
+    // arms the guard for the calling thread
+    void alloc_guard_arm(bool abort_on_allocation = false);
+    void alloc_guard_disarm();
+
+    // allocations made on armed threads
+    uint64_t alloc_guard_count();
+
+}
+
+
+#endif
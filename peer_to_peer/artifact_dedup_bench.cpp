@@ -0,0 +1,138 @@
+/**
+ * Purpose:
+ *  Measure artifactStore: how many repeated artifact reports it keeps off the
+ *  air and what a lookup costs with thousands of known artifacts.
+ *
+ *  A field of artifacts is scattered over a 2 km square. Robots report them
+ *  over and over, each report a noisy (0.3 m per axis) sighting of a randomly
+ *  chosen artifact. Every report goes through artifactStore::report, only NEW
+ *  and UPDATE would be transmitted.
+ *
+ *  For comparison the same reports are looked up with a linear scan over an
+ *  array of artifact_message_t, the obvious store without the grid.
+ *
+ * Optional Command line arguments
+ *  argv[1] - number of artifacts
+ *  argv[2] - number of reports
+ *  argv[3] - merge radius, metres
+ *  argv[4] - update distance, metres
+ *
+ */
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>                  // atoi, atof
+#include <random>
+#include <vector>
+
+#include "artifact_store.h"
+#include "simulation_constants.h"
+
+
+using rfd900sim::SimConstants;
+using steady = std::chrono::steady_clock;
+
+constexpr double FIELD_SIZE = 2000.0;           // metres
+constexpr double FIELD_HEIGHT = 50.0;
+constexpr double SIGHTING_NOISE = 0.3;          // metres, standard deviation per axis
+constexpr size_t LINEAR_SCAN_REPORTS = 20000;   // the scan is slow, time a prefix
+
+
+int main(int argc, char **argv)
+{
+    size_t artifactCount = 5000;
+    size_t reportCount = 500000;
+    rfd900sim::artifactStoreConfig config;
+
+    if(argc > 1){
+        artifactCount = atoi(argv[1]);
+    }
+    if(argc > 2){
+        reportCount = atoi(argv[2]);
+    }
+    if(argc > 3){
+        config.merge_radius = atof(argv[3]);
+    }
+    if(argc > 4){
+        config.update_distance = atof(argv[4]);
+    }
+
+    std::mt19937 rng(900);
+    std::uniform_real_distribution<double> across(0.0, FIELD_SIZE);
+    std::uniform_real_distribution<double> up(0.0, FIELD_HEIGHT);
+    std::uniform_int_distribution<int> category(1, SimConstants::NUM_ARTIFACT_CATEGORIES);
+    std::uniform_int_distribution<size_t> pick(0, artifactCount - 1);
+    std::normal_distribution<double> noise(0.0, SIGHTING_NOISE);
+
+    std::vector<rfd900sim::artifact_message_t> truth(artifactCount);
+    for(rfd900sim::artifact_message_t& a : truth){
+        a.artifact = static_cast<uint8_t>(category(rng));
+        a.position.x = across(rng);
+        a.position.y = across(rng);
+        a.position.z = up(rng);
+    }
+
+    std::vector<rfd900sim::artifact_message_t> reports(reportCount);
+    for(rfd900sim::artifact_message_t& r : reports){
+        const rfd900sim::artifact_message_t& a = truth[pick(rng)];
+        r = a;
+        r.msg_type = SimConstants::ARTIFACT_POSITION;
+        r.position.x += noise(rng);
+        r.position.y += noise(rng);
+        r.position.z += noise(rng);
+    }
+
+    /************* artifactStore *************/
+    rfd900sim::artifactStore store(config);
+    size_t fresh = 0;
+
+    auto start = steady::now();
+    for(rfd900sim::artifact_message_t& r : reports){
+        fresh += store.report(&r) == rfd900sim::artifactReport::NEW ? 1 : 0;
+    }
+    double store_ns = std::chrono::duration<double, std::nano>(steady::now() - start).count() / reportCount;
+
+    /************* linear scan *************/
+    size_t scanCount = reportCount < LINEAR_SCAN_REPORTS ? reportCount : LINEAR_SCAN_REPORTS;
+    std::vector<rfd900sim::artifact_message_t> known;
+    double radius2 = config.merge_radius * config.merge_radius;
+    size_t matched = 0;
+
+    start = steady::now();
+    for(size_t i = 0; i < scanCount; ++i){
+        const rfd900sim::artifact_message_t& r = reports[i];
+        bool found = false;
+        for(const rfd900sim::artifact_message_t& k : known){
+            double ex = k.position.x - r.position.x;
+            double ey = k.position.y - r.position.y;
+            double ez = k.position.z - r.position.z;
+            if(k.artifact == r.artifact && ex * ex + ey * ey + ez * ez <= radius2){
+                found = true;
+                break;
+            }
+        }
+        if(found){
+            ++matched;
+        }
+        else{
+            known.push_back(r);
+        }
+    }
+    double scan_ns = std::chrono::duration<double, std::nano>(steady::now() - start).count() / scanCount;
+
+    size_t sent = fresh + store.updates();
+
+    fprintf(stdout, "artifacts: %lu  reports: %lu  merge radius: %.2f m  update distance: %.2f m\n",
+                artifactCount, reportCount, config.merge_radius, config.update_distance);
+    fprintf(stdout, "known after reports: %lu  (split duplicates: %ld)\n",
+                store.size(), static_cast<long>(store.size()) - static_cast<long>(artifactCount));
+    fprintf(stdout, "transmitted  new: %lu  update: %lu  suppressed: %lu  (%.1f%% of reports sent)\n",
+                fresh, store.updates(), store.suppressed(), 100.0 * sent / reportCount);
+    fprintf(stdout, "artifact messages saved: %lu, %lu framed bytes\n",
+                reportCount - sent, (reportCount - sent) * (sizeof(rfd900sim::artifact_message_t)
+                + SimConstants::MESSAGE_900_START_INDICATOR_LENGTH + SimConstants::MESSAGE_900_END_INDICATOR_LENGTH));
+    fprintf(stdout, "lookup  grid: %.1f ns/report  linear scan: %.1f ns/report over the first %lu reports (%lu matched)\n",
+                store_ns, scan_ns, scanCount, matched);
+
+    return 0;
+}
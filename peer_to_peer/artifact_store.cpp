@@ -0,0 +1,157 @@
+/**
+ * @brief artifactStore class function definitions.
+ *
+ */
+
+#include <algorithm>                // std::find
+#include <cmath>                    // floor
+
+#include "artifact_store.h"
+
+
+namespace rfd900sim
+{
+    artifactStore::artifactStore(const artifactStoreConfig& config) :
+        config(config), cellSize(config.merge_radius > 0.0 ? 2.0 * config.merge_radius : 1.0),
+        reportCount(0), updateCount(0), suppressedCount(0)
+    {
+        // intentionally blank
+    }
+
+
+    int64_t artifactStore::cell_coordinate(double v) const
+    {
+        return static_cast<int64_t>(floor(v / cellSize));
+    }
+
+
+    // 8 bits of type and 18 bits per axis, wrapped coordinates only share a bucket
+    uint64_t artifactStore::cell_key(uint8_t artifact, int64_t cx, int64_t cy, int64_t cz)
+    {
+        const uint64_t mask = (1ULL << 18) - 1;
+        return (uint64_t(artifact) << 54) | ((uint64_t(cx) & mask) << 36) | ((uint64_t(cy) & mask) << 18) | (uint64_t(cz) & mask);
+    }
+
+
+    // index of the closest artifact of the type within merge_radius, -1 when there is none
+    int64_t artifactStore::nearest(uint8_t artifact, const point_t& p) const
+    {
+        // cells are two radii wide, the sphere around p reaches at most one
+        // neighbour per axis, on the side of the cell p sits in
+        double fx = p.x / cellSize, fy = p.y / cellSize, fz = p.z / cellSize;
+        int64_t cx = static_cast<int64_t>(floor(fx));
+        int64_t cy = static_cast<int64_t>(floor(fy));
+        int64_t cz = static_cast<int64_t>(floor(fz));
+        int64_t sx = fx - cx < 0.5 ? -1 : 1;
+        int64_t sy = fy - cy < 0.5 ? -1 : 1;
+        int64_t sz = fz - cz < 0.5 ? -1 : 1;
+
+        double best = config.merge_radius * config.merge_radius;
+        int64_t found = -1;
+
+        for(int n = 0; n < 8; ++n){
+            auto bucket = grid.find(cell_key(artifact, cx + ((n & 1) ? sx : 0), cy + ((n & 2) ? sy : 0), cz + ((n & 4) ? sz : 0)));
+            if(bucket == grid.end()){
+                continue;
+            }
+
+            for(uint32_t i : bucket->second){
+                double ex = x[i] - p.x;
+                double ey = y[i] - p.y;
+                double ez = z[i] - p.z;
+                double d2 = ex * ex + ey * ey + ez * ez;
+                if(d2 <= best && type[i] == artifact){
+                    best = d2;
+                    found = i;
+                }
+            }
+        }
+
+        return found;
+    }
+
+
+    void artifactStore::file(uint32_t index, uint64_t key)
+    {
+        grid[key].push_back(index);
+        cell[index] = key;
+    }
+
+
+    void artifactStore::unfile(uint32_t index, uint64_t key)
+    {
+        auto bucket = grid.find(key);
+        if(bucket == grid.end()){
+            return;
+        }
+
+        std::vector<uint32_t>& v = bucket->second;
+        auto it = std::find(v.begin(), v.end(), index);
+        if(it != v.end()){
+            *it = v.back();
+            v.pop_back();
+        }
+        if(v.empty()){
+            grid.erase(bucket);
+        }
+    }
+
+
+    artifactReport artifactStore::report(artifact_message_t* art)
+    {
+        ++reportCount;
+
+        const point_t& p = art->position;
+        int64_t found = nearest(art->artifact, p);
+
+        if(found < 0){
+            uint32_t index = static_cast<uint32_t>(type.size());
+            type.push_back(art->artifact);
+            x.push_back(p.x);
+            y.push_back(p.y);
+            z.push_back(p.z);
+            sent_x.push_back(p.x);
+            sent_y.push_back(p.y);
+            sent_z.push_back(p.z);
+            weight.push_back(1);
+            cell.push_back(0);
+            file(index, cell_key(art->artifact, cell_coordinate(p.x), cell_coordinate(p.y), cell_coordinate(p.z)));
+            return artifactReport::NEW;
+        }
+
+        uint32_t i = static_cast<uint32_t>(found);
+
+        // running mean, the cap keeps a moved artifact from being pinned by old reports
+        if(weight[i] < config.max_weight){
+            ++weight[i];
+        }
+        double w = 1.0 / weight[i];
+        x[i] += (p.x - x[i]) * w;
+        y[i] += (p.y - y[i]) * w;
+        z[i] += (p.z - z[i]) * w;
+
+        uint64_t key = cell_key(art->artifact, cell_coordinate(x[i]), cell_coordinate(y[i]), cell_coordinate(z[i]));
+        if(key != cell[i]){
+            unfile(i, cell[i]);
+            file(i, key);
+        }
+
+        double ex = x[i] - sent_x[i];
+        double ey = y[i] - sent_y[i];
+        double ez = z[i] - sent_z[i];
+        if(ex * ex + ey * ey + ez * ez <= config.update_distance * config.update_distance){
+            ++suppressedCount;
+            return artifactReport::SUPPRESSED;
+        }
+
+        sent_x[i] = x[i];
+        sent_y[i] = y[i];
+        sent_z[i] = z[i];
+        art->position.x = x[i];
+        art->position.y = y[i];
+        art->position.z = z[i];
+        ++updateCount;
+        return artifactReport::UPDATE;
+    }
+
+}
@@ -0,0 +1,96 @@
+/**
+ * @brief Declares artifactStore, suppression of repeated artifact reports before transmission
+ *
+ * A robot that keeps seeing the same backpack produces a new artifact report
+ * every time, each costing airtime and an ACK. The store remembers every
+ * artifact already sent. A new report of the same artifact type within
+ * merge_radius of a known artifact is merged into it (running mean of the
+ * position) instead of being sent. Only when the merged position has moved
+ * more than update_distance from the position last sent is the artifact
+ * reported again.
+ *
+ * Layout, for lookups at thousands of artifacts:
+ *      struct of arrays, one vector per field, a lookup only touches the
+ *      position and type arrays
+ *      spatial hash grid with cells two merge radii wide, keyed by artifact
+ *      type and cell, a lookup visits the 8 cells the radius can reach
+ *
+ */
+
+#ifndef ARTIFACT_STORE_INCLUDED_H
+#define ARTIFACT_STORE_INCLUDED_H
+
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+#include "sim_artifact_message.h"
+
+
+namespace rfd900sim
+{
+    struct artifactStoreConfig{
+        double merge_radius = 2.0;              // metres, same artifact when closer
+        double update_distance = 0.5;           // metres the merged position moves before it is resent
+        uint32_t max_weight = 32;               // reports averaged, later reports still move the estimate
+    };
+
+    /**
+     * NEW        - first report of this artifact, send it
+     * UPDATE     - merged position moved, send it (art carries the merged position)
+     * SUPPRESSED - merged into a known artifact, nothing to send
+     */
+    enum class artifactReport{
+        NEW,
+        UPDATE,
+        SUPPRESSED
+    };
+
+
+    class artifactStore{
+
+        public:
+
+        explicit artifactStore(const artifactStoreConfig& config = artifactStoreConfig());
+
+        /**
+         * Looks up art among the known artifacts of its type.
+         * For UPDATE the position in art is replaced with the merged position.
+         */
+        artifactReport report(artifact_message_t* art);
+
+        size_t size() const { return type.size(); }
+        uint64_t reports() const { return reportCount; }
+        uint64_t updates() const { return updateCount; }
+        uint64_t suppressed() const { return suppressedCount; }
+
+
+        private:
+
+        artifactStoreConfig config;
+        double cellSize;
+
+        // one entry per known artifact
+        std::vector<uint8_t> type;
+        std::vector<double> x, y, z;                        // merged position
+        std::vector<double> sent_x, sent_y, sent_z;         // position last transmitted
+        std::vector<uint32_t> weight;                       // reports merged, capped at max_weight
+        std::vector<uint64_t> cell;                         // grid key the entry is filed under
+
+        std::unordered_map<uint64_t, std::vector<uint32_t>> grid;
+
+        uint64_t reportCount;
+        uint64_t updateCount;
+        uint64_t suppressedCount;
+
+        int64_t cell_coordinate(double v) const;
+        static uint64_t cell_key(uint8_t artifact, int64_t cx, int64_t cy, int64_t cz);
+        int64_t nearest(uint8_t artifact, const point_t& p) const;
+        void file(uint32_t index, uint64_t key);
+        void unfile(uint32_t index, uint64_t key);
+    };
+
+}
+
+
+#endif
@@ -0,0 +1,307 @@
+/**
+ * @brief asyncRadio, reliableSender and frameQueue function definitions.
+ *
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>                     // strerror
+#include <unistd.h>                     // read
+
+#include "async_radio.h"
+#include "link_stats.h"
+#include "sim_artifact_message.h"
+#include "simulation_constants.h"
+
+namespace rfd900comm{
+
+    /******************** frameQueue ********************/
+
+    frameQueue::frameQueue(eventLoop& loop) : loop(loop)
+    {
+        // intentionally blank
+    }
+
+    void frameQueue::push(std::string frame)
+    {
+        if(!waiters.empty()){
+            awaiter* w = waiters.front();
+            waiters.pop_front();
+            w->frame = std::move(frame);
+            loop.schedule(w->h);
+            return;
+        }
+
+        frames.push_back(std::move(frame));
+    }
+
+    bool frameQueue::awaiter::await_ready()
+    {
+        if(q->frames.empty()){
+            return false;
+        }
+
+        frame = std::move(q->frames.front());
+        q->frames.pop_front();
+        return true;
+    }
+
+    void frameQueue::awaiter::await_suspend(std::coroutine_handle<> handle)
+    {
+        h = handle;
+        q->waiters.push_back(this);
+    }
+
+
+
+    /******************** asyncRadio ********************/
+
+    asyncRadio::asyncRadio(eventLoop& loop, rfd900Modem& modem) :
+        loop(loop), modem(modem), rx_frames(loop)
+    {
+        tx_busy = false;
+    }
+
+
+    void asyncRadio::start()
+    {
+        loop.spawn(reader());
+    }
+
+
+    task<void> asyncRadio::reader()
+    {
+        uint8_t chunk[RX_CHUNK_LENGTH];
+        std::string extracted;
+
+        while(true){
+            co_await loop.readable(modem.get_fd());
+
+            ssize_t bytesRead = read(modem.get_fd(), chunk, RX_CHUNK_LENGTH);
+            if(bytesRead < 0){
+                if(errno == EAGAIN || errno == EINTR){
+                    continue;
+                }
+                fprintf(stderr, "error, %s, read: %s, reader terminating\n", __func__, strerror(errno));
+                co_return;
+            }
+
+            linkStats::add(link_stats().bytes_in, bytesRead);
+            rx_storage.append((const char*)chunk, bytesRead);
+
+            while(rfd900sim::extract_rx_message(rx_storage, extracted)){
+                rx_frames.push(std::move(extracted));
+                extracted.clear();
+            }
+            linkStats::set(link_stats().rx_queue_depth, rx_frames.size());
+        }
+    }
+
+
+    task<ssize_t> asyncRadio::send(const uint8_t* data, size_t length)
+    {
+        size_t totalBytesSent = 0;
+
+        linkStats::set(link_stats().tx_queue_depth, tx_waiters.size());
+        co_await tx_acquire();
+
+        while(totalBytesSent < length){
+            ssize_t bytesSent = modem.write_serial(data + totalBytesSent, length - totalBytesSent);
+
+            if(bytesSent >= 0){
+                totalBytesSent += bytesSent;
+            }
+            else if(errno == EAGAIN){
+                co_await loop.writable(modem.get_fd());
+            }
+            else if(errno != EINTR){
+                fprintf(stderr, "error: %s, errno: %s\n", __func__, strerror(errno));
+                tx_release();
+                co_return -1;
+            }
+        }
+
+        tx_release();
+        linkStats::add(link_stats().frames_out);
+        co_return static_cast<ssize_t>(totalBytesSent);
+    }
+
+
+    void asyncRadio::tx_release()
+    {
+        if(tx_waiters.empty()){
+            tx_busy = false;
+            return;
+        }
+
+        // ownership passes straight to the next sender, tx_busy stays set
+        loop.schedule(tx_waiters.front());
+        tx_waiters.pop_front();
+    }
+
+
+
+    /******************** reliableSender ********************/
+
+    reliableSender::reliableSender(asyncRadio& radio, message900& msg900) :
+        radio(radio), msg900(msg900), data_frames(radio.get_loop())
+    {
+        retransmit_count = 0;
+        window_stall_count = 0;
+
+        // an expired entry leaves room in its window as an ACK does
+        msg900.set_expired_function([this](const message900_t&){ window_release(); });
+    }
+
+
+    void reliableSender::start()
+    {
+        radio.get_loop().spawn(dispatcher());
+    }
+
+
+    task<void> reliableSender::dispatcher()
+    {
+        while(true){
+            std::string frame = co_await radio.recv_frame();
+
+            if(frame.length() >= sizeof(rfd900sim::ack_message_t)
+                    && frame[2] == rfd900sim::SimConstants::ACK){
+                rfd900sim::ack_message_t ack;
+                memcpy(&ack, frame.data(), sizeof(ack));
+                handle_ack(ack.src_id, ack.msg_id);
+            }
+            else if(frame.length() >= sizeof(rfd900sim::ack_bitmap_message_t)
+                    && frame[2] == rfd900sim::SimConstants::ACK_BITMAP){
+                rfd900sim::ack_bitmap_message_t ack;
+                memcpy(&ack, frame.data(), sizeof(ack));
+                handle_ack_bitmap(ack.src_id, ack.cumulative, ack.run, ack.bitmap);
+            }
+            else{
+                data_frames.push(std::move(frame));
+            }
+        }
+    }
+
+
+    // every held sender re-checks its window, entries were released
+    void reliableSender::window_release()
+    {
+        while(!window_waiters.empty()){
+            radio.get_loop().schedule(window_waiters.front());
+            window_waiters.pop_front();
+        }
+    }
+
+
+    void reliableSender::handle_ack(uint8_t src_id, uint16_t msg_id)
+    {
+        if(msg900.process_received_ack(src_id, msg_id) == 0){
+            window_release();
+        }
+
+        auto it = ack_waiters.find(ack_key(src_id, msg_id));
+        if(it != ack_waiters.end()){
+            acknowledge(it->second);
+        }
+    }
+
+
+    // one coalesced ACK can complete every transaction with src_id
+    void reliableSender::handle_ack_bitmap(uint8_t src_id, uint16_t cumulative, uint16_t run, uint64_t bitmap)
+    {
+        if(msg900.process_received_ack_bitmap(src_id, cumulative, run, bitmap) > 0){
+            window_release();
+        }
+
+        for(const auto& entry : ack_waiters){
+            if((entry.first >> 16) == src_id
+                    && message900::ack_bitmap_covers(cumulative, run, bitmap, static_cast<uint16_t>(entry.first))){
+                acknowledge(entry.second);
+            }
+        }
+    }
+
+
+    void reliableSender::acknowledge(ack_waiter* w)
+    {
+        if(w->acked){
+            return;                                     // duplicate or late ACK
+        }
+        w->acked = true;
+
+        // not waiting yet, or the timeout fired earlier in this pass and the sender is already scheduled
+        if(w->h != nullptr && !w->timed_out){
+            radio.get_loop().cancel_timer(w->timer);
+            radio.get_loop().schedule(w->h);
+        }
+    }
+
+
+    task<bool> reliableSender::send_acked(uint8_t dest_id, uint16_t msg_id, std::string frame,
+                    std::chrono::milliseconds timeout, int max_attempts)
+    {
+        if(ack_waiters.count(ack_key(dest_id, msg_id)) != 0){
+            fprintf(stderr, "error, %s, message %hu to %hhu already awaiting ack\n", __func__, msg_id, dest_id);
+            co_return false;
+        }
+
+        // message type follows dest_id and src_id in every serialized message
+        const size_t type_offset = rfd900sim::SimConstants::MESSAGE_900_START_INDICATOR_LENGTH + 2;
+        if(frame.length() <= type_offset){
+            fprintf(stderr, "error, %s, frame length %lu too short\n", __func__, frame.length());
+            co_return false;
+        }
+
+        // backpressure, the producer is suspended until the destination window opens
+        if(!msg900.window_open(dest_id, msg_id, frame.length())){
+            ++window_stall_count;
+            do{
+                co_await wait_for_window();
+            } while(!msg900.window_open(dest_id, msg_id, frame.length()));
+        }
+
+        if(msg900.add_to_ack_wait_list(dest_id, msg_id, static_cast<uint8_t>(frame[type_offset]),
+                    (const uint8_t*)frame.data(), frame.length()) != 0){
+            co_return false;
+        }
+
+        // the ACK may be dispatched while a send is suspended, acknowledge flags it here
+        const uint32_t key = ack_key(dest_id, msg_id);
+        ack_waiter w{};
+        ack_waiters[key] = &w;
+
+        for(int attempt = 0; attempt < max_attempts; ++attempt){
+
+            // the message left the ack wait list by its TTL, it is worth nothing to the receiver
+            if(attempt > 0 && msg900.record_retransmission(dest_id, msg_id) != 0){
+                ack_waiters.erase(key);
+                window_release();
+                co_return false;
+            }
+            if(attempt > 0){
+                ++retransmit_count;
+            }
+
+            if(co_await radio.send((const uint8_t*)frame.data(), frame.length()) < 0){
+                break;
+            }
+
+            std::chrono::milliseconds wait = timeout;
+            if(wait == std::chrono::milliseconds::zero()){
+                wait = std::chrono::duration_cast<std::chrono::milliseconds>(msg900.retransmission_timeout(dest_id));
+            }
+
+            if(co_await wait_for_ack(&w, wait)){
+                ack_waiters.erase(key);
+                co_return true;
+            }
+        }
+
+        ack_waiters.erase(key);
+        msg900.remove_from_ack_wait_list(dest_id, msg_id);
+        window_release();
+        co_return false;
+    }
+
+}
@@ -0,0 +1,247 @@
+/**
+ * @brief Declares the coroutine based radio API
+ *
+ * asyncRadio wraps an rfd900Modem and an eventLoop:
+ *      co_await radio.send(buffer, length)     write a serialized frame
+ *      co_await radio.recv_frame()             next frame extracted from the rx stream
+ *
+ * reliableSender adds acknowledged delivery on top of asyncRadio:
+ *      co_await reliable.send_acked(dest, msg_id, frame, timeout)
+ *      co_await reliable.send_acked(dest, msg_id, frame)           timeout from the message900 RTO
+ *
+ * send_acked transmits the frame, suspends until the matching ACK arrives or
+ * the timeout expires, and retransmits up to max_attempts times. Each
+ * outstanding transaction is one suspended coroutine frame, so a single
+ * thread can keep hundreds of them in flight. A coalesced ACK from an
+ * ackCoalescer resumes every transaction it covers.
+ *
+ * Everything runs on the event loop thread. None of these classes are thread safe.
+ *
+ */
+
+#ifndef ASYNC_RADIO_INCLUDED_H
+#define ASYNC_RADIO_INCLUDED_H
+
+#include <chrono>
+#include <coroutine>
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <unordered_map>
+
+#include "coro_task.h"
+#include "event_loop.h"
+#include "message900.h"
+#include "rfd900_modem.h"
+
+
+namespace rfd900comm{
+
+    /**
+     * FIFO of extracted frames with FIFO of coroutines waiting for one.
+     * A pushed frame is handed directly to the oldest waiter when there is one.
+     */
+    class frameQueue{
+
+        public:
+
+        struct awaiter{
+            frameQueue* q;
+            std::string frame;
+            std::coroutine_handle<> h;
+
+            bool await_ready();
+            void await_suspend(std::coroutine_handle<> handle);
+            std::string await_resume() { return std::move(frame); }
+        };
+
+        frameQueue(eventLoop& loop);
+
+        void push(std::string frame);
+        awaiter pop() { return awaiter{this, std::string(), nullptr}; }
+
+        size_t size() const { return frames.size(); }
+
+
+        private:
+
+        eventLoop& loop;
+        std::deque<std::string> frames;
+        std::deque<awaiter*> waiters;           // awaiters living in suspended coroutine frames
+    };
+
+
+    class asyncRadio{
+
+        public:
+
+        static constexpr size_t RX_CHUNK_LENGTH = 256;
+
+        asyncRadio(eventLoop& loop, rfd900Modem& modem);
+
+        // disable copy constructor
+        asyncRadio(const asyncRadio&) = delete;
+
+        // disable assignment
+        asyncRadio& operator=(const asyncRadio&) = delete;
+
+        // spawns the reader task on the event loop
+        void start();
+
+        // writes all length bytes, frames from concurrent senders are never interleaved
+        // returns bytes written or -1 on error
+        task<ssize_t> send(const uint8_t* data, size_t length);
+
+        auto recv_frame() { return rx_frames.pop(); }
+
+        eventLoop& get_loop() { return loop; }
+
+
+        private:
+
+        eventLoop& loop;
+        rfd900Modem& modem;
+
+        frameQueue rx_frames;
+        std::string rx_storage;
+
+        // send serialization
+        bool tx_busy;
+        std::deque<std::coroutine_handle<>> tx_waiters;
+
+        task<void> reader();
+
+        auto tx_acquire()
+        {
+            struct awaiter{
+                asyncRadio* radio;
+                bool await_ready()
+                {
+                    if(!radio->tx_busy){
+                        radio->tx_busy = true;
+                        return true;
+                    }
+                    return false;
+                }
+                void await_suspend(std::coroutine_handle<> h) { radio->tx_waiters.push_back(h); }
+                void await_resume() {}
+            };
+            return awaiter{this};
+        }
+
+        void tx_release();
+    };
+
+
+    class reliableSender{
+
+        public:
+
+        static constexpr int DEFAULT_MAX_ATTEMPTS = 5;
+
+        reliableSender(asyncRadio& radio, message900& msg900);
+
+        // disable copy constructor
+        reliableSender(const reliableSender&) = delete;
+
+        // disable assignment
+        reliableSender& operator=(const reliableSender&) = delete;
+
+        // spawns the dispatcher that routes ACK and coalesced ACK frames to waiting senders
+        void start();
+
+        /**
+         * Transmit a serialized frame and wait for its ACK, retransmitting after
+         * each timeout. Returns true when acknowledged, false after max_attempts
+         * transmissions without an ACK.
+         *
+         * A zero timeout uses message900::retransmission_timeout for the destination,
+         * re-read before every wait so it follows the RTO backoff.
+         *
+         * While the message900 send window to dest_id is closed the caller is
+         * suspended before the first transmission.
+         *
+         * A message whose TTL runs out in the ack wait list is not sent again,
+         * send_acked returns false.
+         */
+        task<bool> send_acked(uint8_t dest_id, uint16_t msg_id, std::string frame,
+                    std::chrono::milliseconds timeout = std::chrono::milliseconds::zero(),
+                    int max_attempts = DEFAULT_MAX_ATTEMPTS);
+
+        // frames that are not ACKs, use instead of asyncRadio::recv_frame once started
+        auto recv_frame() { return data_frames.pop(); }
+
+        size_t outstanding() const { return ack_waiters.size(); }
+        uint64_t retransmissions() const { return retransmit_count; }
+        uint64_t window_stalls() const { return window_stall_count; }
+
+
+        private:
+
+        // one per send_acked transaction, registered from the first transmission to the return
+        struct ack_waiter{
+            std::coroutine_handle<> h;          // nullptr unless suspended in wait_for_ack
+            eventLoop::timer_id timer;
+            bool acked;                         // set by acknowledge, whenever the ACK arrives
+            bool timed_out;                     // the timer fired, h is scheduled and the timer gone
+        };
+
+        asyncRadio& radio;
+        message900& msg900;
+        frameQueue data_frames;
+
+        std::unordered_map<uint32_t, ack_waiter*> ack_waiters;
+        std::deque<std::coroutine_handle<>> window_waiters;     // senders held by a closed message900 send window
+        uint64_t retransmit_count;
+        uint64_t window_stall_count;
+
+        static uint32_t ack_key(uint8_t node_id, uint16_t msg_id) { return (uint32_t(node_id) << 16) | msg_id; }
+
+        task<void> dispatcher();
+        void handle_ack(uint8_t src_id, uint16_t msg_id);
+        void handle_ack_bitmap(uint8_t src_id, uint16_t cumulative, uint16_t run, uint64_t bitmap);
+        void acknowledge(ack_waiter* w);
+        void window_release();
+
+        auto wait_for_window()
+        {
+            struct awaiter{
+                reliableSender* sender;
+                bool await_ready() const noexcept { return false; }
+                void await_suspend(std::coroutine_handle<> h) { sender->window_waiters.push_back(h); }
+                void await_resume() {}
+            };
+            return awaiter{this};
+        }
+
+        // resumes true once w is acknowledged, false when timeout passes first
+        auto wait_for_ack(ack_waiter* w, std::chrono::milliseconds timeout)
+        {
+            struct awaiter{
+                reliableSender* sender;
+                ack_waiter* w;
+                std::chrono::milliseconds timeout;
+
+                bool await_ready() const noexcept { return w->acked; }
+
+                void await_suspend(std::coroutine_handle<> h)
+                {
+                    w->h = h;
+                    w->timed_out = false;
+                    w->timer = sender->radio.get_loop().add_timer(eventLoop::clock::now() + timeout, h, &w->timed_out);
+                }
+
+                bool await_resume()
+                {
+                    w->h = nullptr;
+                    return w->acked;
+                }
+            };
+            return awaiter{this, w, timeout};
+        }
+    };
+
+}
+
+
+#endif
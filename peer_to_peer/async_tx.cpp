@@ -0,0 +1,150 @@
+/**
+ * Purpose:
+ *  Simulate sending artifact messages to a second radio with acknowledged delivery.
+ *  Uses the coroutine API (asyncRadio, reliableSender) to keep many
+ *  messages awaiting their ACK at the same time on a single thread.
+ *
+ *  Run rxspeed on the receiving radio, it acknowledges every artifact.
+ *
+ *  Without a serial device path the radio is found by port discovery,
+ *  57600 baud is tried first
+ *
+ * Required Command line arguments
+ *  argv[1] - number of messages
+ *  argv[2] - maximum number of messages awaiting ACK at once
+ *
+ * Optional Command line arguments
+ *  argv[3] - ack timeout, milliseconds
+ *  argv[4] - serial device path, auto for port discovery
+ *
+ */
+
+#include <cstdlib>                  // atoi
+#include <cstring>                  // strcmp
+
+#include <chrono>
+#include <string>
+
+#include "async_radio.h"
+#include "event_loop.h"
+#include "link_stats.h"
+#include "message900.h"
+#include "modem_discovery.h"
+#include "rfd900_modem.h"
+#include "simulation_constants.h"
+#include "sim_artifact_message.h"
+
+
+static int acked = 0;
+static int failed = 0;
+
+
+// one reliable transaction, suspended while its ACK is outstanding
+static rfd900comm::task<void> send_one(rfd900comm::reliableSender& reliable, uint8_t myCommId,
+            std::chrono::milliseconds timeout, int* in_flight)
+{
+    const size_t SERIAL_ARTIFACT_BUFFER_LENGTH = sizeof(rfd900sim::artifact_message_t)
+                        + rfd900sim::SimConstants::MESSAGE_900_START_INDICATOR_LENGTH
+                        + rfd900sim::SimConstants::MESSAGE_900_END_INDICATOR_LENGTH;
+
+    std::string frame(SERIAL_ARTIFACT_BUFFER_LENGTH, '\0');
+    rfd900sim::artifact_message_t artmsg;
+
+    rfd900sim::simulate_artifact_message(&artmsg, rfd900sim::SimConstants::BASE_STATION, myCommId);
+    rfd900sim::serialize_artifact_for_900MHz(&artmsg, (uint8_t*)frame.data(), SERIAL_ARTIFACT_BUFFER_LENGTH);
+
+    if(co_await reliable.send_acked(artmsg.dest_id, artmsg.msg_id, std::move(frame), timeout)){
+        ++acked;
+    }
+    else{
+        ++failed;
+    }
+
+    --(*in_flight);
+}
+
+
+static rfd900comm::task<void> producer(rfd900comm::eventLoop& loop, rfd900comm::reliableSender& reliable,
+            int messageCount, int window, std::chrono::milliseconds timeout)
+{
+    uint8_t myCommId = rfd900sim::SimConstants::AERIAL01;
+    int in_flight = 0;
+    int started = 0;
+
+    while(started < messageCount){
+        if(in_flight < window){
+            ++in_flight;
+            ++started;
+            loop.spawn(send_one(reliable, myCommId, timeout, &in_flight));
+        }
+        else{
+            co_await loop.sleep_for(std::chrono::milliseconds(1));
+        }
+    }
+
+    while(in_flight > 0){
+        co_await loop.sleep_for(std::chrono::milliseconds(10));
+    }
+
+    loop.stop();
+}
+
+
+int main(int argc, char **argv)
+{
+    const char* serialDevicePath = nullptr;
+    int baudRate = rfd900comm::rfd900Modem::DEFAULT_BAUD_RATE;
+    rfd900comm::rfd900Modem radio;
+    rfd900comm::message900 msg900;
+    rfd900comm::linkStatsSegment statsSegment;
+
+    int messageCount;
+    int window;
+    std::chrono::milliseconds timeout(3000);
+
+    if(argc < 3){
+       fprintf(stderr, "usage: %s <messages> <max awaiting ack> [ack timeout ms] [serial device]\n", argv[0]);
+       return 1;
+    }
+
+    messageCount = atoi(argv[1]);
+    window = atoi(argv[2]);
+    if(argc > 3){
+        timeout = std::chrono::milliseconds(atoi(argv[3]));
+    }
+    if(argc > 4 && strcmp(argv[4], "auto") != 0){
+        serialDevicePath = argv[4];
+    }
+
+    if( rfd900comm::open_radio(radio, serialDevicePath, baudRate) != 0){
+        fprintf(stderr, "error, %s radio init failure\n", __func__);
+        return 1;
+    }
+
+    if(statsSegment.create("/rfd900_txasync") != 0){
+        fprintf(stderr, "warning, %s, link statistics not shared\n", __func__);
+    }
+
+    // the message900 send window holds the same number of artifacts
+    msg900.set_send_window(window, window * (sizeof(rfd900sim::artifact_message_t)
+                + rfd900sim::SimConstants::MESSAGE_900_START_INDICATOR_LENGTH
+                + rfd900sim::SimConstants::MESSAGE_900_END_INDICATOR_LENGTH));
+
+    rfd900comm::eventLoop loop;
+    rfd900comm::asyncRadio async_radio(loop, radio);
+    rfd900comm::reliableSender reliable(async_radio, msg900);
+
+    async_radio.start();
+    reliable.start();
+
+    auto start = std::chrono::steady_clock::now();
+    loop.spawn(producer(loop, reliable, messageCount, window, timeout));
+    loop.run();
+    auto elapsed = std::chrono::steady_clock::now() - start;
+
+    fprintf(stderr, "program terminating, acked: %d, failed: %d, retransmissions: %lu, elapsed ms: %ld\n",
+            acked, failed, reliable.retransmissions(),
+            std::chrono::duration_cast<std::chrono::milliseconds>(elapsed).count());
+
+    return 0;
+}
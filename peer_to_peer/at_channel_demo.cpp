@@ -0,0 +1,181 @@
+/**
+ * Purpose:
+ *  Run the AT command channel and link adaptation against an emulated
+ *  RFD900x, no radio needed.
+ *
+ *  The program reads the radio's registers, which set the airtime
+ *  accountant's air speed and ECC. It then steps the emulated link through
+ *  good, fading, poor, recovering and lossy reports and polls ATI7 after
+ *  each one. The linkAdapter tier and the settings it applies are printed
+ *  for every report.
+ *
+ *  Payload keeps flowing throughout. Frames are queued and written through
+ *  a txScheduler whenever the channel does not hold the port. The emulated
+ *  radio sends a frame to the program every few milliseconds, including
+ *  during AT sessions. At the end the program checks three things:
+ *  every byte from the air arrived in order, no payload was taken for an
+ *  AT command, and every frame written reached the air.
+ *
+ * Optional Command line arguments
+ *  argv[1] - guard time, milliseconds, default 50
+ *
+ */
+
+#include <cstdio>
+#include <cstdlib>                  // atoi
+#include <string>
+#include <unistd.h>                 // usleep
+
+#include "airtime_accountant.h"
+#include "at_command.h"
+#include "at_modem_emulator.h"
+#include "link_adapter.h"
+#include "message900.h"
+#include "rfd900_modem.h"
+#include "tx_scheduler.h"
+
+
+struct link_phase_t{
+    const char* name;
+    int local_rssi;
+    int remote_rssi;
+    int local_noise;
+    int remote_noise;
+    int packets;
+    int rx_errors;
+};
+
+constexpr size_t FRAME_LENGTH = 40;
+constexpr int PHASE_TRAFFIC_MS = 100;
+
+
+static std::string link_report(const link_phase_t& p)
+{
+    char text[160];
+    snprintf(text, sizeof(text), "L/R RSSI: %d/%d  L/R noise: %d/%d pkts: %d  txe=0 rxe=%d stx=0 srx=0 ecc=0/0 temp=38 dco=0",
+                p.local_rssi, p.remote_rssi, p.local_noise, p.remote_noise, p.packets, p.rx_errors);
+    return text;
+}
+
+
+int main(int argc, char **argv)
+{
+    int guard_ms = argc > 1 ? atoi(argv[1]) : 50;
+
+    rfd900comm::atModemEmulator emulator;
+    rfd900comm::atModemEmulatorConfig emulated;
+    emulated.guard_time = std::chrono::milliseconds(guard_ms);
+    emulated.air_speed_kbps = 128;
+    if(emulator.start(emulated) != 0){
+        return 1;
+    }
+
+    rfd900comm::rfd900Modem radio;
+    if(radio.init(emulator.port_name()) != 0){
+        fprintf(stderr, "error, %s radio init failure\n", __func__);
+        return 1;
+    }
+
+    rfd900comm::message900 arq;
+    rfd900comm::txScheduler scheduler(64000 / 8);
+    rfd900comm::airtimeAccountant airtime;
+    rfd900comm::linkAdapter adapter(arq, &scheduler, &airtime);
+    rfd900comm::atCommandChannel channel(radio, std::chrono::milliseconds(guard_ms));
+
+    channel.set_registers_function([&](const rfd900comm::atCommandChannel& c){ adapter.update_radio(c); });
+    channel.set_quality_function([&](const rfd900comm::radioLinkQuality& q){ adapter.update(q); });
+
+    const link_phase_t phases[] = {
+        {"good",        120, 115, 40, 42,  100,   0},
+        {"fading",       78,  75, 40, 41,  200,   1},
+        {"poor",         60,  58, 41, 42,  300,   3},
+        {"recovering",   80,  79, 42, 42,  400,   4},
+        {"near good",    82,  82, 42, 42,  500,   5},
+        {"good",        120, 118, 40, 41,  600,   5},
+        {"lossy",       120, 118, 40, 41,  700,  25}
+    };
+
+    std::string injected;
+    std::string delivered;
+    uint64_t frames_written = 0;
+    uint64_t injections = 0;
+    uint8_t buffer[512];
+
+    // runs the I/O loop for ms milliseconds, or until the channel is idle when ms is 0
+    auto run = [&](int ms){
+        for(int t = 0; ms == 0 ? (t == 0 || channel.active()) : t < ms; ++t){
+            bool busy = channel.service();
+            size_t n;
+            while((n = channel.take_received(buffer, sizeof(buffer))) > 0){
+                delivered.append(reinterpret_cast<char*>(buffer), n);
+            }
+            if(!busy){
+                ssize_t r;
+                while((r = radio.read_serial(buffer, sizeof(buffer), 0)) > 0){
+                    delivered.append(reinterpret_cast<char*>(buffer), r);
+                }
+                if(scheduler.queued() < 2){
+                    std::string frame = "<#@frame " + std::to_string(frames_written) + " ";
+                    frame.resize(FRAME_LENGTH - 3, 'x');
+                    frame += "@#>";
+                    scheduler.enqueue(rfd900comm::txPriority::NORMAL, reinterpret_cast<const uint8_t*>(frame.data()),
+                                frame.size());
+                }
+                frames_written += scheduler.service(radio);
+            }
+            if(t % 3 == 0){
+                std::string frame = "<#@air " + std::to_string(injections++) + "@#>";
+                emulator.inject(frame);
+                injected += frame;
+            }
+            usleep(1000);
+        }
+    };
+
+    channel.query_registers();
+    run(0);
+    fprintf(stdout, "%s, S2 %s=%d, S5 %s=%d, accountant %u kbps ecc %d\n", channel.banner().c_str(),
+                channel.register_name(2).c_str(), channel.register_value(2),
+                channel.register_name(5).c_str(), channel.register_value(5),
+                airtime.config().air_speed_kbps, airtime.config().ecc ? 1 : 0);
+
+    const char* expected[] = {"good", "fair", "poor", "fair", "fair", "good", "fair"};
+    int mismatches = 0;
+    for(size_t i = 0; i < sizeof(phases) / sizeof(phases[0]); ++i){
+        emulator.set_link_report(link_report(phases[i]));
+        channel.query_link_quality();
+        run(0);
+
+        const rfd900comm::linkTierSettings& s = adapter.settings();
+        fprintf(stdout, "%-10s margin %5.1f dB  rx errors %2u  tier %-4s  min rto %3ld ms  window %2lu/%4lu  backlog %3lu%s\n",
+                    phases[i].name, channel.link_quality().fade_margin_db(), channel.link_quality().rx_errors, s.name,
+                    (long)std::chrono::duration_cast<std::chrono::milliseconds>(s.min_rto).count(),
+                    s.window_frames, s.window_bytes, s.max_backlog_bytes,
+                    adapter.ecc_recommended() ? "  ECC recommended" : "");
+        if(std::string(s.name) != expected[i]){
+            ++mismatches;
+        }
+        run(PHASE_TRAFFIC_MS);
+    }
+
+    // the last injected bytes and written frames
+    usleep(50000);
+    run(20);
+    usleep(50000);
+    ssize_t r;
+    while((r = radio.read_serial(buffer, sizeof(buffer), 0)) > 0){
+        delivered.append(reinterpret_cast<char*>(buffer), r);
+    }
+
+    bool intact = delivered == injected;
+    bool air_ok = emulator.air_bytes() == frames_written * FRAME_LENGTH;
+    fprintf(stdout, "sessions %lu, failed %lu, AT commands %lu, errors %lu\n", channel.sessions(),
+                channel.failed_sessions(), emulator.commands(), emulator.errors());
+    fprintf(stdout, "from the air: %lu bytes sent, %lu delivered, %s\n", injected.size(), delivered.size(),
+                intact ? "intact and in order" : "MISMATCH");
+    fprintf(stdout, "to the air: %lu frames written, %lu bytes on the air, %s\n", frames_written,
+                emulator.air_bytes(), air_ok ? "all of them" : "MISMATCH");
+    fprintf(stdout, "tier mismatches %d, tier changes %lu\n", mismatches, adapter.tier_changes());
+
+    return intact && air_ok && mismatches == 0 && emulator.errors() == 0 ? 0 : 1;
+}
@@ -0,0 +1,481 @@
+/**
+ * @brief atCommandChannel class function definitions.
+ *
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>                     // strtol
+#include <string.h>                     // strerror
+#include <unistd.h>
+
+#include <algorithm>
+
+#include "at_command.h"
+#include "link_stats.h"
+#include "virtual_clock.h"
+
+namespace rfd900comm{
+
+    double radioLinkQuality::fade_margin_db() const
+    {
+        int local = local_rssi - local_noise;
+        int remote = remote_rssi - remote_noise;
+        return std::min(local, remote) / 1.9;
+    }
+
+
+    // the number after key, false when key is missing
+    static bool field(const std::string& line, const char* key, long* value)
+    {
+        size_t pos = line.find(key);
+        if(pos == std::string::npos){
+            return false;
+        }
+        *value = strtol(line.c_str() + pos + strlen(key), nullptr, 10);
+        return true;
+    }
+
+
+    // "L/R RSSI: 210/205  L/R noise: 35/40 pkts: 120  txe=0 rxe=2 stx=0 srx=0 ecc=0/0 temp=38 dco=0"
+    bool parse_link_report(const std::string& line, radioLinkQuality* quality)
+    {
+        int local_rssi, remote_rssi, local_noise, remote_noise;
+        size_t rssi = line.find("RSSI:");
+        size_t noise = line.find("noise:");
+        if(rssi == std::string::npos || noise == std::string::npos
+                || sscanf(line.c_str() + rssi + 5, "%d/%d", &local_rssi, &remote_rssi) != 2
+                || sscanf(line.c_str() + noise + 6, "%d/%d", &local_noise, &remote_noise) != 2){
+            return false;
+        }
+
+        radioLinkQuality q;
+        q.valid = true;
+        q.local_rssi = local_rssi;
+        q.remote_rssi = remote_rssi;
+        q.local_noise = local_noise;
+        q.remote_noise = remote_noise;
+
+        long value;
+        if(field(line, "pkts:", &value)) q.packets = value;
+        if(field(line, "txe=", &value)) q.tx_errors = value;
+        if(field(line, "rxe=", &value)) q.rx_errors = value;
+        if(field(line, "stx=", &value)) q.serial_tx_overflows = value;
+        if(field(line, "srx=", &value)) q.serial_rx_overflows = value;
+        if(field(line, "temp=", &value)) q.temperature = value;
+
+        unsigned corrected, errors;
+        size_t ecc = line.find("ecc=");
+        if(ecc != std::string::npos && sscanf(line.c_str() + ecc + 4, "%u/%u", &corrected, &errors) == 2){
+            q.ecc_corrected = corrected;
+            q.ecc_errors = errors;
+        }
+
+        *quality = q;
+        return true;
+    }
+
+
+    atCommandChannel::atCommandChannel(rfd900Modem& modem, std::chrono::milliseconds guard_time) :
+        radio(modem), guardTime(guard_time), commandHead(0), commandCount(0), stage(stage_t::IDLE),
+        leaveStep(0), sessionCount(0), failedCount(0)
+    {
+        for(int& value : registers){
+            value = -1;
+        }
+    }
+
+
+    int atCommandChannel::queue_command(const std::string& command, reply_function done)
+    {
+        if(commandCount == MAX_QUEUED_COMMANDS){
+            fprintf(stderr, "error, %s, command queue full, %s not queued\n", __func__, command.c_str());
+            return -1;
+        }
+
+        command_t& c = commands[(commandHead + commandCount) % MAX_QUEUED_COMMANDS];
+        c.text = command;
+        c.done = std::move(done);
+        ++commandCount;
+        return 0;
+    }
+
+
+    int atCommandChannel::query_link_quality()
+    {
+        return queue_command("ATI7", [this](int status, const std::string& reply){
+            radioLinkQuality q;
+            if(status != 0 || !parse_link_report(reply, &q)){
+                return;
+            }
+            q.when = clock_now();
+            quality = q;
+
+            linkStats& stats = link_stats();
+            linkStats::set(stats.radio_rssi_local, q.local_rssi);
+            linkStats::set(stats.radio_rssi_remote, q.remote_rssi);
+            linkStats::set(stats.radio_noise_local, q.local_noise);
+            linkStats::set(stats.radio_noise_remote, q.remote_noise);
+            linkStats::set(stats.radio_rx_errors, q.rx_errors);
+
+            if(qualityDone){
+                qualityDone(quality);
+            }
+        });
+    }
+
+
+    int atCommandChannel::query_registers()
+    {
+        int rv = queue_command("ATI", [this](int status, const std::string& reply){
+            if(status == 0){
+                bannerText = reply.substr(0, reply.find('\n'));
+            }
+        });
+        if(rv != 0){
+            return rv;
+        }
+
+        return queue_command("ATI5", [this](int status, const std::string& reply){
+            if(status != 0){
+                return;
+            }
+            parse_registers(reply);
+            if(registersDone){
+                registersDone(*this);
+            }
+        });
+    }
+
+
+    int atCommandChannel::set_register(int reg, int value, bool save)
+    {
+        if(reg < 0 || reg >= MAX_REGISTERS){
+            fprintf(stderr, "error, %s, register %d out of range\n", __func__, reg);
+            return -1;
+        }
+
+        char command[32];
+        snprintf(command, sizeof(command), "ATS%d=%d", reg, value);
+        int rv = queue_command(command, [this, reg, value](int status, const std::string&){
+            if(status == 0){
+                registers[reg] = value;
+            }
+        });
+        if(rv == 0 && save){
+            rv = queue_command("AT&W");
+        }
+        return rv;
+    }
+
+
+    // "S2:AIR_SPEED=64" per line
+    void atCommandChannel::parse_registers(const std::string& reply)
+    {
+        size_t start = 0;
+        while(start < reply.size()){
+            size_t end = reply.find('\n', start);
+            if(end == std::string::npos){
+                end = reply.size();
+            }
+            std::string line = reply.substr(start, end - start);
+            start = end + 1;
+
+            int reg, value;
+            char name[32];
+            if(sscanf(line.c_str(), "S%d:%31[^=]=%d", &reg, name, &value) == 3 && reg >= 0 && reg < MAX_REGISTERS){
+                registers[reg] = value;
+                registerNames[reg] = name;
+            }
+        }
+    }
+
+
+    size_t atCommandChannel::take_received(uint8_t* buffer, size_t length)
+    {
+        size_t n = std::min(length, received.size());
+        std::copy(received.begin(), received.begin() + n, buffer);
+        received.erase(received.begin(), received.begin() + n);
+        return n;
+    }
+
+
+    void atCommandChannel::read_port()
+    {
+        char buffer[256];
+        ssize_t n;
+        while((n = read(radio.get_fd(), buffer, sizeof(buffer))) > 0){
+            raw.append(buffer, n);
+        }
+    }
+
+
+    /**
+     * Moves framed payload, "<#@" to "@#>", to received and the bytes
+     * between frames to input. An unfinished frame waits in raw for its end,
+     * up to MAX_FRAME_LENGTH bytes, after which it is taken as text.
+     */
+    void atCommandChannel::sort_input(bool all_payload)
+    {
+        static const std::string START = "<#@";
+        static const std::string END = "@#>";
+        constexpr size_t MAX_FRAME_LENGTH = 512;
+
+        if(all_payload){
+            received.insert(received.end(), raw.begin(), raw.end());
+            raw.clear();
+            return;
+        }
+
+        size_t before = input.size();
+        size_t pos = 0;
+        while(pos < raw.size()){
+            size_t start = raw.find(START, pos);
+            if(start == std::string::npos){
+                // a trailing "<" or "<#" can be the start of a frame
+                size_t keep = 0;
+                if(raw.compare(raw.size() - 1, 1, "<") == 0){
+                    keep = 1;
+                }
+                else if(raw.size() - pos >= 2 && raw.compare(raw.size() - 2, 2, "<#") == 0){
+                    keep = 2;
+                }
+                input.append(raw, pos, raw.size() - pos - keep);
+                pos = raw.size() - keep;
+                break;
+            }
+
+            input.append(raw, pos, start - pos);
+            size_t end = raw.find(END, start + START.size());
+            if(end == std::string::npos){
+                if(raw.size() - start <= MAX_FRAME_LENGTH){
+                    pos = start;
+                    break;
+                }
+                input.append(raw, start, START.size());
+                pos = start + START.size();
+                continue;
+            }
+            received.insert(received.end(), raw.begin() + start, raw.begin() + end + END.size());
+            pos = end + END.size();
+        }
+        raw.erase(0, pos);
+
+        if(input.size() > before){
+            lastByte = clock_now();
+        }
+    }
+
+
+    // AT bytes never reach the air, they bypass write_serial and the modem's occupancy model
+    void atCommandChannel::write_port(const std::string& text)
+    {
+        ssize_t n = write(radio.get_fd(), text.data(), text.size());
+        if(n != static_cast<ssize_t>(text.size())){
+            fprintf(stderr, "error, %s, write %s: %s\n", __func__, text.c_str(), n < 0 ? strerror(errno) : "short write");
+        }
+    }
+
+
+    void atCommandChannel::enter(stage_t next)
+    {
+        stage = next;
+        stageStart = clock_now();
+    }
+
+
+    void atCommandChannel::send_next_command()
+    {
+        replyText.clear();
+        write_port(commands[commandHead].text + "\r");
+        enter(stage_t::COMMAND);
+    }
+
+
+    /**
+     * The reply is every line after the echoed command up to OK or ERROR.
+     * Some commands, ATI7 and ATSn? among them, end without OK, their reply
+     * is complete when a line has arrived and the radio pauses for REPLY_GAP.
+     */
+    bool atCommandChannel::reply_complete(steady::time_point now, int* status, std::string* reply)
+    {
+        const std::string& command = commands[commandHead].text;
+
+        size_t end;
+        while((end = input.find_first_of("\r\n")) != std::string::npos){
+            std::string line = input.substr(0, end);
+            input.erase(0, end + 1);
+            if(line.empty() || line == command){
+                continue;
+            }
+            if(line == "OK" || line == "ERROR"){
+                *status = line == "OK" ? 0 : -1;
+                *reply = replyText;
+                return true;
+            }
+            if(!replyText.empty()){
+                replyText += '\n';
+            }
+            replyText += line;
+        }
+
+        if(!replyText.empty() && now - lastByte >= REPLY_GAP){
+            *status = 0;
+            *reply = replyText;
+            return true;
+        }
+        if(now - stageStart >= RESPONSE_TIMEOUT){
+            *status = -1;
+            *reply = replyText;
+            return true;
+        }
+        return false;
+    }
+
+
+    void atCommandChannel::finish_command(int status, const std::string& reply)
+    {
+        // off the queue before the call, done may queue another command
+        reply_function done = std::move(commands[commandHead].done);
+        commands[commandHead].done = nullptr;
+        commandHead = (commandHead + 1) % MAX_QUEUED_COMMANDS;
+        --commandCount;
+
+        if(status != 0){
+            fprintf(stderr, "warning, %s, command failed, reply: %s\n", __func__, reply.c_str());
+        }
+        if(done){
+            done(status, reply);
+        }
+    }
+
+
+    void atCommandChannel::fail_session()
+    {
+        fprintf(stderr, "error, %s, no OK from the radio after +++\n", __func__);
+        ++failedCount;
+        while(commandCount > 0){
+            finish_command(-1, std::string());
+        }
+        enter(stage_t::IDLE);
+    }
+
+
+    bool atCommandChannel::service()
+    {
+        if(stage == stage_t::IDLE){
+            if(commandCount == 0){
+                return false;
+            }
+            input.clear();
+            enter(stage_t::DRAINING);
+        }
+
+        steady::time_point now = clock_now();
+        read_port();
+        sort_input(stage == stage_t::DRAINING || stage == stage_t::GUARD);
+
+        switch(stage){
+        case stage_t::DRAINING:{
+            // bytes still queued would arrive at the radio inside the guard time
+            received.insert(received.end(), input.begin(), input.end());
+            input.clear();
+            ssize_t queued = radio.kernel_tx_queued();
+            size_t buffered = radio.modem_model_enabled() ? radio.modem_buffered() : 0;
+            if(queued <= 0 && buffered == 0){
+                enter(stage_t::GUARD);
+            }
+            break;
+        }
+
+        case stage_t::GUARD:
+            received.insert(received.end(), input.begin(), input.end());
+            input.clear();
+            if(now - stageStart >= guardTime){
+                write_port("+++");
+                enter(stage_t::ESCAPE);
+            }
+            break;
+
+        case stage_t::ESCAPE:{
+            // payload can still arrive ahead of the OK
+            size_t ok = input.find("OK\r");
+            if(ok == std::string::npos){
+                ok = input.find("OK\n");
+            }
+            if(ok != std::string::npos){
+                received.insert(received.end(), input.begin(), input.begin() + ok);
+                input.erase(0, ok + 3);
+                ++sessionCount;
+                send_next_command();
+            }
+            else if(now - stageStart >= guardTime + RESPONSE_TIMEOUT){
+                received.insert(received.end(), input.begin(), input.end());
+                input.clear();
+                fail_session();
+            }
+            else if(input.size() > 2){
+                // keep what could be the start of OK
+                received.insert(received.end(), input.begin(), input.end() - 2);
+                input.erase(0, input.size() - 2);
+            }
+            break;
+        }
+
+        case stage_t::COMMAND:{
+            int status;
+            std::string reply;
+            if(reply_complete(now, &status, &reply)){
+                finish_command(status, reply);
+                if(commandCount > 0){
+                    send_next_command();
+                }
+                else{
+                    write_port("ATO\r");
+                    leaveStep = 0;
+                    enter(stage_t::LEAVING);
+                }
+            }
+            break;
+        }
+
+        case stage_t::LEAVING:
+            if(leaveStep == 0){
+                size_t echo = input.find("ATO\r");
+                if(echo != std::string::npos){
+                    input.erase(0, echo + 4);
+                    leaveStep = 1;
+                    stageStart = now;
+                }
+                else if(now - stageStart >= RESPONSE_TIMEOUT){
+                    input.clear();
+                    enter(stage_t::IDLE);
+                    break;
+                }
+            }
+            if(leaveStep == 1){
+                // the line end after the echo, then payload, whose frames never start with CR or LF
+                while(!input.empty() && (input[0] == '\r' || input[0] == '\n')){
+                    input.erase(0, 1);
+                }
+                if(!input.empty()){
+                    leaveStep = 2;
+                }
+            }
+            if(leaveStep == 2){
+                received.insert(received.end(), input.begin(), input.end());
+                input.clear();
+            }
+            if(leaveStep > 0 && now - stageStart >= REPLY_GAP){
+                enter(stage_t::IDLE);
+            }
+            break;
+
+        case stage_t::IDLE:
+            break;
+        }
+
+        return stage != stage_t::IDLE;
+    }
+
+}
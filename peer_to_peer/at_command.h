@@ -0,0 +1,202 @@
+/**
+ * @brief Declares atCommandChannel, the RFD900x AT command interface beside the payload stream
+ *
+ * The radio knows its link better than the ARQ does: it reports the signal
+ * and noise at both ends, packet and error counts, and holds its air speed
+ * and ECC setting in S registers. The SiK firmware exposes them through an
+ * AT command mode on the same serial port that carries the payload.
+ *
+ * Commands are queued and run in sessions from service(), which the I/O
+ * loop calls in place of the transmit path while it returns true:
+ *
+ *      DRAINING    waits until the kernel and the modem model hold no
+ *                  written bytes, the last payload is on the air
+ *      GUARD       guard_time of silence from the host
+ *      ESCAPE      "+++" written, waits for "OK"
+ *      COMMAND     each queued command in turn, its reply is the lines
+ *                  up to OK or ERROR, or up to a REPLY_GAP pause
+ *      LEAVING     "ATO", back to data mode
+ *
+ * A session costs about two guard times during which nothing is written,
+ * so link quality is polled every few seconds, not per frame. Frames
+ * already written reach the air before the escape. Bytes received from the
+ * air while the channel holds the port are kept for the caller in
+ * take_received: everything before the radio answers "OK" and after "ATO",
+ * and in command mode every frame between the start and end indicators,
+ * which never look like an AT reply. A session neither corrupts nor loses
+ * framed payload.
+ *
+ *      ATI     banner
+ *      ATI5    every S register, "S2:AIR_SPEED=64"
+ *      ATI7    link report, "L/R RSSI: 210/205  L/R noise: 35/40 pkts: 120
+ *              txe=0 rxe=2 stx=0 srx=0 ecc=0/0 temp=38 dco=0"
+ *      ATSn?   register n, ATSn=v sets it, AT&W saves the registers
+ *
+ * RSSI and noise are in the radio's units, about 1.9 per dB.
+ *
+ */
+
+#ifndef AT_COMMAND_INCLUDED_H
+#define AT_COMMAND_INCLUDED_H
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "rfd900_modem.h"
+
+
+namespace rfd900comm{
+
+    struct radioLinkQuality{
+        bool valid = false;
+        std::chrono::steady_clock::time_point when;
+        int local_rssi = 0;
+        int remote_rssi = 0;
+        int local_noise = 0;
+        int remote_noise = 0;
+        uint32_t packets = 0;
+        uint32_t tx_errors = 0;
+        uint32_t rx_errors = 0;
+        uint32_t serial_tx_overflows = 0;
+        uint32_t serial_rx_overflows = 0;
+        uint32_t ecc_corrected = 0;
+        uint32_t ecc_errors = 0;
+        int temperature = 0;
+
+        static double rssi_dbm(int rssi) { return rssi / 1.9 - 127.0; }
+
+        // signal above noise at the weaker end, dB
+        double fade_margin_db() const;
+    };
+
+    // parses an ATI7 report, returns false when the line is not one
+    bool parse_link_report(const std::string& line, radioLinkQuality* quality);
+
+
+    class atCommandChannel{
+
+        public:
+
+        static constexpr auto DEFAULT_GUARD_TIME = std::chrono::milliseconds(1000);
+        static constexpr auto RESPONSE_TIMEOUT = std::chrono::milliseconds(500);
+        static constexpr auto REPLY_GAP = std::chrono::milliseconds(30);
+        static constexpr size_t MAX_QUEUED_COMMANDS = 16;
+        static constexpr int MAX_REGISTERS = 32;
+
+        static constexpr int AIR_SPEED_REGISTER = 2;
+        static constexpr int ECC_REGISTER = 5;
+
+        // status 0 with the reply lines, -1 on ERROR or when the radio did not answer
+        using reply_function = std::function<void(int status, const std::string& reply)>;
+        using quality_function = std::function<void(const radioLinkQuality& quality)>;
+        using registers_function = std::function<void(const atCommandChannel& channel)>;
+
+        explicit atCommandChannel(rfd900Modem& modem, std::chrono::milliseconds guard_time = DEFAULT_GUARD_TIME);
+
+        // disable copy constructor
+        atCommandChannel(const atCommandChannel&) = delete;
+
+        // disable assignment
+        atCommandChannel& operator=(const atCommandChannel&) = delete;
+
+        // queues command for the next session, returns 0, or -1 when the queue is full
+        int queue_command(const std::string& command, reply_function done = nullptr);
+
+        // ATI7, the report goes to link_quality, link_stats and the quality function
+        int query_link_quality();
+
+        // ATI and ATI5, the banner and the values go to banner, register_value and the registers function
+        int query_registers();
+
+        // ATSn=v, with save AT&W as well, the new value takes effect after a reboot
+        int set_register(int reg, int value, bool save = false);
+
+        /**
+         * Runs the session while commands are queued. Call it from the I/O
+         * loop; while it returns true the channel owns the port, the caller
+         * must not write to it or read from it.
+         */
+        bool service();
+
+        bool active() const { return stage != stage_t::IDLE; }
+
+        // payload bytes the channel read while it held the port, returns the bytes copied
+        size_t take_received(uint8_t* buffer, size_t length);
+        size_t received_pending() const { return received.size(); }
+
+        void set_quality_function(quality_function f) { qualityDone = std::move(f); }
+        void set_registers_function(registers_function f) { registersDone = std::move(f); }
+
+        const radioLinkQuality& link_quality() const { return quality; }
+        const std::string& banner() const { return bannerText; }
+
+        // -1 until read
+        int register_value(int reg) const { return reg >= 0 && reg < MAX_REGISTERS ? registers[reg] : -1; }
+        const std::string& register_name(int reg) const { return registerNames[reg]; }
+
+        uint64_t sessions() const { return sessionCount; }
+        uint64_t failed_sessions() const { return failedCount; }
+
+
+        private:
+
+        using steady = std::chrono::steady_clock;
+
+        enum class stage_t{
+            IDLE,
+            DRAINING,
+            GUARD,
+            ESCAPE,
+            COMMAND,
+            LEAVING
+        };
+
+        struct command_t{
+            std::string text;
+            reply_function done;
+        };
+
+        rfd900Modem& radio;
+        std::chrono::milliseconds guardTime;
+
+        command_t commands[MAX_QUEUED_COMMANDS];
+        size_t commandHead;
+        size_t commandCount;
+
+        stage_t stage;
+        steady::time_point stageStart;
+        steady::time_point lastByte;
+        std::string raw;                        // bytes read, not yet sorted into payload and replies
+        std::string input;                      // AT reply bytes not yet consumed
+        std::string replyText;                  // lines of the running command's reply
+        int leaveStep;                          // LEAVING: 0 before the ATO echo, 1 in its line end, 2 payload
+        std::vector<uint8_t> received;          // payload held for the caller
+
+        radioLinkQuality quality;
+        quality_function qualityDone;
+        registers_function registersDone;
+        std::string bannerText;
+        int registers[MAX_REGISTERS];
+        std::string registerNames[MAX_REGISTERS];
+
+        uint64_t sessionCount;
+        uint64_t failedCount;
+
+        void read_port();
+        void sort_input(bool all_payload);
+        void write_port(const std::string& text);
+        void enter(stage_t next);
+        void send_next_command();
+        bool reply_complete(steady::time_point now, int* status, std::string* reply);
+        void finish_command(int status, const std::string& reply);
+        void fail_session();
+        void parse_registers(const std::string& reply);
+    };
+
+}
+
+
+#endif
@@ -0,0 +1,281 @@
+/**
+ * @brief atModemEmulator class function definitions.
+ *
+ */
+
+#include <ctype.h>                      // toupper, isdigit
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>                     // posix_openpt, grantpt, unlockpt, ptsname, atoi
+#include <string.h>                     // strerror
+#include <termios.h>
+#include <unistd.h>
+
+#include "at_modem_emulator.h"
+
+namespace rfd900comm{
+
+    // the SiK parameters, ATI5 lists them in this order
+    const char* const atModemEmulator::REGISTER_NAMES[NUM_REGISTERS] = {
+        "FORMAT", "SERIAL_SPEED", "AIR_SPEED", "NETID", "TXPOWER", "ECC", "MAVLINK", "OPPRESEND",
+        "MIN_FREQ", "MAX_FREQ", "NUM_CHANNELS", "DUTY_CYCLE", "LBT_RSSI", "MANCHESTER", "RTSCTS", "MAX_WINDOW"
+    };
+
+
+    atModemEmulator::atModemEmulator() : masterFd(-1), slaveFd(-1), plusCount(0)
+    {
+        running = false;
+        commandMode = false;
+        commandCount = 0;
+        errorCount = 0;
+        airBytes = 0;
+        for(std::atomic<int>& value : registers){
+            value = 0;
+        }
+        linkReport = "L/R RSSI: 210/205  L/R noise: 35/40 pkts: 0  txe=0 rxe=0 stx=0 srx=0 ecc=0/0 temp=38 dco=0";
+    }
+
+    atModemEmulator::~atModemEmulator()
+    {
+        stop();
+    }
+
+
+    int atModemEmulator::start(const atModemEmulatorConfig& config)
+    {
+        struct termios tio;
+
+        if(running){
+            fprintf(stderr, "error, %s, emulator already running\n", __func__);
+            return -1;
+        }
+
+        cfg = config;
+        commandMode = false;
+        commandCount = 0;
+        errorCount = 0;
+        airBytes = 0;
+        plusCount = 0;
+        line.clear();
+
+        int defaults[NUM_REGISTERS] = {25, config.baud_rate / 1000, config.air_speed_kbps, 25, 30, config.ecc ? 1 : 0,
+                    1, 0, 915000, 928000, 20, 100, 0, 0, 0, 131};
+        for(int i = 0; i < NUM_REGISTERS; ++i){
+            registers[i] = defaults[i];
+        }
+
+        masterFd = posix_openpt(O_RDWR | O_NOCTTY | O_NONBLOCK);
+        if(masterFd < 0){
+            fprintf(stderr, "error, %s, posix_openpt: %s\n", __func__, strerror(errno));
+            return -1;
+        }
+
+        if(grantpt(masterFd) != 0 || unlockpt(masterFd) != 0){
+            fprintf(stderr, "error, %s, grantpt/unlockpt: %s\n", __func__, strerror(errno));
+            close_port();
+            return -1;
+        }
+
+        slaveName = ptsname(masterFd);
+
+        slaveFd = open(slaveName.c_str(), O_RDWR | O_NOCTTY | O_NONBLOCK);
+        if(slaveFd < 0){
+            fprintf(stderr, "error, %s, open %s: %s\n", __func__, slaveName.c_str(), strerror(errno));
+            close_port();
+            return -1;
+        }
+
+        // raw until the program under test applies its own settings
+        if(tcgetattr(slaveFd, &tio) == 0){
+            cfmakeraw(&tio);
+            tcsetattr(slaveFd, TCSANOW, &tio);
+        }
+
+        lastByte = std::chrono::steady_clock::now();
+        running = true;
+        worker = std::thread(&atModemEmulator::run, this);
+        return 0;
+    }
+
+
+    void atModemEmulator::stop()
+    {
+        if(running){
+            running = false;
+            worker.join();
+        }
+        close_port();
+    }
+
+
+    void atModemEmulator::close_port()
+    {
+        if(slaveFd >= 0){
+            close(slaveFd);
+            slaveFd = -1;
+        }
+        if(masterFd >= 0){
+            close(masterFd);
+            masterFd = -1;
+        }
+    }
+
+
+    // the master reports the termios of the slave, so the speed the program set
+    bool atModemEmulator::rate_matches()
+    {
+        struct termios tio;
+        if(tcgetattr(masterFd, &tio) != 0){
+            return false;
+        }
+
+        speed_t speed;
+        switch(cfg.baud_rate){
+        case 9600:      speed = B9600;      break;
+        case 19200:     speed = B19200;     break;
+        case 38400:     speed = B38400;     break;
+        case 57600:     speed = B57600;     break;
+        case 115200:    speed = B115200;    break;
+        default:        return false;
+        }
+        return cfgetospeed(&tio) == speed;
+    }
+
+
+    void atModemEmulator::run()
+    {
+        uint8_t buffer[256];
+
+        while(running){
+            struct pollfd pfd;
+            pfd.fd = masterFd;
+            pfd.events = POLLIN;
+            pfd.revents = 0;
+            poll(&pfd, 1, 2);
+
+            if(pfd.revents & POLLIN){
+                ssize_t n = read(masterFd, buffer, sizeof(buffer));
+                if(n > 0 && cfg.radio && rate_matches()){
+                    receive(buffer, n);
+                }
+                else if(n > 0){
+                    plusCount = 0;                  // noise cancels an escape in progress
+                }
+                lastByte = std::chrono::steady_clock::now();
+            }
+
+            // the escape completes after the guard time with nothing more received
+            if(plusCount == 3 && std::chrono::steady_clock::now() - lastByte >= cfg.guard_time){
+                plusCount = 0;
+                commandMode = true;
+                line.clear();
+                reply("OK\r\n");
+            }
+        }
+    }
+
+
+    void atModemEmulator::receive(const uint8_t* data, size_t length)
+    {
+        for(size_t i = 0; i < length; ++i){
+            char c = static_cast<char>(data[i]);
+
+            if(!commandMode){
+                // the data goes on the air, an escape sequence does not
+                if(c == '+' && plusCount < 3){
+                    ++plusCount;
+                }
+                else{
+                    airBytes += plusCount + 1;
+                    plusCount = 0;
+                }
+                continue;
+            }
+
+            reply(std::string(1, c));                       // echo
+            if(c == '\r'){
+                run_command();
+                line.clear();
+            }
+            else if(c != '\n' && line.size() < 64){
+                line += static_cast<char>(toupper(static_cast<unsigned char>(c)));
+            }
+        }
+    }
+
+
+    void atModemEmulator::run_command()
+    {
+        ++commandCount;
+
+        if(line == "AT"){
+            reply("\r\nOK\r\n");
+        }
+        else if(line == "ATI"){
+            reply("\r\n" + cfg.banner + "\r\n");
+        }
+        else if(line == "ATI5"){
+            std::string text = "\r\n";
+            for(int i = 0; i < NUM_REGISTERS; ++i){
+                text += "S" + std::to_string(i) + ":" + REGISTER_NAMES[i] + "=" + std::to_string(registers[i]) + "\r\n";
+            }
+            reply(text);
+        }
+        else if(line == "ATI7"){
+            std::lock_guard<std::mutex> lock(reportMutex);
+            reply("\r\n" + linkReport + "\r\n");
+        }
+        else if(line == "AT&W"){
+            reply("\r\nOK\r\n");
+        }
+        else if(line == "ATO"){
+            reply("\r\n");
+            commandMode = false;
+        }
+        else if(line.compare(0, 3, "ATS") == 0 && line.size() > 3 && isdigit(static_cast<unsigned char>(line[3]))){
+            int reg = atoi(line.c_str() + 3);
+            size_t op = line.find_first_of("?=");
+            if(reg >= NUM_REGISTERS || op == std::string::npos){
+                ++errorCount;
+                reply("\r\nERROR\r\n");
+            }
+            else if(line[op] == '?'){
+                reply("\r\n" + std::to_string(registers[reg]) + "\r\n");
+            }
+            else{
+                registers[reg] = atoi(line.c_str() + op + 1);
+                reply("\r\nOK\r\n");
+            }
+        }
+        else if(!line.empty()){
+            ++errorCount;
+            reply("\r\nERROR\r\n");
+        }
+    }
+
+
+    void atModemEmulator::set_link_report(const std::string& report)
+    {
+        std::lock_guard<std::mutex> lock(reportMutex);
+        linkReport = report;
+    }
+
+
+    void atModemEmulator::inject(const std::string& bytes)
+    {
+        reply(bytes);
+    }
+
+
+    void atModemEmulator::reply(const std::string& text)
+    {
+        std::lock_guard<std::mutex> lock(writeMutex);
+        ssize_t n = write(masterFd, text.data(), text.size());
+        if(n < 0 && errno != EAGAIN){
+            fprintf(stderr, "error, %s, write: %s\n", __func__, strerror(errno));
+        }
+    }
+
+}
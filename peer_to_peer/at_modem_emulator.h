@@ -0,0 +1,128 @@
+/**
+ * @brief Declares atModemEmulator, a pseudo terminal that answers like an RFD900x at its AT prompt
+ *
+ * Stands in for a radio when testing port discovery. The program opens the
+ * slave side (port_name) as it would open /dev/ttyUSB0. The emulator reads
+ * the baud rate the program set on the slave and only understands it at
+ * baud_rate; at any other rate its input is noise and it stays silent, as a
+ * real radio's answers would be unreadable.
+ *
+ * Like the SiK firmware:
+ *      "+++" followed by guard_time of silence gives "OK" and command mode,
+ *      any byte within the guard time cancels it
+ *      in command mode every byte is echoed, and a line ending in CR runs:
+ *          AT    - OK
+ *          ATI   - the banner
+ *          ATI5  - the S registers, "S2:AIR_SPEED=64"
+ *          ATI7  - the link report set by set_link_report
+ *          ATSn? - register n, ATSn=v sets it, AT&W saves
+ *          ATO   - back to data mode
+ *          anything else - ERROR
+ *
+ * inject writes bytes to the program as if they came from the air, in data
+ * or command mode, to check that an AT session loses no payload. Bytes the
+ * program writes in data mode are counted as sent on the air.
+ *
+ * With radio false the port never answers, some other serial device that
+ * discovery must pass over.
+ *
+ */
+
+#ifndef AT_MODEM_EMULATOR_INCLUDED_H
+#define AT_MODEM_EMULATOR_INCLUDED_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+
+
+namespace rfd900comm{
+
+    struct atModemEmulatorConfig{
+        int baud_rate = 57600;
+        std::chrono::milliseconds guard_time{1000};
+        std::string banner = "RFD SiK 3.54 on RFD900x";
+        bool radio = true;
+        int air_speed_kbps = 64;                            // S2
+        bool ecc = false;                                   // S5
+    };
+
+
+    class atModemEmulator{
+
+        public:
+
+        atModemEmulator();
+        ~atModemEmulator();
+
+        // disable copy constructor
+        atModemEmulator(const atModemEmulator&) = delete;
+
+        // disable assignment
+        atModemEmulator& operator=(const atModemEmulator&) = delete;
+
+        int start(const atModemEmulatorConfig& config);
+        void stop();
+
+        // slave device path, pass to rfd900Modem::init or modemDiscoveryConfig::candidates
+        const char* port_name() const { return slaveName.c_str(); }
+
+        bool command_mode() const { return commandMode; }
+
+        // AT commands run, and those answered ERROR
+        uint64_t commands() const { return commandCount; }
+        uint64_t errors() const { return errorCount; }
+
+        // bytes written by the program in data mode, other than the "+++" escape
+        uint64_t air_bytes() const { return airBytes; }
+
+        // the ATI7 reply, "L/R RSSI: 210/205  L/R noise: 35/40 pkts: 120 ..."
+        void set_link_report(const std::string& report);
+
+        // bytes from the air to the program
+        void inject(const std::string& bytes);
+
+        int register_value(int reg) const { return registers[reg]; }
+
+
+        private:
+
+        atModemEmulatorConfig cfg;
+        int masterFd;
+        int slaveFd;                            // held open so the pty never hangs up
+        std::string slaveName;
+
+        std::thread worker;
+        std::atomic<bool> running;
+        std::atomic<bool> commandMode;
+        std::atomic<uint64_t> commandCount;
+        std::atomic<uint64_t> errorCount;
+        std::atomic<uint64_t> airBytes;
+
+        static constexpr int NUM_REGISTERS = 16;
+        static const char* const REGISTER_NAMES[NUM_REGISTERS];
+        std::atomic<int> registers[NUM_REGISTERS];
+
+        std::mutex writeMutex;                  // replies and injected bytes
+        std::mutex reportMutex;
+        std::string linkReport;
+
+        int plusCount;                          // consecutive '+' received in data mode
+        std::chrono::steady_clock::time_point lastByte;
+        std::string line;
+
+        void run();
+        bool rate_matches();
+        void receive(const uint8_t* data, size_t length);
+        void run_command();
+        void reply(const std::string& text);
+        void close_port();
+    };
+
+}
+
+
+#endif
@@ -0,0 +1,187 @@
+/**
+ * Purpose:
+ *  Measure the aggregate throughput of a bondedLink over several emulated
+ *  radios and its failover when one radio degrades.
+ *
+ *  Every radio pair is its own linkEmulator channel. The sender's bondedLink
+ *  writes artifacts while a radio has backlog room, the receiver's bondedLink
+ *  runs on its own thread and counts the messages it delivers in order. Each
+ *  scenario reports the delivered rate, the share of frames each radio
+ *  carried, the frames held out of order and the gaps skipped:
+ *
+ *      one radio
+ *      two radios of equal air rate, the rate should double
+ *      two radios at 2:1 air rate, frames should split 2:1
+ *      failover, two equal radios and the second starts losing chunks half
+ *      way through, its traffic should move to the first radio
+ *
+ * Optional Command line arguments
+ *  argv[1] - seconds per scenario
+ *  argv[2] - loss probability of the failing radio
+ *
+ */
+
+#include <atomic>
+#include <chrono>
+#include <cstdlib>                  // atoi, atof
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "bonded_link.h"
+#include "link_emulator.h"
+#include "rfd900_modem.h"
+#include "simulation_constants.h"
+#include "sim_artifact_message.h"
+
+
+using rfd900sim::SimConstants;
+using steady = std::chrono::steady_clock;
+
+constexpr long SERVICE_TIMEOUT = 1000L;         // units, microseconds
+
+struct radio_pair_t{
+    rfd900comm::linkEmulator emulator;
+    rfd900comm::rfd900Modem tx_radio;
+    rfd900comm::rfd900Modem rx_radio;
+};
+
+static std::atomic<bool> receiverRunning;
+static std::atomic<uint64_t> deliveredCount;
+
+
+static void receiver(rfd900sim::bondedLink* rx_bond)
+{
+    while(receiverRunning){
+        rx_bond->service(10 * SERVICE_TIMEOUT);
+    }
+}
+
+
+// rates, bytes/s, of each radio, fail_loss > 0 degrades the last radio half way through
+static int run_scenario(const char* name, const std::vector<uint32_t>& rates, double seconds, double fail_loss)
+{
+    std::vector<std::unique_ptr<radio_pair_t>> pairs;
+    rfd900sim::bondedLink tx_bond(SimConstants::AERIAL01, SimConstants::BASE_STATION, [](const std::string&){});
+    rfd900sim::bondedLink rx_bond(SimConstants::BASE_STATION, SimConstants::AERIAL01,
+                [](const std::string&){ ++deliveredCount; });
+
+    for(size_t i = 0; i < rates.size(); ++i){
+        rfd900comm::linkEmulatorConfig config;
+        config.air_bytes_per_sec = rates[i];
+        config.latency = std::chrono::milliseconds(20);
+        config.seed = i + 1;
+
+        pairs.emplace_back(new radio_pair_t);
+        radio_pair_t& pair = *pairs.back();
+        if(pair.emulator.start(config) != 0){
+            return -1;
+        }
+        if(pair.tx_radio.init(pair.emulator.port_name(0)) != 0 || pair.rx_radio.init(pair.emulator.port_name(1)) != 0){
+            fprintf(stderr, "error, %s radio init failure\n", __func__);
+            return -1;
+        }
+
+        tx_bond.add_link(&pair.tx_radio, rates[i]);
+        rx_bond.add_link(&pair.rx_radio, rates[i]);
+    }
+
+    deliveredCount = 0;
+    receiverRunning = true;
+    std::thread receiver_thread(receiver, &rx_bond);
+
+    const size_t SERIAL_ARTIFACT_BUFFER_LENGTH = sizeof(rfd900sim::artifact_message_t)
+                        + SimConstants::MESSAGE_900_START_INDICATOR_LENGTH
+                        + SimConstants::MESSAGE_900_END_INDICATOR_LENGTH;
+    std::vector<uint8_t> serial_check_buffer(SERIAL_ARTIFACT_BUFFER_LENGTH);
+
+    rfd900sim::artifact_message_t artmsg;
+    bool held = false;
+    uint64_t sent = 0;
+    uint64_t deliveredAtFailure = 0;
+    double secondsAtFailure = 0.0;
+    bool failed = false;
+    auto start = steady::now();
+    auto fail_at = start + std::chrono::duration_cast<steady::duration>(std::chrono::duration<double>(seconds / 2));
+    auto stop_at = start + std::chrono::duration_cast<steady::duration>(std::chrono::duration<double>(seconds));
+
+    while(steady::now() < stop_at){
+
+        if(fail_loss > 0.0 && !failed && steady::now() >= fail_at){
+            pairs.back()->emulator.set_loss_probability(fail_loss);
+            deliveredAtFailure = deliveredCount;
+            secondsAtFailure = std::chrono::duration<double>(steady::now() - start).count();
+            failed = true;
+        }
+
+        // an artifact with an indicator inside it could never be extracted, draw another
+        while(!held){
+            rfd900sim::simulate_artifact_message(&artmsg, SimConstants::BASE_STATION, SimConstants::AERIAL01);
+            rfd900sim::serialize_artifact_for_900MHz(&artmsg, serial_check_buffer.data(), SERIAL_ARTIFACT_BUFFER_LENGTH);
+            held = rfd900sim::frame_is_clean(serial_check_buffer.data(), SERIAL_ARTIFACT_BUFFER_LENGTH);
+        }
+
+        while(held && tx_bond.can_send(sizeof(artmsg))){
+            if(tx_bond.send(&artmsg, sizeof(artmsg)) < 0){
+                break;
+            }
+            held = false;
+            ++sent;
+        }
+
+        tx_bond.service(SERVICE_TIMEOUT);
+    }
+
+    double elapsed = std::chrono::duration<double>(steady::now() - start).count();
+    uint64_t delivered = deliveredCount;
+
+    receiverRunning = false;
+    receiver_thread.join();
+
+    uint64_t frames = 0;
+    for(size_t i = 0; i < tx_bond.link_count(); ++i){
+        frames += tx_bond.link_state(i).frames_sent;
+    }
+
+    fprintf(stdout, "%s\n", name);
+    fprintf(stdout, "  sent: %lu, delivered: %lu, %.1f msgs/s, %.0f payload bytes/s\n",
+                sent, delivered, delivered / elapsed, delivered * sizeof(artmsg) / elapsed);
+    if(failed){
+        fprintf(stdout, "  before failure: %.1f msgs/s, after: %.1f msgs/s\n", deliveredAtFailure / secondsAtFailure,
+                    (delivered - deliveredAtFailure) / (elapsed - secondsAtFailure));
+    }
+    for(size_t i = 0; i < tx_bond.link_count(); ++i){
+        rfd900sim::bondLinkState state = tx_bond.link_state(i);
+        fprintf(stdout, "  radio %lu: %5u B/s air, share %5.1f%%, goodput %6.0f B/s, srtt %5ld ms, loss %.2f, %s, failovers %lu\n",
+                    i, rates[i], frames ? 100.0 * state.frames_sent / frames : 0.0, state.goodput,
+                    (long)std::chrono::duration_cast<std::chrono::milliseconds>(state.srtt).count(), state.loss,
+                    state.healthy ? "healthy" : "degraded", state.failovers);
+    }
+    fprintf(stdout, "  held out of order: %lu, gaps skipped: %lu\n\n", rx_bond.held_out_of_order(), rx_bond.gaps_skipped());
+
+    return 0;
+}
+
+
+int main(int argc, char **argv)
+{
+    double seconds = 5.0;
+    double failLoss = 0.7;
+
+    if(argc > 1){
+        seconds = atof(argv[1]);
+    }
+    if(argc > 2){
+        failLoss = atof(argv[2]);
+    }
+
+    if(run_scenario("one radio, 8000 B/s", {8000}, seconds, 0.0) != 0
+            || run_scenario("two radios, 8000 + 8000 B/s", {8000, 8000}, seconds, 0.0) != 0
+            || run_scenario("two radios, 8000 + 4000 B/s", {8000, 4000}, seconds, 0.0) != 0
+            || run_scenario("failover, 8000 + 8000 B/s, radio 1 degrades half way", {8000, 8000}, 2 * seconds, failLoss) != 0){
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,535 @@
+/**
+ * @brief bondedLink class function definitions.
+ *
+ */
+
+#include <poll.h>
+#include <cstdio>                   // fprintf
+#include <cstring>                  // memcpy, memset
+
+#include "bonded_link.h"
+#include "simulation_constants.h"
+#include "sim_artifact_message.h"
+#include "time_sync.h"
+#include "virtual_clock.h"
+
+
+namespace rfd900sim
+{
+    constexpr size_t BOND_SERIAL_BUFFER_LENGTH = sizeof(bond_message_t) + 6;        // plus start and end indicators
+    constexpr double BOND_MIN_GOODPUT = 64.0;                                       // bytes/s, keeps the estimate usable
+    constexpr int BOND_CLEAN_ATTEMPTS = 16;
+
+
+    bondedLink::bondedLink(uint8_t my_id, uint8_t peer_id, delivery_function deliver, const bondConfig& config) :
+        myId(my_id), peerId(peer_id), deliver(std::move(deliver)), cfg(config),
+        nextBondSeq(0), resequenceStarted(false), expectedSeq(0), heldFrames(0),
+        heldCount(0), gapCount(0), delivered(0)
+    {
+        for(held_t& h : held){
+            h.filled = false;
+            h.message.reserve(BOND_PAYLOAD_LENGTH);
+        }
+    }
+
+
+    int bondedLink::add_link(rfd900comm::rfd900Modem* modem, uint32_t air_bytes_per_sec)
+    {
+        if(links.size() >= BOND_MAX_LINKS){
+            fprintf(stderr, "error, %s, a bonded link takes at most %lu radios\n", __func__, BOND_MAX_LINKS);
+            return -1;
+        }
+
+        steady::time_point now = rfd900comm::clock_now();
+
+        links.emplace_back();
+        link_t& link = links.back();
+        link.modem = modem;
+        link.id = static_cast<uint8_t>(links.size() - 1);
+        link.goodput = air_bytes_per_sec > BOND_MIN_GOODPUT ? air_bytes_per_sec : BOND_MIN_GOODPUT;
+        link.backlog = 0.0;
+        link.last_drain = now;
+        link.link_seq = 0;
+        link.frames_sent = 0;
+        link.bytes_sent = 0;
+        link.healthy = true;
+        link.failovers = 0;
+        link.srtt_us = 0.0;
+        link.loss = 0.0;
+        link.have_status = false;
+        link.unanswered = false;
+        link.last_probe = now;
+
+        reserve_rx_storage(link.rx_storage, link.extracted);
+        link.rx_pending = false;
+        link.rx_probe = false;
+        link.rx_started = false;
+        link.rx_link_id = 0;
+        link.rx_frames = 0;
+        link.rx_bytes = 0;
+        link.rx_highest_link_seq = 0;
+        link.rx_echo_stamp = 0;
+        link.rx_last_status = now;
+
+        return link.id;
+    }
+
+
+    uint32_t bondedLink::now_us()
+    {
+        return static_cast<uint32_t>(rfd900comm::timeSync::steady_now_us());
+    }
+
+
+    // the backlog model drains at the goodput estimate
+    void bondedLink::drain(link_t* link, steady::time_point now)
+    {
+        double elapsed = std::chrono::duration<double>(now - link->last_drain).count();
+        link->backlog -= elapsed * link->goodput;
+        if(link->backlog < 0.0){
+            link->backlog = 0.0;
+        }
+        link->last_drain = now;
+    }
+
+
+    bool bondedLink::usable(const link_t& link, bool any_healthy) const
+    {
+        return link.healthy || !any_healthy;
+    }
+
+
+    bool bondedLink::can_send(size_t msg_length)
+    {
+        steady::time_point now = rfd900comm::clock_now();
+        size_t framed = BOND_HEADER_LENGTH + msg_length + SimConstants::MESSAGE_900_START_INDICATOR_LENGTH
+                    + SimConstants::MESSAGE_900_END_INDICATOR_LENGTH;
+
+        bool any_healthy = false;
+        for(const link_t& link : links){
+            any_healthy = any_healthy || link.healthy;
+        }
+
+        for(link_t& link : links){
+            if(!usable(link, any_healthy)){
+                continue;
+            }
+            drain(&link, now);
+            if(link.backlog == 0.0 || link.backlog + framed <= cfg.max_backlog_bytes){
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+
+    int bondedLink::send(const void* msg, size_t msg_length)
+    {
+        if(msg_length > BOND_PAYLOAD_LENGTH){
+            fprintf(stderr, "error, %s, message of %lu bytes exceeds %lu\n", __func__, msg_length, BOND_PAYLOAD_LENGTH);
+            return -1;
+        }
+
+        steady::time_point now = rfd900comm::clock_now();
+        size_t framed = BOND_HEADER_LENGTH + msg_length + SimConstants::MESSAGE_900_START_INDICATOR_LENGTH
+                    + SimConstants::MESSAGE_900_END_INDICATOR_LENGTH;
+
+        bool any_healthy = false;
+        for(const link_t& link : links){
+            any_healthy = any_healthy || link.healthy;
+        }
+
+        // earliest expected finish among the radios with backlog room
+        link_t* best = nullptr;
+        double best_finish = 0.0;
+        for(link_t& link : links){
+            if(!usable(link, any_healthy)){
+                continue;
+            }
+
+            drain(&link, now);
+            if(link.backlog > 0.0 && link.backlog + framed > cfg.max_backlog_bytes){
+                continue;
+            }
+
+            double finish = (link.backlog + framed) / link.goodput;
+            if(best == nullptr || finish < best_finish){
+                best = &link;
+                best_finish = finish;
+            }
+        }
+
+        if(best == nullptr){
+            return -1;
+        }
+
+        if(write_frame(best, msg, msg_length, 0) != 0){
+            return -1;
+        }
+        ++nextBondSeq;
+        return best->id;
+    }
+
+
+    int bondedLink::write_frame(link_t* link, const void* msg, size_t msg_length, uint8_t flags)
+    {
+        bond_message_t bond;
+        uint8_t serial_buffer[BOND_SERIAL_BUFFER_LENGTH];
+        size_t length = BOND_HEADER_LENGTH + msg_length;
+        size_t framed = length + SimConstants::MESSAGE_900_START_INDICATOR_LENGTH + SimConstants::MESSAGE_900_END_INDICATOR_LENGTH;
+
+        memset(&bond, 0, BOND_HEADER_LENGTH);
+        bond.dest_id = peerId;
+        bond.src_id = myId;
+        bond.msg_type = SimConstants::BONDED;
+        bond.link_id = link->id;
+        bond.bond_seq = nextBondSeq;
+        bond.link_seq = link->link_seq;
+        bond.tx_stamp_us = now_us();
+        bond.flags = flags;
+        bond.payload_length = static_cast<uint8_t>(msg_length);
+        if(msg_length > 0){
+            memcpy(bond.payload, msg, msg_length);      // probes have no payload, and msg is nullptr
+        }
+
+        // a stamp a few microseconds late keeps the indicators out of the header
+        for(int attempt = 0; attempt < BOND_CLEAN_ATTEMPTS; ++attempt){
+            frame_for_900MHz(&bond, length, serial_buffer, framed);
+            if(frame_is_clean(serial_buffer, framed)){
+                break;
+            }
+            ++bond.tx_stamp_us;
+        }
+
+        if(link->modem->send_message((const char*)serial_buffer, framed) < 0){
+            fprintf(stderr, "error, %s, write to radio %hhu failed\n", __func__, link->id);
+            return -1;
+        }
+
+        steady::time_point now = rfd900comm::clock_now();
+        drain(link, now);
+        link->backlog += framed;
+        link->bytes_sent += framed;
+        ++link->frames_sent;
+        ++link->link_seq;
+        if(!link->unanswered){
+            link->unanswered = true;
+            link->first_unanswered = now;
+        }
+        return 0;
+    }
+
+
+    void bondedLink::send_status(link_t* link, steady::time_point now)
+    {
+        bond_status_message_t status;
+        uint8_t serial_buffer[sizeof(bond_status_message_t) + 6];
+        size_t framed = sizeof(bond_status_message_t) + SimConstants::MESSAGE_900_START_INDICATOR_LENGTH
+                    + SimConstants::MESSAGE_900_END_INDICATOR_LENGTH;
+
+        memset(&status, 0, sizeof(status));
+        status.dest_id = peerId;
+        status.src_id = myId;
+        status.msg_type = SimConstants::BOND_STATUS;
+        status.link_id = link->rx_link_id;
+        status.highest_link_seq = link->rx_highest_link_seq;
+        status.frames_received = link->rx_frames;
+        status.bytes_received = link->rx_bytes;
+        status.echo_stamp_us = link->rx_echo_stamp;
+        status.hold_us = static_cast<uint32_t>(std::chrono::duration_cast<std::chrono::microseconds>(now - link->rx_echo_arrival).count());
+
+        for(int attempt = 0; attempt < BOND_CLEAN_ATTEMPTS; ++attempt){
+            frame_for_900MHz(&status, sizeof(status), serial_buffer, framed);
+            if(frame_is_clean(serial_buffer, framed)){
+                break;
+            }
+            ++status.hold_us;
+        }
+
+        if(link->modem->send_message((const char*)serial_buffer, framed) < 0){
+            fprintf(stderr, "error, %s, write to radio %hhu failed\n", __func__, link->id);
+        }
+
+        drain(link, now);
+        link->backlog += framed;
+        link->rx_pending = false;
+        link->rx_probe = false;
+        link->rx_last_status = now;
+    }
+
+
+    size_t bondedLink::service(long timeout_us)
+    {
+        size_t delivered_before = delivered;
+        struct pollfd fds[BOND_MAX_LINKS];
+
+        for(size_t i = 0; i < links.size(); ++i){
+            fds[i].fd = links[i].modem->get_fd();
+            fds[i].events = POLLIN;
+            fds[i].revents = 0;
+        }
+
+        int ready = poll(fds, links.size(), static_cast<int>((timeout_us + 999) / 1000));
+        steady::time_point now = rfd900comm::clock_now();
+
+        if(ready > 0){
+            for(size_t i = 0; i < links.size(); ++i){
+                if(fds[i].revents & POLLIN){
+                    receive(&links[i], now);
+                }
+            }
+        }
+
+        for(link_t& link : links){
+            if(link.rx_pending && (link.rx_probe || now - link.rx_last_status >= cfg.status_interval)){
+                send_status(&link, now);
+            }
+        }
+
+        skip_expired(now);
+
+        for(link_t& link : links){
+            update_health(&link, now);
+            if(!link.healthy && now - link.last_probe >= cfg.probe_interval){
+                link.last_probe = now;
+                write_frame(&link, nullptr, 0, BOND_FLAG_PROBE);
+            }
+        }
+
+        return delivered - delivered_before;
+    }
+
+
+    void bondedLink::receive(link_t* link, steady::time_point now)
+    {
+        uint8_t serial_rx_buffer[256];
+        ssize_t bytesRead;
+
+        while((bytesRead = link->modem->read_serial(serial_rx_buffer, sizeof(serial_rx_buffer), 0L)) > 0){
+            append_rx_data(link->rx_storage, serial_rx_buffer, bytesRead);
+
+            while(extract_rx_message(link->rx_storage, link->extracted)){
+                if(link->extracted.length() < 3){
+                    continue;
+                }
+
+                switch(link->extracted[2]){
+                    case SimConstants::BONDED:
+                        process_bonded(link, link->extracted, now);
+                        break;
+                    case SimConstants::BOND_STATUS:
+                        process_status(link, link->extracted, now);
+                        break;
+                    default:
+                        ++delivered;
+                        deliver(link->extracted);
+                        break;
+                }
+            }
+        }
+    }
+
+
+    void bondedLink::process_bonded(link_t* link, const std::string& frame, steady::time_point now)
+    {
+        bond_message_t bond;
+        if(frame.length() < BOND_HEADER_LENGTH || frame.length() > sizeof(bond_message_t)){
+            return;
+        }
+
+        memcpy(&bond, frame.data(), frame.length());
+        if(bond.dest_id != myId || frame.length() != BOND_HEADER_LENGTH + bond.payload_length){
+            return;
+        }
+
+        if(!link->rx_started || static_cast<int16_t>(bond.link_seq - link->rx_highest_link_seq) > 0){
+            link->rx_highest_link_seq = bond.link_seq;
+            link->rx_started = true;
+        }
+        ++link->rx_frames;
+        link->rx_bytes += frame.length() + SimConstants::MESSAGE_900_START_INDICATOR_LENGTH
+                    + SimConstants::MESSAGE_900_END_INDICATOR_LENGTH;
+        link->rx_link_id = bond.link_id;
+        link->rx_echo_stamp = bond.tx_stamp_us;
+        link->rx_echo_arrival = now;
+        link->rx_pending = true;
+
+        if(bond.flags & BOND_FLAG_PROBE){
+            link->rx_probe = true;
+            return;
+        }
+
+        hold(bond.bond_seq, bond.payload, bond.payload_length, now);
+    }
+
+
+    void bondedLink::process_status(link_t* link, const std::string& frame, steady::time_point now)
+    {
+        bond_status_message_t status;
+        if(frame.length() != sizeof(bond_status_message_t)){
+            return;
+        }
+
+        memcpy(&status, frame.data(), sizeof(status));
+        if(status.dest_id != myId){
+            return;
+        }
+
+        int32_t rtt_us = static_cast<int32_t>(now_us() - status.echo_stamp_us - status.hold_us);
+        if(rtt_us >= 0){
+            link->srtt_us = link->srtt_us == 0.0 ? rtt_us : 0.875 * link->srtt_us + 0.125 * rtt_us;
+        }
+
+        if(link->have_status){
+            uint16_t sent = static_cast<uint16_t>(status.highest_link_seq - link->status_link_seq);
+            uint16_t received = static_cast<uint16_t>(status.frames_received - link->status_frames);
+            if(sent > 0){
+                double sample = received >= sent ? 0.0 : 1.0 - static_cast<double>(received) / sent;
+                link->loss = 0.75 * link->loss + 0.25 * sample;
+            }
+
+            // delivered bytes only measure capacity while the radio was offered at least its estimate
+            double elapsed = std::chrono::duration<double>(now - link->status_time).count();
+            if(elapsed > 0.0){
+                double rate = static_cast<uint32_t>(status.bytes_received - link->status_bytes) / elapsed;
+                double offered = (link->bytes_sent - link->status_bytes_sent) / elapsed;
+                if(offered >= 0.9 * link->goodput){
+                    link->goodput = 0.75 * link->goodput + 0.25 * rate;
+                }
+                else if(rate > link->goodput){
+                    link->goodput = rate;
+                }
+                if(link->goodput < BOND_MIN_GOODPUT){
+                    link->goodput = BOND_MIN_GOODPUT;
+                }
+            }
+        }
+
+        link->have_status = true;
+        link->status_link_seq = status.highest_link_seq;
+        link->status_frames = status.frames_received;
+        link->status_bytes = status.bytes_received;
+        link->status_bytes_sent = link->bytes_sent;
+        link->status_time = now;
+        link->unanswered = false;
+    }
+
+
+    void bondedLink::update_health(link_t* link, steady::time_point now)
+    {
+        double degraded_rtt_us = std::chrono::duration_cast<std::chrono::microseconds>(cfg.degraded_rtt).count();
+        bool silent = link->unanswered && now - link->first_unanswered > cfg.silence_timeout;
+
+        if(link->healthy){
+            if(silent || link->srtt_us > degraded_rtt_us || link->loss > cfg.degraded_loss){
+                link->healthy = false;
+                link->last_probe = now;
+                ++link->failovers;
+            }
+        }
+        else if(!silent && link->have_status && link->srtt_us < degraded_rtt_us / 2 && link->loss < cfg.degraded_loss / 2){
+            link->healthy = true;
+        }
+    }
+
+
+    void bondedLink::hold(uint16_t bond_seq, const uint8_t* payload, size_t length, steady::time_point now)
+    {
+        if(!resequenceStarted){
+            expectedSeq = bond_seq;
+            resequenceStarted = true;
+        }
+
+        if(static_cast<int16_t>(bond_seq - expectedSeq) < 0){
+            return;                                 // its gap was already skipped, or a duplicate
+        }
+
+        // too far ahead for the window, give up on the oldest missing frames
+        while(static_cast<int16_t>(bond_seq - expectedSeq) >= static_cast<int16_t>(BOND_RESEQUENCE_WINDOW)){
+            held_t& h = held[expectedSeq % BOND_RESEQUENCE_WINDOW];
+            if(h.filled && h.bond_seq == expectedSeq){
+                h.filled = false;
+                --heldFrames;
+                ++delivered;
+                deliver(h.message);
+            }
+            else{
+                ++gapCount;
+            }
+            ++expectedSeq;
+        }
+
+        held_t& slot = held[bond_seq % BOND_RESEQUENCE_WINDOW];
+        if(slot.filled){
+            return;                                 // duplicate
+        }
+
+        slot.filled = true;
+        slot.bond_seq = bond_seq;
+        slot.arrival = now;
+        slot.message.assign((const char*)payload, length);
+        ++heldFrames;
+        if(bond_seq != expectedSeq){
+            ++heldCount;
+        }
+
+        deliver_in_order();
+    }
+
+
+    void bondedLink::deliver_in_order()
+    {
+        while(heldFrames > 0){
+            held_t& h = held[expectedSeq % BOND_RESEQUENCE_WINDOW];
+            if(!h.filled || h.bond_seq != expectedSeq){
+                return;
+            }
+
+            h.filled = false;
+            --heldFrames;
+            ++expectedSeq;
+            ++delivered;
+            deliver(h.message);
+        }
+    }
+
+
+    // a frame held longer than resequence_timeout ends the wait for the gap ahead of it
+    void bondedLink::skip_expired(steady::time_point now)
+    {
+        while(heldFrames > 0){
+            const held_t* next = nullptr;
+            for(const held_t& h : held){
+                if(h.filled && (next == nullptr
+                            || static_cast<int16_t>(h.bond_seq - expectedSeq) < static_cast<int16_t>(next->bond_seq - expectedSeq))){
+                    next = &h;
+                }
+            }
+
+            if(now - next->arrival < cfg.resequence_timeout){
+                return;
+            }
+
+            gapCount += static_cast<uint16_t>(next->bond_seq - expectedSeq);
+            expectedSeq = next->bond_seq;
+            deliver_in_order();
+        }
+    }
+
+
+    bondLinkState bondedLink::link_state(size_t link) const
+    {
+        const link_t& l = links[link];
+        bondLinkState state;
+        state.healthy = l.healthy;
+        state.goodput = l.goodput;
+        state.srtt = std::chrono::microseconds(static_cast<int64_t>(l.srtt_us));
+        state.loss = l.loss;
+        state.frames_sent = l.frames_sent;
+        state.bytes_sent = l.bytes_sent;
+        state.failovers = l.failovers;
+        return state;
+    }
+
+}
@@ -0,0 +1,234 @@
+/**
+ * @brief Declares bondedLink, one logical link striped over several radios
+ *
+ * A vehicle with two radios opens an rfd900Modem for each and adds both to
+ * a bondedLink. Messages sent on the bonded link are wrapped in a BONDED
+ * frame carrying a bond sequence number, a per radio sequence number and the
+ * sender's transmit stamp, and written to one of the radios:
+ *
+ *      each radio keeps a model of the bytes it has not yet put on the air,
+ *      drained at its goodput estimate
+ *      a message goes to the healthy radio expected to finish it first,
+ *      (backlog + length) / goodput, so at saturation traffic splits in
+ *      proportion to the goodputs
+ *
+ * The receiving bondedLink resequences BONDED frames by bond sequence number
+ * and delivers the messages in order. A gap is held for resequence_timeout,
+ * then skipped: bonding does not retransmit, message900 recovers the lost
+ * message end to end. Frames of other types are delivered as they arrive.
+ *
+ * Every status_interval the receiver answers each radio that carried frames
+ * with a BOND_STATUS on the same radio: the frames and bytes received, the
+ * highest per radio sequence number and the newest transmit stamp with the
+ * time it was held. The sender derives per radio
+ *      goodput  - delivered bytes per second, updated while the radio was
+ *                 offered at least its estimate
+ *      loss     - received frames against the per radio sequence numbers
+ *      RTT      - now - echoed stamp - hold time
+ *
+ * Failover: a radio whose smoothed RTT exceeds degraded_rtt, whose loss
+ * exceeds degraded_loss, or which sent frames without a status for
+ * silence_timeout is marked degraded and gets no further messages. Every
+ * probe_interval it carries one empty probe frame, the receiver answers a
+ * probe at once. The radio is healthy again when its RTT and loss fall under
+ * half the limits. With every radio degraded messages use all of them.
+ *
+ * Both ends run a bondedLink over the same set of radios and call service()
+ * regularly.
+ *
+ */
+
+#ifndef BONDED_LINK_INCLUDED_H
+#define BONDED_LINK_INCLUDED_H
+
+#include <chrono>
+#include <cstddef>                  // offsetof
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "rfd900_modem.h"
+
+
+namespace rfd900sim
+{
+    constexpr size_t BOND_PAYLOAD_LENGTH = 240;
+    constexpr size_t BOND_MAX_LINKS = 4;
+    constexpr size_t BOND_RESEQUENCE_WINDOW = 64;                   // bond sequence numbers held for reordering
+
+    constexpr uint8_t BOND_FLAG_PROBE = 0x01;                       // no payload, answered with a status at once
+
+
+    // only the header and payload_length bytes of payload are transmitted
+    struct bond_message_t{
+        uint8_t dest_id;
+        uint8_t src_id;
+        uint8_t msg_type;
+        uint8_t link_id;
+        uint16_t bond_seq;                  // order across every radio
+        uint16_t link_seq;                  // order on this radio, for its loss
+        uint32_t tx_stamp_us;               // sender steady clock, echoed by the status
+        uint8_t flags;
+        uint8_t payload_length;
+        uint8_t payload[BOND_PAYLOAD_LENGTH];       // an unframed message
+    };
+
+    constexpr size_t BOND_HEADER_LENGTH = offsetof(bond_message_t, payload);
+
+
+    struct bond_status_message_t{
+        uint8_t dest_id;
+        uint8_t src_id;
+        uint8_t msg_type;
+        uint8_t link_id;
+        uint16_t highest_link_seq;
+        uint16_t frames_received;           // counts wrap
+        uint32_t bytes_received;
+        uint32_t echo_stamp_us;             // tx_stamp_us of the newest frame received
+        uint32_t hold_us;                   // time since that frame arrived
+    };
+
+
+    struct bondConfig{
+        std::chrono::milliseconds status_interval{100};
+        std::chrono::milliseconds resequence_timeout{200};
+        std::chrono::milliseconds degraded_rtt{1000};
+        double degraded_loss = 0.2;
+        std::chrono::milliseconds silence_timeout{1000};
+        std::chrono::milliseconds probe_interval{250};
+        size_t max_backlog_bytes = 512;     // per radio, modeled bytes not yet on the air
+    };
+
+
+    struct bondLinkState{
+        bool healthy;
+        double goodput;                     // bytes/s
+        std::chrono::microseconds srtt;
+        double loss;
+        uint64_t frames_sent;
+        uint64_t bytes_sent;
+        uint64_t failovers;                 // times the radio was marked degraded
+    };
+
+
+    class bondedLink{
+
+        public:
+
+        // message is an unframed message, as extract_rx_message returns it
+        using delivery_function = std::function<void(const std::string& message)>;
+
+        bondedLink(uint8_t my_id, uint8_t peer_id, delivery_function deliver, const bondConfig& config = bondConfig());
+
+        // disable copy constructor
+        bondedLink(const bondedLink&) = delete;
+
+        // disable assignment
+        bondedLink& operator=(const bondedLink&) = delete;
+
+        // air_bytes_per_sec is the starting goodput estimate, returns the link index or -1
+        int add_link(rfd900comm::rfd900Modem* modem, uint32_t air_bytes_per_sec);
+
+        // true when a radio has backlog room for a message of msg_length bytes
+        bool can_send(size_t msg_length);
+
+        // msg is an unframed message struct, returns the link index used or -1
+        int send(const void* msg, size_t msg_length);
+
+        // reads every radio for up to timeout_us, delivers messages, sends status and probes,
+        // updates link health, returns the number of messages delivered
+        size_t service(long timeout_us);
+
+        size_t link_count() const { return links.size(); }
+        bondLinkState link_state(size_t link) const;
+
+        uint64_t held_out_of_order() const { return heldCount; }
+        uint64_t gaps_skipped() const { return gapCount; }
+
+
+        private:
+
+        using steady = std::chrono::steady_clock;
+
+        struct link_t{
+            rfd900comm::rfd900Modem* modem;
+            uint8_t id;
+
+            // sender
+            double goodput;
+            double backlog;
+            steady::time_point last_drain;
+            uint16_t link_seq;
+            uint64_t frames_sent;
+            uint64_t bytes_sent;
+            bool healthy;
+            uint64_t failovers;
+            double srtt_us;
+            double loss;
+            bool have_status;
+            uint16_t status_link_seq;
+            uint16_t status_frames;
+            uint32_t status_bytes;
+            uint64_t status_bytes_sent;         // bytes_sent when the previous status arrived
+            steady::time_point status_time;
+            steady::time_point first_unanswered;   // first frame sent after the newest status
+            bool unanswered;
+            steady::time_point last_probe;
+
+            // receiver
+            std::string rx_storage;
+            std::string extracted;
+            bool rx_pending;                    // frames received since the last status
+            bool rx_probe;
+            bool rx_started;
+            uint8_t rx_link_id;                 // the sender's index for this radio
+            uint16_t rx_highest_link_seq;
+            uint16_t rx_frames;
+            uint32_t rx_bytes;
+            uint32_t rx_echo_stamp;
+            steady::time_point rx_echo_arrival;
+            steady::time_point rx_last_status;
+        };
+
+        struct held_t{
+            bool filled;
+            uint16_t bond_seq;
+            steady::time_point arrival;
+            std::string message;
+        };
+
+        uint8_t myId;
+        uint8_t peerId;
+        delivery_function deliver;
+        bondConfig cfg;
+
+        std::vector<link_t> links;
+        uint16_t nextBondSeq;
+
+        held_t held[BOND_RESEQUENCE_WINDOW];
+        bool resequenceStarted;
+        uint16_t expectedSeq;
+        size_t heldFrames;
+        uint64_t heldCount;
+        uint64_t gapCount;
+        size_t delivered;
+
+        static uint32_t now_us();
+        void drain(link_t* link, steady::time_point now);
+        bool usable(const link_t& link, bool any_healthy) const;
+        int write_frame(link_t* link, const void* msg, size_t msg_length, uint8_t flags);
+        void send_status(link_t* link, steady::time_point now);
+        void receive(link_t* link, steady::time_point now);
+        void process_bonded(link_t* link, const std::string& frame, steady::time_point now);
+        void process_status(link_t* link, const std::string& frame, steady::time_point now);
+        void hold(uint16_t bond_seq, const uint8_t* payload, size_t length, steady::time_point now);
+        void deliver_in_order();
+        void skip_expired(steady::time_point now);
+        void update_health(link_t* link, steady::time_point now);
+    };
+
+}
+
+
+#endif
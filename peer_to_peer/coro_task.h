@@ -0,0 +1,187 @@
+/**
+ * @brief Declares the task<T> coroutine return type used by the async radio API
+ *
+ * A task is lazily started: the coroutine body does not run until the task is
+ * co_awaited (or handed to eventLoop::spawn). When the body finishes, control
+ * transfers directly back to the awaiting coroutine (symmetric transfer), so
+ * long chains of awaits do not grow the stack.
+ *
+ * The library does not use exceptions. An exception escaping a task body
+ * terminates the program.
+ *
+ */
+
+#ifndef CORO_TASK_INCLUDED_H
+#define CORO_TASK_INCLUDED_H
+
+#include <coroutine>
+#include <exception>            // std::terminate
+#include <optional>
+#include <utility>              // std::move, std::exchange
+
+
+namespace rfd900comm{
+
+    namespace detail{
+
+        // resumes whoever is awaiting the finished task, if anyone
+        struct final_awaiter{
+            bool await_ready() noexcept { return false; }
+
+            template<typename Promise>
+            std::coroutine_handle<> await_suspend(std::coroutine_handle<Promise> h) noexcept
+            {
+                std::coroutine_handle<> continuation = h.promise().continuation;
+                if(continuation){
+                    return continuation;
+                }
+                return std::noop_coroutine();
+            }
+
+            void await_resume() noexcept {}
+        };
+
+        struct promise_base{
+            std::coroutine_handle<> continuation;
+
+            std::suspend_always initial_suspend() noexcept { return {}; }
+            final_awaiter final_suspend() noexcept { return {}; }
+            void unhandled_exception() noexcept { std::terminate(); }
+        };
+    }
+
+
+    template<typename T>
+    class task{
+        public:
+
+        struct promise_type : detail::promise_base{
+            std::optional<T> value;
+
+            task get_return_object() { return task(std::coroutine_handle<promise_type>::from_promise(*this)); }
+            void return_value(T v) { value = std::move(v); }
+        };
+
+        task() : coro(nullptr) {}
+        task(task&& other) noexcept : coro(std::exchange(other.coro, nullptr)) {}
+        task& operator=(task&& other) noexcept
+        {
+            if(this != &other){
+                destroy();
+                coro = std::exchange(other.coro, nullptr);
+            }
+            return *this;
+        }
+
+        task(const task&) = delete;
+        task& operator=(const task&) = delete;
+
+        ~task() { destroy(); }
+
+        bool done() const { return !coro || coro.done(); }
+
+        auto operator co_await() noexcept
+        {
+            struct awaiter{
+                std::coroutine_handle<promise_type> coro;
+
+                bool await_ready() noexcept { return !coro || coro.done(); }
+
+                std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiting) noexcept
+                {
+                    coro.promise().continuation = awaiting;
+                    return coro;
+                }
+
+                T await_resume() { return std::move(*coro.promise().value); }
+            };
+            return awaiter{coro};
+        }
+
+        // used by eventLoop to start and reap detached tasks
+        std::coroutine_handle<> handle() const { return coro; }
+
+
+        private:
+
+        explicit task(std::coroutine_handle<promise_type> h) : coro(h) {}
+
+        void destroy()
+        {
+            if(coro){
+                coro.destroy();
+                coro = nullptr;
+            }
+        }
+
+        std::coroutine_handle<promise_type> coro;
+    };
+
+
+    template<>
+    class task<void>{
+        public:
+
+        struct promise_type : detail::promise_base{
+            task get_return_object() { return task(std::coroutine_handle<promise_type>::from_promise(*this)); }
+            void return_void() noexcept {}
+        };
+
+        task() : coro(nullptr) {}
+        task(task&& other) noexcept : coro(std::exchange(other.coro, nullptr)) {}
+        task& operator=(task&& other) noexcept
+        {
+            if(this != &other){
+                destroy();
+                coro = std::exchange(other.coro, nullptr);
+            }
+            return *this;
+        }
+
+        task(const task&) = delete;
+        task& operator=(const task&) = delete;
+
+        ~task() { destroy(); }
+
+        bool done() const { return !coro || coro.done(); }
+
+        auto operator co_await() noexcept
+        {
+            struct awaiter{
+                std::coroutine_handle<promise_type> coro;
+
+                bool await_ready() noexcept { return !coro || coro.done(); }
+
+                std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiting) noexcept
+                {
+                    coro.promise().continuation = awaiting;
+                    return coro;
+                }
+
+                void await_resume() noexcept {}
+            };
+            return awaiter{coro};
+        }
+
+        std::coroutine_handle<> handle() const { return coro; }
+
+
+        private:
+
+        explicit task(std::coroutine_handle<promise_type> h) : coro(h) {}
+
+        void destroy()
+        {
+            if(coro){
+                coro.destroy();
+                coro = nullptr;
+            }
+        }
+
+        std::coroutine_handle<promise_type> coro;
+    };
+
+}
+
+
+#endif
@@ -0,0 +1,499 @@
+/**
+ * Purpose:
+ *  Measure the frame handoff between a client process and the radio daemon
+ *  and check the daemon's arbitration between clients.
+ *
+ *  Handoff: two processes bounce a 64 byte frame back and forth and the
+ *  program reports the one way time, half the round trip, over
+ *
+ *      shm eventfd - the shmRing and eventfd wakeups the daemon uses
+ *      shm spin    - the same rings with the receiver spinning, the floor
+ *      unix socket - a SOCK_SEQPACKET socketpair, one write and read per frame
+ *
+ *  Arbitration: a radioDaemon owns one end of a linkEmulator. Three client
+ *  processes connect to it
+ *
+ *      planner    - CONTROL, a frame every 50 ms, echoed back by the far end
+ *      telemetry  - NORMAL, a burst as fast as its TX ring takes it
+ *      perception - BULK, a burst as fast as its TX ring takes it
+ *
+ *  and the far end reports per client the frames received and their latency
+ *  from the client's write into the ring to the far end. A fourth
+ *  connection never sends its hello; the longest daemon service call shows
+ *  that it holds up no one while the daemon waits for it.
+ *
+ * Optional Command line arguments
+ *  argv[1] - number of handoff round trips
+ *  argv[2] - frames in each burst
+ *
+ */
+
+#include <errno.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>                  // atoi
+#include <cstring>                  // memcpy, memset, strncpy
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "link_emulator.h"
+#include "radio_client.h"
+#include "radio_daemon.h"
+#include "rfd900_modem.h"
+#include "shm_ring.h"
+#include "simulation_constants.h"
+#include "sim_artifact_message.h"
+
+
+using rfd900sim::SimConstants;
+using steady = std::chrono::steady_clock;
+
+constexpr size_t HANDOFF_FRAME_LENGTH = 64;
+constexpr const char* BENCH_SOCKET = "/tmp/rfd900d_bench.sock";
+constexpr size_t NUM_CLIENTS = 3;
+constexpr int PLANNER_FRAMES = 40;
+constexpr size_t SERIAL_RX_BUFFER_LENGTH = 256;
+
+enum class handoffMode{
+    SHM_EVENTFD,
+    SHM_SPIN,
+    UNIX_SOCKET
+};
+
+struct pingPong_t{
+    rfd900comm::shmRing to_echo;
+    rfd900comm::shmRing to_ping;
+};
+
+struct bench_frame_t{
+    uint8_t dest_id;
+    uint8_t src_id;
+    uint8_t msg_type;
+    uint8_t client;
+    uint32_t seq;
+    int64_t stamp_ns;                   // steady clock, shared by every process on the host
+    uint8_t pad[48];
+};
+
+constexpr size_t SERIAL_BENCH_FRAME_LENGTH = sizeof(bench_frame_t) + 6;     // plus start and end indicators
+
+// written by the client processes, read by the parent after they exit
+struct client_results_t{
+    int frames_sent;
+    int echoes;
+    double echo_rtt_sum_ms;
+};
+
+struct client_spec_t{
+    const char* name;
+    rfd900comm::txPriority priority;
+    int frames;
+};
+
+
+static int64_t now_ns()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(steady::now().time_since_epoch()).count();
+}
+
+
+static void ring_send(rfd900comm::shmRing* ring, int event_fd, const uint8_t* frame, bool notify)
+{
+    rfd900comm::shmSlot* slot;
+    while((slot = ring->reserve()) == nullptr){
+    }
+
+    memcpy(slot->data, frame, HANDOFF_FRAME_LENGTH);
+    slot->length = HANDOFF_FRAME_LENGTH;
+    if(ring->commit() && notify){
+        uint64_t one = 1;
+        ssize_t w = write(event_fd, &one, sizeof(one));
+        (void)w;
+    }
+}
+
+
+// check, clear the eventfd, check again, then sleep
+static void ring_receive(rfd900comm::shmRing* ring, int event_fd, uint8_t* frame, bool sleep)
+{
+    const rfd900comm::shmSlot* slot;
+    while((slot = ring->peek()) == nullptr){
+        if(!sleep){
+            continue;
+        }
+
+        uint64_t count;
+        ssize_t r = read(event_fd, &count, sizeof(count));
+        (void)r;
+        if((slot = ring->peek()) != nullptr){
+            break;
+        }
+
+        struct pollfd pfd = {event_fd, POLLIN, 0};
+        poll(&pfd, 1, -1);
+    }
+
+    memcpy(frame, slot->data, slot->length);
+    ring->release();
+}
+
+
+static int run_handoff(handoffMode mode, int roundTrips)
+{
+    // a spinning receiver only measures anything with a core of its own
+    if(mode == handoffMode::SHM_SPIN && sysconf(_SC_NPROCESSORS_ONLN) < 2){
+        fprintf(stdout, "%12s    skipped, one CPU\n", "shm spin");
+        return 0;
+    }
+
+    void* addr = mmap(nullptr, sizeof(pingPong_t), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if(addr == MAP_FAILED){
+        fprintf(stderr, "error, %s, mmap: %s\n", __func__, strerror(errno));
+        return -1;
+    }
+    pingPong_t* rings = static_cast<pingPong_t*>(addr);
+    rings->to_echo.reset();
+    rings->to_ping.reset();
+
+    int echo_event = eventfd(0, EFD_NONBLOCK);
+    int ping_event = eventfd(0, EFD_NONBLOCK);
+    int sockets[2];
+    if(echo_event < 0 || ping_event < 0 || socketpair(AF_UNIX, SOCK_SEQPACKET, 0, sockets) != 0){
+        fprintf(stderr, "error, %s, eventfd/socketpair: %s\n", __func__, strerror(errno));
+        return -1;
+    }
+
+    bool sleep = mode == handoffMode::SHM_EVENTFD;
+    uint8_t frame[HANDOFF_FRAME_LENGTH];
+    memset(frame, 0x5A, sizeof(frame));
+
+    pid_t pid = fork();
+    if(pid == 0){
+        // echo process
+        for(int i = 0; i < roundTrips; ++i){
+            if(mode == handoffMode::UNIX_SOCKET){
+                if(read(sockets[1], frame, sizeof(frame)) != sizeof(frame)
+                        || write(sockets[1], frame, sizeof(frame)) != sizeof(frame)){
+                    _exit(1);
+                }
+            }
+            else{
+                ring_receive(&rings->to_echo, echo_event, frame, sleep);
+                ring_send(&rings->to_ping, ping_event, frame, sleep);
+            }
+        }
+        _exit(0);
+    }
+
+    std::vector<int64_t> one_way_ns;
+    one_way_ns.reserve(roundTrips);
+
+    for(int i = 0; i < roundTrips; ++i){
+        int64_t start = now_ns();
+        if(mode == handoffMode::UNIX_SOCKET){
+            if(write(sockets[0], frame, sizeof(frame)) != sizeof(frame)
+                    || read(sockets[0], frame, sizeof(frame)) != sizeof(frame)){
+                fprintf(stderr, "error, %s, socket write/read failed\n", __func__);
+                break;
+            }
+        }
+        else{
+            ring_send(&rings->to_echo, echo_event, frame, sleep);
+            ring_receive(&rings->to_ping, ping_event, frame, sleep);
+        }
+        one_way_ns.push_back((now_ns() - start) / 2);
+    }
+
+    waitpid(pid, nullptr, 0);
+
+    std::sort(one_way_ns.begin(), one_way_ns.end());
+    size_t n = one_way_ns.size();
+    if(n > 0){
+        const char* names[] = {"shm eventfd", "shm spin", "unix socket"};
+        fprintf(stdout, "%12s %10.2f %10.2f %10.2f\n", names[static_cast<int>(mode)],
+                    one_way_ns[n / 2] / 1000.0, one_way_ns[n * 99 / 100] / 1000.0, one_way_ns[n - 1] / 1000.0);
+    }
+
+    close(echo_event);
+    close(ping_event);
+    close(sockets[0]);
+    close(sockets[1]);
+    munmap(addr, sizeof(pingPong_t));
+    return 0;
+}
+
+
+static void serialize_bench_frame(bench_frame_t* frame, uint8_t* serial_buffer)
+{
+    // a stamp a nanosecond late keeps the indicators out of the frame
+    frame->stamp_ns = now_ns();
+    rfd900sim::frame_for_900MHz(frame, sizeof(*frame), serial_buffer, SERIAL_BENCH_FRAME_LENGTH);
+    while(!rfd900sim::frame_is_clean(serial_buffer, SERIAL_BENCH_FRAME_LENGTH)){
+        ++frame->stamp_ns;
+        rfd900sim::frame_for_900MHz(frame, sizeof(*frame), serial_buffer, SERIAL_BENCH_FRAME_LENGTH);
+    }
+}
+
+
+static void client_process(uint8_t index, const client_spec_t& spec, client_results_t* results)
+{
+    rfd900comm::radioClient client;
+    bool planner = spec.priority == rfd900comm::txPriority::CONTROL;
+
+    if(client.connect(spec.name, spec.priority, planner ? rfd900comm::RADIO_RX_ALL_TYPES : 0, BENCH_SOCKET) != 0){
+        _exit(1);
+    }
+
+    bench_frame_t frame;
+    memset(&frame, 0, sizeof(frame));
+    frame.dest_id = SimConstants::BASE_STATION;
+    frame.src_id = SimConstants::AERIAL01;
+    frame.msg_type = SimConstants::ROBOT_POSITION;
+    frame.client = index;
+
+    uint8_t rx_buffer[rfd900comm::SHM_SLOT_DATA_LENGTH];
+    auto next_send = steady::now();
+
+    for(int i = 0; i < spec.frames; ++i){
+        if(planner){
+            std::this_thread::sleep_until(next_send);
+            next_send += std::chrono::milliseconds(50);
+        }
+
+        // zero copy, the frame is serialized straight into the TX slot
+        uint8_t* slot;
+        while((slot = client.tx_reserve()) == nullptr){
+            usleep(1000);
+        }
+        frame.seq = i;
+        serialize_bench_frame(&frame, slot);
+        client.tx_commit(SERIAL_BENCH_FRAME_LENGTH, spec.priority);
+        ++results->frames_sent;
+
+        while(planner && client.receive(rx_buffer, sizeof(rx_buffer), 0) > 0){
+            bench_frame_t echo;
+            memcpy(&echo, rx_buffer, sizeof(echo));
+            ++results->echoes;
+            results->echo_rtt_sum_ms += (now_ns() - echo.stamp_ns) / 1e6;
+        }
+    }
+
+    // frames still in the ring are lost when the client closes
+    auto give_up = steady::now() + std::chrono::seconds(30);
+    while(steady::now() < give_up && (!client.channel_state()->tx.empty() || (planner && results->echoes < spec.frames))){
+        ssize_t n = planner ? client.receive(rx_buffer, sizeof(rx_buffer), 10000L) : 0;
+        if(n > 0){
+            bench_frame_t echo;
+            memcpy(&echo, rx_buffer, sizeof(echo));
+            ++results->echoes;
+            results->echo_rtt_sum_ms += (now_ns() - echo.stamp_ns) / 1e6;
+        }
+        else if(!planner){
+            usleep(1000);
+        }
+    }
+
+    client.close();
+    _exit(0);
+}
+
+
+struct far_end_stats_t{
+    int received[NUM_CLIENTS];
+    double latency_sum_ms[NUM_CLIENTS];
+    double latency_max_ms[NUM_CLIENTS];
+};
+
+static std::atomic<bool> farEndRunning;
+
+
+// counts the frames of each client and echoes the planner's back
+static void far_end(rfd900comm::rfd900Modem* radio, far_end_stats_t* stats)
+{
+    uint8_t serial_rx_buffer[SERIAL_RX_BUFFER_LENGTH];
+    uint8_t serial_echo_buffer[SERIAL_BENCH_FRAME_LENGTH];
+    std::string temp_rx_storage;
+    std::string extracted_rx_data;
+    rfd900sim::reserve_rx_storage(temp_rx_storage, extracted_rx_data);
+
+    while(farEndRunning){
+        ssize_t bytesRead = radio->read_serial(serial_rx_buffer, SERIAL_RX_BUFFER_LENGTH, 10000L);
+        if(bytesRead <= 0){
+            continue;
+        }
+
+        rfd900sim::append_rx_data(temp_rx_storage, serial_rx_buffer, bytesRead);
+        while(rfd900sim::extract_rx_message(temp_rx_storage, extracted_rx_data)){
+            bench_frame_t frame;
+            if(extracted_rx_data.length() != sizeof(frame)){
+                continue;
+            }
+
+            memcpy(&frame, extracted_rx_data.data(), sizeof(frame));
+            if(frame.client >= NUM_CLIENTS){
+                continue;
+            }
+
+            double latency_ms = (now_ns() - frame.stamp_ns) / 1e6;
+            ++stats->received[frame.client];
+            stats->latency_sum_ms[frame.client] += latency_ms;
+            stats->latency_max_ms[frame.client] = std::max(stats->latency_max_ms[frame.client], latency_ms);
+
+            if(frame.client == 0){
+                rfd900sim::frame_for_900MHz(&frame, sizeof(frame), serial_echo_buffer, SERIAL_BENCH_FRAME_LENGTH);
+                radio->send_message((const char*)serial_echo_buffer, SERIAL_BENCH_FRAME_LENGTH);
+            }
+        }
+    }
+}
+
+
+static int run_arbitration(int burstFrames)
+{
+    const client_spec_t specs[NUM_CLIENTS] = {
+        {"planner", rfd900comm::txPriority::CONTROL, PLANNER_FRAMES},
+        {"telemetry", rfd900comm::txPriority::NORMAL, burstFrames},
+        {"perception", rfd900comm::txPriority::BULK, burstFrames}
+    };
+
+    void* addr = mmap(nullptr, NUM_CLIENTS * sizeof(client_results_t), PROT_READ | PROT_WRITE,
+                MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if(addr == MAP_FAILED){
+        fprintf(stderr, "error, %s, mmap: %s\n", __func__, strerror(errno));
+        return -1;
+    }
+    client_results_t* results = static_cast<client_results_t*>(addr);
+    memset(results, 0, NUM_CLIENTS * sizeof(client_results_t));
+
+    rfd900comm::linkEmulatorConfig config;
+    config.latency = std::chrono::milliseconds(20);
+    rfd900comm::rfd900Modem daemon_radio;
+    // paced under the air rate, the far end's echoes share the half duplex channel
+    rfd900comm::radioDaemon daemon(daemon_radio, config.air_bytes_per_sec * 7 / 8);
+
+    if(daemon.open(BENCH_SOCKET) != 0){
+        return -1;
+    }
+
+    // connected, but never says hello
+    int silent = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+    struct sockaddr_un silent_addr;
+    memset(&silent_addr, 0, sizeof(silent_addr));
+    silent_addr.sun_family = AF_UNIX;
+    strncpy(silent_addr.sun_path, BENCH_SOCKET, sizeof(silent_addr.sun_path) - 1);
+    if(silent < 0 || connect(silent, (struct sockaddr*)&silent_addr, sizeof(silent_addr)) != 0){
+        fprintf(stderr, "error, %s, silent client connect: %s\n", __func__, strerror(errno));
+        return -1;
+    }
+
+    // the clients are forked before any thread starts, they connect and wait for the daemon
+    pid_t pids[NUM_CLIENTS];
+    for(size_t c = 0; c < NUM_CLIENTS; ++c){
+        pids[c] = fork();
+        if(pids[c] == 0){
+            client_process(static_cast<uint8_t>(c), specs[c], &results[c]);
+        }
+    }
+
+    rfd900comm::linkEmulator emulator;
+    rfd900comm::rfd900Modem far_radio;
+    if(emulator.start(config) != 0){
+        return -1;
+    }
+    if(daemon_radio.init(emulator.port_name(0)) != 0 || far_radio.init(emulator.port_name(1)) != 0){
+        fprintf(stderr, "error, %s radio init failure\n", __func__);
+        return -1;
+    }
+
+    far_end_stats_t stats;
+    memset(&stats, 0, sizeof(stats));
+    farEndRunning = true;
+    std::thread far_thread(far_end, &far_radio, &stats);
+
+    // serve until every client has exited and the last frames are on the air
+    size_t running = NUM_CLIENTS;
+    auto start = steady::now();
+    auto drain_until = steady::time_point::max();
+    double longest_service_ms = 0;
+    while(steady::now() < drain_until){
+        auto call = steady::now();
+        daemon.service(10000L);
+        longest_service_ms = std::max(longest_service_ms,
+                    std::chrono::duration<double, std::milli>(steady::now() - call).count());
+
+        for(size_t c = 0; c < NUM_CLIENTS; ++c){
+            if(pids[c] > 0 && waitpid(pids[c], nullptr, WNOHANG) == pids[c]){
+                pids[c] = 0;
+                --running;
+            }
+        }
+        if(running == 0 && drain_until == steady::time_point::max()){
+            drain_until = steady::now() + std::chrono::seconds(1);
+        }
+    }
+    double elapsed = std::chrono::duration<double>(steady::now() - start).count();
+
+    farEndRunning = false;
+    far_thread.join();
+
+    fprintf(stdout, "%12s %8s %8s %10s %12s %12s\n", "client", "class", "sent", "received", "mean ms", "max ms");
+    const char* classes[] = {"CONTROL", "HIGH", "NORMAL", "BULK"};
+    for(size_t c = 0; c < NUM_CLIENTS; ++c){
+        int received = stats.received[c];
+        fprintf(stdout, "%12s %8s %8d %10d %12.1f %12.1f\n", specs[c].name, classes[static_cast<int>(specs[c].priority)],
+                    results[c].frames_sent, received, received ? stats.latency_sum_ms[c] / received : 0.0,
+                    stats.latency_max_ms[c]);
+    }
+
+    rfd900comm::radioDaemonStats daemon_stats = daemon.get_stats();
+    fprintf(stdout, "planner echoes through the daemon RX ring: %d, mean round trip %.1f ms\n",
+                results[0].echoes, results[0].echoes ? results[0].echo_rtt_sum_ms / results[0].echoes : 0.0);
+    fprintf(stdout, "daemon: %lu clients, %lu tx frames, %lu rx messages, %lu dropped, %.1f s\n",
+                daemon_stats.clients_accepted, daemon_stats.tx_frames, daemon_stats.rx_messages,
+                daemon_stats.rx_dropped, elapsed);
+    fprintf(stdout, "silent connection: longest service call %.1f ms with a 10 ms timeout\n", longest_service_ms);
+
+    close(silent);
+    daemon.close();
+    munmap(addr, NUM_CLIENTS * sizeof(client_results_t));
+    return 0;
+}
+
+
+int main(int argc, char **argv)
+{
+    int roundTrips = 20000;
+    int burstFrames = 200;
+
+    if(argc > 1){
+        roundTrips = atoi(argv[1]);
+    }
+    if(argc > 2){
+        burstFrames = atoi(argv[2]);
+    }
+
+    fprintf(stdout, "handoff, %d round trips of %lu bytes, one way microseconds\n", roundTrips, HANDOFF_FRAME_LENGTH);
+    fprintf(stdout, "%12s %10s %10s %10s\n", "mode", "median", "p99", "max");
+    if(run_handoff(handoffMode::SHM_EVENTFD, roundTrips) != 0
+            || run_handoff(handoffMode::SHM_SPIN, roundTrips) != 0
+            || run_handoff(handoffMode::UNIX_SOCKET, roundTrips) != 0){
+        return 1;
+    }
+
+    fprintf(stdout, "\narbitration, 3 clients through one radioDaemon, 8000 bytes/s air rate\n");
+    if(run_arbitration(burstFrames) != 0){
+        return 1;
+    }
+
+    return 0;
+}
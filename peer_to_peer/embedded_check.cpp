@@ -0,0 +1,230 @@
+/**
+ * Purpose:
+ *  Check that the RFD900_EMBEDDED build runs the RX/TX path without
+ *  allocating after startup, and report the peak resident set size.
+ *
+ *  Two radios are connected through a linkEmulator. At startup the program
+ *  sizes every buffer and queue: the message900 ack wait list, the
+ *  txScheduler frame pool and the receive strings. It then arms the
+ *  allocation guard and runs the whole path on one thread:
+ *
+ *      simulate and serialize an artifact, queue it on the txScheduler and
+ *      add it to the ack wait list while the send window is open
+ *      receive, extract and process it, and send the ACK back
+ *      receive and process the ACK, scan for retransmissions
+ *
+ *  Any malloc or operator new on that thread after startup is counted and
+ *  the program exits with status 1.
+ *
+ *  Peak RSS still grows a little after startup without any allocation:
+ *  library code run for the first time is paged in (file backed), and
+ *  buffers sized at startup and the linkEmulator thread's queues are
+ *  touched for the first time (anonymous). Both are reported. Both level
+ *  off after the first few hundred messages.
+ *
+ * Optional Command line arguments
+ *  argv[1] - number of artifact messages
+ *  argv[2] - 1 to abort at the first allocation instead of counting
+ *
+ */
+
+#include <fcntl.h>
+#include <unistd.h>                 // read, close
+#include <chrono>
+#include <cstdlib>                  // atoi, strtol
+#include <cstring>                  // memcpy, strstr
+#include <string>
+
+#include "alloc_guard.h"
+#include "link_emulator.h"
+#include "link_stats.h"
+#include "message900.h"
+#include "rfd900_modem.h"
+#include "simulation_constants.h"
+#include "sim_artifact_message.h"
+#include "tx_scheduler.h"
+
+
+using rfd900sim::SimConstants;
+using steady = std::chrono::steady_clock;
+
+constexpr size_t SERIAL_RX_BUFFER_LENGTH = 256;
+constexpr size_t WAIT_LIST_CAPACITY = 64;
+constexpr size_t SCHEDULER_CAPACITY = 64;
+constexpr long POLL_TIMEOUT = 1000L;            // units, microseconds
+
+
+// kilobytes, from /proc/self/status
+struct memory_usage_t{
+    long peak;                                  // VmHWM
+    long anon;                                  // RssAnon, heap, stacks, buffers
+    long file;                                  // RssFile, program and library pages
+};
+
+
+static long status_field(const char* status, const char* name)
+{
+    const char* field = strstr(status, name);
+    return field != nullptr ? strtol(field + strlen(name), nullptr, 10) : -1;
+}
+
+
+// reads into a stack buffer, measuring does not allocate
+static memory_usage_t memory_usage()
+{
+    char status[4096];
+    ssize_t n = -1;
+    int fd = open("/proc/self/status", O_RDONLY);
+    if(fd >= 0){
+        n = read(fd, status, sizeof(status) - 1);
+        close(fd);
+    }
+    status[n > 0 ? n : 0] = '\0';
+    return {status_field(status, "VmHWM:"), status_field(status, "RssAnon:"), status_field(status, "RssFile:")};
+}
+
+
+int main(int argc, char **argv)
+{
+    int messageCount = 2000;
+    bool abortOnAllocation = false;
+
+    if(argc > 1){
+        messageCount = atoi(argv[1]);
+    }
+    if(argc > 2){
+        abortOnAllocation = atoi(argv[2]) != 0;
+    }
+
+    const size_t SERIAL_ARTIFACT_BUFFER_LENGTH = sizeof(rfd900sim::artifact_message_t)
+                        + SimConstants::MESSAGE_900_START_INDICATOR_LENGTH
+                        + SimConstants::MESSAGE_900_END_INDICATOR_LENGTH;
+    const size_t SERIAL_ACK_BUFFER_LENGTH = sizeof(rfd900sim::ack_message_t)
+                        + SimConstants::MESSAGE_900_START_INDICATOR_LENGTH
+                        + SimConstants::MESSAGE_900_END_INDICATOR_LENGTH;
+
+    // startup, everything is sized here
+    rfd900comm::linkEmulator emulator;
+    rfd900comm::linkEmulatorConfig config;
+    rfd900comm::rfd900Modem tx_radio;
+    rfd900comm::rfd900Modem rx_radio;
+    rfd900comm::message900 msg900(rfd900comm::rtoMode::ADAPTIVE, WAIT_LIST_CAPACITY);
+    rfd900comm::txScheduler scheduler(0, rfd900comm::txScheduler::DEFAULT_MAX_BACKLOG, SCHEDULER_CAPACITY);
+
+    uint8_t serial_tx_buffer[SERIAL_RX_BUFFER_LENGTH];
+    uint8_t serial_ack_buffer[SERIAL_RX_BUFFER_LENGTH];
+    uint8_t serial_rx_buffer[SERIAL_RX_BUFFER_LENGTH];
+    std::string tx_rx_storage;
+    std::string tx_extracted;
+    std::string rx_rx_storage;
+    std::string rx_extracted;
+
+    rfd900sim::reserve_rx_storage(tx_rx_storage, tx_extracted);
+    rfd900sim::reserve_rx_storage(rx_rx_storage, rx_extracted);
+    msg900.set_send_window(WAIT_LIST_CAPACITY / 2, WAIT_LIST_CAPACITY / 2 * SERIAL_ARTIFACT_BUFFER_LENGTH);
+
+    if(emulator.start(config) != 0){
+        return 1;
+    }
+
+    if(tx_radio.init(emulator.port_name(0)) != 0 || rx_radio.init(emulator.port_name(1)) != 0){
+        fprintf(stderr, "error, %s radio init failure\n", __func__);
+        return 1;
+    }
+
+    size_t retransmissions = 0;
+    auto retransmit = [&](const rfd900comm::message900_t& msg){
+        tx_radio.send_message((const char*)msg.data, msg.data_length);
+        ++retransmissions;
+    };
+    rfd900comm::message900::retransmit_function retransmit_function(retransmit);
+
+    memory_usage_t startup_memory = memory_usage();
+    fprintf(stdout, "messages: %d, ack wait list: %lu, scheduler frames: %lu, rx storage: %lu bytes\n",
+                messageCount, msg900.ack_wait_list_capacity(), SCHEDULER_CAPACITY, rfd900sim::RX_STORAGE_CAPACITY);
+
+    rfd900comm::alloc_guard_arm(abortOnAllocation);
+
+    rfd900sim::artifact_message_t artmsg;
+    rfd900sim::point_stamped_message_t point;
+    bool held = false;                          // artmsg waits for the window
+    int sent = 0;
+    int acked = 0;
+    auto start = steady::now();
+    auto give_up = start + std::chrono::seconds(30 + messageCount / 10);
+
+    while((sent < messageCount || msg900.ack_wait_list_size() > 0) && steady::now() < give_up){
+
+        // transmit
+        if(sent < messageCount){
+            // an artifact with an indicator inside its frame could never be extracted, draw another
+            while(!held){
+                rfd900sim::simulate_artifact_message(&artmsg, SimConstants::BASE_STATION, SimConstants::AERIAL01);
+                rfd900sim::serialize_artifact_for_900MHz(&artmsg, serial_tx_buffer, SERIAL_ARTIFACT_BUFFER_LENGTH);
+                rfd900sim::random_point_stamped_message(&point);
+                held = rfd900sim::frame_is_clean(serial_tx_buffer, SERIAL_ARTIFACT_BUFFER_LENGTH);
+            }
+
+            if(msg900.window_open(artmsg.dest_id, artmsg.msg_id, SERIAL_ARTIFACT_BUFFER_LENGTH)
+                    && scheduler.enqueue(rfd900comm::txPriority::HIGH, serial_tx_buffer, SERIAL_ARTIFACT_BUFFER_LENGTH) != 0){
+                msg900.add_to_ack_wait_list(artmsg.dest_id, artmsg.msg_id, artmsg.msg_type,
+                            serial_tx_buffer, SERIAL_ARTIFACT_BUFFER_LENGTH);
+                held = false;
+                ++sent;
+            }
+        }
+        scheduler.service(tx_radio);
+
+        // receiver, acknowledge artifacts
+        ssize_t bytesRead = rx_radio.read_serial(serial_rx_buffer, SERIAL_RX_BUFFER_LENGTH, 0L);
+        if(bytesRead > 0){
+            rfd900sim::append_rx_data(rx_rx_storage, serial_rx_buffer, bytesRead);
+            while(rfd900sim::extract_rx_message(rx_rx_storage, rx_extracted)){
+                rfd900sim::ack_message_t ackmsg;
+                if(rfd900sim::process_rx_message(rx_extracted, &ackmsg, true) == SimConstants::SEND_ACK){
+                    rfd900sim::serialize_acknowledgement_for_900MHz(&ackmsg, serial_ack_buffer, SERIAL_ACK_BUFFER_LENGTH);
+                    rx_radio.send_message((const char*)serial_ack_buffer, SERIAL_ACK_BUFFER_LENGTH);
+                }
+            }
+        }
+
+        // sender, release acknowledged messages
+        bytesRead = tx_radio.read_serial(serial_rx_buffer, SERIAL_RX_BUFFER_LENGTH, held ? POLL_TIMEOUT : 0L);
+        if(bytesRead > 0){
+            rfd900sim::append_rx_data(tx_rx_storage, serial_rx_buffer, bytesRead);
+            while(rfd900sim::extract_rx_message(tx_rx_storage, tx_extracted)){
+                rfd900sim::ack_message_t ack;
+                if(rfd900sim::process_rx_message(tx_extracted, &ack) != SimConstants::PROCESS_ACK
+                        || tx_extracted[2] != SimConstants::ACK){
+                    continue;
+                }
+
+                memcpy(&ack, tx_extracted.data(), sizeof(ack));
+                if(msg900.process_received_ack(ack.src_id, ack.msg_id) == 0){
+                    ++acked;
+                }
+            }
+        }
+
+        msg900.scan_list_for_retransmission(retransmit_function);
+    }
+
+    memory_usage_t exit_memory = memory_usage();
+    rfd900comm::alloc_guard_disarm();
+
+    double elapsed = std::chrono::duration<double>(steady::now() - start).count();
+    uint64_t allocations = rfd900comm::alloc_guard_count();
+
+    fprintf(stdout, "sent: %d, acknowledged: %d, retransmitted: %lu, %.1f s\n", sent, acked, retransmissions, elapsed);
+    fprintf(stdout, "allocations after startup: %lu\n", allocations);
+    fprintf(stdout, "peak RSS: %ld kB at startup, %ld kB at exit\n", startup_memory.peak, exit_memory.peak);
+    fprintf(stdout, "resident growth: %ld kB anonymous, %ld kB file backed\n",
+                exit_memory.anon - startup_memory.anon, exit_memory.file - startup_memory.file);
+
+    if(allocations != 0 || acked != messageCount){
+        fprintf(stderr, "error, %s, %s\n", __func__, allocations != 0 ? "allocation after startup" : "messages not acknowledged");
+        return 1;
+    }
+
+    return 0;
+}
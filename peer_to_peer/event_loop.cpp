@@ -0,0 +1,188 @@
+/**
+ * @brief eventLoop class function definitions.
+ *
+ */
+
+#include <errno.h>
+#include <poll.h>
+#include <stdio.h>
+#include <string.h>                     // strerror
+
+#include "event_loop.h"
+
+namespace rfd900comm{
+
+    const short eventLoop::POLL_READ = POLLIN;
+    const short eventLoop::POLL_WRITE = POLLOUT;
+
+
+    eventLoop::eventLoop()
+    {
+        stopped = false;
+    }
+
+    eventLoop::~eventLoop()
+    {
+        // destroying the owning task objects destroys any suspended frames,
+        // including the child tasks they are awaiting
+        spawned.clear();
+    }
+
+
+    void eventLoop::spawn(task<void> t)
+    {
+        std::coroutine_handle<> h = t.handle();
+        spawned.push_back(std::move(t));
+        schedule(h);
+    }
+
+
+    void eventLoop::stop()
+    {
+        stopped = true;
+    }
+
+
+    void eventLoop::schedule(std::coroutine_handle<> h)
+    {
+        ready.push_back(h);
+    }
+
+
+    eventLoop::timer_id eventLoop::add_timer(clock::time_point when, std::coroutine_handle<> h, bool* fired)
+    {
+        return timers.emplace(when, timer_entry{h, fired});
+    }
+
+
+    void eventLoop::cancel_timer(timer_id id)
+    {
+        timers.erase(id);
+    }
+
+
+    void eventLoop::watch_fd(int fd, short events, std::coroutine_handle<> h)
+    {
+        watches.push_back(fd_watch{fd, events, h});
+    }
+
+
+    void eventLoop::run()
+    {
+        stopped = false;
+
+        while(!stopped){
+
+            run_ready();
+            reap_spawned();
+
+            if(stopped){
+                break;
+            }
+
+            if(ready.empty() && timers.empty() && watches.empty()){
+                break;                                  // nothing left to wait for
+            }
+
+            wait_for_io(poll_timeout_ms());
+            fire_timers();
+        }
+    }
+
+
+    void eventLoop::run_ready()
+    {
+        // coroutines scheduled while this batch runs wait for the next pass,
+        // so timers and I/O are never starved by a busy coroutine
+        size_t count = ready.size();
+        while(count > 0 && !ready.empty()){
+            std::coroutine_handle<> h = ready.front();
+            ready.pop_front();
+            h.resume();
+            --count;
+        }
+    }
+
+
+    int eventLoop::poll_timeout_ms() const
+    {
+        if(!ready.empty()){
+            return 0;
+        }
+
+        if(timers.empty()){
+            return -1;                                  // block until I/O
+        }
+
+        auto delay = timers.begin()->first - clock::now();
+        if(delay <= clock::duration::zero()){
+            return 0;
+        }
+
+        // round up so the timer is due when poll returns
+        auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(delay + std::chrono::microseconds(999));
+        return static_cast<int>(ms.count());
+    }
+
+
+    void eventLoop::fire_timers()
+    {
+        clock::time_point now = clock::now();
+        while(!timers.empty() && timers.begin()->first <= now){
+            timer_entry& t = timers.begin()->second;
+            if(t.fired != nullptr){
+                *t.fired = true;
+            }
+            schedule(t.h);
+            timers.erase(timers.begin());
+        }
+    }
+
+
+    void eventLoop::wait_for_io(int timeout_ms)
+    {
+        std::vector<struct pollfd> pfds;
+        pfds.reserve(watches.size());
+        for(const fd_watch& w : watches){
+            pfds.push_back(pollfd{w.fd, w.events, 0});
+        }
+
+        int rv = poll(pfds.data(), pfds.size(), timeout_ms);
+        if(rv < 0){
+            if(errno != EINTR){
+                fprintf(stderr, "error, %s, poll: %s\n", __func__, strerror(errno));
+            }
+            return;
+        }
+
+        if(rv == 0){
+            return;
+        }
+
+        // every watch is one-shot, remove the ones that fired
+        size_t keep = 0;
+        for(size_t i = 0; i < watches.size(); ++i){
+            if(pfds[i].revents != 0){
+                schedule(watches[i].h);
+            }
+            else{
+                watches[keep++] = watches[i];
+            }
+        }
+        watches.resize(keep);
+    }
+
+
+    void eventLoop::reap_spawned()
+    {
+        for(auto it = spawned.begin(); it != spawned.end(); ){
+            if(it->done()){
+                it = spawned.erase(it);
+            }
+            else{
+                ++it;
+            }
+        }
+    }
+
+}
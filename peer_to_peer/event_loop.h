@@ -0,0 +1,127 @@
+/**
+ * @brief Declares eventLoop, a single threaded scheduler for coroutine tasks
+ *
+ * The loop multiplexes three sources of work:
+ *      coroutines that are ready to run
+ *      timers (sleep_for, ack timeouts)
+ *      file descriptor readiness (serial port readable / writable)
+ *
+ * Every wait is one-shot: the suspended coroutine is resumed exactly once,
+ * by whichever source fires first. Nothing blocks except poll(), so a single
+ * thread can drive hundreds of outstanding transactions.
+ *
+ * A timer that races another wake up (an ACK and its timeout) is given a
+ * fired flag. Once the flag is set the timer is gone and its coroutine is
+ * scheduled, so the other source must neither cancel nor schedule it.
+ *
+ */
+
+#ifndef EVENT_LOOP_INCLUDED_H
+#define EVENT_LOOP_INCLUDED_H
+
+#include <chrono>
+#include <coroutine>
+#include <deque>
+#include <list>
+#include <map>
+#include <vector>
+
+#include "coro_task.h"
+
+
+namespace rfd900comm{
+
+    class eventLoop{
+
+        public:
+
+        using clock = std::chrono::steady_clock;
+
+        struct timer_entry{
+            std::coroutine_handle<> h;
+            bool* fired;                        // set when the timer fires, may be nullptr
+        };
+
+        using timer_id = std::multimap<clock::time_point, timer_entry>::iterator;
+
+        eventLoop();
+        ~eventLoop();
+
+        // disable copy constructor
+        eventLoop(const eventLoop&) = delete;
+
+        // disable assignment
+        eventLoop& operator=(const eventLoop&) = delete;
+
+
+        // takes ownership of t and starts it on the next loop iteration
+        void spawn(task<void> t);
+
+        // runs until stop() is called or no work remains
+        void run();
+        void stop();
+
+        // low level scheduling, used by the awaitables below
+        void schedule(std::coroutine_handle<> h);
+        timer_id add_timer(clock::time_point when, std::coroutine_handle<> h, bool* fired = nullptr);
+        void cancel_timer(timer_id id);
+        void watch_fd(int fd, short events, std::coroutine_handle<> h);
+
+        size_t timer_count() const { return timers.size(); }
+
+
+        // awaitables
+        auto sleep_for(clock::duration d)
+        {
+            struct awaiter{
+                eventLoop* loop;
+                clock::time_point when;
+                bool await_ready() const noexcept { return false; }
+                void await_suspend(std::coroutine_handle<> h) { loop->add_timer(when, h); }
+                void await_resume() const noexcept {}
+            };
+            return awaiter{this, clock::now() + d};
+        }
+
+        auto readable(int fd) { return fd_awaiter{this, fd, POLL_READ}; }
+        auto writable(int fd) { return fd_awaiter{this, fd, POLL_WRITE}; }
+
+
+        private:
+
+        static const short POLL_READ;
+        static const short POLL_WRITE;
+
+        struct fd_awaiter{
+            eventLoop* loop;
+            int fd;
+            short events;
+            bool await_ready() const noexcept { return false; }
+            void await_suspend(std::coroutine_handle<> h) { loop->watch_fd(fd, events, h); }
+            void await_resume() const noexcept {}
+        };
+
+        struct fd_watch{
+            int fd;
+            short events;
+            std::coroutine_handle<> h;
+        };
+
+        bool stopped;
+
+        std::deque<std::coroutine_handle<>> ready;
+        std::multimap<clock::time_point, timer_entry> timers;
+        std::vector<fd_watch> watches;
+        std::list<task<void>> spawned;          // detached tasks owned by the loop
+
+        int poll_timeout_ms() const;
+        void run_ready();
+        void fire_timers();
+        void wait_for_io(int timeout_ms);
+        void reap_spawned();
+    };
+
+}
+
+
+#endif
@@ -0,0 +1,94 @@
+/**
+ * @brief expiryWheel class function definitions.
+ *
+ */
+
+#include "expiry_wheel.h"
+#include "virtual_clock.h"
+
+namespace rfd900comm{
+
+    expiryWheel::expiryWheel(size_t capacity, std::chrono::microseconds tick, size_t slots) :
+        entries(), heads(slots > 0 ? slots : DEFAULT_SLOTS, NO_ENTRY),
+        tickNs(std::chrono::duration_cast<std::chrono::nanoseconds>(tick).count()), cursor(0), count(0)
+    {
+        if(tickNs <= 0){
+            tickNs = 1000000;
+        }
+        resize(capacity);
+        cursor = tick_of(clock_now());
+    }
+
+
+    void expiryWheel::resize(size_t capacity)
+    {
+        entry_t unused;
+        unused.prev = NO_ENTRY;
+        unused.next = NO_ENTRY;
+        unused.slot = NO_SLOT;
+        if(capacity > entries.size()){
+            entries.resize(capacity, unused);
+        }
+    }
+
+
+    int64_t expiryWheel::tick_of(steady::time_point t) const
+    {
+        int64_t ns = std::chrono::duration_cast<std::chrono::nanoseconds>(t.time_since_epoch()).count();
+        return ns >= 0 ? ns / tickNs : 0;
+    }
+
+
+    void expiryWheel::schedule(uint32_t id, steady::time_point deadline)
+    {
+        if(entries[id].slot != NO_SLOT){
+            unlink(id);
+        }
+
+        // a deadline the cursor has passed goes in the cursor's slot, expire() visits it next
+        int64_t tick = tick_of(deadline);
+        if(tick < cursor){
+            tick = cursor;
+        }
+        uint32_t slot = static_cast<uint32_t>(static_cast<uint64_t>(tick) % heads.size());
+
+        entry_t& e = entries[id];
+        e.deadline = deadline;
+        e.slot = slot;
+        e.prev = NO_ENTRY;
+        e.next = heads[slot];
+        if(e.next != NO_ENTRY){
+            entries[e.next].prev = id;
+        }
+        heads[slot] = id;
+        ++count;
+    }
+
+
+    void expiryWheel::cancel(uint32_t id)
+    {
+        if(id < entries.size() && entries[id].slot != NO_SLOT){
+            unlink(id);
+        }
+    }
+
+
+    void expiryWheel::unlink(uint32_t id)
+    {
+        entry_t& e = entries[id];
+        if(e.prev != NO_ENTRY){
+            entries[e.prev].next = e.next;
+        }
+        else{
+            heads[e.slot] = e.next;
+        }
+        if(e.next != NO_ENTRY){
+            entries[e.next].prev = e.prev;
+        }
+        e.prev = NO_ENTRY;
+        e.next = NO_ENTRY;
+        e.slot = NO_SLOT;
+        --count;
+    }
+
+}
@@ -0,0 +1,125 @@
+/**
+ * @brief Declares expiryWheel, O(1) deadlines for entries of a fixed pool
+ *
+ * A hashed timing wheel over the indices of a caller's pool, the ack wait
+ * list of message900 or the frame pool of txScheduler. An entry with a
+ * deadline is linked into the slot of its tick, deadline / tick modulo the
+ * slot count, so scheduling and cancelling, on an ACK or when a frame is
+ * sent, are O(1). expire() visits the slots of the ticks passed since its
+ * last call and hands every entry whose deadline has come to the caller.
+ * An entry further out than one turn of the wheel stays in its slot until
+ * the turn in which it is due.
+ *
+ * The links live in arrays sized by the constructor, or by resize for pools
+ * that grow, so the wheel itself never allocates.
+ *
+ */
+
+#ifndef EXPIRY_WHEEL_INCLUDED_H
+#define EXPIRY_WHEEL_INCLUDED_H
+
+#include <chrono>
+#include <cstdint>
+#include <vector>
+
+
+namespace rfd900comm{
+
+    class expiryWheel{
+
+        public:
+
+        using steady = std::chrono::steady_clock;
+
+        static constexpr size_t DEFAULT_SLOTS = 1024;
+
+        expiryWheel(size_t capacity, std::chrono::microseconds tick, size_t slots = DEFAULT_SLOTS);
+
+        // disable copy constructor
+        expiryWheel(const expiryWheel&) = delete;
+
+        // disable assignment
+        expiryWheel& operator=(const expiryWheel&) = delete;
+
+        // grows the pool the ids index, scheduled entries keep their deadlines
+        void resize(size_t capacity);
+
+        // replaces an earlier deadline of id, a deadline already passed expires on the next expire()
+        void schedule(uint32_t id, steady::time_point deadline);
+        void cancel(uint32_t id);
+
+        bool scheduled(uint32_t id) const { return entries[id].slot != NO_SLOT; }
+        size_t size() const { return count; }
+
+        /**
+         * Calls expired(id) for every entry whose deadline is at or before now,
+         * each entry is cancelled before the call. expired may cancel or
+         * schedule the id it is given, but no other id.
+         * returns the number of entries expired
+         */
+        template<typename F>
+        size_t expire(steady::time_point now, F&& expired);
+
+
+        private:
+
+        static constexpr uint32_t NO_ENTRY = UINT32_MAX;
+        static constexpr uint32_t NO_SLOT = UINT32_MAX;
+
+        struct entry_t{
+            steady::time_point deadline;
+            uint32_t prev;
+            uint32_t next;
+            uint32_t slot;
+        };
+
+        std::vector<entry_t> entries;
+        std::vector<uint32_t> heads;            // first entry of each slot
+        int64_t tickNs;
+        int64_t cursor;                         // last tick expire() visited
+        size_t count;
+
+        int64_t tick_of(steady::time_point t) const;
+        void unlink(uint32_t id);
+    };
+
+
+    template<typename F>
+    size_t expiryWheel::expire(steady::time_point now, F&& expired)
+    {
+        int64_t now_tick = tick_of(now);
+        if(count == 0){
+            cursor = now_tick;
+            return 0;
+        }
+
+        // the slot of the cursor's tick is visited again, it can hold entries later in that tick
+        int64_t first = cursor;
+        int64_t steps = now_tick - cursor + 1;
+        if(steps <= 0 || steps > static_cast<int64_t>(heads.size())){
+            first = now_tick;
+            steps = heads.size();
+        }
+
+        size_t n = 0;
+        for(int64_t t = first; t < first + steps && count > 0; ++t){
+            uint32_t id = heads[static_cast<uint64_t>(t) % heads.size()];
+            while(id != NO_ENTRY){
+                uint32_t next = entries[id].next;
+                if(entries[id].deadline <= now){
+                    unlink(id);
+                    ++n;
+                    expired(id);
+                }
+                id = next;
+            }
+        }
+
+        cursor = now_tick;
+        return n;
+    }
+
+}
+
+
+#endif
@@ -0,0 +1,187 @@
+/**
+ * Purpose:
+ *  Compare artifact loss at saturation with and without flow control into
+ *  the modem.
+ *
+ *  Two radios are connected through a linkEmulator that models a limited
+ *  modem transmit buffer. The sender keeps a txScheduler full of artifact
+ *  messages and writes as fast as the serial port takes them:
+ *
+ *  NONE      - no flow control, bytes arriving at the full modem buffer are lost
+ *  RTS_CTS   - hardware flow control, the full modem holds the host off and the
+ *              kernel TX queue absorbs the excess
+ *  OCCUPANCY - no flow control, the scheduler keeps within the modem buffer
+ *              using rfd900Modem's occupancy model (TIOCOUTQ and air rate)
+ *
+ *  The receiver counts complete artifact messages.
+ *
+ * Optional Command line arguments
+ *  argv[1] - seconds of saturation per mode
+ *  argv[2] - modem buffer, bytes
+ *
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>                  // atoi
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "link_emulator.h"
+#include "rfd900_modem.h"
+#include "simulation_constants.h"
+#include "sim_artifact_message.h"
+#include "tx_scheduler.h"
+
+
+using rfd900sim::SimConstants;
+using steady = std::chrono::steady_clock;
+
+constexpr size_t SERIAL_RX_BUFFER_LENGTH = 256;
+constexpr long POLL_TIMEOUT = 5000L;            // units, microseconds
+constexpr size_t SCHEDULER_DEPTH = 32;          // artifacts kept queued
+
+enum class flowMode{
+    NONE,
+    RTS_CTS,
+    OCCUPANCY
+};
+
+static std::atomic<bool> receiverRunning;
+
+
+static void receiver(rfd900comm::rfd900Modem* radio, std::atomic<uint64_t>* received)
+{
+    uint8_t serial_rx_buffer[SERIAL_RX_BUFFER_LENGTH];
+    std::string temp_rx_storage;
+    std::string extracted_rx_data;
+
+    while(receiverRunning){
+        ssize_t bytesRead = radio->read_serial(serial_rx_buffer, SERIAL_RX_BUFFER_LENGTH, POLL_TIMEOUT);
+        if(bytesRead <= 0){
+            continue;
+        }
+
+        temp_rx_storage.append((const char*)serial_rx_buffer, bytesRead);
+        while(rfd900sim::extract_rx_message(temp_rx_storage, extracted_rx_data)){
+            if(extracted_rx_data.length() == sizeof(rfd900sim::artifact_message_t)
+                    && extracted_rx_data[2] == SimConstants::ARTIFACT_POSITION){
+                ++*received;
+            }
+        }
+    }
+}
+
+
+static int run_mode(flowMode mode, rfd900comm::linkEmulatorConfig config, int seconds)
+{
+    const size_t SERIAL_ARTIFACT_BUFFER_LENGTH = sizeof(rfd900sim::artifact_message_t)
+                        + SimConstants::MESSAGE_900_START_INDICATOR_LENGTH
+                        + SimConstants::MESSAGE_900_END_INDICATOR_LENGTH;
+
+    rfd900comm::linkEmulator emulator;
+    rfd900comm::rfd900Modem tx_radio;
+    rfd900comm::rfd900Modem rx_radio;
+    rfd900comm::txScheduler scheduler;
+    std::vector<uint8_t> serial_tx_buffer(SERIAL_ARTIFACT_BUFFER_LENGTH);
+    std::atomic<uint64_t> received(0);
+
+    config.hardware_flow_control = (mode == flowMode::RTS_CTS);
+    rfd900comm::flowControl flow = mode == flowMode::RTS_CTS ? rfd900comm::flowControl::RTS_CTS : rfd900comm::flowControl::NONE;
+
+    if(emulator.start(config) != 0){
+        return -1;
+    }
+
+    if(tx_radio.init(emulator.port_name(0), rfd900comm::rfd900Modem::DEFAULT_BAUD_RATE, rfd900comm::serialProfile::LOW_LATENCY, flow) != 0
+            || rx_radio.init(emulator.port_name(1)) != 0){
+        fprintf(stderr, "error, %s radio init failure\n", __func__);
+        return -1;
+    }
+
+    if(mode == flowMode::OCCUPANCY){
+        tx_radio.set_modem_model(config.air_bytes_per_sec, config.modem_buffer_bytes);
+    }
+
+    receiverRunning = true;
+    std::thread rx_thread(receiver, &rx_radio, &received);
+
+    uint64_t written = 0;
+    ssize_t max_kernel_queued = 0;
+    auto start = steady::now();
+    auto end = start + std::chrono::seconds(seconds);
+
+    while(steady::now() < end){
+        while(scheduler.queued() < SCHEDULER_DEPTH){
+            rfd900sim::artifact_message_t artmsg;
+            rfd900sim::simulate_artifact_message(&artmsg, SimConstants::BASE_STATION, SimConstants::AERIAL01);
+            rfd900sim::serialize_artifact_for_900MHz(&artmsg, serial_tx_buffer.data(), SERIAL_ARTIFACT_BUFFER_LENGTH);
+            scheduler.enqueue(rfd900comm::txPriority::HIGH, serial_tx_buffer.data(), SERIAL_ARTIFACT_BUFFER_LENGTH);
+        }
+
+        written += scheduler.service(tx_radio);
+
+        ssize_t queued = tx_radio.kernel_tx_queued();
+        max_kernel_queued = queued > max_kernel_queued ? queued : max_kernel_queued;
+
+        // zero after service() means the port itself is full
+        auto delay = scheduler.next_service_delay(&tx_radio);
+        if(delay == std::chrono::microseconds::zero()){
+            delay = std::chrono::microseconds(200);
+        }
+        std::this_thread::sleep_for(std::min(delay, std::chrono::microseconds(1000)));
+    }
+
+    // everything written gets its airtime, with flow control the pty still holds a backlog
+    uint64_t delivered = 0;
+    for(int i = 0; i < 120; ++i){
+        std::this_thread::sleep_for(std::chrono::milliseconds(500));
+        uint64_t now_delivered = emulator.get_stats().bytes_delivered;
+        if(now_delivered == delivered){
+            break;
+        }
+        delivered = now_delivered;
+    }
+
+    receiverRunning = false;
+    rx_thread.join();
+
+    rfd900comm::linkEmulatorStats stats = emulator.get_stats();
+    const char* label = mode == flowMode::NONE ? "none" : (mode == flowMode::RTS_CTS ? "rts/cts" : "occupancy");
+    double lost = written > 0 ? 100.0 * (written - std::min<uint64_t>(received, written)) / written : 0.0;
+
+    fprintf(stdout, "%10s %10lu %10lu %8.1f%% %12lu %10.1f %12ld\n", label, written, (uint64_t)received, lost,
+                stats.bytes_overflowed, (double)received / std::chrono::duration<double>(steady::now() - start).count(), max_kernel_queued);
+    return 0;
+}
+
+
+int main(int argc, char **argv)
+{
+    int seconds = 5;
+    rfd900comm::linkEmulatorConfig config;
+    config.latency = std::chrono::milliseconds(20);
+    config.modem_buffer_bytes = rfd900comm::rfd900Modem::DEFAULT_MODEM_BUFFER_BYTES;
+
+    if(argc > 1){
+        seconds = atoi(argv[1]);
+    }
+    if(argc > 2){
+        config.modem_buffer_bytes = atoi(argv[2]);
+    }
+
+    fprintf(stdout, "air rate: %u bytes/s, modem buffer: %lu bytes, %d s of saturation per mode\n\n",
+                config.air_bytes_per_sec, config.modem_buffer_bytes, seconds);
+    fprintf(stdout, "%10s %10s %10s %9s %12s %10s %12s\n",
+                "flow", "written", "received", "lost", "overflowed", "msgs/s", "max TIOCOUTQ");
+
+    if(run_mode(flowMode::NONE, config, seconds) != 0
+            || run_mode(flowMode::RTS_CTS, config, seconds) != 0
+            || run_mode(flowMode::OCCUPANCY, config, seconds) != 0){
+        return 1;
+    }
+
+    return 0;
+}
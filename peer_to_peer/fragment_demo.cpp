@@ -0,0 +1,241 @@
+/**
+ * Purpose:
+ *  Transfer a large payload with fragmentSender and fragmentReassembler while
+ *  artifact reports and their ACKs share the link.
+ *
+ *  Two radios are connected through a linkEmulator with latency and loss.
+ *  GROUND01 sends a binary tile to BASE_STATION and an artifact report every
+ *  artifact interval. BASE_STATION queues ACKs and fragment status at
+ *  CONTROL priority.
+ *
+ *  The run is repeated with an unpaced scheduler, which writes the whole
+ *  transfer into the serial buffers at once, and with a paced scheduler.
+ *  For each the program reports the transfer time, repaired fragments and
+ *  the artifact ACK round trip times seen during the transfer.
+ *
+ * Optional Command line arguments
+ *  argv[1] - payload bytes
+ *  argv[2] - one way latency, milliseconds
+ *  argv[3] - loss probability per chunk
+ *  argv[4] - milliseconds between artifact reports
+ *
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>                  // atoi, atof
+#include <cstring>                  // memcmp, memcpy
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "fragmentation.h"
+#include "link_emulator.h"
+#include "rfd900_modem.h"
+#include "simulation_constants.h"
+#include "sim_artifact_message.h"
+#include "sim_random.h"
+#include "tx_scheduler.h"
+
+
+using rfd900sim::SimConstants;
+using steady = std::chrono::steady_clock;
+
+constexpr size_t SERIAL_RX_BUFFER_LENGTH = 256;
+constexpr long POLL_TIMEOUT = 500L;             // units, microseconds
+
+
+struct node_t{
+    rfd900comm::rfd900Modem radio;
+    rfd900comm::txScheduler scheduler;
+    std::string temp_rx_storage;
+
+    explicit node_t(size_t air_bytes_per_sec) : scheduler(air_bytes_per_sec) {}
+
+    // appends newly read bytes to temp_rx_storage
+    void poll()
+    {
+        uint8_t serial_rx_buffer[SERIAL_RX_BUFFER_LENGTH];
+        ssize_t bytesRead = radio.read_serial(serial_rx_buffer, SERIAL_RX_BUFFER_LENGTH, POLL_TIMEOUT);
+        if(bytesRead > 0){
+            temp_rx_storage.append((const char*)serial_rx_buffer, bytesRead);
+        }
+    }
+};
+
+
+static void summarize(const char* label, std::vector<double>& ms)
+{
+    if(ms.empty()){
+        fprintf(stdout, "    %-16s none\n", label);
+        return;
+    }
+
+    std::sort(ms.begin(), ms.end());
+    fprintf(stdout, "    %-16s n: %4lu  p50: %8.1f ms  p95: %8.1f ms  max: %8.1f ms\n",
+                label, ms.size(), ms[ms.size() / 2], ms[(ms.size() * 95) / 100], ms[ms.size() - 1]);
+}
+
+
+static int run(bool paced, const rfd900comm::linkEmulatorConfig& config,
+            const std::vector<uint8_t>& payload, int artifact_millis)
+{
+    const size_t SERIAL_ARTIFACT_BUFFER_LENGTH = sizeof(rfd900sim::artifact_message_t)
+                        + SimConstants::MESSAGE_900_START_INDICATOR_LENGTH
+                        + SimConstants::MESSAGE_900_END_INDICATOR_LENGTH;
+    const size_t SERIAL_ACK_BUFFER_LENGTH = sizeof(rfd900sim::ack_message_t)
+                        + SimConstants::MESSAGE_900_START_INDICATOR_LENGTH
+                        + SimConstants::MESSAGE_900_END_INDICATOR_LENGTH;
+    const size_t SERIAL_STATUS_BUFFER_LENGTH = sizeof(rfd900sim::fragment_status_message_t)
+                        + SimConstants::MESSAGE_900_START_INDICATOR_LENGTH
+                        + SimConstants::MESSAGE_900_END_INDICATOR_LENGTH;
+
+    size_t air_rate = paced ? config.air_bytes_per_sec : 0;
+    rfd900comm::linkEmulator emulator;
+    node_t ground(air_rate);
+    node_t base(air_rate);
+
+    if(emulator.start(config) != 0){
+        return -1;
+    }
+    if(ground.radio.init(emulator.port_name(0)) != 0 || base.radio.init(emulator.port_name(1)) != 0){
+        fprintf(stderr, "error, %s radio init failure\n", __func__);
+        return -1;
+    }
+
+    bool finished = false;
+    bool delivered = false;
+    bool intact = false;
+
+    rfd900sim::fragmentSender sender(SimConstants::GROUND01, ground.scheduler);
+    sender.set_completion([&](uint8_t, uint16_t, bool ok){
+        finished = true;
+        delivered = ok;
+    });
+
+    rfd900sim::fragmentReassembler reassembler(SimConstants::BASE_STATION,
+                [&](uint8_t, uint16_t, const uint8_t* data, size_t length){
+        intact = length == payload.size() && memcmp(data, payload.data(), length) == 0;
+    });
+
+    std::vector<uint8_t> serial_tx_buffer(std::max({SERIAL_ARTIFACT_BUFFER_LENGTH, SERIAL_ACK_BUFFER_LENGTH,
+                        SERIAL_STATUS_BUFFER_LENGTH}));
+    std::unordered_map<uint16_t, steady::time_point> artifact_sent;
+    std::vector<double> ack_ms;
+    std::string extracted_rx_data;
+
+    auto start = steady::now();
+    auto next_artifact = start;
+    if(sender.send(SimConstants::BASE_STATION, payload.data(), payload.size()) < 0){
+        return -1;
+    }
+
+    while(!finished && steady::now() - start < std::chrono::seconds(120)){
+
+        // artifact reports keep flowing during the transfer
+        if(steady::now() >= next_artifact){
+            rfd900sim::artifact_message_t artmsg;
+            rfd900sim::simulate_artifact_message(&artmsg, SimConstants::BASE_STATION, SimConstants::GROUND01);
+            rfd900sim::serialize_artifact_for_900MHz(&artmsg, serial_tx_buffer.data(), SERIAL_ARTIFACT_BUFFER_LENGTH);
+            ground.scheduler.enqueue(rfd900comm::txPriority::HIGH, serial_tx_buffer.data(), SERIAL_ARTIFACT_BUFFER_LENGTH);
+            artifact_sent[artmsg.msg_id] = steady::now();
+            next_artifact += std::chrono::milliseconds(artifact_millis);
+        }
+
+        ground.scheduler.service(ground.radio);
+        base.scheduler.service(base.radio);
+
+        /************* base station *************/
+        base.poll();
+        while(rfd900sim::extract_rx_message(base.temp_rx_storage, extracted_rx_data)){
+            rfd900sim::ack_message_t ackmsg;
+            int action = rfd900sim::process_rx_message(extracted_rx_data, &ackmsg, true);
+
+            if(action == SimConstants::SEND_ACK){
+                rfd900sim::serialize_acknowledgement_for_900MHz(&ackmsg, serial_tx_buffer.data(), SERIAL_ACK_BUFFER_LENGTH);
+                base.scheduler.enqueue(rfd900comm::txPriority::CONTROL, serial_tx_buffer.data(), SERIAL_ACK_BUFFER_LENGTH);
+            }
+            else if(action == SimConstants::FRAGMENTATION){
+                rfd900sim::fragment_status_message_t status;
+                if(reassembler.process_fragment(extracted_rx_data, &status) == SimConstants::SEND_FRAGMENT_STATUS){
+                    rfd900sim::serialize_fragment_status_for_900MHz(&status, serial_tx_buffer.data(), SERIAL_STATUS_BUFFER_LENGTH);
+                    base.scheduler.enqueue(rfd900comm::txPriority::CONTROL, serial_tx_buffer.data(), SERIAL_STATUS_BUFFER_LENGTH);
+                }
+            }
+        }
+
+        /************* ground robot *************/
+        ground.poll();
+        while(rfd900sim::extract_rx_message(ground.temp_rx_storage, extracted_rx_data)){
+            uint8_t msg_type = extracted_rx_data.length() > 2 ? extracted_rx_data[2] : 0xFF;
+
+            if(msg_type == SimConstants::ACK && extracted_rx_data.length() == sizeof(rfd900sim::ack_message_t)){
+                rfd900sim::ack_message_t ack;
+                memcpy(&ack, extracted_rx_data.data(), sizeof(ack));
+                auto it = artifact_sent.find(ack.msg_id);
+                if(it != artifact_sent.end()){
+                    ack_ms.push_back(std::chrono::duration<double, std::milli>(steady::now() - it->second).count());
+                    artifact_sent.erase(it);
+                }
+            }
+            else if(msg_type == SimConstants::FRAGMENT_STATUS
+                        && extracted_rx_data.length() == sizeof(rfd900sim::fragment_status_message_t)){
+                rfd900sim::fragment_status_message_t status;
+                rfd900sim::deserialize_fragment_status_for_900MHz(&status, (const uint8_t*)extracted_rx_data.data());
+                sender.process_status(&status);
+            }
+        }
+
+        sender.service();
+        reassembler.evict_expired();
+    }
+
+    double seconds = std::chrono::duration<double>(steady::now() - start).count();
+    fprintf(stdout, "%s scheduler: %s in %.2f s (%.0f B/s), fragments sent: %lu, repaired: %lu, artifacts unacked: %lu\n",
+                paced ? "paced  " : "unpaced", delivered && intact ? "delivered intact" : "FAILED",
+                seconds, payload.size() / seconds, sender.fragments_sent(), sender.fragments_repaired(), artifact_sent.size());
+    summarize("artifact ack rtt", ack_ms);
+
+    return delivered && intact ? 0 : -1;
+}
+
+
+int main(int argc, char **argv)
+{
+    size_t payloadLength = 24 * 1024;
+    int artifact_millis = 200;
+    rfd900comm::linkEmulatorConfig config;
+    config.latency = std::chrono::milliseconds(30);
+    config.loss_probability = 0.05;
+
+    if(argc > 1){
+        payloadLength = atoi(argv[1]);
+    }
+    if(argc > 2){
+        config.latency = std::chrono::milliseconds(atoi(argv[2]));
+    }
+    if(argc > 3){
+        config.loss_probability = atof(argv[3]);
+    }
+    if(argc > 4){
+        artifact_millis = atoi(argv[4]);
+    }
+
+    // incompressible stand in for an image or occupancy grid tile
+    std::vector<uint8_t> payload(payloadLength);
+    for(uint8_t& b : payload){
+        b = static_cast<uint8_t>(rfd900sim::sim_random().next());
+    }
+
+    fprintf(stdout, "payload: %lu bytes in %lu fragments, one way latency: %ld ms, loss: %.2f\n",
+                payloadLength, (payloadLength + rfd900sim::FRAGMENT_PAYLOAD_LENGTH - 1) / rfd900sim::FRAGMENT_PAYLOAD_LENGTH,
+                (long)std::chrono::duration_cast<std::chrono::milliseconds>(config.latency).count(),
+                config.loss_probability);
+
+    int result = run(false, config, payload, artifact_millis);
+    if(run(true, config, payload, artifact_millis) != 0){
+        result = -1;
+    }
+
+    return result == 0 ? 0 : 1;
+}
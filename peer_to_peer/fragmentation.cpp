@@ -0,0 +1,523 @@
+/**
+ * @brief fragmentSender and fragmentReassembler function definitions.
+ *
+ */
+
+#include <algorithm>                // std::min
+#include <cstdio>
+#include <cstring>                  // memset, memcpy
+
+#include "fragmentation.h"
+#include "link_stats.h"
+#include "sim_artifact_message.h"
+#include "simulation_constants.h"
+#include "virtual_clock.h"
+
+
+namespace rfd900sim
+{
+    // one entry per byte value, a byte at a time instead of eight data dependent branches per byte
+    struct crc16Table{
+        uint16_t entry[256];
+
+        constexpr crc16Table() : entry()
+        {
+            for(int b = 0; b < 256; ++b){
+                uint16_t crc = static_cast<uint16_t>(b << 8);
+                for(int bit = 0; bit < 8; ++bit){
+                    crc = (crc & 0x8000) ? static_cast<uint16_t>((crc << 1) ^ 0x1021) : static_cast<uint16_t>(crc << 1);
+                }
+                entry[b] = crc;
+            }
+        }
+    };
+
+    static constexpr crc16Table crcTable;
+
+
+    uint16_t crc16_ccitt(const uint8_t* data, size_t length, uint16_t crc)
+    {
+        for(size_t i = 0; i < length; ++i){
+            crc = static_cast<uint16_t>((crc << 8) ^ crcTable.entry[(crc >> 8) ^ data[i]]);
+        }
+        return crc;
+    }
+
+
+    // seed 0 leaves the payload unchanged, the keystream is its own inverse
+    static void whiten_payload(uint8_t* payload, size_t length, uint8_t seed)
+    {
+        if(seed == 0){
+            return;
+        }
+
+        uint32_t state = (seed + 1U) * 2654435761U;
+        for(size_t i = 0; i < length; ++i){
+            state = state * 1103515245U + 12345U;
+            payload[i] ^= static_cast<uint8_t>(state >> 24);
+        }
+    }
+
+
+    size_t serialize_fragment_for_900MHz(const fragment_message_t* frag, uint8_t *serial_buffer, size_t serial_buffer_length)
+    {
+        size_t msg_length = FRAGMENT_HEADER_LENGTH + frag->payload_length;
+        size_t framed_length = msg_length + SimConstants::MESSAGE_900_START_INDICATOR_LENGTH
+                    + SimConstants::MESSAGE_900_END_INDICATOR_LENGTH;
+
+        if(frag->payload_length > FRAGMENT_PAYLOAD_LENGTH || framed_length > serial_buffer_length){
+            fprintf(stderr, "error, %s, fragment of %lu bytes does not fit %lu byte buffer\n",
+                        __func__, framed_length, serial_buffer_length);
+            return 0;
+        }
+
+        frame_for_900MHz(frag, msg_length, serial_buffer, framed_length);
+        return framed_length;
+    }
+
+
+    void serialize_fragment_status_for_900MHz(const fragment_status_message_t* status, uint8_t *serial_buffer, size_t serial_buffer_length)
+    {
+        frame_for_900MHz(status, sizeof(fragment_status_message_t), serial_buffer, serial_buffer_length);
+    }
+
+
+    void deserialize_fragment_status_for_900MHz(fragment_status_message_t* status, const uint8_t *serial_buffer)
+    {
+        memcpy(status, serial_buffer, sizeof(fragment_status_message_t));
+    }
+
+
+
+    /**************** SENDER ********************/
+    fragmentSender::fragmentSender(uint8_t my_id, rfd900comm::txScheduler& scheduler,
+                std::chrono::milliseconds poll_timeout, int max_polls) :
+        myId(my_id), scheduler(scheduler), pollTimeout(poll_timeout), maxPolls(max_polls),
+        nextTransferId(0), fragmentsSent(0), fragmentsRepaired(0)
+    {
+        // intentionally blank
+    }
+
+
+    int fragmentSender::send(uint8_t dest_id, const uint8_t* data, size_t length)
+    {
+        size_t count = (length + FRAGMENT_PAYLOAD_LENGTH - 1) / FRAGMENT_PAYLOAD_LENGTH;
+        if(length == 0 || count > UINT16_MAX){
+            fprintf(stderr, "error, %s, cannot fragment %lu bytes\n", __func__, length);
+            return -1;
+        }
+
+        uint16_t id = nextTransferId++;
+        auto inserted = transfers.try_emplace(transfer_key(dest_id, id));
+        if(!inserted.second){
+            fprintf(stderr, "error, %s, transfer %hu to %hhu still active\n", __func__, id, dest_id);
+            return -1;
+        }
+
+        transfer_t* t = &inserted.first->second;
+        t->dest_id = dest_id;
+        t->transfer_id = id;
+        t->data.assign(data, data + length);
+        t->fragment_count = static_cast<uint16_t>(count);
+        t->pass = 0;
+        t->polls = 0;
+
+        for(uint16_t i = 0; i < t->fragment_count; ++i){
+            queue_fragment(t, i, i == t->fragment_count - 1);
+        }
+
+        return id;
+    }
+
+
+    void fragmentSender::queue_fragment(transfer_t* t, uint16_t index, bool poll)
+    {
+        fragment_message_t frag;
+        uint8_t serial_buffer[SERIAL_FRAGMENT_BUFFER_LENGTH];
+        size_t offset = static_cast<size_t>(index) * FRAGMENT_PAYLOAD_LENGTH;
+        size_t framed_length = 0;
+
+        memset(&frag, 0, sizeof(frag));
+        frag.dest_id = t->dest_id;
+        frag.src_id = myId;
+        frag.msg_type = SimConstants::FRAGMENT;
+        frag.msg_id = t->transfer_id;
+        frag.flags = poll ? FRAGMENT_FLAG_POLL : 0;
+        frag.pass = t->pass;
+        frag.fragment_index = index;
+        frag.fragment_count = t->fragment_count;
+        frag.total_length = static_cast<uint32_t>(t->data.size());
+        frag.payload_length = static_cast<uint8_t>(std::min(FRAGMENT_PAYLOAD_LENGTH, t->data.size() - offset));
+
+        // first keystream that keeps the indicators out of the frame, nearly always seed 0
+        for(int seed = 0; seed <= UINT8_MAX; ++seed){
+            frag.whitening = static_cast<uint8_t>(seed);
+            memcpy(frag.payload, &t->data[offset], frag.payload_length);
+            whiten_payload(frag.payload, frag.payload_length, frag.whitening);
+
+            frag.crc = 0;
+            frag.crc = crc16_ccitt((const uint8_t*)&frag, FRAGMENT_HEADER_LENGTH + frag.payload_length);
+
+            framed_length = serialize_fragment_for_900MHz(&frag, serial_buffer, sizeof(serial_buffer));
+            if(framed_length == 0 || frame_is_clean(serial_buffer, framed_length)){
+                break;
+            }
+        }
+
+        uint64_t ticket = scheduler.enqueue(rfd900comm::txPriority::BULK, serial_buffer, framed_length);
+        ++fragmentsSent;
+
+        if(poll){
+            t->poll_index = index;
+            t->poll_ticket = ticket;
+            t->poll_on_air = false;
+        }
+    }
+
+
+    void fragmentSender::process_status(const fragment_status_message_t* status)
+    {
+        if(status->dest_id != myId){
+            return;
+        }
+
+        auto it = transfers.find(transfer_key(status->src_id, status->msg_id));
+        if(it == transfers.end()){
+            return;
+        }
+
+        transfer_t* t = &it->second;
+        if(status->pass != t->pass){
+            rfd900comm::linkStats::add(rfd900comm::link_stats().dedup_hits);
+            return;                                     // answer to an earlier poll of this pass
+        }
+
+        if(status->result == FRAGMENT_COMPLETE){
+            finish(it, true);
+            return;
+        }
+        if(status->result == FRAGMENT_REFUSED){
+            fprintf(stderr, "warning, %s, node %hhu refused transfer %hu\n", __func__, status->src_id, status->msg_id);
+            finish(it, false);
+            return;
+        }
+
+        // selective repeat of the fragments the bitmap reports missing
+        std::vector<uint16_t> missing;
+        for(size_t i = 0; i < FRAGMENT_STATUS_WINDOW; ++i){
+            size_t index = status->base_index + i;
+            if(index >= t->fragment_count){
+                break;
+            }
+            if(!(status->bitmap[i / 8] & (1 << (i % 8)))){
+                missing.push_back(static_cast<uint16_t>(index));
+            }
+        }
+
+        if(missing.empty()){
+            fprintf(stderr, "warning, %s, status without missing fragments for transfer %hu\n", __func__, t->transfer_id);
+            return;
+        }
+
+        ++t->pass;
+        t->polls = 0;
+        for(size_t i = 0; i < missing.size(); ++i){
+            queue_fragment(t, missing[i], i == missing.size() - 1);
+        }
+        fragmentsRepaired += missing.size();
+    }
+
+
+    void fragmentSender::service()
+    {
+        steady::time_point now = rfd900comm::clock_now();
+
+        for(auto it = transfers.begin(); it != transfers.end();){
+            transfer_t* t = &it->second;
+
+            // the poll timer starts once the POLL fragment has left the scheduler
+            if(!t->poll_on_air){
+                if(scheduler.sent(rfd900comm::txPriority::BULK, t->poll_ticket)){
+                    t->poll_on_air = true;
+                    t->poll_sent = now;
+                }
+                ++it;
+                continue;
+            }
+
+            if(now - t->poll_sent < pollTimeout){
+                ++it;
+                continue;
+            }
+
+            if(t->polls >= maxPolls){
+                fprintf(stderr, "warning, %s, transfer %hu to %hhu unanswered after %d polls\n",
+                            __func__, t->transfer_id, t->dest_id, t->polls);
+                auto expired = it++;
+                finish(expired, false);
+                continue;
+            }
+
+            ++t->polls;
+            rfd900comm::linkStats::add(rfd900comm::link_stats().retransmits);
+            queue_fragment(t, t->poll_index, true);
+            ++it;
+        }
+    }
+
+
+    void fragmentSender::finish(std::unordered_map<uint32_t, transfer_t>::iterator it, bool delivered)
+    {
+        uint8_t dest_id = it->second.dest_id;
+        uint16_t transfer_id = it->second.transfer_id;
+
+        transfers.erase(it);
+        if(completion){
+            completion(dest_id, transfer_id, delivered);
+        }
+    }
+
+
+
+    /**************** RECEIVER ********************/
+    fragmentReassembler::fragmentReassembler(uint8_t my_id, delivery_function deliver,
+                size_t max_transfers, size_t max_transfer_length, std::chrono::milliseconds timeout) :
+        myId(my_id), deliver(std::move(deliver)), maxTransferLength(max_transfer_length),
+        bitmapLength((max_transfer_length / FRAGMENT_PAYLOAD_LENGTH + 1 + 7) / 8), timeout(timeout),
+        storage(max_transfers * max_transfer_length), bitmaps(max_transfers * bitmapLength),
+        slots(max_transfers), nextCompleted(0), evictionCount(0), refusedCount(0)
+    {
+        for(size_t i = 0; i < slots.size(); ++i){
+            slots[i].in_use = false;
+            slots[i].buffer = &storage[i * maxTransferLength];
+            slots[i].bitmap = &bitmaps[i * bitmapLength];
+        }
+        memset(completed, 0, sizeof(completed));
+    }
+
+
+    int fragmentReassembler::process_fragment(const std::string& rx_string, fragment_status_message_t* status)
+    {
+        fragment_message_t frag;
+
+        if(rx_string.length() < FRAGMENT_HEADER_LENGTH || rx_string.length() > sizeof(fragment_message_t)){
+            rfd900comm::linkStats::add(rfd900comm::link_stats().crc_failures);
+            return -1;
+        }
+
+        memset(&frag, 0, sizeof(frag));
+        memcpy(&frag, rx_string.data(), rx_string.length());
+
+        uint16_t crc = frag.crc;
+        frag.crc = 0;
+        if(frag.payload_length != rx_string.length() - FRAGMENT_HEADER_LENGTH
+                || crc16_ccitt((const uint8_t*)&frag, rx_string.length()) != crc){
+            rfd900comm::linkStats::add(rfd900comm::link_stats().crc_failures);
+            return -1;
+        }
+
+        if(frag.dest_id != myId){
+            return 0;
+        }
+
+        // every fragment but the last is full, so the count follows from the length and no fragment ends past it
+        size_t offset = static_cast<size_t>(frag.fragment_index) * FRAGMENT_PAYLOAD_LENGTH;
+        size_t expected_length = frag.fragment_index + 1 < frag.fragment_count
+                    ? FRAGMENT_PAYLOAD_LENGTH : frag.total_length - offset;
+        if(frag.fragment_index >= frag.fragment_count
+                || frag.fragment_count != (frag.total_length + FRAGMENT_PAYLOAD_LENGTH - 1) / FRAGMENT_PAYLOAD_LENGTH
+                || offset >= frag.total_length || frag.payload_length != expected_length){
+            fprintf(stderr, "error, %s, inconsistent fragment %hu/%hu of transfer %hu\n",
+                        __func__, frag.fragment_index, frag.fragment_count, frag.msg_id);
+            return -1;
+        }
+
+        bool poll = frag.flags & FRAGMENT_FLAG_POLL;
+
+        // a repeat of a finished transfer, its sender missed the final status
+        const completed_t* done = find_completed(frag.src_id, frag.msg_id);
+        if(done != nullptr && done->fragment_count == frag.fragment_count){
+            rfd900comm::linkStats::add(rfd900comm::link_stats().dedup_hits);
+            if(poll){
+                fill_status(nullptr, &frag, status);
+                status->result = FRAGMENT_COMPLETE;
+                return SimConstants::SEND_FRAGMENT_STATUS;
+            }
+            return 0;
+        }
+
+        slot_t* slot = find_slot(frag.src_id, frag.msg_id);
+        if(slot != nullptr && (slot->total_length != frag.total_length || slot->fragment_count != frag.fragment_count)){
+            // the sender reused the transfer id, the old transfer is abandoned
+            slot->in_use = false;
+            slot = nullptr;
+        }
+
+        if(slot == nullptr){
+            if(frag.total_length > maxTransferLength){
+                ++refusedCount;
+                if(poll){
+                    fill_status(nullptr, &frag, status);
+                    status->result = FRAGMENT_REFUSED;
+                    return SimConstants::SEND_FRAGMENT_STATUS;
+                }
+                return -1;
+            }
+
+            slot = allocate_slot();
+            if(slot == nullptr){
+                ++refusedCount;                         // table full, the sender polls again
+                return -1;
+            }
+
+            slot->in_use = true;
+            slot->src_id = frag.src_id;
+            slot->transfer_id = frag.msg_id;
+            slot->total_length = frag.total_length;
+            slot->fragment_count = frag.fragment_count;
+            slot->received = 0;
+            memset(slot->bitmap, 0, bitmapLength);
+        }
+
+        slot->last_activity = rfd900comm::clock_now();
+
+        uint8_t mask = static_cast<uint8_t>(1 << (frag.fragment_index % 8));
+        if(slot->bitmap[frag.fragment_index / 8] & mask){
+            rfd900comm::linkStats::add(rfd900comm::link_stats().dedup_hits);
+        }
+        else{
+            whiten_payload(frag.payload, frag.payload_length, frag.whitening);
+            memcpy(slot->buffer + offset, frag.payload, frag.payload_length);
+            slot->bitmap[frag.fragment_index / 8] |= mask;
+            ++slot->received;
+        }
+
+        if(slot->received == slot->fragment_count){
+            completed_t* c = &completed[nextCompleted];
+            nextCompleted = (nextCompleted + 1) % COMPLETED_HISTORY;
+            c->valid = true;
+            c->src_id = slot->src_id;
+            c->transfer_id = slot->transfer_id;
+            c->fragment_count = slot->fragment_count;
+
+            slot->in_use = false;
+            if(deliver){
+                deliver(slot->src_id, slot->transfer_id, slot->buffer, slot->total_length);
+            }
+
+            if(poll){
+                fill_status(nullptr, &frag, status);
+                status->result = FRAGMENT_COMPLETE;
+                return SimConstants::SEND_FRAGMENT_STATUS;
+            }
+            return 0;
+        }
+
+        if(poll){
+            fill_status(slot, &frag, status);
+            return SimConstants::SEND_FRAGMENT_STATUS;
+        }
+        return 0;
+    }
+
+
+    // slot is nullptr for complete and refused transfers, which carry no bitmap
+    void fragmentReassembler::fill_status(const slot_t* slot, const fragment_message_t* frag, fragment_status_message_t* status) const
+    {
+        memset(status, 0, sizeof(fragment_status_message_t));
+        status->dest_id = frag->src_id;
+        status->src_id = myId;
+        status->msg_type = SimConstants::FRAGMENT_STATUS;
+        status->msg_id = frag->msg_id;
+        status->pass = frag->pass;
+        status->fragment_count = frag->fragment_count;
+        status->base_index = frag->fragment_count;
+
+        if(slot == nullptr){
+            return;
+        }
+
+        status->result = FRAGMENT_IN_PROGRESS;
+
+        uint16_t base = 0;
+        while(base < slot->fragment_count && (slot->bitmap[base / 8] & (1 << (base % 8)))){
+            ++base;
+        }
+        status->base_index = base;
+
+        for(size_t i = 0; i < FRAGMENT_STATUS_WINDOW && base + i < slot->fragment_count; ++i){
+            size_t index = base + i;
+            if(slot->bitmap[index / 8] & (1 << (index % 8))){
+                status->bitmap[i / 8] |= static_cast<uint8_t>(1 << (i % 8));
+            }
+        }
+    }
+
+
+    fragmentReassembler::slot_t* fragmentReassembler::find_slot(uint8_t src_id, uint16_t transfer_id)
+    {
+        for(slot_t& slot : slots){
+            if(slot.in_use && slot.src_id == src_id && slot.transfer_id == transfer_id){
+                return &slot;
+            }
+        }
+        return nullptr;
+    }
+
+
+    fragmentReassembler::slot_t* fragmentReassembler::allocate_slot()
+    {
+        for(int attempt = 0; attempt < 2; ++attempt){
+            for(slot_t& slot : slots){
+                if(!slot.in_use){
+                    return &slot;
+                }
+            }
+            if(evict_expired() == 0){
+                break;
+            }
+        }
+        return nullptr;
+    }
+
+
+    const fragmentReassembler::completed_t* fragmentReassembler::find_completed(uint8_t src_id, uint16_t transfer_id) const
+    {
+        for(const completed_t& c : completed){
+            if(c.valid && c.src_id == src_id && c.transfer_id == transfer_id){
+                return &c;
+            }
+        }
+        return nullptr;
+    }
+
+
+    size_t fragmentReassembler::evict_expired()
+    {
+        steady::time_point now = rfd900comm::clock_now();
+        size_t evicted = 0;
+
+        for(slot_t& slot : slots){
+            if(slot.in_use && now - slot.last_activity > timeout){
+                fprintf(stderr, "warning, %s, transfer %hu from %hhu timed out with %hu of %hu fragments\n",
+                            __func__, slot.transfer_id, slot.src_id, slot.received, slot.fragment_count);
+                slot.in_use = false;
+                ++evicted;
+            }
+        }
+
+        evictionCount += evicted;
+        return evicted;
+    }
+
+
+    size_t fragmentReassembler::active() const
+    {
+        size_t count = 0;
+        for(const slot_t& slot : slots){
+            count += slot.in_use ? 1 : 0;
+        }
+        return count;
+    }
+
+}
@@ -0,0 +1,258 @@
+/**
+ * @brief Declares fragmentation and reassembly of payloads larger than one radio frame
+ *
+ * Occupancy grid tiles and thumbnails are tens of KB, one frame carries
+ * FRAGMENT_PAYLOAD_LENGTH bytes. A transfer is split into numbered fragments,
+ * each carrying its index, the fragment count, the total length and a CRC16
+ * over the fragment.
+ *
+ * Selective repeat:
+ *      the sender queues every fragment at BULK priority, the last one of the
+ *      pass is flagged POLL
+ *      the receiver answers a POLL fragment with a FRAGMENT_STATUS: the index
+ *      of the first missing fragment and a bitmap of the fragments received
+ *      after it (STATUS_WINDOW fragments)
+ *      the sender queues only the missing fragments as the next pass
+ *      a POLL with no status after poll_timeout is sent again
+ *
+ * The receiver reassembles into buffers preallocated at construction:
+ * max_transfers slots of max_transfer_length bytes. A transfer with no
+ * fragment for the reassembly timeout is evicted. A new transfer that finds
+ * no free slot is refused, its sender polls again later.
+ *
+ * Fragments go through a txScheduler, ACKs and status messages queued at
+ * CONTROL priority are written ahead of any queued fragment.
+ *
+ * Frames are delimited by text indicators, binary payloads can contain the
+ * end indicator. The payload of each fragment is whitened with one of 256
+ * keystreams, the sender picks the first whose frame holds no indicator.
+ *
+ */
+
+#ifndef FRAGMENTATION_INCLUDED_H
+#define FRAGMENTATION_INCLUDED_H
+
+#include <chrono>
+#include <cstddef>                  // offsetof
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "tx_scheduler.h"
+
+
+namespace rfd900sim
+{
+    constexpr size_t FRAGMENT_PAYLOAD_LENGTH = 192;
+    constexpr size_t FRAGMENT_STATUS_WINDOW = 256;                  // fragments covered by one status bitmap
+
+    constexpr uint8_t FRAGMENT_FLAG_POLL = 0x01;                    // receiver answers with a status
+
+    // status result
+    constexpr uint8_t FRAGMENT_IN_PROGRESS = 0;
+    constexpr uint8_t FRAGMENT_COMPLETE = 1;
+    constexpr uint8_t FRAGMENT_REFUSED = 2;                         // larger than the reassembly buffers
+
+
+    // only the header and payload_length bytes of payload are transmitted
+    struct fragment_message_t{
+        uint8_t dest_id;
+        uint8_t src_id;
+        uint8_t msg_type;
+        uint16_t msg_id;                    // transfer id
+        uint8_t flags;
+        uint8_t pass;                       // repair pass, echoed by the status
+        uint8_t whitening;                  // payload keystream seed
+        uint16_t fragment_index;
+        uint16_t fragment_count;
+        uint32_t total_length;
+        uint16_t crc;                       // CRC16 of the transmitted bytes with crc zero
+        uint8_t payload_length;
+        uint8_t payload[FRAGMENT_PAYLOAD_LENGTH];
+    };
+
+    constexpr size_t FRAGMENT_HEADER_LENGTH = offsetof(fragment_message_t, payload);
+
+
+    struct fragment_status_message_t{
+        uint8_t dest_id;
+        uint8_t src_id;
+        uint8_t msg_type;
+        uint16_t msg_id;                    // transfer id
+        uint8_t result;
+        uint8_t pass;
+        uint16_t base_index;                // first missing fragment, fragment_count when complete
+        uint16_t fragment_count;
+        uint8_t bitmap[FRAGMENT_STATUS_WINDOW / 8];     // bit i set, base_index + i received
+    };
+
+
+    // CRC-16/CCITT-FALSE
+    uint16_t crc16_ccitt(const uint8_t* data, size_t length, uint16_t crc = 0xFFFF);
+
+    // returns the framed length, 0 when serial_buffer_length is too short
+    size_t serialize_fragment_for_900MHz(const fragment_message_t* frag, uint8_t *serial_buffer, size_t serial_buffer_length);
+    void serialize_fragment_status_for_900MHz(const fragment_status_message_t* status, uint8_t *serial_buffer, size_t serial_buffer_length);
+    void deserialize_fragment_status_for_900MHz(fragment_status_message_t* status, const uint8_t *serial_buffer);
+
+    constexpr size_t SERIAL_FRAGMENT_BUFFER_LENGTH = sizeof(fragment_message_t) + 6;      // plus start and end indicators
+
+
+    class fragmentSender{
+
+        public:
+
+        // delivered is false when the receiver refused the transfer or stopped answering polls
+        using completion_function = std::function<void(uint8_t dest_id, uint16_t transfer_id, bool delivered)>;
+
+        static constexpr int DEFAULT_MAX_POLLS = 8;
+
+        fragmentSender(uint8_t my_id, rfd900comm::txScheduler& scheduler,
+                    std::chrono::milliseconds poll_timeout = std::chrono::seconds(1),
+                    int max_polls = DEFAULT_MAX_POLLS);
+
+        // disable copy constructor
+        fragmentSender(const fragmentSender&) = delete;
+
+        // disable assignment
+        fragmentSender& operator=(const fragmentSender&) = delete;
+
+        void set_completion(completion_function done) { completion = std::move(done); }
+
+        // copies the data and queues every fragment, returns the transfer id or -1
+        int send(uint8_t dest_id, const uint8_t* data, size_t length);
+
+        void process_status(const fragment_status_message_t* status);
+
+        // resends POLL fragments that were not answered in time
+        void service();
+
+        size_t active() const { return transfers.size(); }
+        uint64_t fragments_sent() const { return fragmentsSent; }
+        uint64_t fragments_repaired() const { return fragmentsRepaired; }
+
+
+        private:
+
+        using steady = std::chrono::steady_clock;
+
+        struct transfer_t{
+            uint8_t dest_id;
+            uint16_t transfer_id;
+            std::vector<uint8_t> data;
+            uint16_t fragment_count;
+            uint8_t pass;
+            uint16_t poll_index;
+            uint64_t poll_ticket;               // txScheduler ticket of the POLL fragment
+            bool poll_on_air;
+            steady::time_point poll_sent;
+            int polls;
+        };
+
+        uint8_t myId;
+        rfd900comm::txScheduler& scheduler;
+        std::chrono::milliseconds pollTimeout;
+        int maxPolls;
+        uint16_t nextTransferId;
+        completion_function completion;
+
+        std::unordered_map<uint32_t, transfer_t> transfers;
+
+        uint64_t fragmentsSent;
+        uint64_t fragmentsRepaired;
+
+        static uint32_t transfer_key(uint8_t node_id, uint16_t transfer_id) { return (uint32_t(node_id) << 16) | transfer_id; }
+
+        void queue_fragment(transfer_t* t, uint16_t index, bool poll);
+        void finish(std::unordered_map<uint32_t, transfer_t>::iterator it, bool delivered);
+    };
+
+
+    class fragmentReassembler{
+
+        public:
+
+        // data points into the reassembly buffer, valid only during the call
+        using delivery_function = std::function<void(uint8_t src_id, uint16_t transfer_id, const uint8_t* data, size_t length)>;
+
+        static constexpr size_t DEFAULT_MAX_TRANSFERS = 4;
+        static constexpr size_t DEFAULT_MAX_TRANSFER_LENGTH = 64 * 1024;
+        static constexpr size_t COMPLETED_HISTORY = 16;             // finished transfers still answered
+
+        fragmentReassembler(uint8_t my_id, delivery_function deliver,
+                    size_t max_transfers = DEFAULT_MAX_TRANSFERS,
+                    size_t max_transfer_length = DEFAULT_MAX_TRANSFER_LENGTH,
+                    std::chrono::milliseconds timeout = std::chrono::seconds(10));
+
+        // disable copy constructor
+        fragmentReassembler(const fragmentReassembler&) = delete;
+
+        // disable assignment
+        fragmentReassembler& operator=(const fragmentReassembler&) = delete;
+
+        /**
+         * rx_string is an extracted FRAGMENT message.
+         * returns SimConstants::SEND_FRAGMENT_STATUS with status filled when the fragment polls,
+         * 0 when there is nothing to send and -1 for a corrupt or refused fragment
+         */
+        int process_fragment(const std::string& rx_string, fragment_status_message_t* status);
+
+        // frees slots of transfers idle longer than the timeout, returns the number evicted
+        size_t evict_expired();
+
+        size_t active() const;
+        uint64_t evictions() const { return evictionCount; }
+        uint64_t refused() const { return refusedCount; }
+
+
+        private:
+
+        using steady = std::chrono::steady_clock;
+
+        struct slot_t{
+            bool in_use;
+            uint8_t src_id;
+            uint16_t transfer_id;
+            uint32_t total_length;
+            uint16_t fragment_count;
+            uint16_t received;
+            steady::time_point last_activity;
+            uint8_t* buffer;                    // into storage
+            uint8_t* bitmap;                    // into bitmaps
+        };
+
+        struct completed_t{
+            bool valid;
+            uint8_t src_id;
+            uint16_t transfer_id;
+            uint16_t fragment_count;
+        };
+
+        uint8_t myId;
+        delivery_function deliver;
+        size_t maxTransferLength;
+        size_t bitmapLength;
+        std::chrono::milliseconds timeout;
+
+        std::vector<uint8_t> storage;
+        std::vector<uint8_t> bitmaps;
+        std::vector<slot_t> slots;
+
+        completed_t completed[COMPLETED_HISTORY];
+        size_t nextCompleted;
+
+        uint64_t evictionCount;
+        uint64_t refusedCount;
+
+        slot_t* find_slot(uint8_t src_id, uint16_t transfer_id);
+        slot_t* allocate_slot();
+        const completed_t* find_completed(uint8_t src_id, uint16_t transfer_id) const;
+        void fill_status(const slot_t* slot, const fragment_message_t* frag, fragment_status_message_t* status) const;
+    };
+
+}
+
+
+#endif
@@ -0,0 +1,259 @@
+/**
+ * Purpose:
+ *  Measure udpGateway throughput on localhost with the linkEmulator as the
+ *  radio.
+ *
+ *  Two gateways, AERIAL01 and BASE_STATION, run on the two ends of an
+ *  emulated link, each on its own thread. A sender socket offers datagrams
+ *  to the AERIAL01 gateway's BASE_STATION port at a fixed rate, the
+ *  BASE_STATION gateway delivers them to a receiver socket. For each
+ *  datagram size, with and without aggregation, the program reports
+ *
+ *      the offered and delivered datagram rates and payload bytes/s
+ *      payload bytes per radio byte
+ *      datagrams per radio frame, per recvmmsg and per sendmmsg call
+ *      mean latency from the sender's sendto to the receiver
+ *
+ *  at the RFD900x default air rate, where the radio is the limit, and at a
+ *  high emulated rate, where the gateway and the pty are.
+ *
+ * Optional Command line arguments
+ *  argv[1] - seconds per run
+ *  argv[2] - offered load, times the radio's capacity for unaggregated datagrams
+ *
+ */
+
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>                  // atof, strtoll
+#include <cstring>                  // memset
+#include <thread>
+
+#include "link_emulator.h"
+#include "rfd900_modem.h"
+#include "simulation_constants.h"
+#include "udp_gateway.h"
+
+
+using rfd900sim::SimConstants;
+using steady = std::chrono::steady_clock;
+
+constexpr uint16_t SENDER_GATEWAY_BASE = 15000;
+constexpr uint16_t RECEIVER_GATEWAY_BASE = 16000;
+constexpr uint16_t DELIVER_BASE = 17000;
+constexpr size_t FRAME_OVERHEAD = 6 + rfd900comm::GATEWAY_HEADER_LENGTH + 1;    // indicators, header, record length
+
+static std::atomic<bool> running;
+
+struct receiver_stats_t{
+    std::atomic<uint64_t> datagrams;
+    std::atomic<uint64_t> bytes;
+    std::atomic<uint64_t> latency_sum_us;
+};
+
+
+static int64_t now_us()
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(steady::now().time_since_epoch()).count();
+}
+
+
+static void gateway_thread(rfd900comm::udpGateway* gateway)
+{
+    while(running){
+        gateway->service(10000L);
+    }
+}
+
+
+static void receiver_thread(int fd, receiver_stats_t* stats)
+{
+    constexpr size_t BATCH = 32;
+    struct mmsghdr msgs[BATCH];
+    struct iovec iov[BATCH];
+    char buffers[BATCH][rfd900comm::GATEWAY_MAX_DATAGRAM_LENGTH + 1];
+
+    for(size_t i = 0; i < BATCH; ++i){
+        iov[i].iov_base = buffers[i];
+        iov[i].iov_len = rfd900comm::GATEWAY_MAX_DATAGRAM_LENGTH;
+        memset(&msgs[i], 0, sizeof(msgs[i]));
+        msgs[i].msg_hdr.msg_iov = &iov[i];
+        msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+
+    struct timeval tv = {0, 10000};
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+
+    while(running){
+        int n = recvmmsg(fd, msgs, BATCH, MSG_WAITFORONE, nullptr);
+        int64_t now = now_us();
+        for(int i = 0; i < n; ++i){
+            buffers[i][msgs[i].msg_len] = '\0';
+            ++stats->datagrams;
+            stats->bytes += msgs[i].msg_len;
+            stats->latency_sum_us += now - strtoll(buffers[i], nullptr, 10);
+        }
+    }
+}
+
+
+static int udp_socket(uint16_t port)
+{
+    int fd = socket(AF_INET, SOCK_DGRAM, 0);
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons(port);
+    if(fd < 0 || bind(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0){
+        fprintf(stderr, "error, %s, socket on port %u\n", __func__, port);
+        return -1;
+    }
+    return fd;
+}
+
+
+static int run(uint32_t air_bytes_per_sec, size_t datagram_length, bool aggregate, double seconds, double load)
+{
+    rfd900comm::linkEmulator emulator;
+    rfd900comm::linkEmulatorConfig emuConfig;
+    emuConfig.air_bytes_per_sec = air_bytes_per_sec;
+    emuConfig.latency = std::chrono::milliseconds(20);
+
+    rfd900comm::rfd900Modem sender_radio;
+    rfd900comm::rfd900Modem receiver_radio;
+    rfd900comm::udpGateway sender_gateway(sender_radio);
+    rfd900comm::udpGateway receiver_gateway(receiver_radio);
+
+    if(emulator.start(emuConfig) != 0){
+        return -1;
+    }
+    if(sender_radio.init(emulator.port_name(0)) != 0 || receiver_radio.init(emulator.port_name(1)) != 0){
+        fprintf(stderr, "error, %s radio init failure\n", __func__);
+        return -1;
+    }
+
+    rfd900comm::udpGatewayConfig config;
+    config.air_bytes_per_sec = air_bytes_per_sec;
+    config.aggregate = aggregate;
+    config.my_id = SimConstants::AERIAL01;
+    config.base_port = SENDER_GATEWAY_BASE;
+    if(sender_gateway.open(config) != 0){
+        return -1;
+    }
+    config.my_id = SimConstants::BASE_STATION;
+    config.base_port = RECEIVER_GATEWAY_BASE;
+    config.deliver_base_port = DELIVER_BASE;
+    if(receiver_gateway.open(config) != 0){
+        return -1;
+    }
+
+    int sender_fd = socket(AF_INET, SOCK_DGRAM, 0);
+    int receiver_fd = udp_socket(DELIVER_BASE + SimConstants::AERIAL01);
+    if(sender_fd < 0 || receiver_fd < 0){
+        return -1;
+    }
+
+    struct sockaddr_in dest;
+    memset(&dest, 0, sizeof(dest));
+    dest.sin_family = AF_INET;
+    dest.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    dest.sin_port = htons(SENDER_GATEWAY_BASE + SimConstants::BASE_STATION);
+
+    receiver_stats_t received;
+    received.datagrams = 0;
+    received.bytes = 0;
+    received.latency_sum_us = 0;
+    running = true;
+    std::thread sender_gateway_thread(gateway_thread, &sender_gateway);
+    std::thread receiver_gateway_thread(gateway_thread, &receiver_gateway);
+    std::thread receiving(receiver_thread, receiver_fd, &received);
+
+    // offered in proportion to what the radio carries one datagram per frame
+    double offered_rate = load * air_bytes_per_sec / (datagram_length + FRAME_OVERHEAD);
+    auto interval = std::chrono::duration<double>(1.0 / offered_rate);
+
+    // text payload, the sender's clock then padding, never a frame indicator
+    char payload[rfd900comm::GATEWAY_MAX_DATAGRAM_LENGTH];
+    uint64_t offered = 0;
+    auto start = steady::now();
+    auto stop = start + std::chrono::duration_cast<steady::duration>(std::chrono::duration<double>(seconds));
+    auto next = start;
+
+    while(next < stop){
+        std::this_thread::sleep_until(next);
+
+        // catch up in bursts when the sleep overshoots
+        for(auto now = steady::now(); next <= now && next < stop;
+                    next += std::chrono::duration_cast<steady::duration>(interval)){
+            memset(payload, 'x', datagram_length);
+            int n = snprintf(payload, datagram_length, "%ld ", now_us());
+            payload[n < (int)datagram_length ? n : datagram_length - 1] = ' ';
+            sendto(sender_fd, payload, datagram_length, 0, (struct sockaddr*)&dest, sizeof(dest));
+            ++offered;
+        }
+    }
+
+    // delivered within the run, the rest is still queued
+    double elapsed = std::chrono::duration<double>(steady::now() - start).count();
+    uint64_t delivered = received.datagrams;
+    uint64_t bytes = received.bytes;
+    double latency_sum = received.latency_sum_us / 1000.0;
+
+    running = false;
+    sender_gateway_thread.join();
+    receiver_gateway_thread.join();
+    receiving.join();
+
+    rfd900comm::udpGatewayStats tx = sender_gateway.get_stats();
+    rfd900comm::udpGatewayStats rx = receiver_gateway.get_stats();
+
+    fprintf(stdout, "%8u %6lu %4s %9.0f %9.0f %10.0f %6.2f %7.1f %7.1f %7.1f %9.1f\n",
+                air_bytes_per_sec, datagram_length, aggregate ? "on" : "off", offered / elapsed, delivered / elapsed,
+                bytes / elapsed, tx.radio_bytes_out ? (double)tx.payload_bytes_out / tx.radio_bytes_out : 0.0,
+                tx.frames_out ? (double)tx.datagrams_in / tx.frames_out : 0.0,
+                tx.recvmmsg_calls ? (double)tx.datagrams_in / tx.recvmmsg_calls : 0.0,
+                rx.sendmmsg_calls ? (double)rx.datagrams_out / rx.sendmmsg_calls : 0.0,
+                delivered ? latency_sum / delivered : 0.0);
+
+    close(sender_fd);
+    close(receiver_fd);
+    return 0;
+}
+
+
+int main(int argc, char **argv)
+{
+    double seconds = 3.0;
+    double load = 1.5;
+
+    if(argc > 1){
+        seconds = atof(argv[1]);
+    }
+    if(argc > 2){
+        load = atof(argv[2]);
+    }
+
+    fprintf(stdout, "%8s %6s %4s %9s %9s %10s %6s %7s %7s %7s %9s\n", "air B/s", "size", "agg",
+                "offer/s", "deliv/s", "payload/s", "eff", "dg/frm", "dg/recv", "dg/send", "lat ms");
+
+    const size_t sizes[] = {16, 64, 200};
+    for(size_t size : sizes){
+        if(run(8000, size, false, seconds, load) != 0 || run(8000, size, true, seconds, load) != 0){
+            return 1;
+        }
+    }
+
+    for(size_t size : sizes){
+        if(run(1000000, size, true, seconds, load) != 0){
+            return 1;
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,346 @@
+/**
+ * Purpose:
+ *  Measure what an outboundJournal costs message900 and check that a crashed
+ *  sender gets its unacknowledged messages back, no radio needed.
+ *
+ *  The program first times adding and acknowledging messages with no
+ *  journal, with group commit every 50 ms and with a commit per record.
+ *  A forked child then fills an ack wait list through a journal,
+ *  acknowledges every third message and exits without closing anything.
+ *  The parent times the restore into a fresh message900. It then checks
+ *  three things: every unacknowledged message came back, no acknowledged
+ *  one did, and messages whose TTL ran out while no process was running
+ *  stay gone. A torn record is written at the end of the journal, which
+ *  must be discarded on the next open without losing a frame. Last, a
+ *  small journal is run through many times its size to check compaction.
+ *  Then a journal is filled to its last 16 bytes, too few for the COMMIT
+ *  record, and committed, which must compact rather than write past the
+ *  end of the file.
+ *
+ * Optional Command line arguments
+ *  argv[1] - journal path, default /tmp/rfd900_journal.bin
+ *  argv[2] - messages left by the crashed sender, default 4000
+ *
+ */
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>                  // atoi
+#include <cstring>                  // memset
+#include <string>
+#include <fcntl.h>
+#include <sys/wait.h>
+#include <unistd.h>                 // fork, pwrite, unlink, usleep
+
+#include "message900.h"
+#include "outbound_journal.h"
+
+
+using steady = std::chrono::steady_clock;
+
+constexpr uint8_t DATA_TYPE = 1;
+constexpr uint8_t SHORT_TTL_TYPE = 2;
+constexpr auto SHORT_TTL = std::chrono::milliseconds(100);
+constexpr uint8_t NUM_DEST = 8;
+constexpr uint8_t GROUP_ID = 200;
+constexpr uint16_t GROUP_MSG_ID = 7;
+constexpr size_t SHORT_TTL_MESSAGES = 10;
+constexpr size_t FRAME_LENGTH = 64;
+
+
+static void fill_frame(uint8_t* frame, uint8_t dest_id, uint16_t msg_id)
+{
+    for(size_t i = 0; i < FRAME_LENGTH; ++i){
+        frame[i] = static_cast<uint8_t>(dest_id * 31 + msg_id + i);
+    }
+}
+
+
+static uint8_t dest_of(size_t i) { return static_cast<uint8_t>(1 + i % NUM_DEST); }
+static uint16_t msg_id_of(size_t i) { return static_cast<uint16_t>(i / NUM_DEST); }
+
+
+// adds count messages and acknowledges each once lag more have been added, returns ns per message
+static double time_add_and_ack(rfd900comm::message900& arq, size_t count, size_t lag)
+{
+    uint8_t frame[FRAME_LENGTH];
+    auto start = steady::now();
+    for(size_t i = 0; i < count; ++i){
+        fill_frame(frame, dest_of(i), msg_id_of(i));
+        arq.add_to_ack_wait_list(dest_of(i), msg_id_of(i), DATA_TYPE, frame, FRAME_LENGTH);
+        if(i >= lag){
+            arq.process_received_ack(dest_of(i - lag), msg_id_of(i - lag));
+        }
+    }
+    auto elapsed = steady::now() - start;
+    for(size_t i = count > lag ? count - lag : 0; i < count; ++i){
+        arq.process_received_ack(dest_of(i), msg_id_of(i));
+    }
+    return std::chrono::duration<double, std::nano>(elapsed).count() / count;
+}
+
+
+// the crashed sender, never returns
+static void crashing_sender(const char* path, size_t messages)
+{
+    rfd900comm::outboundJournal journal;
+    if(journal.open(path) != 0){
+        _exit(1);
+    }
+
+    rfd900comm::message900 arq(rfd900comm::rtoMode::ADAPTIVE, messages + 64);
+    arq.set_send_window(rfd900comm::message900::MAX_WINDOW_FRAMES / 2, SIZE_MAX);
+    arq.set_message_ttl(SHORT_TTL_TYPE, SHORT_TTL);
+    arq.attach_journal(&journal);
+
+    uint8_t frame[FRAME_LENGTH];
+    for(size_t i = 0; i < messages; ++i){
+        fill_frame(frame, dest_of(i), msg_id_of(i));
+        arq.add_to_ack_wait_list(dest_of(i), msg_id_of(i), DATA_TYPE, frame, FRAME_LENGTH);
+    }
+    for(size_t i = 0; i < messages; i += 3){
+        arq.process_received_ack(dest_of(i), msg_id_of(i));
+    }
+
+    rfd900comm::nodeSet ackers;
+    ackers.insert(1);
+    ackers.insert(2);
+    ackers.insert(3);
+    fill_frame(frame, GROUP_ID, GROUP_MSG_ID);
+    arq.add_to_ack_wait_list(GROUP_ID, GROUP_MSG_ID, DATA_TYPE, frame, FRAME_LENGTH, ackers);
+
+    for(size_t i = 0; i < SHORT_TTL_MESSAGES; ++i){
+        fill_frame(frame, NUM_DEST + 1, static_cast<uint16_t>(i));
+        arq.add_to_ack_wait_list(NUM_DEST + 1, static_cast<uint16_t>(i), SHORT_TTL_TYPE, frame, FRAME_LENGTH);
+    }
+
+    // no close, no commit, no destructors
+    _exit(0);
+}
+
+
+// returns the number of mismatches between arq and what the crashed sender left
+static size_t check_restored(const rfd900comm::message900& arq, size_t messages)
+{
+    size_t mismatches = 0;
+    for(size_t i = 0; i < messages; ++i){
+        bool expected = i % 3 != 0;
+        if(arq.in_ack_wait_list(dest_of(i), msg_id_of(i)) != expected){
+            ++mismatches;
+        }
+    }
+    for(size_t i = 0; i < SHORT_TTL_MESSAGES; ++i){
+        if(arq.in_ack_wait_list(NUM_DEST + 1, static_cast<uint16_t>(i))){
+            ++mismatches;
+        }
+    }
+    const rfd900comm::nodeSet* ackers = arq.outstanding_ackers(GROUP_ID, GROUP_MSG_ID);
+    if(ackers == nullptr || ackers->size() != 3){
+        ++mismatches;
+    }
+    return mismatches;
+}
+
+
+int main(int argc, char **argv)
+{
+    std::string path = argc > 1 ? argv[1] : "/tmp/rfd900_journal.bin";
+    size_t messages = argc > 2 ? atoi(argv[2]) : 4000;
+    bool ok = true;
+
+    // the cost per message
+    fprintf(stdout, "add + ack, %lu byte frames\n", FRAME_LENGTH);
+    {
+        rfd900comm::message900 arq;
+        double ns = time_add_and_ack(arq, 200000, 128);
+        fprintf(stdout, "  %-24s %8.0f ns per message\n", "no journal", ns);
+    }
+
+    const struct{
+        const char* name;
+        int interval_ms;
+        size_t count;
+    } variants[] = {
+        {"group commit 50 ms", 50, 200000},
+        {"commit per record", 0, 2000}
+    };
+    for(const auto& v : variants){
+        unlink(path.c_str());
+        rfd900comm::outboundJournalConfig config;
+        config.durability_interval = std::chrono::milliseconds(v.interval_ms);
+        rfd900comm::outboundJournal journal;
+        if(journal.open(path.c_str(), config) != 0){
+            return 1;
+        }
+        rfd900comm::message900 arq;
+        arq.attach_journal(&journal);
+        double ns = time_add_and_ack(arq, v.count, 128);
+        fprintf(stdout, "  %-24s %8.0f ns per message, %lu commits, %lu compactions\n", v.name, ns,
+                    journal.commits(), journal.compactions());
+        arq.detach_journal();
+    }
+
+    // crash and restore
+    unlink(path.c_str());
+    pid_t child = fork();
+    if(child == 0){
+        crashing_sender(path.c_str(), messages);
+    }
+    int status = 0;
+    waitpid(child, &status, 0);
+    if(!WIFEXITED(status) || WEXITSTATUS(status) != 0){
+        fprintf(stderr, "error, %s, sender failed\n", __func__);
+        return 1;
+    }
+    usleep(std::chrono::duration_cast<std::chrono::microseconds>(SHORT_TTL).count() * 2);
+
+    size_t live_expected = messages - (messages + 2) / 3 + 1;
+    {
+        rfd900comm::outboundJournal journal;
+        rfd900comm::message900 arq(rfd900comm::rtoMode::ADAPTIVE, messages + 64);
+        auto start = steady::now();
+        if(journal.open(path.c_str()) != 0){
+            return 1;
+        }
+        size_t restored = arq.attach_journal(&journal);
+        double ms = std::chrono::duration<double, std::milli>(steady::now() - start).count();
+
+        size_t mismatches = check_restored(arq, messages);
+        uint16_t last = 0;
+        bool have_last = journal.last_msg_id(1, &last);
+        fprintf(stdout, "restart after a crash: %lu records scanned, %lu after the last commit, %lu restored in %.2f ms\n",
+                    journal.recovered_records(), journal.uncommitted_records(), restored, ms);
+        fprintf(stdout, "  expected %lu, mismatches %lu, last msg_id to 1: %hu\n", live_expected, mismatches,
+                    have_last ? last : 0);
+        ok = ok && restored == live_expected && mismatches == 0 && have_last && last == msg_id_of((messages - 1) / NUM_DEST * NUM_DEST);
+        arq.detach_journal();
+    }
+
+    // a record torn by a crash mid write
+    {
+        rfd900comm::outboundJournal journal;
+        if(journal.open(path.c_str()) != 0){
+            return 1;
+        }
+        size_t live = journal.live();
+        size_t end = journal.used_bytes();
+        journal.close();
+
+        uint8_t torn[40];
+        memset(torn, 0xA5, sizeof(torn));
+        int fd = open(path.c_str(), O_WRONLY);
+        ssize_t written = fd >= 0 ? pwrite(fd, torn, sizeof(torn), end) : -1;
+        if(fd >= 0){
+            close(fd);
+        }
+
+        rfd900comm::message900 arq(rfd900comm::rtoMode::ADAPTIVE, messages + 64);
+        if(written != static_cast<ssize_t>(sizeof(torn)) || journal.open(path.c_str()) != 0){
+            return 1;
+        }
+        size_t restored = arq.attach_journal(&journal);
+        size_t mismatches = check_restored(arq, messages);
+        fprintf(stdout, "torn record: %lu bytes discarded, %lu of %lu frames restored, mismatches %lu\n",
+                    journal.discarded_bytes(), restored, live, mismatches);
+        ok = ok && journal.discarded_bytes() == sizeof(torn) && restored == live && mismatches == 0;
+        arq.detach_journal();
+    }
+
+    // a journal much smaller than what passes through it
+    {
+        std::string small = path + ".small";
+        unlink(small.c_str());
+        rfd900comm::outboundJournalConfig config;
+        config.capacity_bytes = 64 * 1024;
+        rfd900comm::outboundJournal journal;
+        if(journal.open(small.c_str(), config) != 0){
+            return 1;
+        }
+        rfd900comm::message900 arq;
+        arq.attach_journal(&journal);
+
+        uint8_t frame[FRAME_LENGTH];
+        const size_t total = 50000;
+        const size_t lag = 64;
+        for(size_t i = 0; i < total; ++i){
+            fill_frame(frame, dest_of(i), msg_id_of(i));
+            arq.add_to_ack_wait_list(dest_of(i), msg_id_of(i), DATA_TYPE, frame, FRAME_LENGTH);
+            if(i >= lag){
+                arq.process_received_ack(dest_of(i - lag), msg_id_of(i - lag));
+            }
+        }
+        size_t waiting = arq.ack_wait_list_size();
+        uint64_t compactions = journal.compactions();
+        arq.detach_journal();
+        journal.close();
+
+        rfd900comm::message900 restarted;
+        if(journal.open(small.c_str(), config) != 0){
+            return 1;
+        }
+        size_t restored = restarted.attach_journal(&journal);
+        fprintf(stdout, "compaction: %lu messages through a %lu byte journal, %lu compactions, %lu of %lu restored\n",
+                    total, journal.capacity(), compactions, restored, waiting);
+        ok = ok && compactions > 0 && restored == waiting;
+        restarted.detach_journal();
+        journal.close();
+        unlink(small.c_str());
+    }
+
+    // a journal filled up to its last 16 bytes, less than a COMMIT record
+    {
+        std::string full = path + ".full";
+        unlink(full.c_str());
+        rfd900comm::outboundJournalConfig config;
+        config.capacity_bytes = 64 * 1024;
+        config.durability_interval = std::chrono::hours(1);
+        rfd900comm::outboundJournal journal;
+        if(journal.open(full.c_str(), config) != 0){
+            return 1;
+        }
+
+        uint8_t frame[rfd900comm::outboundJournal::MAX_FRAME_LENGTH];
+        memset(frame, 0x5A, sizeof(frame));
+        rfd900comm::journalFrame jf;
+        jf.msg_type = DATA_TYPE;
+        jf.group = false;
+        jf.expires_ns = rfd900comm::outboundJournal::NO_EXPIRY;
+        jf.data = frame;
+        jf.dest_id = 1;
+        jf.msg_id = 0;
+        jf.length = FRAME_LENGTH;
+
+        // one dead frame for compaction to drop, then live frames up to the last 16 bytes
+        size_t before = journal.used_bytes();
+        int status = journal.append(jf);
+        size_t record = journal.used_bytes() - before;
+        status |= journal.tombstone(jf.dest_id, jf.msg_id);
+
+        size_t live = 0;
+        bool last = false;
+        while(status == 0 && !last){
+            size_t room = journal.capacity() - journal.used_bytes() - 16;
+            last = room - record <= rfd900comm::outboundJournal::MAX_FRAME_LENGTH - FRAME_LENGTH;
+            jf.msg_id = static_cast<uint16_t>(live + 1);
+            jf.length = last ? FRAME_LENGTH + room - record : FRAME_LENGTH;
+            status |= journal.append(jf);
+            ++live;
+        }
+        status |= journal.commit();
+        size_t used = journal.used_bytes();
+        uint64_t compactions = journal.compactions();
+        journal.close();
+
+        bool reopened = journal.open(full.c_str(), config) == 0;
+        fprintf(stdout, "full journal: %lu live frames, commit %s, %lu of %lu bytes used, %lu compactions, %lu restored\n",
+                    live, status == 0 ? "ok" : "failed", used, journal.capacity(), compactions, journal.live());
+        ok = ok && status == 0 && used <= journal.capacity() && reopened && journal.live() == live
+                    && journal.discarded_bytes() == 0;
+        journal.close();
+        unlink(full.c_str());
+    }
+
+    unlink(path.c_str());
+    fprintf(stdout, "%s\n", ok ? "all checks passed" : "CHECKS FAILED");
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,93 @@
+/**
+ * @brief linkAdapter class function definitions.
+ *
+ */
+
+#include "airtime_accountant.h"
+#include "link_adapter.h"
+#include "message900.h"
+#include "tx_scheduler.h"
+
+namespace rfd900comm{
+
+    const linkTierSettings linkAdapter::TIERS[NUM_LINK_TIERS] = {
+        {"good", 20.0, std::chrono::milliseconds(100), 64, 8192, 256},
+        {"fair", 10.0, std::chrono::milliseconds(250), 32, 4096, 192},
+        {"poor", -1000.0, std::chrono::milliseconds(500), 8, 1024, 128}
+    };
+
+
+    linkAdapter::linkAdapter(message900& arq, txScheduler* scheduler, airtimeAccountant* airtime) :
+        arq(arq), scheduler(scheduler), airtime(airtime), current(linkTier::GOOD), radioEcc(false), changes(0)
+    {
+        // intentionally blank
+    }
+
+
+    linkTier linkAdapter::update(const radioLinkQuality& quality)
+    {
+        if(!quality.valid){
+            return current;
+        }
+
+        double margin = quality.fade_margin_db();
+        int raw = NUM_LINK_TIERS - 1;
+        for(int t = 0; t < NUM_LINK_TIERS; ++t){
+            if(margin >= TIERS[t].min_margin_db){
+                raw = t;
+                break;
+            }
+        }
+
+        // receive errors since the last report, the counters restart when the radio reboots
+        if(last.valid && quality.packets > last.packets && quality.rx_errors >= last.rx_errors){
+            double errors = quality.rx_errors - last.rx_errors;
+            double packets = quality.packets - last.packets;
+            if(errors / (packets + errors) > MAX_RX_ERROR_RATE && raw < NUM_LINK_TIERS - 1){
+                ++raw;
+            }
+        }
+        last = quality;
+
+        int now = static_cast<int>(current);
+        if(raw < now && margin < TIERS[raw].min_margin_db + HYSTERESIS_DB){
+            raw = now;
+        }
+        if(raw != now){
+            current = static_cast<linkTier>(raw);
+            ++changes;
+            apply();
+        }
+        return current;
+    }
+
+
+    void linkAdapter::update_radio(const atCommandChannel& channel)
+    {
+        int air_speed_kbps = channel.register_value(atCommandChannel::AIR_SPEED_REGISTER);
+        int ecc = channel.register_value(atCommandChannel::ECC_REGISTER);
+        if(air_speed_kbps <= 0 || ecc < 0){
+            return;
+        }
+
+        radioEcc = ecc != 0;
+        if(airtime != nullptr){
+            airtime->set_radio(air_speed_kbps, radioEcc);
+        }
+        if(scheduler != nullptr && scheduler->air_rate() != 0){
+            scheduler->set_air_rate(air_speed_kbps * 1000 / 8 / (radioEcc ? 2 : 1));
+        }
+    }
+
+
+    void linkAdapter::apply()
+    {
+        const linkTierSettings& s = settings();
+        arq.get_rtt_estimator().set_min_rto(s.min_rto);
+        arq.set_send_window(s.window_frames, s.window_bytes);
+        if(scheduler != nullptr){
+            scheduler->set_max_backlog(s.max_backlog_bytes);
+        }
+    }
+
+}
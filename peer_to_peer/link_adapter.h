@@ -0,0 +1,109 @@
+/**
+ * @brief Declares linkAdapter, transmit settings that follow the radio's link quality
+ *
+ * The radio's ATI7 report (atCommandChannel) gives the fade margin, signal
+ * above noise at the weaker end, and the receive error count. linkAdapter
+ * maps them to one of three tiers and applies the tier's settings:
+ *
+ *      tier    margin      min RTO     send window         tx backlog
+ *      GOOD    >= 20 dB    100 ms      64 frames / 8 KB    256 bytes
+ *      FAIR    >= 10 dB    250 ms      32 frames / 4 KB    192 bytes
+ *      POOR    <  10 dB    500 ms       8 frames / 1 KB    128 bytes
+ *
+ * On a weak link frames are lost and ACKs come late: a higher minimum RTO
+ * stops spurious retransmissions, a smaller window keeps fewer frames in
+ * flight to be lost together, and a smaller transmit backlog aggregates
+ * fewer bytes ahead of each ACK. A report with more than 5 % receive errors
+ * since the last one counts one tier worse than its margin.
+ *
+ * The tier only improves once the margin clears the better tier's threshold
+ * by HYSTERESIS_DB, so a margin hovering at a threshold does not flap.
+ *
+ * Forward error correction is the radio's ECC register, which doubles every
+ * byte on the air, must match on both radios and only takes effect after a
+ * save and reboot. linkAdapter recommends it on a POOR link and leaves the
+ * change to the operator; the air speed and ECC read from the registers
+ * configure the airtime accountant and the scheduler's pacing.
+ *
+ */
+
+#ifndef LINK_ADAPTER_INCLUDED_H
+#define LINK_ADAPTER_INCLUDED_H
+
+#include <cstdint>
+
+#include "at_command.h"
+#include "rtt_estimator.h"
+
+
+namespace rfd900comm{
+
+    class airtimeAccountant;
+    class message900;
+    class txScheduler;
+
+    enum class linkTier{
+        GOOD = 0,
+        FAIR,
+        POOR
+    };
+
+    constexpr int NUM_LINK_TIERS = 3;
+
+    struct linkTierSettings{
+        const char* name;
+        double min_margin_db;
+        rttEstimator::duration min_rto;
+        size_t window_frames;
+        size_t window_bytes;
+        size_t max_backlog_bytes;
+    };
+
+
+    class linkAdapter{
+
+        public:
+
+        static constexpr double HYSTERESIS_DB = 3.0;
+        static constexpr double MAX_RX_ERROR_RATE = 0.05;
+
+        static const linkTierSettings TIERS[NUM_LINK_TIERS];
+
+        // scheduler and airtime may be nullptr
+        explicit linkAdapter(message900& arq, txScheduler* scheduler = nullptr, airtimeAccountant* airtime = nullptr);
+
+        // disable copy constructor
+        linkAdapter(const linkAdapter&) = delete;
+
+        // disable assignment
+        linkAdapter& operator=(const linkAdapter&) = delete;
+
+        // picks the tier for a link report and applies it, returns the tier
+        linkTier update(const radioLinkQuality& quality);
+
+        // the radio's AIR_SPEED and ECC registers, as read by atCommandChannel::query_registers
+        void update_radio(const atCommandChannel& channel);
+
+        linkTier tier() const { return current; }
+        const linkTierSettings& settings() const { return TIERS[static_cast<int>(current)]; }
+        bool ecc_recommended() const { return current == linkTier::POOR && !radioEcc; }
+        uint64_t tier_changes() const { return changes; }
+
+
+        private:
+
+        message900& arq;
+        txScheduler* scheduler;
+        airtimeAccountant* airtime;
+        linkTier current;
+        bool radioEcc;
+        radioLinkQuality last;
+        uint64_t changes;
+
+        void apply();
+    };
+
+}
+
+
+#endif
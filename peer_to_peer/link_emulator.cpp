@@ -0,0 +1,304 @@
+/**
+ * @brief linkEmulator class function definitions.
+ *
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdint.h>                     // SIZE_MAX
+#include <stdio.h>
+#include <stdlib.h>                     // posix_openpt, grantpt, unlockpt, ptsname
+#include <string.h>                     // strerror
+#include <termios.h>
+#include <unistd.h>
+
+#include "link_emulator.h"
+
+namespace rfd900comm{
+
+    linkEmulator::linkEmulator()
+    {
+        running = false;
+        lossProbability = 0.0;
+        memset(&stats, 0, sizeof(stats));
+        rng_state = 1;
+    }
+
+    linkEmulator::~linkEmulator()
+    {
+        stop();
+    }
+
+
+    int linkEmulator::start(const linkEmulatorConfig& config)
+    {
+        if(running){
+            fprintf(stderr, "error, %s, emulator already running\n", __func__);
+            return -1;
+        }
+
+        cfg = config;
+        rng_state = config.seed ? config.seed : 1;
+        lossProbability = config.loss_probability;
+        memset(&stats, 0, sizeof(stats));
+        channel_free = std::chrono::steady_clock::now();
+
+        ports.resize(cfg.ports);
+        for(port_t& port : ports){
+            if(open_port(&port) != 0){
+                close_ports();
+                return -1;
+            }
+        }
+
+        running = true;
+        worker = std::thread(&linkEmulator::run, this);
+        return 0;
+    }
+
+
+    void linkEmulator::stop()
+    {
+        if(running){
+            running = false;
+            worker.join();
+        }
+        close_ports();
+    }
+
+
+    const char* linkEmulator::port_name(size_t port) const
+    {
+        if(port >= ports.size()){
+            return nullptr;
+        }
+        return ports[port].slave_name.c_str();
+    }
+
+
+    linkEmulatorStats linkEmulator::get_stats()
+    {
+        std::lock_guard<std::mutex> lock(stats_mutex);
+        return stats;
+    }
+
+
+    int linkEmulator::open_port(port_t* port)
+    {
+        struct termios tio;
+
+        port->master_fd = -1;
+        port->slave_fd = -1;
+        port->buffered.clear();
+        port->buffered_bytes = 0;
+
+        port->master_fd = posix_openpt(O_RDWR | O_NOCTTY | O_NONBLOCK);
+        if(port->master_fd < 0){
+            fprintf(stderr, "error, %s, posix_openpt: %s\n", __func__, strerror(errno));
+            return -1;
+        }
+
+        if(grantpt(port->master_fd) != 0 || unlockpt(port->master_fd) != 0){
+            fprintf(stderr, "error, %s, grantpt/unlockpt: %s\n", __func__, strerror(errno));
+            return -1;
+        }
+
+        port->slave_name = ptsname(port->master_fd);
+
+        port->slave_fd = open(port->slave_name.c_str(), O_RDWR | O_NOCTTY | O_NONBLOCK);
+        if(port->slave_fd < 0){
+            fprintf(stderr, "error, %s, open %s: %s\n", __func__, port->slave_name.c_str(), strerror(errno));
+            return -1;
+        }
+
+        // raw until the program under test applies its own settings
+        if(tcgetattr(port->slave_fd, &tio) == 0){
+            cfmakeraw(&tio);
+            tcsetattr(port->slave_fd, TCSANOW, &tio);
+        }
+
+        return 0;
+    }
+
+
+    void linkEmulator::close_ports()
+    {
+        for(port_t& port : ports){
+            if(port.slave_fd >= 0){
+                close(port.slave_fd);
+            }
+            if(port.master_fd >= 0){
+                close(port.master_fd);
+            }
+        }
+        ports.clear();
+        in_flight.clear();
+    }
+
+
+    void linkEmulator::run()
+    {
+        std::vector<struct pollfd> pfds(ports.size());
+        uint8_t chunk[CHUNK_LENGTH];
+
+        while(running){
+
+            auto now = std::chrono::steady_clock::now();
+            bool held = false;
+
+            for(size_t i = 0; i < ports.size(); ++i){
+                pfds[i].fd = ports[i].master_fd;
+                pfds[i].events = POLLIN;
+                pfds[i].revents = 0;
+
+                // flow control, a full modem buffer leaves the bytes in the pty
+                if(cfg.hardware_flow_control && modem_room(&ports[i], now) == 0){
+                    pfds[i].events = 0;
+                    held = true;
+                }
+            }
+
+            // wake for the next delivery, and at least every 10 ms to notice stop()
+            int timeout_ms = held ? 1 : 10;
+            if(!in_flight.empty()){
+                auto delay = in_flight.front().deliver_at - std::chrono::steady_clock::now();
+                long ms = std::chrono::duration_cast<std::chrono::milliseconds>(delay).count();
+                timeout_ms = ms < 0 ? 0 : (ms < timeout_ms ? static_cast<int>(ms) : timeout_ms);
+            }
+
+            int rv = poll(pfds.data(), pfds.size(), timeout_ms);
+            if(rv < 0 && errno != EINTR){
+                fprintf(stderr, "error, %s, poll: %s\n", __func__, strerror(errno));
+                break;
+            }
+
+            for(size_t i = 0; rv > 0 && i < ports.size(); ++i){
+                if(pfds[i].revents & POLLIN){
+                    size_t length = CHUNK_LENGTH;
+                    if(cfg.hardware_flow_control){
+                        size_t room = modem_room(&ports[i], std::chrono::steady_clock::now());
+                        length = room < length ? room : length;
+                    }
+
+                    ssize_t n = read(ports[i].master_fd, chunk, length);
+                    if(n > 0){
+                        accept_chunk(i, chunk, static_cast<size_t>(n));
+                    }
+                }
+            }
+
+            deliver_due();
+        }
+    }
+
+
+    // bytes the port's modem buffer can take now, SIZE_MAX without a modem buffer
+    size_t linkEmulator::modem_room(port_t* port, std::chrono::steady_clock::time_point now)
+    {
+        if(cfg.modem_buffer_bytes == 0){
+            return SIZE_MAX;
+        }
+
+        while(!port->buffered.empty() && port->buffered.front().air_done <= now){
+            port->buffered_bytes -= port->buffered.front().length;
+            port->buffered.pop_front();
+        }
+
+        // the chunk on the air frees its bytes as they are sent
+        size_t occupied = port->buffered_bytes;
+        if(!port->buffered.empty() && port->buffered.front().air_start < now){
+            auto sent = std::chrono::duration_cast<std::chrono::microseconds>(now - port->buffered.front().air_start);
+            occupied -= static_cast<size_t>(sent.count() * cfg.air_bytes_per_sec / 1000000ULL);
+        }
+
+        return occupied >= cfg.modem_buffer_bytes ? 0 : cfg.modem_buffer_bytes - occupied;
+    }
+
+
+    void linkEmulator::accept_chunk(size_t src_port, const uint8_t* data, size_t length)
+    {
+        auto now = std::chrono::steady_clock::now();
+
+        {
+            std::lock_guard<std::mutex> lock(stats_mutex);
+            stats.bytes_offered += length;
+        }
+
+        // the bytes that do not fit in the modem buffer are lost
+        size_t room = modem_room(&ports[src_port], now);
+        if(length > room){
+            std::lock_guard<std::mutex> lock(stats_mutex);
+            stats.bytes_overflowed += length - room;
+            length = room;
+        }
+        if(length == 0){
+            return;
+        }
+
+        // half duplex: the chunk starts when the channel frees up and occupies it for its airtime
+        auto airtime = std::chrono::microseconds(length * 1000000ULL / cfg.air_bytes_per_sec);
+        auto tx_start = channel_free > now ? channel_free : now;
+        channel_free = tx_start + airtime;
+
+        if(cfg.modem_buffer_bytes != 0){
+            ports[src_port].buffered.push_back(buffered_t{tx_start, channel_free, length});
+            ports[src_port].buffered_bytes += length;
+        }
+
+        double loss = lossProbability;
+        if(!cfg.independent_loss && loss > 0.0 && next_uniform() < loss){
+            std::lock_guard<std::mutex> lock(stats_mutex);
+            ++stats.chunks_dropped;
+            return;
+        }
+
+        in_flight.push_back(in_flight_t{channel_free + cfg.latency, src_port,
+                    std::string((const char*)data, length)});
+    }
+
+
+    void linkEmulator::deliver_due()
+    {
+        auto now = std::chrono::steady_clock::now();
+        double loss = lossProbability;
+
+        // deliver_at is monotonic because the channel serializes transmissions
+        while(!in_flight.empty() && in_flight.front().deliver_at <= now){
+            const in_flight_t& f = in_flight.front();
+
+            for(size_t i = 0; i < ports.size(); ++i){
+                if(i == f.src_port){
+                    continue;
+                }
+
+                if(cfg.independent_loss && loss > 0.0 && next_uniform() < loss){
+                    std::lock_guard<std::mutex> lock(stats_mutex);
+                    ++stats.chunks_dropped;
+                    continue;
+                }
+
+                // a full receive buffer loses bytes, as the radio would
+                ssize_t n = write(ports[i].master_fd, f.bytes.data(), f.bytes.length());
+                if(n > 0){
+                    std::lock_guard<std::mutex> lock(stats_mutex);
+                    stats.bytes_delivered += n;
+                }
+            }
+
+            in_flight.pop_front();
+        }
+    }
+
+
+    // xorshift64*, deterministic for a given seed
+    double linkEmulator::next_uniform()
+    {
+        rng_state ^= rng_state >> 12;
+        rng_state ^= rng_state << 25;
+        rng_state ^= rng_state >> 27;
+        uint64_t r = rng_state * 2685821657736338717ULL;
+        return static_cast<double>(r >> 11) * (1.0 / 9007199254740992.0);
+    }
+
+}
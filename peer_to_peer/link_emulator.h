@@ -0,0 +1,135 @@
+/**
+ * @brief Declares linkEmulator, a pseudo terminal stand-in for a set of radios
+ *
+ * Each port is a pty pair. Programs open the slave side (port_name) exactly
+ * as they would open /dev/ttyUSB0, so rfd900Modem runs unmodified.
+ *
+ * The ports share one emulated half-duplex channel:
+ *      bytes written by one port are delivered to every other port
+ *      the channel carries air_bytes_per_sec, transmissions queue behind each other
+ *      every chunk arrives latency after it finishes transmitting
+ *      a chunk is dropped with probability loss_probability, for every port at
+ *      once or, with independent_loss, for each receiving port separately
+ *
+ * With modem_buffer_bytes set each port models the radio's transmit buffer,
+ * the bytes a port has written that are not yet on the air:
+ *      without hardware_flow_control bytes arriving at a full buffer are
+ *      dropped (bytes_overflowed), as the RFD900x drops them
+ *      with hardware_flow_control the emulator stops reading the pty while
+ *      the buffer is full, the writer's kernel queue fills and writes block,
+ *      as they do when the modem deasserts CTS
+ *
+ * A background thread moves the bytes. Statistics are read with get_stats.
+ *
+ */
+
+#ifndef LINK_EMULATOR_INCLUDED_H
+#define LINK_EMULATOR_INCLUDED_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+
+namespace rfd900comm{
+
+    struct linkEmulatorConfig{
+        size_t ports = 2;
+        uint32_t air_bytes_per_sec = 64000 / 8;             // RFD900x default air speed 64 kbps
+        std::chrono::microseconds latency{0};               // one way propagation + radio processing
+        double loss_probability = 0.0;                      // per chunk written by a port
+        uint32_t seed = 1;
+        size_t modem_buffer_bytes = 0;                      // per port transmit buffer, 0 is unlimited
+        bool hardware_flow_control = false;
+        bool independent_loss = false;                      // each receiving port loses chunks on its own
+    };
+
+    struct linkEmulatorStats{
+        uint64_t bytes_offered;
+        uint64_t bytes_delivered;
+        uint64_t chunks_dropped;                            // counted per receiving port with independent_loss
+        uint64_t bytes_overflowed;                          // dropped at a full modem buffer
+    };
+
+
+    class linkEmulator{
+
+        public:
+
+        linkEmulator();
+        ~linkEmulator();
+
+        // disable copy constructor
+        linkEmulator(const linkEmulator&) = delete;
+
+        // disable assignment
+        linkEmulator& operator=(const linkEmulator&) = delete;
+
+        int start(const linkEmulatorConfig& config);
+        void stop();
+
+        // slave device path for port, pass to rfd900Modem::init
+        const char* port_name(size_t port) const;
+
+        linkEmulatorStats get_stats();
+
+        // changes the loss probability of a running emulator, a link fading or recovering
+        void set_loss_probability(double loss_probability) { lossProbability = loss_probability; }
+
+
+        private:
+
+        static constexpr size_t CHUNK_LENGTH = 256;
+
+        struct buffered_t{
+            std::chrono::steady_clock::time_point air_start;
+            std::chrono::steady_clock::time_point air_done;
+            size_t length;
+        };
+
+        struct port_t{
+            int master_fd;
+            int slave_fd;                       // held open so the pty never hangs up
+            std::string slave_name;
+            std::deque<buffered_t> buffered;    // accepted chunks still waiting for their airtime
+            size_t buffered_bytes;
+        };
+
+        struct in_flight_t{
+            std::chrono::steady_clock::time_point deliver_at;
+            size_t src_port;
+            std::string bytes;
+        };
+
+        linkEmulatorConfig cfg;
+        std::vector<port_t> ports;
+        std::deque<in_flight_t> in_flight;
+        std::chrono::steady_clock::time_point channel_free;
+
+        std::thread worker;
+        std::atomic<bool> running;
+        std::atomic<double> lossProbability;
+
+        std::mutex stats_mutex;
+        linkEmulatorStats stats;
+
+        uint64_t rng_state;
+
+        int open_port(port_t* port);
+        void close_ports();
+        void run();
+        void accept_chunk(size_t src_port, const uint8_t* data, size_t length);
+        size_t modem_room(port_t* port, std::chrono::steady_clock::time_point now);
+        void deliver_due();
+        double next_uniform();
+    };
+
+}
+
+
+#endif
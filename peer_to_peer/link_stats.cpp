@@ -0,0 +1,168 @@
+/**
+ * @brief linkStats and linkStatsSegment function definitions.
+ *
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>                     // strerror, strncpy
+#include <unistd.h>
+
+#include <sys/mman.h>
+
+#include "link_stats.h"
+
+namespace rfd900comm{
+
+    static linkStats local_stats;
+
+    // swapped by create and release while the reader, sender and event loop threads count
+    static std::atomic<linkStats*> active_stats{&local_stats};
+
+
+    linkStats& link_stats()
+    {
+        return *active_stats.load(std::memory_order_acquire);
+    }
+
+
+    void linkStats::reset()
+    {
+        magic = MAGIC;
+        version = VERSION;
+        pid = getpid();
+
+        std::atomic<uint64_t>* counters[] = {
+            &bytes_in, &bytes_out,
+            &frames_in, &frames_out, &framing_resyncs, &crc_failures, &sequence_gaps,
+            &retransmits, &acks_received, &ack_rtt_count, &ack_rtt_sum_us,
+            &ack_rtt_min_us, &ack_rtt_max_us, &ack_rtt_last_us,
+            &tx_queue_depth, &rx_queue_depth, &ack_wait_depth,
+            &dedup_hits, &superseded,
+            &air_utilization_permille, &admission_degraded, &admission_rejected,
+            &expired_drops,
+            &radio_rssi_local, &radio_rssi_remote, &radio_noise_local, &radio_noise_remote, &radio_rx_errors
+        };
+
+        for(std::atomic<uint64_t>* c : counters){
+            c->store(0, std::memory_order_relaxed);
+        }
+    }
+
+
+    void linkStats::record_ack_rtt(uint64_t rtt_us)
+    {
+        add(acks_received);
+        add(ack_rtt_count);
+        add(ack_rtt_sum_us, rtt_us);
+        set(ack_rtt_last_us, rtt_us);
+
+        // ack_rtt_min_us is 0 until the first sample
+        uint64_t current = get(ack_rtt_min_us);
+        while((current == 0 || rtt_us < current) && !ack_rtt_min_us.compare_exchange_weak(current, rtt_us, std::memory_order_relaxed)){
+        }
+
+        current = get(ack_rtt_max_us);
+        while(rtt_us > current && !ack_rtt_max_us.compare_exchange_weak(current, rtt_us, std::memory_order_relaxed)){
+        }
+    }
+
+
+
+    linkStatsSegment::linkStatsSegment()
+    {
+        block = nullptr;
+        owner = false;
+        segmentName[0] = '\0';
+    }
+
+    linkStatsSegment::~linkStatsSegment()
+    {
+        release();
+    }
+
+
+    int linkStatsSegment::create(const char* name)
+    {
+        release();
+
+        int fd = shm_open(name, O_RDWR | O_CREAT, 0644);
+        if(fd < 0){
+            fprintf(stderr, "error, %s, shm_open %s: %s\n", __func__, name, strerror(errno));
+            return -1;
+        }
+
+        if(ftruncate(fd, sizeof(linkStats)) != 0){
+            fprintf(stderr, "error, %s, ftruncate: %s\n", __func__, strerror(errno));
+            close(fd);
+            return -1;
+        }
+
+        void* addr = mmap(nullptr, sizeof(linkStats), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        close(fd);                                      // the mapping keeps the segment alive
+        if(addr == MAP_FAILED){
+            fprintf(stderr, "error, %s, mmap: %s\n", __func__, strerror(errno));
+            return -1;
+        }
+
+        block = static_cast<linkStats*>(addr);
+        block->reset();
+        owner = true;
+        strncpy(segmentName, name, sizeof(segmentName) - 1);
+        segmentName[sizeof(segmentName) - 1] = '\0';
+
+        active_stats.store(block, std::memory_order_release);
+        return 0;
+    }
+
+
+    int linkStatsSegment::attach(const char* name)
+    {
+        release();
+
+        int fd = shm_open(name, O_RDONLY, 0);
+        if(fd < 0){
+            fprintf(stderr, "error, %s, shm_open %s: %s\n", __func__, name, strerror(errno));
+            return -1;
+        }
+
+        void* addr = mmap(nullptr, sizeof(linkStats), PROT_READ, MAP_SHARED, fd, 0);
+        close(fd);
+        if(addr == MAP_FAILED){
+            fprintf(stderr, "error, %s, mmap: %s\n", __func__, strerror(errno));
+            return -1;
+        }
+
+        block = static_cast<linkStats*>(addr);
+        if(block->magic != linkStats::MAGIC || block->version != linkStats::VERSION){
+            fprintf(stderr, "error, %s, %s is not a version %u link statistics segment\n",
+                        __func__, name, linkStats::VERSION);
+            release();
+            return -1;
+        }
+
+        return 0;
+    }
+
+
+    void linkStatsSegment::release()
+    {
+        if(block == nullptr){
+            return;
+        }
+
+        if(owner){
+            // instrumented code falls back to the local block, a counter update already
+            // holding the block can still land in it, release after those threads stop
+            linkStats* expected = block;
+            active_stats.compare_exchange_strong(expected, &local_stats, std::memory_order_acq_rel);
+            shm_unlink(segmentName);
+        }
+
+        munmap(block, sizeof(linkStats));
+        block = nullptr;
+        owner = false;
+    }
+
+}
@@ -0,0 +1,146 @@
+/**
+ * @brief Declares the link statistics block and its POSIX shared memory segment
+ *
+ * The radio process counts traffic in a linkStats block of relaxed atomic
+ * counters. Until a segment is created the counters live in a process local
+ * block, so instrumented code never has to check whether monitoring is on.
+ *
+ * linkStatsSegment::create places the block in shared memory (shm_open),
+ * where rfdstat can map it read only and display it live without touching
+ * the radio process or the serial port.
+ *
+ * link_stats() may be called from any thread while create or the segment's
+ * destructor switches the block. Destroy the segment after the threads that
+ * count have stopped, it unmaps the block they were writing to.
+ *
+ */
+
+#ifndef LINK_STATS_INCLUDED_H
+#define LINK_STATS_INCLUDED_H
+
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>                  // size_t
+
+
+namespace rfd900comm{
+
+    struct linkStats{
+
+        static constexpr uint32_t MAGIC = 0x52464453;           // "RFDS"
+        static constexpr uint32_t VERSION = 5;
+
+        uint32_t magic;
+        uint32_t version;
+        int32_t pid;                                            // owning radio process
+
+        // serial port
+        std::atomic<uint64_t> bytes_in;
+        std::atomic<uint64_t> bytes_out;
+
+        // framing
+        std::atomic<uint64_t> frames_in;
+        std::atomic<uint64_t> frames_out;
+        std::atomic<uint64_t> framing_resyncs;                  // bytes skipped to find a start indicator
+        std::atomic<uint64_t> crc_failures;                     // frames rejected by an integrity check
+        std::atomic<uint64_t> sequence_gaps;                    // msg_id jumped forward, frames lost
+
+        // acknowledged delivery
+        std::atomic<uint64_t> retransmits;
+        std::atomic<uint64_t> acks_received;
+        std::atomic<uint64_t> ack_rtt_count;
+        std::atomic<uint64_t> ack_rtt_sum_us;
+        std::atomic<uint64_t> ack_rtt_min_us;
+        std::atomic<uint64_t> ack_rtt_max_us;
+        std::atomic<uint64_t> ack_rtt_last_us;
+
+        // queue depths, current value
+        std::atomic<uint64_t> tx_queue_depth;
+        std::atomic<uint64_t> rx_queue_depth;
+        std::atomic<uint64_t> ack_wait_depth;
+
+        // duplicates recognised and not delivered twice
+        std::atomic<uint64_t> dedup_hits;
+
+        // queued latest value frames overwritten by a newer value before transmission
+        std::atomic<uint64_t> superseded;
+
+        // airtime accounting, current channel utilization and frames the admission control thinned or refused
+        std::atomic<uint64_t> air_utilization_permille;
+        std::atomic<uint64_t> admission_degraded;
+        std::atomic<uint64_t> admission_rejected;
+
+        // messages and queued frames dropped at their deadlines
+        std::atomic<uint64_t> expired_drops;
+
+        // the radio's last ATI7 report, RSSI and noise in its units, and its receive error count
+        std::atomic<uint64_t> radio_rssi_local;
+        std::atomic<uint64_t> radio_rssi_remote;
+        std::atomic<uint64_t> radio_noise_local;
+        std::atomic<uint64_t> radio_noise_remote;
+        std::atomic<uint64_t> radio_rx_errors;
+
+
+        void reset();
+        void record_ack_rtt(uint64_t rtt_us);
+
+        static void add(std::atomic<uint64_t>& counter, uint64_t n = 1)
+        {
+            counter.fetch_add(n, std::memory_order_relaxed);
+        }
+
+        static void set(std::atomic<uint64_t>& gauge, uint64_t value)
+        {
+            gauge.store(value, std::memory_order_relaxed);
+        }
+
+        static uint64_t get(const std::atomic<uint64_t>& counter)
+        {
+            return counter.load(std::memory_order_relaxed);
+        }
+    };
+
+    static_assert(std::atomic<uint64_t>::is_always_lock_free, "linkStats requires lock free 64 bit atomics in shared memory");
+
+
+    // the block instrumented code writes to, process local until a segment is created
+    linkStats& link_stats();
+
+
+    class linkStatsSegment{
+
+        public:
+
+        static constexpr const char* DEFAULT_NAME = "/rfd900_link_stats";
+
+        linkStatsSegment();
+        ~linkStatsSegment();
+
+        // disable copy constructor
+        linkStatsSegment(const linkStatsSegment&) = delete;
+
+        // disable assignment
+        linkStatsSegment& operator=(const linkStatsSegment&) = delete;
+
+        // radio process: create the segment and route link_stats() to it
+        int create(const char* name = DEFAULT_NAME);
+
+        // monitor process: map an existing segment read only
+        int attach(const char* name = DEFAULT_NAME);
+
+        const linkStats* stats() const { return block; }
+
+
+        private:
+
+        linkStats* block;
+        bool owner;
+        char segmentName[64];
+
+        void release();
+    };
+
+}
+
+
+#endif
@@ -0,0 +1,245 @@
+/**
+ * @brief loadGenerator class function definitions.
+ *
+ */
+
+#include <cmath>                        // log, floor
+#include <cstring>                      // memset, memcpy
+
+#include "load_generator.h"
+
+namespace rfd900sim
+{
+    constexpr int MAX_FRAME_ATTEMPTS = 16;
+    constexpr uint64_t FNV_OFFSET = 0xCBF29CE484222325ULL;
+    constexpr uint64_t FNV_PRIME = 0x100000001B3ULL;
+
+
+    static uint64_t fnv1a(uint64_t hash, const uint8_t* data, size_t length)
+    {
+        for(size_t i = 0; i < length; ++i){
+            hash = (hash ^ data[i]) * FNV_PRIME;
+        }
+        return hash;
+    }
+
+
+    loadGenerator::loadGenerator(const loadGeneratorConfig& config) : cfg(config)
+    {
+        if(cfg.source_count > MAX_LOAD_SOURCES){
+            cfg.source_count = MAX_LOAD_SOURCES;
+        }
+        if(cfg.bulk_length > FRAGMENT_PAYLOAD_LENGTH){
+            cfg.bulk_length = FRAGMENT_PAYLOAD_LENGTH;
+        }
+        mixTotal = cfg.mix.artifact + cfg.mix.robot_position + cfg.mix.ack + cfg.mix.bulk;
+        reset();
+    }
+
+
+    void loadGenerator::reset()
+    {
+        for(size_t i = 0; i < cfg.source_count; ++i){
+            source_t& source = sources[i];
+
+            // independent streams, adding a source leaves the others unchanged
+            source.random.reseed(cfg.seed + 0x632BE59BD9B4E019ULL * (i + 1));
+            source.burst_remaining = 0;
+            source.msg_id = 0;
+            source.robot_started = false;
+
+            // constant rate sources start at random phases rather than all at once
+            source.due_ns = cfg.arrivals == arrivalProcess::CONSTANT
+                        ? static_cast<uint64_t>(source.random.uniform() * next_gap(source)) : next_gap(source);
+        }
+        count = 0;
+        hash = FNV_OFFSET;
+    }
+
+
+    uint64_t loadGenerator::next_gap(source_t& source)
+    {
+        double mean_ns = cfg.rate > 0.0 ? 1e9 / cfg.rate : 1e9;
+        double gap;
+
+        switch(cfg.arrivals)
+        {
+            case arrivalProcess::CONSTANT:
+                gap = mean_ns;
+                break;
+            case arrivalProcess::POISSON:
+                gap = source.random.exponential(mean_ns);
+                break;
+            case arrivalProcess::BURSTY:
+            default:
+            {
+                if(source.burst_remaining > 0){
+                    --source.burst_remaining;
+                    return cfg.burst_gap_ns;
+                }
+
+                // the burst after this gap, geometric size with mean burst_mean
+                double m = cfg.burst_mean > 1.0 ? cfg.burst_mean : 1.0;
+                uint32_t size = 1;
+                if(m > 1.0){
+                    size += static_cast<uint32_t>(std::floor(std::log(1.0 - source.random.uniform()) / std::log(1.0 - 1.0 / m)));
+                }
+                source.burst_remaining = size - 1;
+
+                // bursts of mean m every m / rate on average, less the time spent inside them
+                double between = m * mean_ns - (m - 1.0) * cfg.burst_gap_ns;
+                gap = source.random.exponential(between > 0.0 ? between : 0.0);
+                break;
+            }
+        }
+
+        return static_cast<uint64_t>(gap + 0.5);
+    }
+
+
+    uint8_t loadGenerator::pick_type(source_t& source)
+    {
+        if(mixTotal <= 0.0){
+            return SimConstants::ARTIFACT_POSITION;
+        }
+
+        double u = source.random.uniform() * mixTotal;
+        if((u -= cfg.mix.artifact) < 0.0){
+            return SimConstants::ARTIFACT_POSITION;
+        }
+        if((u -= cfg.mix.robot_position) < 0.0){
+            return SimConstants::ROBOT_POSITION;
+        }
+        if((u -= cfg.mix.ack) < 0.0){
+            return SimConstants::ACK;
+        }
+        return SimConstants::FRAGMENT;
+    }
+
+
+    void loadGenerator::random_position(source_t& source, point_t* p)
+    {
+        p->x = source.random.below(3000) + source.random.uniform();
+        p->y = source.random.below(3000) + source.random.uniform();
+        p->z = source.random.below(3000) + source.random.uniform();
+    }
+
+
+    void loadGenerator::next(generated_message_t* out)
+    {
+        size_t first = 0;
+        for(size_t i = 1; i < cfg.source_count; ++i){
+            if(sources[i].due_ns < sources[first].due_ns){
+                first = i;
+            }
+        }
+
+        source_t& source = sources[first];
+        out->due_ns = source.due_ns;
+        build(source, static_cast<uint8_t>(cfg.first_source + first), out);
+        source.due_ns += next_gap(source);
+
+        ++count;
+        hash = fnv1a(hash, (const uint8_t*)&out->due_ns, sizeof(out->due_ns));
+        hash = fnv1a(hash, out->frame, out->length);
+    }
+
+
+    void loadGenerator::build(source_t& source, uint8_t src_id, generated_message_t* out)
+    {
+        const size_t indicators = SimConstants::MESSAGE_900_START_INDICATOR_LENGTH + SimConstants::MESSAGE_900_END_INDICATOR_LENGTH;
+
+        out->src_id = src_id;
+        out->msg_type = pick_type(source);
+        out->msg_id = source.msg_id;
+
+        // contents are redrawn until the frame holds no indicator, the first draw nearly always does
+        for(int attempt = 0; attempt < MAX_FRAME_ATTEMPTS; ++attempt){
+            switch(out->msg_type)
+            {
+                case SimConstants::ARTIFACT_POSITION:
+                {
+                    artifact_message_t art;
+                    memset(&art, 0, sizeof(art));                   // no stray padding bytes on the air
+                    art.dest_id = cfg.dest;
+                    art.src_id = src_id;
+                    art.msg_type = SimConstants::ARTIFACT_POSITION;
+                    art.msg_id = out->msg_id;
+                    art.artifact = static_cast<uint8_t>(source.random.below(SimConstants::NUM_ARTIFACT_CATEGORIES));
+                    art.stamp.sec = out->due_ns / 1000000000ULL;
+                    art.stamp.nsec = out->due_ns % 1000000000ULL;
+                    random_position(source, &art.position);
+                    out->length = sizeof(art) + indicators;
+                    serialize_artifact_for_900MHz(&art, out->frame, out->length);
+                    break;
+                }
+                case SimConstants::ROBOT_POSITION:
+                {
+                    // a random walk of up to 5 cm per axis between poses
+                    if(!source.robot_started){
+                        random_position(source, &source.robot_position);
+                        source.robot_started = true;
+                    }
+                    else{
+                        source.robot_position.x += (static_cast<int>(source.random.below(101)) - 50) / 1000.0;
+                        source.robot_position.y += (static_cast<int>(source.random.below(101)) - 50) / 1000.0;
+                        source.robot_position.z += (static_cast<int>(source.random.below(101)) - 50) / 1000.0;
+                    }
+
+                    robot_position_message_t pos;
+                    memset(&pos, 0, sizeof(pos));
+                    pos.dest_id = cfg.dest;
+                    pos.src_id = src_id;
+                    pos.msg_type = SimConstants::ROBOT_POSITION;
+                    pos.msg_id = out->msg_id;
+                    pos.stamp_us = static_cast<uint32_t>(out->due_ns / 1000ULL);
+                    pos.position = source.robot_position;
+                    out->length = sizeof(pos) + indicators;
+                    serialize_robot_position_for_900MHz(&pos, out->frame, out->length);
+                    break;
+                }
+                case SimConstants::ACK:
+                {
+                    // acknowledges a message the destination might have sent
+                    ack_message_t ack;
+                    memset(&ack, 0, sizeof(ack));
+                    out->msg_id = static_cast<uint16_t>(source.random.below(UINT16_MAX + 1U));
+                    populate_ack_message(&ack, cfg.dest, src_id, out->msg_id);
+                    out->length = sizeof(ack) + indicators;
+                    serialize_acknowledgement_for_900MHz(&ack, out->frame, out->length);
+                    break;
+                }
+                default:
+                {
+                    // a single fragment transfer of incompressible bytes
+                    fragment_message_t frag;
+                    memset(&frag, 0, sizeof(frag));
+                    frag.dest_id = cfg.dest;
+                    frag.src_id = src_id;
+                    frag.msg_type = SimConstants::FRAGMENT;
+                    frag.msg_id = out->msg_id;
+                    frag.fragment_count = 1;
+                    frag.total_length = static_cast<uint32_t>(cfg.bulk_length);
+                    frag.payload_length = static_cast<uint8_t>(cfg.bulk_length);
+                    for(size_t i = 0; i < cfg.bulk_length; i += sizeof(uint64_t)){
+                        uint64_t r = source.random.next();
+                        size_t n = cfg.bulk_length - i < sizeof(r) ? cfg.bulk_length - i : sizeof(r);
+                        memcpy(frag.payload + i, &r, n);
+                    }
+                    frag.crc = crc16_ccitt((const uint8_t*)&frag, FRAGMENT_HEADER_LENGTH + frag.payload_length);
+                    out->length = serialize_fragment_for_900MHz(&frag, out->frame, sizeof(out->frame));
+                    break;
+                }
+            }
+
+            if(frame_is_clean(out->frame, out->length)){
+                break;
+            }
+        }
+
+        if(out->msg_type != SimConstants::ACK){
+            ++source.msg_id;
+        }
+    }
+
+}
@@ -0,0 +1,136 @@
+/**
+ * @brief Declares the deterministic synthetic load generator
+ *
+ * Stress tests need traffic that is heavier and more varied than one
+ * artifact message per interval, and that is the same on every run. The
+ * loadGenerator produces framed messages, ready for send_message or a
+ * txScheduler, together with the time each one is due.
+ *
+ *      sources     source_count simulated nodes, ids first_source onward,
+ *                  each with its own msg_id sequence and random stream
+ *      mix         relative weights of ARTIFACT_POSITION, ROBOT_POSITION,
+ *                  ACK and bulk messages; bulk is a single FRAGMENT of
+ *                  bulk_length random bytes with a valid CRC
+ *      arrivals    per source
+ *                  CONSTANT  one message every 1 / rate seconds
+ *                  POISSON   exponential gaps with mean 1 / rate
+ *                  BURSTY    bursts arriving as a Poisson process, geometric
+ *                            burst sizes with mean burst_mean, burst_gap
+ *                            between the messages of a burst; the long run
+ *                            rate is still rate
+ *
+ * Everything, message contents and timestamps included, follows from the
+ * seed and the due times, never from the wall clock, so two generators with
+ * the same configuration produce the same bytes. digest() summarizes the
+ * sequence for comparing runs.
+ *
+ * The generator allocates nothing after construction.
+ *
+ */
+
+#ifndef LOAD_GENERATOR_INCLUDED_H
+#define LOAD_GENERATOR_INCLUDED_H
+
+#include <cstddef>
+#include <cstdint>
+
+#include "fragmentation.h"
+#include "sim_artifact_message.h"
+#include "sim_random.h"
+#include "simulation_constants.h"
+
+
+namespace rfd900sim
+{
+    constexpr size_t MAX_LOAD_SOURCES = 32;
+    constexpr size_t LOAD_FRAME_LENGTH = SERIAL_FRAGMENT_BUFFER_LENGTH;        // the longest generated frame
+
+    enum class arrivalProcess{
+        CONSTANT,
+        POISSON,
+        BURSTY
+    };
+
+    // relative weights, need not sum to one
+    struct loadMix{
+        double artifact = 1.0;
+        double robot_position = 0.0;
+        double ack = 0.0;
+        double bulk = 0.0;
+    };
+
+    struct loadGeneratorConfig{
+        uint64_t seed = DEFAULT_SIM_SEED;
+        arrivalProcess arrivals = arrivalProcess::POISSON;
+        double rate = 10.0;                                 // messages/s per source, long run mean
+        double burst_mean = 8.0;                            // BURSTY, messages per burst
+        uint64_t burst_gap_ns = 0;                          // BURSTY, between the messages of a burst
+        uint8_t first_source = SimConstants::AERIAL01;
+        size_t source_count = 1;
+        uint8_t dest = SimConstants::BASE_STATION;
+        loadMix mix;
+        size_t bulk_length = FRAGMENT_PAYLOAD_LENGTH;
+    };
+
+    struct generated_message_t{
+        uint64_t due_ns;                                    // since the start of the sequence
+        uint8_t src_id;
+        uint8_t msg_type;
+        uint16_t msg_id;
+        size_t length;                                      // framed bytes
+        uint8_t frame[LOAD_FRAME_LENGTH];
+    };
+
+
+    class loadGenerator{
+
+        public:
+
+        // source_count is clamped to MAX_LOAD_SOURCES, bulk_length to FRAGMENT_PAYLOAD_LENGTH
+        explicit loadGenerator(const loadGeneratorConfig& config);
+
+        // disable copy constructor
+        loadGenerator(const loadGenerator&) = delete;
+
+        // disable assignment
+        loadGenerator& operator=(const loadGenerator&) = delete;
+
+        // back to the first message of the sequence
+        void reset();
+
+        // the next message in due order, ties go to the lower source id
+        void next(generated_message_t* out);
+
+        uint64_t generated() const { return count; }
+
+        // FNV-1a over the due times and frames generated since reset
+        uint64_t digest() const { return hash; }
+
+
+        private:
+
+        struct source_t{
+            xoshiro256 random;
+            uint64_t due_ns;
+            uint32_t burst_remaining;
+            uint16_t msg_id;
+            bool robot_started;
+            point_t robot_position;
+        };
+
+        uint64_t next_gap(source_t& source);
+        uint8_t pick_type(source_t& source);
+        void build(source_t& source, uint8_t src_id, generated_message_t* out);
+        void random_position(source_t& source, point_t* p);
+
+        loadGeneratorConfig cfg;
+        double mixTotal;
+        source_t sources[MAX_LOAD_SOURCES];
+        uint64_t count;
+        uint64_t hash;
+    };
+
+}
+
+
+#endif
@@ -0,0 +1,177 @@
+/**
+ * Purpose:
+ *  Check the loadGenerator's statistics and reproducibility and measure its
+ *  speed, no radio needed.
+ *
+ *  For each arrival process the program generates an hour of traffic from
+ *  several sources and reports
+ *
+ *      the achieved rate per source against the configured rate
+ *      the index of dispersion of the message count per 100 ms window,
+ *      0 for CONSTANT, 1 for POISSON, above 1 for BURSTY
+ *      the share of each message type against the configured mix
+ *
+ *  It then generates the same sequence on two threads at once and again on
+ *  this thread after a reset and compares the digests, and times message
+ *  generation against simulate_artifact_message plus serialization.
+ *
+ * Optional Command line arguments
+ *  argv[1] - seed
+ *  argv[2] - messages/s per source
+ *  argv[3] - number of sources
+ *
+ */
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>                  // atoi, atof, strtoull
+#include <thread>
+#include <vector>
+
+#include "load_generator.h"
+#include "sim_artifact_message.h"
+#include "simulation_constants.h"
+
+
+using rfd900sim::SimConstants;
+using steady = std::chrono::steady_clock;
+
+constexpr uint64_t WINDOW_NS = 100000000ULL;
+constexpr double SIMULATED_SECONDS = 3600.0;
+constexpr uint64_t TIMED_MESSAGES = 2000000;
+
+
+static const char* arrival_name(rfd900sim::arrivalProcess arrivals)
+{
+    switch(arrivals)
+    {
+        case rfd900sim::arrivalProcess::CONSTANT: return "constant";
+        case rfd900sim::arrivalProcess::POISSON: return "poisson";
+        default: return "bursty";
+    }
+}
+
+
+static void statistics(const rfd900sim::loadGeneratorConfig& config)
+{
+    rfd900sim::loadGenerator generator(config);
+    rfd900sim::generated_message_t msg;
+    uint64_t end_ns = static_cast<uint64_t>(SIMULATED_SECONDS * 1e9);
+
+    std::vector<uint64_t> windows(end_ns / WINDOW_NS, 0);
+    uint64_t types[4] = {0, 0, 0, 0};
+    uint64_t total = 0;
+
+    for(generator.next(&msg); msg.due_ns < end_ns; generator.next(&msg)){
+        ++windows[msg.due_ns / WINDOW_NS];
+        ++total;
+        switch(msg.msg_type)
+        {
+            case SimConstants::ARTIFACT_POSITION: ++types[0]; break;
+            case SimConstants::ROBOT_POSITION: ++types[1]; break;
+            case SimConstants::ACK: ++types[2]; break;
+            default: ++types[3]; break;
+        }
+    }
+
+    double mean = static_cast<double>(total) / windows.size();
+    double variance = 0.0;
+    for(uint64_t w : windows){
+        variance += (w - mean) * (w - mean);
+    }
+    variance /= windows.size();
+
+    fprintf(stdout, "%-9s %10.2f %10.2f %10.2f   %5.1f %5.1f %5.1f %5.1f\n", arrival_name(config.arrivals),
+                config.rate, total / SIMULATED_SECONDS / config.source_count, mean > 0.0 ? variance / mean : 0.0,
+                100.0 * types[0] / total, 100.0 * types[1] / total, 100.0 * types[2] / total, 100.0 * types[3] / total);
+}
+
+
+static void digest_thread(const rfd900sim::loadGeneratorConfig* config, uint64_t count, uint64_t* digest)
+{
+    rfd900sim::loadGenerator generator(*config);
+    rfd900sim::generated_message_t msg;
+    for(uint64_t i = 0; i < count; ++i){
+        generator.next(&msg);
+    }
+    *digest = generator.digest();
+}
+
+
+int main(int argc, char **argv)
+{
+    rfd900sim::loadGeneratorConfig config;
+    config.rate = 50.0;
+    config.source_count = 4;
+    config.mix.artifact = 0.2;
+    config.mix.robot_position = 0.5;
+    config.mix.ack = 0.2;
+    config.mix.bulk = 0.1;
+
+    if(argc > 1){
+        config.seed = strtoull(argv[1], nullptr, 0);
+    }
+    if(argc > 2){
+        config.rate = atof(argv[2]);
+    }
+    if(argc > 3){
+        config.source_count = atoi(argv[3]);
+    }
+
+    fprintf(stdout, "seed %llu, %lu sources, mix artifact/robot/ack/bulk %.0f/%.0f/%.0f/%.0f %%, %.0f s simulated\n",
+                (unsigned long long)config.seed, config.source_count, 100.0 * config.mix.artifact,
+                100.0 * config.mix.robot_position, 100.0 * config.mix.ack, 100.0 * config.mix.bulk, SIMULATED_SECONDS);
+    fprintf(stdout, "%-9s %10s %10s %10s   %5s %5s %5s %5s\n", "arrivals", "rate", "achieved", "dispersion",
+                "art%", "pos%", "ack%", "bulk%");
+
+    const rfd900sim::arrivalProcess processes[] = {
+        rfd900sim::arrivalProcess::CONSTANT, rfd900sim::arrivalProcess::POISSON, rfd900sim::arrivalProcess::BURSTY
+    };
+    for(rfd900sim::arrivalProcess arrivals : processes){
+        config.arrivals = arrivals;
+        statistics(config);
+    }
+
+    // the same configuration on two threads at once and again here after a reset
+    config.arrivals = rfd900sim::arrivalProcess::BURSTY;
+    uint64_t digests[3];
+    std::thread first(digest_thread, &config, TIMED_MESSAGES / 2, &digests[0]);
+    std::thread second(digest_thread, &config, TIMED_MESSAGES / 2, &digests[1]);
+    first.join();
+    second.join();
+
+    rfd900sim::loadGenerator generator(config);
+    rfd900sim::generated_message_t msg;
+    for(uint64_t i = 0; i < TIMED_MESSAGES / 2; ++i){
+        generator.next(&msg);
+    }
+    generator.reset();
+
+    auto start = steady::now();
+    for(uint64_t i = 0; i < TIMED_MESSAGES / 2; ++i){
+        generator.next(&msg);
+    }
+    double generator_ns = std::chrono::duration<double, std::nano>(steady::now() - start).count() / (TIMED_MESSAGES / 2);
+    digests[2] = generator.digest();
+
+    fprintf(stdout, "digests of %llu messages: %016llx %016llx %016llx, %s\n", (unsigned long long)TIMED_MESSAGES / 2,
+                (unsigned long long)digests[0], (unsigned long long)digests[1], (unsigned long long)digests[2],
+                digests[0] == digests[1] && digests[1] == digests[2] ? "identical" : "DIFFERENT");
+
+    // the artifact only path the simulation used before
+    const size_t SERIAL_ARTIFACT_BUFFER_LENGTH = sizeof(rfd900sim::artifact_message_t) + 6;     // plus start and end indicators
+    uint8_t serial_buffer[SERIAL_ARTIFACT_BUFFER_LENGTH];
+    uint64_t sink = 0;
+    start = steady::now();
+    for(uint64_t i = 0; i < TIMED_MESSAGES / 2; ++i){
+        rfd900sim::artifact_message_t art;
+        rfd900sim::simulate_artifact_message(&art, SimConstants::BASE_STATION, SimConstants::AERIAL01);
+        rfd900sim::serialize_artifact_for_900MHz(&art, serial_buffer, SERIAL_ARTIFACT_BUFFER_LENGTH);
+        sink += serial_buffer[10];
+    }
+    double simulate_ns = std::chrono::duration<double, std::nano>(steady::now() - start).count() / (TIMED_MESSAGES / 2);
+
+    fprintf(stdout, "loadGenerator mix: %.0f ns/message, simulate_artifact_message + serialize: %.0f ns/message (%llu)\n",
+                generator_ns, simulate_ns, (unsigned long long)(sink & 1));
+    return digests[0] == digests[1] && digests[1] == digests[2] ? 0 : 1;
+}
@@ -1,13 +1,27 @@
 #include <cstdio>                   // fprintf
-#include <cstring>                  // strlen
-#include <cstdlib>                  // malloc, free
+#include <cstring>                  // memcpy, memset
+#include <utility>
+#include "link_stats.h"
 #include "message900.h"
+#include "outbound_journal.h"
+#include "trace.h"
+#include "virtual_clock.h"
 
 namespace rfd900comm{
 
-    message900::message900()
+    message900::message900(rtoMode mode, size_t capacity, size_t max_frame_length) :
+        nodes(capacity), storage(capacity * max_frame_length), maxFrameLength(max_frame_length),
+        head(NO_ENTRY), tail(NO_ENTRY), freeHead(NO_ENTRY), count(0),
+        expiry(capacity, EXPIRY_TICK), expiredCount(),
+        rto_mode(mode),
+        rtt(std::chrono::duration_cast<rttEstimator::duration>(retransmission_interval)),
+        windowFrames(DEFAULT_WINDOW_FRAMES), windowBytes(DEFAULT_WINDOW_BYTES),
+        journal(nullptr)
     {
-        // intentionally blank
+        for(std::chrono::milliseconds& ttl : typeTtl){
+            ttl = DEFAULT_MESSAGE_TTL;
+        }
+        empty_ack_wait_list();
     }
 
     message900::~message900()
@@ -17,49 +31,601 @@ namespace rfd900comm{
     
     void message900::empty_ack_wait_list()
     {
-        while(!ack_wait_list.empty()){
-            free(ack_wait_list.front().data);
-            ack_wait_list.pop_front();
+        // every node back on the free list, each owns a fixed slot of storage
+        for(size_t i = 0; i < nodes.size(); ++i){
+            nodes[i].msg.data = storage.data() + i * maxFrameLength;
+            nodes[i].next = i + 1 < nodes.size() ? i + 1 : NO_ENTRY;
+            expiry.cancel(i);
+        }
+        freeHead = nodes.empty() ? NO_ENTRY : 0;
+        head = NO_ENTRY;
+        tail = NO_ENTRY;
+        count = 0;
+        memset(windows, 0, sizeof(windows));
+
+    }
+
+    void message900::set_send_window(size_t window_frames, size_t window_bytes)
+    {
+        windowFrames = window_frames < 1 ? 1 : (window_frames > MAX_WINDOW_FRAMES ? MAX_WINDOW_FRAMES : window_frames);
+        windowBytes = window_bytes;
+    }
+
+
+    bool message900::window_open(uint8_t dest_id, uint16_t msg_id, size_t txdata_length) const
+    {
+        const window_t& w = windows[dest_id];
+        if(w.frames == 0){
+            return true;                                // an empty window always takes one message
+        }
+        if(w.frames >= windowFrames || w.bytes + txdata_length > windowBytes){
+            return false;
+        }
+
+        // the oldest unacknowledged message to the destination is the first in the list
+        for(uint32_t i = head; i != NO_ENTRY; i = nodes[i].next){
+            const message900_t& msg = nodes[i].msg;
+            if(msg.dest_id == dest_id){
+                uint16_t span = static_cast<uint16_t>(msg_id - msg.message_id);
+                return span < windowFrames;
+            }
         }
 
+        return true;
     }
 
+
     int message900::add_to_ack_wait_list(uint8_t dest_id, uint16_t msg_id, uint8_t msg_type, const uint8_t* txdata, size_t txdata_length)
     {
-        message900_t msg900;
-        msg900.dest_id = dest_id;
-        msg900.message_id = msg_id;
-        msg900.message_type = msg_type;
-        msg900.data = (uint8_t*)malloc(txdata_length*sizeof(uint8_t));
-        if(msg900.data == nullptr){
-            fprintf(stderr, "error, %s malloc failure\n", __func__);
+        return add_entry(dest_id, msg_id, msg_type, txdata, txdata_length, nullptr, message_deadline(msg_type));
+    }
+
+
+    int message900::add_to_ack_wait_list(uint8_t dest_id, uint16_t msg_id, uint8_t msg_type, const uint8_t* txdata, size_t txdata_length,
+                std::chrono::steady_clock::time_point expires)
+    {
+        return add_entry(dest_id, msg_id, msg_type, txdata, txdata_length, nullptr, expires);
+    }
+
+
+    int message900::add_to_ack_wait_list(uint8_t group_id, uint16_t msg_id, uint8_t msg_type, const uint8_t* txdata, size_t txdata_length,
+                const nodeSet& ackers)
+    {
+        if(ackers.empty()){
+            fprintf(stderr, "error, %s, group message to %hhu has no ackers, msg_id: %hu\n", __func__, group_id, msg_id);
             return -1;
         }
 
+        return add_entry(group_id, msg_id, msg_type, txdata, txdata_length, &ackers, message_deadline(msg_type));
+    }
+
+
+    int message900::add_entry(uint8_t dest_id, uint16_t msg_id, uint8_t msg_type, const uint8_t* txdata, size_t txdata_length,
+                const nodeSet* ackers, std::chrono::steady_clock::time_point expires)
+    {
+        // expired entries give their places in the window and the pool to this one
+        expire_messages();
+
+        if(!window_open(dest_id, msg_id, txdata_length)){
+            fprintf(stderr, "error, %s, send window to %hhu closed, msg_id: %hu\n", __func__, dest_id, msg_id);
+            return -1;
+        }
+
+        if(txdata_length > maxFrameLength){
+            fprintf(stderr, "error, %s, frame of %lu bytes exceeds %lu, msg_id: %hu\n", __func__, txdata_length, maxFrameLength, msg_id);
+            return -1;
+        }
+
+        if(freeHead == NO_ENTRY){
+            fprintf(stderr, "error, %s, ack wait list full (%lu), msg_id: %hu\n", __func__, nodes.size(), msg_id);
+            return -1;
+        }
+
+        uint32_t index = freeHead;
+        node_t& node = nodes[index];
+        freeHead = node.next;
+
+        message900_t& msg900 = node.msg;
+        msg900.dest_id = dest_id;
+        msg900.message_id = msg_id;
+        msg900.message_type = msg_type;
+        msg900.data_length = txdata_length;
         memcpy(msg900.data, txdata, txdata_length);
         get_timestamp(&msg900.sec, &msg900.nsec);                 // record transmit time
-        ack_wait_list.push_back(msg900);
+        msg900.tx_count = 1;
+        msg900.group = ackers != nullptr;
+        msg900.ackers = ackers != nullptr ? *ackers : nodeSet();
+        msg900.last_tx = clock_now();
+        msg900.retransmit_deadline = msg900.last_tx + entry_timeout(msg900);
+        msg900.expires = expires;
+        if(expires != std::chrono::steady_clock::time_point::max()){
+            expiry.schedule(index, expires);
+        }
+
+        // append, the list stays in transmit order
+        node.prev = tail;
+        node.next = NO_ENTRY;
+        if(tail == NO_ENTRY){
+            head = index;
+        }
+        else{
+            nodes[tail].next = index;
+        }
+        tail = index;
+        ++count;
+
+        ++windows[dest_id].frames;
+        windows[dest_id].bytes += txdata_length;
+        linkStats::set(link_stats().ack_wait_depth, count);
+        RFD900_TRACE_INSTANT(traceEvent::ACK_WAIT_ADD, msg_id);
+
+        if(journal != nullptr){
+            journalFrame frame;
+            frame.dest_id = dest_id;
+            frame.msg_id = msg_id;
+            frame.msg_type = msg_type;
+            frame.group = msg900.group;
+            frame.ackers = msg900.ackers;
+            frame.expires_ns = wall_clock_deadline(expires);
+            frame.data = txdata;
+            frame.length = txdata_length;
+            if(journal->append(frame) != 0){
+                fprintf(stderr, "warning, %s, msg_id %hu to %hhu not journaled\n", __func__, msg_id, dest_id);
+            }
+            journal->service();
+        }
         return 0;
     }
 
+
+    /**
+     * Journaled expiry times are wall clock, the steady clock starts over
+     * with the process. Restored entries count as retransmitted (Karn's rule,
+     * an ACK for them gives no RTT sample) and are due at once, the receiver
+     * may never have seen them. The send window is opened for the restore so
+     * every live frame fits, and frames that expired while the process was
+     * down are tombstoned.
+     */
+    size_t message900::attach_journal(outboundJournal* outbound)
+    {
+        journal = nullptr;
+        if(outbound == nullptr || !outbound->is_open()){
+            return 0;
+        }
+
+        auto now = clock_now();
+        int64_t wall_now = wall_clock_ns();
+        size_t saved_frames = windowFrames;
+        size_t saved_bytes = windowBytes;
+        windowFrames = MAX_WINDOW_FRAMES;
+        windowBytes = SIZE_MAX;
+
+        size_t restored = 0;
+        std::vector<std::pair<uint8_t, uint16_t>> stale;
+        outbound->for_each_live([&](const journalFrame& frame){
+            auto expires = std::chrono::steady_clock::time_point::max();
+            if(frame.expires_ns != outboundJournal::NO_EXPIRY){
+                if(frame.expires_ns <= wall_now){
+                    stale.emplace_back(frame.dest_id, frame.msg_id);
+                    return;
+                }
+                expires = now + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                            std::chrono::nanoseconds(frame.expires_ns - wall_now));
+            }
+
+            // a frame that does not fit stays in the journal for a larger list
+            if(add_entry(frame.dest_id, frame.msg_id, frame.msg_type, frame.data, frame.length,
+                        frame.group ? &frame.ackers : nullptr, expires) != 0){
+                return;
+            }
+            message900_t& msg = nodes[tail].msg;
+            msg.tx_count = 2;
+            msg.retransmit_deadline = now;
+            ++restored;
+        });
+
+        windowFrames = saved_frames;
+        windowBytes = saved_bytes;
+        journal = outbound;
+
+        for(const std::pair<uint8_t, uint16_t>& key : stale){
+            journal->tombstone(key.first, key.second);
+        }
+        journal->commit();
+        return restored;
+    }
+
+
+    int64_t message900::wall_clock_ns()
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    std::chrono::system_clock::now().time_since_epoch()).count();
+    }
+
+
+    int64_t message900::wall_clock_deadline(std::chrono::steady_clock::time_point expires)
+    {
+        if(expires == std::chrono::steady_clock::time_point::max()){
+            return outboundJournal::NO_EXPIRY;
+        }
+        return wall_clock_ns() + std::chrono::duration_cast<std::chrono::nanoseconds>(expires - clock_now()).count();
+    }
+
    
 
-    void message900::process_received_ack()
+    /**
+     * An ACK is sent by the node the original message was addressed to, so
+     * the ACK source id matches the dest_id recorded in the wait list. For a
+     * group message the ACK source is one of the entry's ackers.
+     *
+     * returns 0 when a matching entry was found and credited, -1 otherwise
+     * (duplicate or late ACK)
+     */
+    int message900::process_received_ack(uint8_t src_id, uint16_t msg_id)
+    {
+        uint32_t index = find_in_ack_wait_list(src_id, msg_id);
+        if(index == NO_ENTRY){
+            index = find_group_entry(src_id, msg_id);
+            if(index == NO_ENTRY){
+                return -1;
+            }
+        }
+        const message900_t& msg = nodes[index].msg;
+        RFD900_TRACE_INSTANT(traceEvent::ACK_RECEIVED, msg_id);
+
+        // Karn's rule: an ACK for a retransmitted message could belong to any of
+        // its transmissions, so only single transmissions produce an RTT sample
+        if(msg.tx_count == 1){
+            auto sample = std::chrono::duration_cast<rttEstimator::duration>(
+                        clock_now() - msg.last_tx);
+            rtt.add_sample(src_id, sample);
+            link_stats().record_ack_rtt(sample.count());
+        }
+        else{
+            linkStats::add(link_stats().acks_received);
+        }
+
+        if(credit_ack(index, src_id)){
+            erase_from_ack_wait_list(index);
+        }
+        return 0;
+    }
+
+
+    bool message900::ack_bitmap_covers(uint16_t cumulative, uint16_t run, uint64_t bitmap, uint16_t msg_id)
+    {
+        // serial number distance, ids wrap at 16 bits
+        int16_t behind = static_cast<int16_t>(cumulative - msg_id);
+        return behind >= 0 ? behind < run
+                    : (behind >= -64 && ((bitmap >> (-behind - 1)) & 1));
+    }
+
+
+    /**
+     * A coalesced ACK covers every msg_id in (cumulative - run, cumulative] and
+     * cumulative + 1 + i for every bit i set in bitmap. All covered entries are
+     * released in one pass over the wait list.
+     *
+     * Only the most recently transmitted covered entry gives an RTT sample, the
+     * older ones waited for the receiver's flush timer as well as the round trip.
+     *
+     * A covered group entry loses src_id from its ackers and is released once
+     * every acker has acknowledged.
+     *
+     * returns the number of entries credited
+     */
+    size_t message900::process_received_ack_bitmap(uint8_t src_id, uint16_t cumulative, uint16_t run, uint64_t bitmap)
+    {
+        bool sampled = false;
+        std::chrono::steady_clock::time_point newest;
+        size_t released = 0;
+
+        uint32_t index = head;
+        while(index != NO_ENTRY){
+            const message900_t& msg = nodes[index].msg;
+            if(!acknowledged_by(index, src_id)){
+                index = nodes[index].next;
+                continue;
+            }
+
+            if(!ack_bitmap_covers(cumulative, run, bitmap, msg.message_id)){
+                index = nodes[index].next;
+                continue;
+            }
+
+            if(msg.tx_count == 1 && (!sampled || msg.last_tx > newest)){
+                sampled = true;
+                newest = msg.last_tx;
+            }
+
+            index = credit_ack(index, src_id) ? erase_from_ack_wait_list(index) : nodes[index].next;
+            ++released;
+        }
+
+        if(released == 0){
+            return 0;
+        }
+
+        if(sampled){
+            auto sample = std::chrono::duration_cast<rttEstimator::duration>(clock_now() - newest);
+            rtt.add_sample(src_id, sample);
+            link_stats().record_ack_rtt(sample.count());
+        }
+        linkStats::add(link_stats().acks_received, sampled ? released - 1 : released);
+
+        return released;
+    }
+
+
+    int message900::remove_from_ack_wait_list(uint8_t dest_id, uint16_t msg_id)
+    {
+        uint32_t index = find_in_ack_wait_list(dest_id, msg_id);
+        if(index == NO_ENTRY){
+            return -1;
+        }
+
+        erase_from_ack_wait_list(index);
+        return 0;
+    }
+
+
+    uint32_t message900::find_in_ack_wait_list(uint8_t dest_id, uint16_t msg_id) const
+    {
+        for(uint32_t i = head; i != NO_ENTRY; i = nodes[i].next){
+            if(nodes[i].msg.dest_id == dest_id && nodes[i].msg.message_id == msg_id){
+                return i;
+            }
+        }
+
+        return NO_ENTRY;
+    }
+
+
+    uint32_t message900::find_group_entry(uint8_t src_id, uint16_t msg_id) const
     {
-        fprintf(stderr, "\nerror: %s incomplete\n", __func__);
+        for(uint32_t i = head; i != NO_ENTRY; i = nodes[i].next){
+            const message900_t& msg = nodes[i].msg;
+            if(msg.group && msg.message_id == msg_id && msg.ackers.contains(src_id)){
+                return i;
+            }
+        }
+
+        return NO_ENTRY;
     }
 
 
-     void message900::scan_list_for_retransmission()
-     {
-         fprintf(stderr, "\nerror: %s incomplete\n", __func__);
-     }
+    // true when an ACK from src_id can cover the entry
+    bool message900::acknowledged_by(uint32_t index, uint8_t src_id) const
+    {
+        const message900_t& msg = nodes[index].msg;
+        return msg.group ? msg.ackers.contains(src_id) : msg.dest_id == src_id;
+    }
+
+
+    // true when the entry has no ACK left to wait for
+    bool message900::credit_ack(uint32_t index, uint8_t src_id)
+    {
+        message900_t& msg = nodes[index].msg;
+        if(!msg.group){
+            return true;
+        }
+
+        msg.ackers.erase(src_id);
+        return msg.ackers.empty();
+    }
+
+
+    const nodeSet* message900::outstanding_ackers(uint8_t group_id, uint16_t msg_id) const
+    {
+        uint32_t index = find_in_ack_wait_list(group_id, msg_id);
+        if(index == NO_ENTRY || !nodes[index].msg.group){
+            return nullptr;
+        }
+        return &nodes[index].msg.ackers;
+    }
+
+
+    uint32_t message900::erase_from_ack_wait_list(uint32_t index)
+    {
+        node_t& node = nodes[index];
+        uint32_t next = node.next;
+
+        expiry.cancel(index);
+        if(journal != nullptr){
+            journal->tombstone(node.msg.dest_id, node.msg.message_id);
+        }
+
+        window_t& w = windows[node.msg.dest_id];
+        --w.frames;
+        w.bytes -= node.msg.data_length;
+
+        // unlink, the node and its storage slot go back on the free list
+        if(node.prev == NO_ENTRY){
+            head = next;
+        }
+        else{
+            nodes[node.prev].next = next;
+        }
+        if(next == NO_ENTRY){
+            tail = node.prev;
+        }
+        else{
+            nodes[next].prev = node.prev;
+        }
+
+        node.next = freeHead;
+        freeHead = index;
+        --count;
+
+        linkStats::set(link_stats().ack_wait_depth, count);
+        return next;
+    }
+
+
+    bool message900::in_ack_wait_list(uint8_t dest_id, uint16_t msg_id) const
+    {
+        return find_in_ack_wait_list(dest_id, msg_id) != NO_ENTRY;
+    }
+
+
+    /**
+     * Messages are retransmitted when their deadline passes. In ADAPTIVE mode the
+     * destination RTO backs off first, so the new deadline uses the doubled value.
+     * A group message waits for the slowest of its outstanding ackers, and only
+     * their RTOs back off.
+     */
+    size_t message900::scan_list_for_retransmission(const retransmit_function& retransmit)
+    {
+        expire_messages();
+        auto now = clock_now();
+        size_t retransmitted = 0;
+
+        for(uint32_t i = head; i != NO_ENTRY; i = nodes[i].next){
+            message900_t& msg = nodes[i].msg;
+            if(msg.retransmit_deadline > now){
+                continue;
+            }
+
+            backoff_entry(msg, now);
+            RFD900_TRACE_INSTANT(traceEvent::RETRANSMIT, msg.message_id);
+            retransmit(msg);
+
+            if(msg.tx_count < UINT8_MAX){
+                ++msg.tx_count;
+            }
+            msg.last_tx = now;
+            msg.retransmit_deadline = now + entry_timeout(msg);
+            ++retransmitted;
+        }
+
+        if(retransmitted > 0){
+            linkStats::add(link_stats().retransmits, retransmitted);
+        }
+        if(journal != nullptr){
+            journal->service();
+        }
+
+        return retransmitted;
+    }
+
+
+    std::chrono::steady_clock::time_point message900::next_retransmission_deadline() const
+    {
+        // backoff reorders the deadlines, the list is in transmit order
+        auto deadline = std::chrono::steady_clock::time_point::max();
+        for(uint32_t i = head; i != NO_ENTRY; i = nodes[i].next){
+            if(nodes[i].msg.retransmit_deadline < deadline){
+                deadline = nodes[i].msg.retransmit_deadline;
+            }
+        }
+        return deadline;
+    }
+
+
+    int message900::record_retransmission(uint8_t dest_id, uint16_t msg_id)
+    {
+        // an expired message is not retransmitted, the caller sees it gone
+        expire_messages();
+        uint32_t index = find_in_ack_wait_list(dest_id, msg_id);
+        if(index == NO_ENTRY){
+            return -1;
+        }
+        message900_t& msg = nodes[index].msg;
+        RFD900_TRACE_INSTANT(traceEvent::RETRANSMIT, msg_id);
+
+        auto now = clock_now();
+        backoff_entry(msg, now);
+
+        if(msg.tx_count < UINT8_MAX){
+            ++msg.tx_count;
+        }
+        msg.last_tx = now;
+        msg.retransmit_deadline = now + entry_timeout(msg);
+        linkStats::add(link_stats().retransmits);
+        return 0;
+    }
+
+
+    void message900::set_message_ttl(uint8_t msg_type, std::chrono::milliseconds ttl)
+    {
+        typeTtl[msg_type] = ttl < std::chrono::milliseconds::zero() ? std::chrono::milliseconds::zero() : ttl;
+    }
+
+
+    std::chrono::steady_clock::time_point message900::message_deadline(uint8_t msg_type) const
+    {
+        if(typeTtl[msg_type] == std::chrono::milliseconds::zero()){
+            return std::chrono::steady_clock::time_point::max();
+        }
+        return clock_now() + typeTtl[msg_type];
+    }
+
+
+    size_t message900::expire_messages()
+    {
+        if(expiry.size() == 0){
+            return 0;
+        }
+
+        size_t dropped = expiry.expire(clock_now(), [this](uint32_t index){
+            const message900_t& msg = nodes[index].msg;
+            ++expiredCount[msg.message_type];
+            RFD900_TRACE_INSTANT(traceEvent::EXPIRED, msg.message_id);
+            if(expiredFunction){
+                expiredFunction(msg);
+            }
+            erase_from_ack_wait_list(index);
+        });
+
+        if(dropped > 0){
+            linkStats::add(link_stats().expired_drops, dropped);
+        }
+        return dropped;
+    }
+
+
+    std::chrono::microseconds message900::retransmission_timeout(uint8_t dest_id) const
+    {
+        if(rto_mode == rtoMode::FIXED){
+            return std::chrono::duration_cast<std::chrono::microseconds>(retransmission_interval);
+        }
+        return rtt.rto(dest_id);
+    }
+
+
+    std::chrono::microseconds message900::entry_timeout(const message900_t& msg) const
+    {
+        if(!msg.group){
+            return retransmission_timeout(msg.dest_id);
+        }
+
+        std::chrono::microseconds timeout = std::chrono::microseconds::zero();
+        msg.ackers.for_each([&](uint8_t id){
+            std::chrono::microseconds t = retransmission_timeout(id);
+            timeout = t > timeout ? t : timeout;
+        });
+        return timeout;
+    }
+
+
+    void message900::backoff_entry(const message900_t& msg, std::chrono::steady_clock::time_point now)
+    {
+        if(rto_mode != rtoMode::ADAPTIVE){
+            return;
+        }
+
+        if(!msg.group){
+            rtt.backoff(msg.dest_id, now);
+            return;
+        }
+        msg.ackers.for_each([&](uint8_t id){ rtt.backoff(id, now); });
+    }
+
 
      // returns time since epoch
     void message900::get_timestamp(uint64_t* sec, uint64_t* nsec){
     
-        *nsec = std::chrono::duration_cast<std::chrono::nanoseconds>
-              (std::chrono::high_resolution_clock::now().time_since_epoch()).count();
+        *nsec = clock_epoch_ns();
 
         *sec = *nsec / 1000000000UL;
         *nsec = *nsec - (*sec * 1000000000UL);
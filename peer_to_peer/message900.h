@@ -4,12 +4,47 @@
 
 #include <chrono>
 #include <cstdint>
-#include <list>
+#include <functional>
 #include <string>
+#include <vector>
+
+#include "expiry_wheel.h"
+#include "rtt_estimator.h"
 
 
 namespace rfd900comm{
 
+    // set of node ids, one bit per id
+    struct nodeSet{
+        uint64_t bits[4] = {0, 0, 0, 0};
+
+        void insert(uint8_t id) { bits[id >> 6] |= 1ULL << (id & 63); }
+        void erase(uint8_t id) { bits[id >> 6] &= ~(1ULL << (id & 63)); }
+        bool contains(uint8_t id) const { return (bits[id >> 6] >> (id & 63)) & 1; }
+        bool empty() const { return (bits[0] | bits[1] | bits[2] | bits[3]) == 0; }
+
+        size_t size() const
+        {
+            size_t n = 0;
+            for(uint64_t word : bits){
+                n += __builtin_popcountll(word);
+            }
+            return n;
+        }
+
+        // calls f(id) for every id in the set, lowest first
+        template<typename F>
+        void for_each(F f) const
+        {
+            for(int w = 0; w < 4; ++w){
+                for(uint64_t word = bits[w]; word != 0; word &= word - 1){
+                    f(static_cast<uint8_t>(w * 64 + __builtin_ctzll(word)));
+                }
+            }
+        }
+    };
+
+
      struct message900_t{
         //timestamp_t tx_time;                // time message was transmitted
         uint64_t sec;
@@ -18,31 +53,205 @@ namespace rfd900comm{
         uint16_t message_id;
         uint8_t message_type;               // to be determined if this is needed
         uint8_t *data;
+        size_t data_length;
+        uint8_t tx_count;                   // 1 after the first transmission
+        bool group;                         // dest_id is a group address such as broadcast
+        nodeSet ackers;                     // group messages, nodes that have not acknowledged
+        std::chrono::steady_clock::time_point last_tx;
+        std::chrono::steady_clock::time_point retransmit_deadline;
+        std::chrono::steady_clock::time_point expires;      // dropped unacknowledged after this, max() never
+    };
+
+
+    /**
+     * FIXED    - every message is retransmitted retransmission_interval after its last transmission
+     * ADAPTIVE - the interval is the per destination RTO estimated from ACK round trip times
+     */
+    class outboundJournal;
+
+
+    enum class rtoMode{
+        FIXED,
+        ADAPTIVE
     };
 
+    /**
+     * Per destination send window, selective repeat over the uint16_t msg_id space.
+     *
+     * A message may enter the ack wait list when, for its destination,
+     *      the unacknowledged frames stay within window_frames
+     *      the unacknowledged bytes stay within window_bytes
+     *      its msg_id is less than window_frames ids after the oldest
+     *      unacknowledged msg_id (serial arithmetic, ids wrap)
+     *
+     * The last rule keeps a lost message from letting the sender run more than
+     * a window ahead of it. window_frames is capped at half the id space so
+     * old and new ids never alias. Producers check window_open before they
+     * transmit and hold the message while the window is closed.
+     *
+     * A group message (broadcast or multicast) is transmitted once and tracked
+     * as one entry whose ackers set holds the nodes still to acknowledge. Each
+     * ACK removes its source from the set and the entry is released once the
+     * set is empty. Retransmissions are for the nodes left in ackers, the
+     * retransmit function reads the set and addresses copies to them.
+     * The group address has its own send window.
+     *
+     * Time to live: a message that has not been acknowledged by its expiry
+     * time is worth nothing to the receiver and is dropped rather than
+     * retransmitted forever ahead of fresh data. The expiry is set by the
+     * caller or, by default, from the TTL of the message type, 60 seconds
+     * unless set_message_ttl changes it, zero for no expiry. Expired entries
+     * leave the list through an expiryWheel in O(1) each, before every
+     * retransmission scan and whenever an entry is added, and are counted
+     * per message type. set_expired_function is told of each one, so a
+     * producer held by a closed send window can be woken.
+     *
+     * The ack wait list is a fixed pool of capacity entries with
+     * max_frame_length bytes of storage each, allocated by the constructor.
+     * Adding, acknowledging and retransmitting messages never allocates.
+     *
+     * With an outboundJournal attached every entry added is appended to the
+     * journal and every entry leaving the list, acknowledged, removed or
+     * expired, is tombstoned, so a restarted process gets its unacknowledged
+     * messages back. attach_journal restores them, due for retransmission at
+     * once. Only whole entries are journaled: a restored group message waits
+     * for all of its original ackers again.
+     */
     class message900{
         public:
 
         static constexpr auto retransmission_interval = std::chrono::seconds(3);
+        static constexpr auto DEFAULT_MESSAGE_TTL = std::chrono::seconds(60);
+        static constexpr auto EXPIRY_TICK = std::chrono::milliseconds(100);
+
+        static constexpr size_t DEFAULT_WINDOW_FRAMES = 64;
+        static constexpr size_t DEFAULT_WINDOW_BYTES = 8192;
+        static constexpr size_t MAX_WINDOW_FRAMES = 0x8000;
+        static constexpr size_t DEFAULT_CAPACITY = 256;
+        static constexpr size_t DEFAULT_MAX_FRAME_LENGTH = 256;
+
+        using retransmit_function = std::function<void(const message900_t&)>;
+        using expired_function = std::function<void(const message900_t&)>;
 
-        message900();
+        message900(rtoMode mode = rtoMode::ADAPTIVE, size_t capacity = DEFAULT_CAPACITY,
+                    size_t max_frame_length = DEFAULT_MAX_FRAME_LENGTH);
         ~message900();
 
+        // disable copy constructor, entries point into this object's storage
+        message900(const message900&) = delete;
+
+        // disable assignment
+        message900& operator=(const message900&) = delete;
+
+
+        void set_send_window(size_t window_frames, size_t window_bytes);
+        bool window_open(uint8_t dest_id, uint16_t msg_id, size_t txdata_length) const;
+        size_t in_flight_frames(uint8_t dest_id) const { return windows[dest_id].frames; }
+        size_t in_flight_bytes(uint8_t dest_id) const { return windows[dest_id].bytes; }
 
         int add_to_ack_wait_list(uint8_t dest_id, uint16_t msg_id, uint8_t msg_type, const uint8_t* txdata, size_t txdata_length);
-        void process_received_ack();
-        void scan_list_for_retransmission();
+        int add_to_ack_wait_list(uint8_t dest_id, uint16_t msg_id, uint8_t msg_type, const uint8_t* txdata, size_t txdata_length,
+                    std::chrono::steady_clock::time_point expires);
+        int add_to_ack_wait_list(uint8_t group_id, uint16_t msg_id, uint8_t msg_type, const uint8_t* txdata, size_t txdata_length,
+                    const nodeSet& ackers);
+        int process_received_ack(uint8_t src_id, uint16_t msg_id);
+        size_t process_received_ack_bitmap(uint8_t src_id, uint16_t cumulative, uint16_t run, uint64_t bitmap);
+
+        // true when a coalesced ACK of cumulative, run and bitmap covers msg_id
+        static bool ack_bitmap_covers(uint16_t cumulative, uint16_t run, uint64_t bitmap, uint16_t msg_id);
 
-        
+        int remove_from_ack_wait_list(uint8_t dest_id, uint16_t msg_id);
+        bool in_ack_wait_list(uint8_t dest_id, uint16_t msg_id) const;
+
+        // a ttl of zero keeps messages of the type until they are acknowledged
+        void set_message_ttl(uint8_t msg_type, std::chrono::milliseconds ttl);
+        std::chrono::milliseconds message_ttl(uint8_t msg_type) const { return typeTtl[msg_type]; }
+
+        // now plus the type's ttl, for the copies of a message queued elsewhere, max() without a ttl
+        std::chrono::steady_clock::time_point message_deadline(uint8_t msg_type) const;
+
+        // drops the expired messages, returns the number dropped
+        size_t expire_messages();
+        uint64_t expired(uint8_t msg_type) const { return expiredCount[msg_type]; }
+
+        // called for each entry expire_messages drops, before it leaves the list
+        void set_expired_function(const expired_function& f) { expiredFunction = f; }
+
+        // calls retransmit for every message whose deadline has passed, returns the number retransmitted
+        size_t scan_list_for_retransmission(const retransmit_function& retransmit);
+
+        // the earliest retransmission deadline, time_point::max() when nothing waits
+        std::chrono::steady_clock::time_point next_retransmission_deadline() const;
+
+        // for callers that time retransmissions themselves (reliableSender)
+        int record_retransmission(uint8_t dest_id, uint16_t msg_id);
+
+        std::chrono::microseconds retransmission_timeout(uint8_t dest_id) const;
+
+        // nodes that have not acknowledged a group message, nullptr when it is not waiting
+        const nodeSet* outstanding_ackers(uint8_t group_id, uint16_t msg_id) const;
+
+        size_t ack_wait_list_size() const { return count; }
+        size_t ack_wait_list_capacity() const { return nodes.size(); }
+        rtoMode get_rto_mode() const { return rto_mode; }
+        rttEstimator& get_rtt_estimator() { return rtt; }
+
+        // restores the journal's live frames and journals from then on, returns the number restored
+        size_t attach_journal(outboundJournal* outbound);
+        void detach_journal() { journal = nullptr; }
 
 
         private:
 
-        // list to store transmitted messages
-        std::list<message900_t> ack_wait_list;
+        static constexpr uint32_t NO_ENTRY = UINT32_MAX;
+
+        // transmitted messages, linked oldest first, unused nodes on the free list
+        struct node_t{
+            message900_t msg;
+            uint32_t prev;
+            uint32_t next;
+        };
+
+        std::vector<node_t> nodes;
+        std::vector<uint8_t> storage;           // max_frame_length bytes per node
+        size_t maxFrameLength;
+        uint32_t head;
+        uint32_t tail;
+        uint32_t freeHead;
+        size_t count;
+        expiryWheel expiry;
+
+        std::chrono::milliseconds typeTtl[UINT8_MAX + 1];
+        uint64_t expiredCount[UINT8_MAX + 1];
+        expired_function expiredFunction;
+
+        rtoMode rto_mode;
+        rttEstimator rtt;
+
+        struct window_t{
+            size_t frames;
+            size_t bytes;
+        };
+
+        size_t windowFrames;
+        size_t windowBytes;
+        window_t windows[UINT8_MAX + 1];
+
+        outboundJournal* journal;
 
         void empty_ack_wait_list();
+        int add_entry(uint8_t dest_id, uint16_t msg_id, uint8_t msg_type, const uint8_t* txdata, size_t txdata_length,
+                    const nodeSet* ackers, std::chrono::steady_clock::time_point expires);
+        uint32_t find_in_ack_wait_list(uint8_t dest_id, uint16_t msg_id) const;
+        uint32_t find_group_entry(uint8_t src_id, uint16_t msg_id) const;
+        bool acknowledged_by(uint32_t index, uint8_t src_id) const;
+        bool credit_ack(uint32_t index, uint8_t src_id);
+        uint32_t erase_from_ack_wait_list(uint32_t index);          // returns the next entry
+        std::chrono::microseconds entry_timeout(const message900_t& msg) const;
+        void backoff_entry(const message900_t& msg, std::chrono::steady_clock::time_point now);
         void get_timestamp(uint64_t* sec, uint64_t* nsec);
+        static int64_t wall_clock_ns();
+        static int64_t wall_clock_deadline(std::chrono::steady_clock::time_point expires);
 
 
     };
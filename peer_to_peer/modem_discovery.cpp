@@ -0,0 +1,319 @@
+/**
+ * @brief Serial port discovery function definitions.
+ *
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <glob.h>
+#include <poll.h>
+#include <stdio.h>
+#include <string.h>                     // strerror
+#include <termios.h>
+#include <unistd.h>
+
+#include <algorithm>
+
+#include "modem_discovery.h"
+
+namespace rfd900comm{
+
+    namespace{
+
+        using steady = std::chrono::steady_clock;
+
+        enum class probeStage{
+            ESCAPE,                             // "+++" sent, waiting for OK
+            IDENTIFY,                           // "ATI" sent, waiting for the banner
+            DONE,
+            FAILED
+        };
+
+        struct probe_t{
+            std::string path;
+            int fd;
+            size_t rate;                        // index into the rates tried
+            probeStage stage;
+            steady::time_point deadline;
+            std::string reply;
+        };
+
+        constexpr size_t MAX_REPLY = 256;
+
+
+        speed_t speed_of(int baud_rate)
+        {
+            switch(baud_rate){
+            case 9600:      return B9600;
+            case 19200:     return B19200;
+            case 38400:     return B38400;
+            case 115200:    return B115200;
+            default:        return B57600;
+            }
+        }
+
+
+        void add_candidate(std::vector<std::string>* paths, const std::string& path)
+        {
+            if(std::find(paths->begin(), paths->end(), path) == paths->end()){
+                paths->push_back(path);
+            }
+        }
+
+
+        void add_system_ports(std::vector<std::string>* paths)
+        {
+            const char* patterns[] = {"/dev/ttyUSB*", "/dev/ttyACM*"};
+            for(const char* pattern : patterns){
+                glob_t found;
+                if(glob(pattern, 0, nullptr, &found) == 0){
+                    for(size_t i = 0; i < found.gl_pathc; ++i){
+                        add_candidate(paths, found.gl_pathv[i]);
+                    }
+                }
+                globfree(&found);
+            }
+        }
+
+
+        void send(probe_t* probe, const char* text)
+        {
+            ssize_t n = write(probe->fd, text, strlen(text));
+            if(n < 0 && errno != EAGAIN){
+                fprintf(stderr, "warning, %s, write %s: %s\n", __func__, probe->path.c_str(), strerror(errno));
+            }
+        }
+
+
+        // sets the port to the next rate and sends the escape, returns false when the port is failed
+        bool start_rate(probe_t* probe, const std::vector<int>& rates, const modemDiscoveryConfig& config)
+        {
+            struct termios tio;
+
+            if(probe->rate >= rates.size()){
+                probe->stage = probeStage::FAILED;
+                return false;
+            }
+
+            memset(&tio, 0, sizeof(tio));
+            cfmakeraw(&tio);
+            tio.c_cflag |= CLOCAL | CREAD;
+            if(config.flow == flowControl::RTS_CTS){
+                tio.c_cflag |= CRTSCTS;
+            }
+            cfsetispeed(&tio, speed_of(rates[probe->rate]));
+            cfsetospeed(&tio, speed_of(rates[probe->rate]));
+            tio.c_cc[VMIN] = 0;
+            tio.c_cc[VTIME] = 0;
+            if(tcsetattr(probe->fd, TCSANOW, &tio) < 0){
+                probe->stage = probeStage::FAILED;
+                return false;
+            }
+            tcflush(probe->fd, TCIOFLUSH);
+
+            probe->reply.clear();
+            probe->stage = probeStage::ESCAPE;
+            probe->deadline = steady::now() + config.guard_time + config.response_timeout;
+            send(probe, "+++");
+            return true;
+        }
+
+
+        void identify(probe_t* probe, const char* command, const modemDiscoveryConfig& config)
+        {
+            probe->reply.clear();
+            probe->stage = probeStage::IDENTIFY;
+            probe->deadline = steady::now() + config.response_timeout;
+            send(probe, command);
+        }
+
+
+        // the first complete line naming the firmware, not the echoed command
+        bool find_banner(const std::string& reply, std::string* banner)
+        {
+            size_t start = 0;
+            size_t end;
+            while((end = reply.find_first_of("\r\n", start)) != std::string::npos){
+                std::string text = reply.substr(start, end - start);
+                if(text != "ATI" && (text.find("SiK") != std::string::npos || text.find("RFD") != std::string::npos)){
+                    *banner = text;
+                    return true;
+                }
+                start = end + 1;
+            }
+            return false;
+        }
+
+
+        void receive(probe_t* probe, const modemDiscoveryConfig& config, modemDiscoveryResult* result,
+                    const std::vector<int>& rates)
+        {
+            char buffer[128];
+            ssize_t n;
+            while((n = read(probe->fd, buffer, sizeof(buffer))) > 0){
+                probe->reply.append(buffer, n);
+            }
+            if(probe->reply.size() > MAX_REPLY){
+                probe->reply.erase(0, probe->reply.size() - MAX_REPLY);
+            }
+
+            if(probe->stage == probeStage::ESCAPE){
+                if(probe->reply.find("OK") != std::string::npos){
+                    identify(probe, "ATI\r\n", config);
+                }
+                else if(probe->reply.find("+++") != std::string::npos){
+                    // echoed, the radio was already in command mode, the CR ends "+++" as a command
+                    identify(probe, "\rATI\r\n", config);
+                }
+            }
+            else if(probe->stage == probeStage::IDENTIFY){
+                std::string banner;
+                if(find_banner(probe->reply, &banner)){
+                    send(probe, "ATO\r\n");
+                    tcdrain(probe->fd);
+                    probe->stage = probeStage::DONE;
+                    result->modems.push_back({probe->path, rates[probe->rate], banner});
+                }
+            }
+        }
+
+
+        void timed_out(probe_t* probe, const std::vector<int>& rates, const modemDiscoveryConfig& config)
+        {
+            if(probe->stage == probeStage::IDENTIFY){
+                send(probe, "ATO\r\n");             // answered OK but no banner, leave command mode
+            }
+            ++probe->rate;
+            start_rate(probe, rates, config);
+        }
+
+    }
+
+
+    /**
+     * One poll() loop drives every port, each through its own rates, so a
+     * port that never answers costs no more time than the slowest port.
+     */
+    size_t probe_modems(const modemDiscoveryConfig& config, modemDiscoveryResult* result)
+    {
+        steady::time_point start = steady::now();
+
+        result->modems.clear();
+
+        std::vector<std::string> paths;
+        for(const std::string& path : config.candidates){
+            add_candidate(&paths, path);
+        }
+        if(config.scan_system){
+            add_system_ports(&paths);
+        }
+        result->candidates = paths.size();
+
+        // the preferred rate first, then the others in the supported order
+        std::vector<int> rates;
+        rates.push_back(config.preferred_baud);
+        for(int baud : rfd900Modem::SUPPORTED_BAUD_RATES){
+            if(baud != config.preferred_baud){
+                rates.push_back(baud);
+            }
+        }
+
+        std::vector<probe_t> probes;
+        for(const std::string& path : paths){
+            int fd = open(path.c_str(), O_RDWR | O_NOCTTY | O_NONBLOCK);
+            if(fd < 0){
+                fprintf(stderr, "warning, %s, open %s: %s\n", __func__, path.c_str(), strerror(errno));
+                continue;
+            }
+            probes.push_back({path, fd, 0, probeStage::ESCAPE, start, std::string()});
+        }
+        for(probe_t& probe : probes){
+            start_rate(&probe, rates, config);
+        }
+
+        std::vector<struct pollfd> fds;
+        std::vector<probe_t*> polled;
+        while(!(config.first_only && !result->modems.empty())){
+            fds.clear();
+            polled.clear();
+            steady::time_point next = steady::time_point::max();
+            for(probe_t& probe : probes){
+                if(probe.stage == probeStage::ESCAPE || probe.stage == probeStage::IDENTIFY){
+                    fds.push_back({probe.fd, POLLIN, 0});
+                    polled.push_back(&probe);
+                    next = std::min(next, probe.deadline);
+                }
+            }
+            if(polled.empty()){
+                break;
+            }
+
+            auto wait = std::chrono::duration_cast<std::chrono::milliseconds>(next - steady::now());
+            int timeout_ms = wait.count() > 0 ? static_cast<int>(wait.count()) + 1 : 0;
+            if(poll(fds.data(), fds.size(), timeout_ms) < 0 && errno != EINTR){
+                fprintf(stderr, "error, %s, poll: %s\n", __func__, strerror(errno));
+                break;
+            }
+
+            steady::time_point now = steady::now();
+            for(size_t i = 0; i < polled.size(); ++i){
+                probe_t* probe = polled[i];
+                if(fds[i].revents & POLLIN){
+                    receive(probe, config, result, rates);
+                }
+                else if(fds[i].revents & (POLLERR | POLLHUP | POLLNVAL)){
+                    probe->stage = probeStage::FAILED;          // unplugged
+                    continue;
+                }
+
+                // a port that keeps sending, another device or a radio at the wrong rate, still times out
+                if((probe->stage == probeStage::ESCAPE || probe->stage == probeStage::IDENTIFY) && now >= probe->deadline){
+                    timed_out(probe, rates, config);
+                }
+            }
+        }
+
+        for(probe_t& probe : probes){
+            if(probe.stage == probeStage::IDENTIFY){
+                send(&probe, "ATO\r\n");
+            }
+            close(probe.fd);
+        }
+
+        result->elapsed = std::chrono::duration_cast<std::chrono::microseconds>(steady::now() - start);
+        return result->modems.size();
+    }
+
+
+    int discover_modem(rfd900Modem& modem, const modemDiscoveryConfig& config, modemDiscoveryResult* result)
+    {
+        modemDiscoveryResult local;
+        if(result == nullptr){
+            result = &local;
+        }
+
+        if(probe_modems(config, result) == 0){
+            fprintf(stderr, "error, %s, no radio answered on %lu ports\n", __func__, result->candidates);
+            return -1;
+        }
+
+        const discoveredModem& found = result->modems.front();
+        fprintf(stderr, "info, %s, %s at %d baud, %s, %.1f ms\n", __func__, found.path.c_str(), found.baud_rate,
+                    found.banner.c_str(), result->elapsed.count() / 1000.0);
+
+        return modem.init(found.path.c_str(), found.baud_rate, config.profile, config.flow);
+    }
+
+
+    int open_radio(rfd900Modem& modem, const char* devicePath, int baud_rate)
+    {
+        if(devicePath != nullptr && devicePath[0] != '\0'){
+            return modem.init(devicePath, baud_rate);
+        }
+
+        modemDiscoveryConfig config;
+        config.preferred_baud = baud_rate;
+        return discover_modem(modem, config);
+    }
+
+}
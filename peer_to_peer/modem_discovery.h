@@ -0,0 +1,84 @@
+/**
+ * @brief Declares serial port discovery, finding the radio and its baud rate at startup
+ *
+ * A USB re-enumeration moves the radio from /dev/ttyUSB0 to ttyUSB1 or
+ * ttyACM0, a reconfiguration changes its serial speed. discover_modem finds
+ * it instead of failing on a fixed path and rate.
+ *
+ * Every candidate, /dev/ttyUSB* and /dev/ttyACM* plus any paths the caller
+ * adds, is opened nonblocking and probed at the same time from one poll()
+ * loop. On each port the supported baud rates are tried in turn, the
+ * preferred rate first, with the RFD900x (SiK firmware) handshake:
+ *
+ *      "+++"       after guard_time of silence the radio answers "OK" and
+ *                  enters command mode, at the wrong rate nothing useful
+ *                  comes back and the next rate is tried
+ *      "ATI\r\n"   the radio echoes the command and answers with its
+ *                  banner, "RFD SiK 3.54 on RFD900x", which must name SiK
+ *                  or RFD
+ *      "ATO\r\n"   back to data mode
+ *
+ * The time to find a radio is about one guard time per rate tried, for all
+ * ports together. The SiK firmware needs about a second of silence after
+ * "+++"; a radio at the preferred rate is found in that time. A radio left
+ * in command mode echoes the "+++" and is asked for its banner at once.
+ *
+ * With first_only the probe stops at the first radio that answers and
+ * rfd900Modem::init opens it, ready for use. Otherwise every candidate is
+ * probed to the end and all radios found are reported.
+ *
+ */
+
+#ifndef MODEM_DISCOVERY_INCLUDED_H
+#define MODEM_DISCOVERY_INCLUDED_H
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include "rfd900_modem.h"
+
+
+namespace rfd900comm{
+
+    struct modemDiscoveryConfig{
+        std::vector<std::string> candidates;                // probed as well as the system's ports
+        bool scan_system = true;                            // /dev/ttyUSB* and /dev/ttyACM*
+        int preferred_baud = rfd900Modem::DEFAULT_BAUD_RATE;
+        std::chrono::milliseconds guard_time{1000};         // silence the radio needs after "+++"
+        std::chrono::milliseconds response_timeout{200};
+        bool first_only = true;
+        serialProfile profile = serialProfile::LOW_LATENCY;
+        flowControl flow = flowControl::NONE;
+    };
+
+    struct discoveredModem{
+        std::string path;
+        int baud_rate;
+        std::string banner;                                 // the ATI reply
+    };
+
+    struct modemDiscoveryResult{
+        std::vector<discoveredModem> modems;                // in the order they answered
+        size_t candidates;
+        std::chrono::microseconds elapsed;
+    };
+
+
+    // probes the candidates, returns the number of radios found
+    size_t probe_modems(const modemDiscoveryConfig& config, modemDiscoveryResult* result);
+
+    // probes the candidates and opens modem on the first radio found, returns 0, or -1 when none answered
+    int discover_modem(rfd900Modem& modem, const modemDiscoveryConfig& config, modemDiscoveryResult* result = nullptr);
+
+    /**
+     * Startup for the radio programs: opens devicePath at baud_rate when a
+     * path is given, otherwise discovers the radio preferring baud_rate.
+     * returns 0, or -1 when no radio could be opened
+     */
+    int open_radio(rfd900Modem& modem, const char* devicePath, int baud_rate = rfd900Modem::DEFAULT_BAUD_RATE);
+
+}
+
+
+#endif
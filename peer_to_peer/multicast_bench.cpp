@@ -0,0 +1,276 @@
+/**
+ * Purpose:
+ *  Compare the airtime of telling every robot about an artifact with N
+ *  unicast copies against one broadcast tracked with a message900 acker set.
+ *
+ *  The base station and the robots share one linkEmulator channel. Each
+ *  robot loses chunks independently. The base station sends every artifact
+ *
+ *  UNICAST   - as one copy per robot, each copy its own ack wait list entry
+ *  BROADCAST - once to SimConstants::BROADCAST, one entry whose ackers are
+ *              the robots; a retransmission goes to the robots that have not
+ *              acknowledged, a broadcast again only when none has
+ *
+ *  and every robot acknowledges what it receives. For each mode the program
+ *  reports the data and ACK bytes on the air, the airtime they take and the
+ *  retransmissions, once every artifact has been acknowledged by every robot.
+ *
+ * Optional Command line arguments
+ *  argv[1] - number of artifacts
+ *  argv[2] - number of robots, 1 to 4
+ *  argv[3] - loss probability per chunk and robot
+ *
+ */
+
+#include <atomic>
+#include <chrono>
+#include <cstdlib>                  // atoi, atof
+#include <cstring>                  // memcpy
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "link_emulator.h"
+#include "message900.h"
+#include "rfd900_modem.h"
+#include "simulation_constants.h"
+#include "sim_artifact_message.h"
+
+
+using rfd900sim::SimConstants;
+using steady = std::chrono::steady_clock;
+
+constexpr size_t SERIAL_RX_BUFFER_LENGTH = 256;
+constexpr long POLL_TIMEOUT = 1000L;            // units, microseconds
+constexpr size_t MAX_ROBOTS = 4;
+
+const uint8_t robot_ids[MAX_ROBOTS] = {
+    SimConstants::GROUND01, SimConstants::AERIAL01, SimConstants::AERIAL02, SimConstants::ANCHOR_STATION
+};
+
+enum class castMode{
+    UNICAST,
+    BROADCAST
+};
+
+struct robot_t{
+    uint8_t id;
+    rfd900comm::rfd900Modem radio;
+    std::string temp_rx_storage;
+    std::string extracted_rx_data;
+};
+
+static std::atomic<bool> robotsRunning;
+static std::atomic<uint64_t> ackBytes;
+
+
+// one thread serves every robot, process_rx_message keeps sequence statistics in statics
+static void robots(std::vector<std::unique_ptr<robot_t>>* robot_list)
+{
+    const size_t SERIAL_ACK_BUFFER_LENGTH = sizeof(rfd900sim::ack_message_t)
+                        + SimConstants::MESSAGE_900_START_INDICATOR_LENGTH
+                        + SimConstants::MESSAGE_900_END_INDICATOR_LENGTH;
+
+    std::vector<uint8_t> serial_ack_buffer(SERIAL_ACK_BUFFER_LENGTH);
+    uint8_t serial_rx_buffer[SERIAL_RX_BUFFER_LENGTH];
+
+    while(robotsRunning){
+        for(auto& robot : *robot_list){
+            ssize_t bytesRead = robot->radio.read_serial(serial_rx_buffer, SERIAL_RX_BUFFER_LENGTH, POLL_TIMEOUT);
+            if(bytesRead <= 0){
+                continue;
+            }
+
+            rfd900sim::append_rx_data(robot->temp_rx_storage, serial_rx_buffer, bytesRead);
+            while(rfd900sim::extract_rx_message(robot->temp_rx_storage, robot->extracted_rx_data)){
+                uint8_t dest_id = robot->extracted_rx_data[0];
+                if(dest_id != robot->id && dest_id != SimConstants::BROADCAST){
+                    continue;                           // another robot's copy or ACK
+                }
+
+                rfd900sim::ack_message_t ackmsg;
+                if(rfd900sim::process_rx_message(robot->extracted_rx_data, &ackmsg, true, robot->id) == SimConstants::SEND_ACK){
+                    rfd900sim::serialize_acknowledgement_for_900MHz(&ackmsg, serial_ack_buffer.data(), SERIAL_ACK_BUFFER_LENGTH);
+                    robot->radio.send_message((const char*)serial_ack_buffer.data(), SERIAL_ACK_BUFFER_LENGTH);
+                    ackBytes += SERIAL_ACK_BUFFER_LENGTH;
+                }
+            }
+        }
+    }
+}
+
+
+static int run_mode(castMode mode, const rfd900comm::linkEmulatorConfig& config, int messageCount, size_t robotCount)
+{
+    const size_t SERIAL_ARTIFACT_BUFFER_LENGTH = sizeof(rfd900sim::artifact_message_t)
+                        + SimConstants::MESSAGE_900_START_INDICATOR_LENGTH
+                        + SimConstants::MESSAGE_900_END_INDICATOR_LENGTH;
+
+    rfd900comm::linkEmulator emulator;
+    rfd900comm::rfd900Modem base_radio;
+    rfd900comm::message900 msg900;
+    std::vector<std::unique_ptr<robot_t>> robot_list;
+
+    std::vector<uint8_t> serial_tx_buffer(SERIAL_ARTIFACT_BUFFER_LENGTH);
+    std::vector<uint8_t> serial_copy_buffer(SERIAL_ARTIFACT_BUFFER_LENGTH);
+    uint8_t serial_rx_buffer[SERIAL_RX_BUFFER_LENGTH];
+    std::string temp_rx_storage;
+    std::string extracted_rx_data;
+
+    if(emulator.start(config) != 0){
+        return -1;
+    }
+
+    if(base_radio.init(emulator.port_name(0)) != 0){
+        fprintf(stderr, "error, %s base radio init failure\n", __func__);
+        return -1;
+    }
+
+    rfd900comm::nodeSet ackers;
+    for(size_t r = 0; r < robotCount; ++r){
+        robot_list.emplace_back(new robot_t);
+        robot_list.back()->id = robot_ids[r];
+        rfd900sim::reserve_rx_storage(robot_list.back()->temp_rx_storage, robot_list.back()->extracted_rx_data);
+        if(robot_list.back()->radio.init(emulator.port_name(r + 1)) != 0){
+            fprintf(stderr, "error, %s robot radio init failure\n", __func__);
+            return -1;
+        }
+        ackers.insert(robot_ids[r]);
+    }
+
+    uint64_t dataBytes = 0;
+    size_t retransmissions = 0;
+
+    // a group message goes again to each robot still missing it, or to all when none has it
+    auto retransmit = [&](const rfd900comm::message900_t& msg){
+        if(!msg.group || msg.ackers.size() == robotCount){
+            base_radio.send_message((const char*)msg.data, msg.data_length);
+            dataBytes += msg.data_length;
+            ++retransmissions;
+            return;
+        }
+
+        memcpy(serial_copy_buffer.data(), msg.data, msg.data_length);
+        msg.ackers.for_each([&](uint8_t id){
+            rfd900sim::address_frame(serial_copy_buffer.data(), id);
+            base_radio.send_message((const char*)serial_copy_buffer.data(), msg.data_length);
+            dataBytes += msg.data_length;
+            ++retransmissions;
+        });
+    };
+
+    ackBytes = 0;
+    robotsRunning = true;
+    std::thread robot_thread(robots, &robot_list);
+
+    rfd900sim::artifact_message_t artmsg;
+    bool held = false;                          // artmsg waits for the send windows
+    int sent = 0;
+    auto start = steady::now();
+    auto give_up = start + std::chrono::seconds(60 + messageCount);
+
+    while((sent < messageCount || msg900.ack_wait_list_size() > 0) && steady::now() < give_up){
+
+        if(sent < messageCount){
+            // an artifact with an indicator inside its frame could never be extracted, draw another
+            while(!held){
+                rfd900sim::simulate_artifact_message(&artmsg, SimConstants::BROADCAST, SimConstants::BASE_STATION);
+                rfd900sim::serialize_artifact_for_900MHz(&artmsg, serial_tx_buffer.data(), SERIAL_ARTIFACT_BUFFER_LENGTH);
+                held = rfd900sim::frame_is_clean(serial_tx_buffer.data(), SERIAL_ARTIFACT_BUFFER_LENGTH);
+            }
+
+            if(mode == castMode::BROADCAST){
+                if(msg900.window_open(SimConstants::BROADCAST, artmsg.msg_id, SERIAL_ARTIFACT_BUFFER_LENGTH)){
+                    base_radio.send_message((const char*)serial_tx_buffer.data(), SERIAL_ARTIFACT_BUFFER_LENGTH);
+                    dataBytes += SERIAL_ARTIFACT_BUFFER_LENGTH;
+                    msg900.add_to_ack_wait_list(SimConstants::BROADCAST, artmsg.msg_id, artmsg.msg_type,
+                                serial_tx_buffer.data(), SERIAL_ARTIFACT_BUFFER_LENGTH, ackers);
+                    held = false;
+                    ++sent;
+                }
+            }
+            else{
+                bool open = true;
+                for(size_t r = 0; r < robotCount; ++r){
+                    open = open && msg900.window_open(robot_ids[r], artmsg.msg_id, SERIAL_ARTIFACT_BUFFER_LENGTH);
+                }
+
+                if(open){
+                    for(size_t r = 0; r < robotCount; ++r){
+                        rfd900sim::address_frame(serial_tx_buffer.data(), robot_ids[r]);
+                        base_radio.send_message((const char*)serial_tx_buffer.data(), SERIAL_ARTIFACT_BUFFER_LENGTH);
+                        dataBytes += SERIAL_ARTIFACT_BUFFER_LENGTH;
+                        msg900.add_to_ack_wait_list(robot_ids[r], artmsg.msg_id, artmsg.msg_type,
+                                    serial_tx_buffer.data(), SERIAL_ARTIFACT_BUFFER_LENGTH);
+                    }
+                    held = false;
+                    ++sent;
+                }
+            }
+        }
+
+        ssize_t bytesRead = base_radio.read_serial(serial_rx_buffer, SERIAL_RX_BUFFER_LENGTH, held ? POLL_TIMEOUT : 0L);
+        if(bytesRead > 0){
+            rfd900sim::append_rx_data(temp_rx_storage, serial_rx_buffer, bytesRead);
+            while(rfd900sim::extract_rx_message(temp_rx_storage, extracted_rx_data)){
+                rfd900sim::ack_message_t ack;
+                if(rfd900sim::process_rx_message(extracted_rx_data, &ack) != SimConstants::PROCESS_ACK
+                        || extracted_rx_data[2] != SimConstants::ACK){
+                    continue;
+                }
+
+                memcpy(&ack, extracted_rx_data.data(), sizeof(ack));
+                msg900.process_received_ack(ack.src_id, ack.msg_id);
+            }
+        }
+
+        msg900.scan_list_for_retransmission(retransmit);
+    }
+
+    double elapsed = std::chrono::duration<double>(steady::now() - start).count();
+    size_t unacknowledged = msg900.ack_wait_list_size();
+
+    robotsRunning = false;
+    robot_thread.join();
+
+    double airtime = (double)(dataBytes + ackBytes) / config.air_bytes_per_sec;
+    fprintf(stdout, "%10s %10lu %10lu %10.2f %8.3f %14lu %8.1f %10lu\n", mode == castMode::UNICAST ? "unicast" : "broadcast",
+                dataBytes, (uint64_t)ackBytes, airtime, airtime / messageCount, retransmissions, elapsed, unacknowledged);
+    return 0;
+}
+
+
+int main(int argc, char **argv)
+{
+    int messageCount = 200;
+    size_t robotCount = MAX_ROBOTS;
+    rfd900comm::linkEmulatorConfig config;
+    config.latency = std::chrono::milliseconds(20);
+    config.loss_probability = 0.05;
+    config.independent_loss = true;
+
+    if(argc > 1){
+        messageCount = atoi(argv[1]);
+    }
+    if(argc > 2){
+        robotCount = atoi(argv[2]);
+        robotCount = robotCount < 1 ? 1 : (robotCount > MAX_ROBOTS ? MAX_ROBOTS : robotCount);
+    }
+    if(argc > 3){
+        config.loss_probability = atof(argv[3]);
+    }
+    config.ports = robotCount + 1;
+
+    fprintf(stdout, "artifacts: %d, robots: %lu, loss per robot: %.2f, air rate: %u bytes/s\n\n",
+                messageCount, robotCount, config.loss_probability, config.air_bytes_per_sec);
+    fprintf(stdout, "%10s %10s %10s %10s %8s %14s %8s %10s\n",
+                "mode", "data B", "ack B", "airtime s", "s/msg", "retransmits", "time s", "unacked");
+
+    if(run_mode(castMode::UNICAST, config, messageCount, robotCount) != 0
+            || run_mode(castMode::BROADCAST, config, messageCount, robotCount) != 0){
+        return 1;
+    }
+
+    return 0;
+}
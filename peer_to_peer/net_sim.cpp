@@ -0,0 +1,95 @@
+/**
+ * Purpose:
+ *  Run whole networks of node stacks in virtual time, no radios needed.
+ *
+ *  The program first runs five nodes, four reporting artifacts and robot
+ *  positions to the base station, for the configured duration and reports
+ *  delivery, latency, retransmissions and channel use, with the wall clock
+ *  time it took. It then repeats the run for growing node counts, doubling
+ *  up to the maximum, to show how the shared channel and the simulator
+ *  scale.
+ *
+ * Optional Command line arguments
+ *  argv[1] - virtual seconds per run, default 3600
+ *  argv[2] - packet loss probability per receiver, default 0.01
+ *  argv[3] - maximum number of nodes, default 40
+ *  argv[4] - seed
+ *  argv[5] - 1 runs airtime admission control on every node, default 0
+ *
+ */
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>                  // atoi, atof, strtoull
+
+#include "net_simulator.h"
+
+
+using steady = std::chrono::steady_clock;
+
+
+static int run(const rfd900sim::netSimulatorConfig& config, bool header)
+{
+    rfd900sim::netSimulator sim(config);
+
+    auto start = steady::now();
+    if(sim.run() < 0){
+        return -1;
+    }
+    double wall = std::chrono::duration<double>(steady::now() - start).count();
+
+    const rfd900sim::netSimulatorStats& s = sim.get_stats();
+    if(header){
+        fprintf(stdout, "%5s %8s %8s %8s %7s %9s %9s %7s %8s %6s %9s %8s %9s\n", "nodes", "offered", "refused", "expired",
+                    "deliv%", "lat ms", "p95 ms", "retx", "pos/s", "pos ms", "channel%", "wall s", "speedup");
+    }
+
+    uint64_t accepted = s.artifacts_offered - s.artifacts_refused;
+    fprintf(stdout, "%5lu %8llu %8llu %8llu %7.2f %9.1f %9.1f %7llu %8.1f %6.1f %9.1f %8.2f %9.0f\n", config.node_count,
+                (unsigned long long)s.artifacts_offered, (unsigned long long)s.artifacts_refused,
+                (unsigned long long)s.artifacts_expired,
+                accepted > 0 ? 100.0 * s.artifacts_delivered / accepted : 0.0, s.artifact_latency_mean_ms,
+                s.artifact_latency_p95_ms, (unsigned long long)s.retransmissions, s.positions_delivered / config.duration_s,
+                s.position_latency_mean_ms, 100.0 * s.channel_utilization, wall, config.duration_s / wall);
+    return 0;
+}
+
+
+int main(int argc, char **argv)
+{
+    rfd900sim::netSimulatorConfig config;
+    config.loss_probability = 0.01;
+    size_t max_nodes = 40;
+
+    if(argc > 1){
+        config.duration_s = atof(argv[1]);
+    }
+    if(argc > 2){
+        config.loss_probability = atof(argv[2]);
+    }
+    if(argc > 3){
+        max_nodes = atoi(argv[3]);
+    }
+    if(argc > 4){
+        config.seed = strtoull(argv[4], nullptr, 0);
+    }
+    if(argc > 5){
+        config.admission = atoi(argv[5]) != 0;
+    }
+
+    fprintf(stdout, "%.0f s virtual per run, %u bytes/s air rate, %.1f %% loss, artifacts %.2f/s and positions %.1f/s per node,"
+                " admission control %s\n", config.duration_s, config.air_bytes_per_sec, 100.0 * config.loss_probability,
+                config.artifact_rate, config.position_rate, config.admission ? "on" : "off");
+
+    if(run(config, true) < 0){
+        return 1;
+    }
+
+    for(size_t nodes = 2 * config.node_count; nodes <= max_nodes; nodes *= 2){
+        config.node_count = nodes;
+        if(run(config, false) < 0){
+            return 1;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,367 @@
+/**
+ * @brief netSimulator class function definitions.
+ *
+ */
+
+#include <algorithm>                    // min, nth_element
+#include <cerrno>
+#include <cstdio>
+#include <cstring>                      // memcpy
+
+#include "net_simulator.h"
+#include "sim_artifact_message.h"
+#include "virtual_clock.h"
+
+namespace rfd900sim
+{
+    constexpr uint64_t CHANNEL_SEED = 0xC4A77E1ULL;
+
+    using rfd900comm::txPriority;
+
+
+    ssize_t netSimulator::simRadio::write_serial(const uint8_t* data, size_t length)
+    {
+        size_t room = tx_room();
+        if(room == 0 && length > 0){
+            errno = EAGAIN;
+            return -1;
+        }
+
+        size_t n = length < room ? length : room;
+        buffered.append((const char*)data, n);
+        return n;
+    }
+
+
+    netSimulator::netSimulator(const netSimulatorConfig& config) : cfg(config), stats(), channelRandom(config.seed ^ CHANNEL_SEED)
+    {
+        // intentionally blank
+    }
+
+
+    netSimulator::~netSimulator()
+    {
+        // intentionally blank
+    }
+
+
+    /**
+     * Each step jumps to the earliest of the channel coming free, a packet
+     * reaching the other nodes and a node's next message or retransmission
+     * deadline, then processes everything due at that time: the transmitter
+     * that finished refills its radio, packets are delivered, nodes whose
+     * time came are serviced and an idle channel goes to the next radio with
+     * bytes waiting.
+     */
+    int netSimulator::run()
+    {
+        if(cfg.node_count < 2 || cfg.node_count > SimConstants::BROADCAST || cfg.sink_id >= cfg.node_count){
+            fprintf(stderr, "error, %s, %lu nodes with sink %hhu, ids must be below %d\n", __func__,
+                        cfg.node_count, cfg.sink_id, SimConstants::BROADCAST);
+            return -1;
+        }
+        if(cfg.air_bytes_per_sec == 0 || cfg.max_packet_bytes == 0 || cfg.duration_s <= 0.0){
+            fprintf(stderr, "error, %s, air rate, packet length and duration must be positive\n", __func__);
+            return -1;
+        }
+
+        stats = netSimulatorStats();
+        inFlight.clear();
+        delivered.clear();
+        artifactLatencies.clear();
+        positionLatencySum = 0.0;
+        channelRandom.reseed(cfg.seed ^ CHANNEL_SEED);
+
+        // the stacks are built on the virtual clock so their timers start at its zero
+        now = steady::time_point();
+        rfd900comm::set_virtual_clock(&now);
+
+        nodes.clear();
+        for(size_t i = 0; i < cfg.node_count; ++i){
+            nodes.emplace_back(new sim_node_t(static_cast<uint8_t>(i), cfg.radio_buffer_bytes));
+            sim_node_t& node = *nodes.back();
+            node.rx.resize(cfg.node_count);
+            for(std::string& stream : node.rx){
+                reserve_rx_storage(stream, node.extracted);
+            }
+
+            if(cfg.admission){
+                rfd900comm::airtimeConfig air = cfg.airtime;
+                air.air_speed_kbps = cfg.air_bytes_per_sec * 8 / 1000;
+                air.max_packet_bytes = cfg.max_packet_bytes;
+                air.packet_overhead_bytes = cfg.packet_overhead_bytes;
+                node.airtime.reset(new rfd900comm::airtimeAccountant(air));
+                node.scheduler.set_airtime_accountant(node.airtime.get());
+            }
+
+            node.arq.set_message_ttl(SimConstants::ARTIFACT_POSITION, cfg.artifact_ttl);
+
+            if(node.id != cfg.sink_id){
+                loadGeneratorConfig traffic;
+                traffic.seed = cfg.seed + node.id;
+                traffic.arrivals = cfg.arrivals;
+                traffic.rate = cfg.artifact_rate + cfg.position_rate;
+                traffic.first_source = node.id;
+                traffic.dest = cfg.sink_id;
+                traffic.mix.artifact = cfg.artifact_rate;
+                traffic.mix.robot_position = cfg.position_rate;
+                node.traffic.reset(new loadGenerator(traffic));
+                node.traffic->next(&node.next_message);
+            }
+            service(node);
+        }
+
+        const steady::time_point end = now + std::chrono::duration_cast<steady::duration>(std::chrono::duration<double>(cfg.duration_s));
+        channelFree = now;
+        channelBusy = false;
+        lastGranted = cfg.node_count - 1;
+        busySeconds = 0.0;
+
+        while(true){
+            steady::time_point next = end;
+            if(channelBusy && channelFree < next){
+                next = channelFree;
+            }
+            if(!inFlight.empty() && inFlight.front().arrival < next){
+                next = inFlight.front().arrival;
+            }
+            for(const std::unique_ptr<sim_node_t>& node : nodes){
+                if(node->wake < next){
+                    next = node->wake;
+                }
+            }
+            if(next >= end){
+                break;
+            }
+
+            now = next;
+            ++stats.events;
+
+            if(channelBusy && channelFree <= now){
+                channelBusy = false;
+                service(*nodes[lastGranted]);
+            }
+
+            while(!inFlight.empty() && inFlight.front().arrival <= now){
+                deliver(inFlight.front());
+                inFlight.pop_front();
+            }
+
+            for(const std::unique_ptr<sim_node_t>& node : nodes){
+                if(node->wake <= now){
+                    service(*node);
+                }
+            }
+
+            if(!channelBusy){
+                grant();
+            }
+        }
+
+        now = end;
+        for(const std::unique_ptr<sim_node_t>& node : nodes){
+            stats.positions_superseded += node->scheduler.superseded();
+            stats.artifacts_expired += node->arq.expired(SimConstants::ARTIFACT_POSITION);
+        }
+        rfd900comm::set_virtual_clock(nullptr);
+
+        stats.channel_utilization = busySeconds / cfg.duration_s;
+        if(!artifactLatencies.empty()){
+            double sum = 0.0;
+            for(double latency : artifactLatencies){
+                sum += latency;
+            }
+            stats.artifact_latency_mean_ms = sum / artifactLatencies.size();
+
+            size_t p95 = artifactLatencies.size() * 95 / 100;
+            std::nth_element(artifactLatencies.begin(), artifactLatencies.begin() + p95, artifactLatencies.end());
+            stats.artifact_latency_p95_ms = artifactLatencies[p95];
+        }
+        if(stats.positions_delivered > 0){
+            stats.position_latency_mean_ms = positionLatencySum / stats.positions_delivered;
+        }
+
+        return 0;
+    }
+
+
+    void netSimulator::service(sim_node_t& node)
+    {
+        steady::time_point wake = steady::time_point::max();
+
+        if(node.traffic){
+            steady::time_point due;
+            while((due = steady::time_point(std::chrono::nanoseconds(node.next_message.due_ns))) <= now){
+                offer(node, node.next_message);
+                node.traffic->next(&node.next_message);
+            }
+            wake = due;
+        }
+
+        stats.retransmissions += node.arq.scan_list_for_retransmission([&node](const rfd900comm::message900_t& msg){
+            node.scheduler.enqueue(txPriority::HIGH, msg.data, msg.data_length, msg.expires, msg.message_type);
+        });
+        node.scheduler.service(node.radio);
+
+        node.wake = std::min(wake, node.arq.next_retransmission_deadline());
+    }
+
+
+    void netSimulator::offer(sim_node_t& node, const generated_message_t& msg)
+    {
+        if(msg.msg_type == SimConstants::ROBOT_POSITION){
+            ++stats.positions_offered;
+            if(node.scheduler.enqueue_latest(txPriority::NORMAL,
+                        rfd900comm::txScheduler::latest_key(node.id, SimConstants::ROBOT_POSITION), msg.frame, msg.length) < 0){
+                ++stats.positions_refused;
+            }
+            return;
+        }
+
+        // checked here, add_to_ack_wait_list reports a refusal on stderr
+        // the queued copy and the ARQ entry expire together
+        ++stats.artifacts_offered;
+        node.arq.expire_messages();
+        steady::time_point expires = node.arq.message_deadline(msg.msg_type);
+        if(!node.arq.window_open(cfg.sink_id, msg.msg_id, msg.length)
+                    || node.arq.ack_wait_list_size() >= node.arq.ack_wait_list_capacity()
+                    || node.scheduler.enqueue(txPriority::HIGH, msg.frame, msg.length, expires, msg.msg_type) == 0){
+            ++stats.artifacts_refused;
+            return;
+        }
+        node.arq.add_to_ack_wait_list(cfg.sink_id, msg.msg_id, msg.msg_type, msg.frame, msg.length, expires);
+    }
+
+
+    void netSimulator::grant()
+    {
+        for(size_t k = 1; k <= nodes.size(); ++k){
+            size_t i = (lastGranted + k) % nodes.size();
+            sim_node_t& node = *nodes[i];
+            if(node.radio.buffered.empty()){
+                continue;
+            }
+
+            size_t length = std::min(node.radio.buffered.size(), cfg.max_packet_bytes);
+            std::chrono::duration<double> airtime(static_cast<double>(length + cfg.packet_overhead_bytes) / cfg.air_bytes_per_sec);
+
+            air_packet_t packet;
+            packet.sender = i;
+            packet.bytes.assign(node.radio.buffered, 0, length);
+            node.radio.buffered.erase(0, length);
+
+            channelBusy = true;
+            channelFree = now + std::chrono::duration_cast<steady::duration>(airtime);
+            packet.arrival = channelFree + cfg.latency;
+            inFlight.push_back(std::move(packet));
+            busySeconds += airtime.count();
+            lastGranted = i;
+            ++stats.packets;
+
+            // the radio has room again
+            service(node);
+            return;
+        }
+    }
+
+
+    void netSimulator::deliver(const air_packet_t& packet)
+    {
+        for(const std::unique_ptr<sim_node_t>& receiver : nodes){
+            sim_node_t& node = *receiver;
+            if(node.id == packet.sender){
+                continue;
+            }
+            if(cfg.loss_probability > 0.0 && channelRandom.uniform() < cfg.loss_probability){
+                ++stats.packets_lost;
+                continue;
+            }
+            if(node.airtime){
+                node.airtime->charge_heard(packet.bytes.size());
+            }
+
+            std::string& stream = node.rx[packet.sender];
+            append_rx_data(stream, (const uint8_t*)packet.bytes.data(), packet.bytes.size());
+            bool received = false;
+            while(extract_rx_message(stream, node.extracted)){
+                handle(node, packet.sender, node.extracted);
+                received = true;
+            }
+
+            // ACKs go out as soon as the frame that needs them arrives
+            if(received){
+                service(node);
+            }
+        }
+    }
+
+
+    void netSimulator::handle(sim_node_t& node, size_t sender, const std::string& message)
+    {
+        if(message.length() < 3){
+            ++stats.frames_garbled;
+            return;
+        }
+
+        // every node hears every packet, the radios do not filter on address
+        uint8_t dest_id = message[0];
+        if(dest_id != node.id && dest_id != SimConstants::BROADCAST){
+            return;
+        }
+
+        // a frame spliced across a lost packet can carry any header, the frames have no checksum
+        uint8_t msg_type = message[2];
+        if(static_cast<uint8_t>(message[1]) != sender || (msg_type != SimConstants::ARTIFACT_POSITION
+                    && msg_type != SimConstants::ROBOT_POSITION && msg_type != SimConstants::ACK)){
+            ++stats.frames_garbled;
+            return;
+        }
+
+        ack_message_t ack;
+        int action = process_rx_message(message, &ack, node.id == cfg.sink_id, node.id);
+        switch(action)
+        {
+            case SimConstants::SEND_ACK:
+            {
+                artifact_message_t art;
+                deserialize_artifact_for_900MHz(&art, (const uint8_t*)message.data());
+                uint64_t stamp_ns = art.stamp.sec * 1000000000ULL + art.stamp.nsec;
+                if(stamp_ns > static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(now.time_since_epoch()).count())){
+                    ++stats.frames_garbled;
+                    break;
+                }
+                if(delivered.insert((uint64_t(art.src_id) << 56) ^ stamp_ns).second){
+                    ++stats.artifacts_delivered;
+                    artifactLatencies.push_back(std::chrono::duration<double, std::milli>(now.time_since_epoch()).count() - stamp_ns / 1e6);
+                }
+
+                uint8_t serial_ack[sizeof(ack_message_t) + 6];        // plus start and end indicators
+                serialize_acknowledgement_for_900MHz(&ack, serial_ack, sizeof(serial_ack));
+                node.scheduler.enqueue(txPriority::CONTROL, serial_ack, sizeof(serial_ack));
+                break;
+            }
+            case SimConstants::NO_ACK:
+                if(msg_type == SimConstants::ROBOT_POSITION){
+                    robot_position_message_t pos;
+                    deserialize_robot_position_for_900MHz(&pos, (const uint8_t*)message.data());
+                    uint32_t now_us = static_cast<uint32_t>(std::chrono::duration_cast<std::chrono::microseconds>(now.time_since_epoch()).count());
+                    ++stats.positions_delivered;
+                    positionLatencySum += static_cast<uint32_t>(now_us - pos.stamp_us) / 1000.0;
+                }
+                break;
+            case SimConstants::PROCESS_ACK:
+            {
+                ack_message_t received;
+                memcpy(&received, message.data(), sizeof(received));
+                if(node.arq.process_received_ack(received.src_id, received.msg_id) == 0){
+                    ++stats.artifacts_acked;
+                }
+                break;
+            }
+            default:
+                ++stats.frames_garbled;
+                break;
+        }
+    }
+
+}
@@ -0,0 +1,198 @@
+/**
+ * @brief Declares netSimulator, many node stacks on one simulated channel in virtual time
+ *
+ * Testing five nodes on hardware takes five radios, five terminals and real
+ * time. The simulator runs node_count complete node stacks in one thread:
+ *
+ *      traffic     a loadGenerator per reporting node, ARTIFACT_POSITION
+ *                  reports and ROBOT_POSITION updates addressed to sink_id
+ *      ARQ         artifacts wait in the node's message900 for an ACK and
+ *                  are retransmitted at its deadlines, until their time to
+ *                  live runs out
+ *      scheduling  ACKs at CONTROL, artifacts at HIGH and positions as
+ *                  latest value frames at NORMAL through the node's
+ *                  txScheduler, which writes to the node's radio model
+ *      receiving   extract_rx_message and process_rx_message on the bytes
+ *                  the radio delivers; a node ignores frames addressed to
+ *                  another node, the sink acknowledges artifacts, senders
+ *                  credit ACKs to message900
+ *
+ * Channel: the half duplex shared channel of the RFD900x multipoint
+ * firmware. One radio transmits at a time, the radios with bytes buffered
+ * take turns of up to max_packet_bytes, an ideal TDM with no collisions.
+ * A packet occupies the channel for its bytes plus packet_overhead_bytes at
+ * air_bytes_per_sec and reaches every other node latency after it ends,
+ * lost at each receiver with loss_probability. A radio buffers at most
+ * radio_buffer_bytes, the scheduler only writes what fits.
+ *
+ * Time is virtual: the simulator points the thread's clock (see
+ * virtual_clock.h) at the time of the event it is processing, so message900
+ * deadlines, RTT samples and message stamps are all in virtual time, and
+ * jumps from one event to the next. An hour of traffic takes seconds.
+ *
+ * With admission set every node runs an airtimeAccountant on its scheduler,
+ * charged with its own frames and with every packet it hears, so nodes turn
+ * away positions and then artifacts as the shared channel fills up.
+ *
+ * There is no routing in the stack: every node hears every packet and
+ * filters on dest_id, as with the radios.
+ *
+ */
+
+#ifndef NET_SIMULATOR_INCLUDED_H
+#define NET_SIMULATOR_INCLUDED_H
+
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+#include "airtime_accountant.h"
+#include "load_generator.h"
+#include "message900.h"
+#include "sim_random.h"
+#include "simulation_constants.h"
+#include "tx_scheduler.h"
+
+
+namespace rfd900sim
+{
+    struct netSimulatorConfig{
+        size_t node_count = 5;                              // node ids 0 to node_count - 1
+        uint8_t sink_id = SimConstants::BASE_STATION;       // the other nodes report to it
+        uint32_t air_bytes_per_sec = 64000 / 8;
+        size_t packet_overhead_bytes = 8;                   // preamble, header and CRC per air packet
+        size_t max_packet_bytes = 252;                      // serial bytes in one transmitter's turn
+        size_t radio_buffer_bytes = 2048;
+        std::chrono::microseconds latency = std::chrono::microseconds(2000);
+        double loss_probability = 0.0;                      // per packet and receiver
+        uint64_t seed = DEFAULT_SIM_SEED;
+        arrivalProcess arrivals = arrivalProcess::POISSON;
+        double artifact_rate = 0.2;                         // per reporting node, messages/s
+        double position_rate = 2.0;                         // per reporting node, messages/s
+        double duration_s = 3600.0;                         // virtual time
+        std::chrono::milliseconds artifact_ttl = rfd900comm::message900::DEFAULT_MESSAGE_TTL;   // zero keeps artifacts until acknowledged
+        bool admission = false;                             // airtime admission control on every node
+        rfd900comm::airtimeConfig airtime;                  // air speed and packet sizes are taken from above
+    };
+
+    struct netSimulatorStats{
+        uint64_t artifacts_offered;
+        uint64_t artifacts_refused;                         // ack wait list full, send window closed or admission
+        uint64_t artifacts_delivered;                       // distinct artifacts at the sink
+        uint64_t artifacts_acked;
+        uint64_t artifacts_expired;                         // dropped at their deadline, unacknowledged or unsent
+        uint64_t retransmissions;
+        uint64_t positions_offered;
+        uint64_t positions_delivered;
+        uint64_t positions_superseded;
+        uint64_t positions_refused;                         // admission
+        uint64_t packets;
+        uint64_t packets_lost;                              // per receiver
+        uint64_t frames_garbled;                            // extracted from a stream with a lost packet
+        uint64_t events;
+        double channel_utilization;
+        double artifact_latency_mean_ms;                    // generation to first delivery
+        double artifact_latency_p95_ms;
+        double position_latency_mean_ms;
+    };
+
+
+    class netSimulator{
+
+        public:
+
+        explicit netSimulator(const netSimulatorConfig& config);
+        ~netSimulator();
+
+        // disable copy constructor
+        netSimulator(const netSimulator&) = delete;
+
+        // disable assignment
+        netSimulator& operator=(const netSimulator&) = delete;
+
+        // runs duration_s of virtual time on the calling thread, returns 0, or -1 for a bad configuration
+        int run();
+
+        const netSimulatorStats& get_stats() const { return stats; }
+
+
+        private:
+
+        using steady = std::chrono::steady_clock;
+
+        // a radio's serial buffer, the channel takes its bytes when the radio's turn comes
+        class simRadio : public rfd900comm::txSink{
+
+            public:
+
+            explicit simRadio(size_t capacity_bytes) : capacity(capacity_bytes)
+            {
+                // intentionally blank
+            }
+
+            size_t tx_room() override { return capacity - buffered.size(); }
+            ssize_t write_serial(const uint8_t* data, size_t length) override;
+
+            std::string buffered;
+
+
+            private:
+
+            size_t capacity;
+        };
+
+        struct sim_node_t{
+            uint8_t id;
+            simRadio radio;
+            rfd900comm::message900 arq;
+            rfd900comm::txScheduler scheduler;
+            std::unique_ptr<rfd900comm::airtimeAccountant> airtime;
+            std::unique_ptr<loadGenerator> traffic;         // none at the sink
+            generated_message_t next_message;
+            std::vector<std::string> rx;                    // received bytes per sender
+            std::string extracted;
+            steady::time_point wake;
+
+            sim_node_t(uint8_t node_id, size_t radio_buffer_bytes) : id(node_id), radio(radio_buffer_bytes)
+            {
+                // intentionally blank
+            }
+        };
+
+        struct air_packet_t{
+            steady::time_point arrival;
+            size_t sender;
+            std::string bytes;
+        };
+
+        void service(sim_node_t& node);
+        void offer(sim_node_t& node, const generated_message_t& msg);
+        void grant();
+        void deliver(const air_packet_t& packet);
+        void handle(sim_node_t& node, size_t sender, const std::string& message);
+
+        netSimulatorConfig cfg;
+        netSimulatorStats stats;
+        std::vector<std::unique_ptr<sim_node_t>> nodes;
+        std::deque<air_packet_t> inFlight;
+        xoshiro256 channelRandom;
+
+        steady::time_point now;
+        steady::time_point channelFree;
+        bool channelBusy;
+        size_t lastGranted;
+        double busySeconds;
+
+        std::unordered_set<uint64_t> delivered;             // sink, source id and stamp of each artifact
+        std::vector<double> artifactLatencies;
+        double positionLatencySum;
+    };
+
+}
+
+
+#endif
@@ -0,0 +1,556 @@
+/**
+ * @brief outboundJournal class function definitions.
+ *
+ */
+
+#include <errno.h>
+#include <stddef.h>                     // offsetof
+#include <fcntl.h>
+#include <libgen.h>                     // dirname
+#include <stdio.h>
+#include <string.h>                     // memcpy, memset, strerror
+#include <unistd.h>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "outbound_journal.h"
+#include "virtual_clock.h"
+
+namespace rfd900comm{
+
+    outboundJournal::outboundJournal() :
+        fd(-1), base(nullptr), mapLength(0), generation(0), writeOffset(0), syncedOffset(0), dirty(false),
+        liveCount(0), lastMsgId(), commitCount(0), compactionCount(0),
+        recoveredRecords(0), uncommittedRecords(0), discardedBytes(0)
+    {
+        // intentionally blank
+    }
+
+    outboundJournal::~outboundJournal()
+    {
+        close();
+    }
+
+
+    uint32_t outboundJournal::crc32(const uint8_t* data, size_t length, uint32_t crc)
+    {
+        static uint32_t table[256];
+        static bool table_ready = false;
+        if(!table_ready){
+            for(uint32_t i = 0; i < 256; ++i){
+                uint32_t c = i;
+                for(int k = 0; k < 8; ++k){
+                    c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+                }
+                table[i] = c;
+            }
+            table_ready = true;
+        }
+
+        crc = ~crc;
+        for(size_t i = 0; i < length; ++i){
+            crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+        }
+        return ~crc;
+    }
+
+
+    size_t outboundJournal::record_size(size_t body_length)
+    {
+        return (sizeof(record_header_t) + body_length + ALIGNMENT - 1) & ~(ALIGNMENT - 1);
+    }
+
+
+    int outboundJournal::open(const char* path, const outboundJournalConfig& config)
+    {
+        struct stat st;
+
+        close();
+
+        cfg = config;
+        if(cfg.capacity_bytes < HEADER_SIZE + 2 * record_size(sizeof(frame_body_t) + MAX_FRAME_LENGTH)){
+            cfg.capacity_bytes = HEADER_SIZE + 2 * record_size(sizeof(frame_body_t) + MAX_FRAME_LENGTH);
+        }
+        if(cfg.max_live == 0){
+            cfg.max_live = outboundJournalConfig().max_live;
+        }
+        filePath = path;
+
+        size_t slots = 1;
+        while(slots < 2 * cfg.max_live){
+            slots <<= 1;
+        }
+        index.assign(slots, index_slot_t{EMPTY_KEY, 0});
+        liveCount = 0;
+        memset(lastMsgId, 0, sizeof(lastMsgId));
+        seenDest = nodeSet();
+        recoveredRecords = 0;
+        uncommittedRecords = 0;
+        discardedBytes = 0;
+
+        fd = ::open(path, O_RDWR | O_CREAT, 0644);
+        if(fd < 0 || fstat(fd, &st) != 0){
+            fprintf(stderr, "error, %s, open %s: %s\n", __func__, path, strerror(errno));
+            if(fd >= 0){
+                ::close(fd);
+                fd = -1;
+            }
+            return -1;
+        }
+
+        if(st.st_size == 0){
+            ::close(fd);
+            fd = -1;
+            if(create_file(path, cfg.capacity_bytes, 1, &fd, &base) != 0){
+                return -1;
+            }
+            mapLength = cfg.capacity_bytes;
+            generation = 1;
+            writeOffset = HEADER_SIZE;
+            syncedOffset = HEADER_SIZE;
+            dirty = false;
+            return 0;
+        }
+
+        // an existing journal keeps the size it was created with
+        void* map = mmap(nullptr, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if(map == MAP_FAILED){
+            fprintf(stderr, "error, %s, mmap %s: %s\n", __func__, path, strerror(errno));
+            ::close(fd);
+            fd = -1;
+            return -1;
+        }
+
+        const file_header_t* header = static_cast<const file_header_t*>(map);
+        if(static_cast<size_t>(st.st_size) < HEADER_SIZE || header->magic != MAGIC || header->version != VERSION
+                || header->capacity != static_cast<uint64_t>(st.st_size)
+                || header->crc != crc32(static_cast<const uint8_t*>(map), offsetof(file_header_t, crc))){
+            fprintf(stderr, "error, %s, %s is not an outbound journal, left untouched\n", __func__, path);
+            munmap(map, st.st_size);
+            ::close(fd);
+            fd = -1;
+            return -1;
+        }
+
+        base = static_cast<uint8_t*>(map);
+        mapLength = st.st_size;
+        generation = header->generation;
+        dirty = false;
+        scan();
+        return 0;
+    }
+
+
+    int outboundJournal::create_file(const char* path, size_t capacity, uint64_t file_generation, int* file_fd, uint8_t** map)
+    {
+        int new_fd = ::open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+        if(new_fd < 0){
+            fprintf(stderr, "error, %s, open %s: %s\n", __func__, path, strerror(errno));
+            return -1;
+        }
+        if(ftruncate(new_fd, capacity) != 0){
+            fprintf(stderr, "error, %s, ftruncate %s: %s\n", __func__, path, strerror(errno));
+            ::close(new_fd);
+            return -1;
+        }
+
+        void* new_map = mmap(nullptr, capacity, PROT_READ | PROT_WRITE, MAP_SHARED, new_fd, 0);
+        if(new_map == MAP_FAILED){
+            fprintf(stderr, "error, %s, mmap %s: %s\n", __func__, path, strerror(errno));
+            ::close(new_fd);
+            return -1;
+        }
+
+        file_header_t header;
+        memset(&header, 0, sizeof(header));
+        header.magic = MAGIC;
+        header.version = VERSION;
+        header.capacity = capacity;
+        header.generation = file_generation;
+        header.crc = crc32(reinterpret_cast<const uint8_t*>(&header), offsetof(file_header_t, crc));
+        memcpy(new_map, &header, sizeof(header));
+        msync(new_map, HEADER_SIZE, MS_SYNC);
+
+        *file_fd = new_fd;
+        *map = static_cast<uint8_t*>(new_map);
+        return 0;
+    }
+
+
+    void outboundJournal::close()
+    {
+        if(base == nullptr){
+            return;
+        }
+        commit();
+        munmap(base, mapLength);
+        ::close(fd);
+        base = nullptr;
+        fd = -1;
+    }
+
+
+    bool outboundJournal::valid_record(size_t offset) const
+    {
+        if(offset + sizeof(record_header_t) > mapLength){
+            return false;
+        }
+
+        const record_header_t* rec = reinterpret_cast<const record_header_t*>(base + offset);
+        if(rec->type < RECORD_FRAME || rec->type > RECORD_COMMIT || rec->generation != static_cast<uint32_t>(generation)
+                || rec->length > mapLength - offset - sizeof(record_header_t)){
+            return false;
+        }
+        if(rec->type == RECORD_FRAME
+                && (rec->length < sizeof(frame_body_t) || rec->length > sizeof(frame_body_t) + MAX_FRAME_LENGTH)){
+            return false;
+        }
+
+        const uint8_t* covered = base + offset + sizeof(rec->crc);
+        return rec->crc == crc32(covered, sizeof(record_header_t) - sizeof(rec->crc) + rec->length);
+    }
+
+
+    /**
+     * Replays the records into the index. Records after the last COMMIT are
+     * kept, a process crash leaves them intact in the page cache; the scan
+     * only stops at a record that fails its CRC.
+     */
+    void outboundJournal::scan()
+    {
+        size_t offset = HEADER_SIZE;
+        size_t since_commit = 0;
+
+        while(valid_record(offset)){
+            const record_header_t* rec = reinterpret_cast<const record_header_t*>(base + offset);
+            uint32_t key = key_of(rec->dest_id, rec->msg_id);
+
+            if(rec->type == RECORD_FRAME){
+                if(!insert(key, offset)){
+                    fprintf(stderr, "warning, %s, more than %lu live frames, msg_id %hu not restored\n",
+                                __func__, cfg.max_live, rec->msg_id);
+                }
+                lastMsgId[rec->dest_id] = rec->msg_id;
+                seenDest.insert(rec->dest_id);
+            }
+            else if(rec->type == RECORD_TOMBSTONE){
+                erase(key);
+            }
+
+            ++recoveredRecords;
+            since_commit = rec->type == RECORD_COMMIT ? 0 : since_commit + 1;
+            offset += record_size(rec->length);
+        }
+
+        writeOffset = offset;
+        syncedOffset = offset;
+        uncommittedRecords = since_commit;
+
+        // a torn record, cleared so a later append cannot be read as its continuation
+        size_t end = offset + record_size(sizeof(frame_body_t) + MAX_FRAME_LENGTH);
+        if(end > mapLength){
+            end = mapLength;
+        }
+        for(size_t i = end; i > offset; --i){
+            if(base[i - 1] != 0){
+                discardedBytes = i - offset;
+                break;
+            }
+        }
+        if(discardedBytes > 0){
+            memset(base + offset, 0, discardedBytes);
+            size_t page = sysconf(_SC_PAGESIZE);
+            size_t start = offset & ~(page - 1);
+            msync(base + start, offset + discardedBytes - start, MS_SYNC);
+        }
+    }
+
+
+    void outboundJournal::mark_dirty()
+    {
+        if(!dirty){
+            dirty = true;
+            firstDirty = clock_now();
+        }
+    }
+
+
+    size_t outboundJournal::write_record(uint8_t type, uint8_t dest_id, uint16_t msg_id, const void* body, size_t body_length,
+                const uint8_t* data, size_t data_length)
+    {
+        size_t offset = writeOffset;
+        size_t size = record_size(body_length + data_length);
+        uint8_t* p = base + offset;
+
+        record_header_t rec;
+        rec.crc = 0;
+        rec.generation = static_cast<uint32_t>(generation);
+        rec.type = type;
+        rec.dest_id = dest_id;
+        rec.msg_id = msg_id;
+        rec.length = static_cast<uint32_t>(body_length + data_length);
+
+        memcpy(p, &rec, sizeof(rec));
+        if(body_length > 0){
+            memcpy(p + sizeof(rec), body, body_length);
+        }
+        if(data_length > 0){
+            memcpy(p + sizeof(rec) + body_length, data, data_length);
+        }
+        memset(p + sizeof(rec) + rec.length, 0, size - sizeof(rec) - rec.length);
+
+        rec.crc = crc32(p + sizeof(rec.crc), sizeof(rec) - sizeof(rec.crc) + rec.length);
+        memcpy(p, &rec.crc, sizeof(rec.crc));
+
+        writeOffset += size;
+        mark_dirty();
+        return offset;
+    }
+
+
+    int outboundJournal::reserve(size_t bytes)
+    {
+        if(writeOffset + bytes <= mapLength){
+            return 0;
+        }
+        if(compact() != 0 || writeOffset + bytes > mapLength){
+            fprintf(stderr, "error, %s, journal full, %lu live frames in %lu bytes\n", __func__, liveCount, mapLength);
+            return -1;
+        }
+        return 0;
+    }
+
+
+    int outboundJournal::append(const journalFrame& frame)
+    {
+        if(base == nullptr){
+            return -1;
+        }
+        if(frame.length > MAX_FRAME_LENGTH){
+            fprintf(stderr, "error, %s, frame of %lu bytes exceeds %lu, msg_id: %hu\n", __func__, frame.length,
+                        MAX_FRAME_LENGTH, frame.msg_id);
+            return -1;
+        }
+
+        uint32_t key = key_of(frame.dest_id, frame.msg_id);
+        if(find(key) == EMPTY_KEY && liveCount >= cfg.max_live){
+            fprintf(stderr, "error, %s, %lu live frames, msg_id %hu not journaled\n", __func__, liveCount, frame.msg_id);
+            return -1;
+        }
+
+        // reserve the COMMIT that follows with a zero durability interval as well
+        if(reserve(record_size(sizeof(frame_body_t) + frame.length) + COMMIT_RECORD_SIZE) != 0){
+            return -1;
+        }
+
+        frame_body_t body{};
+        body.expires_ns = frame.expires_ns;
+        body.ackers = frame.ackers;
+        body.msg_type = frame.msg_type;
+        body.group = frame.group ? 1 : 0;
+
+        size_t offset = write_record(RECORD_FRAME, frame.dest_id, frame.msg_id, &body, sizeof(body), frame.data, frame.length);
+        insert(key, static_cast<uint32_t>(offset));
+        lastMsgId[frame.dest_id] = frame.msg_id;
+        seenDest.insert(frame.dest_id);
+
+        if(cfg.durability_interval.count() == 0){
+            return commit();
+        }
+        return 0;
+    }
+
+
+    int outboundJournal::tombstone(uint8_t dest_id, uint16_t msg_id)
+    {
+        uint32_t key = key_of(dest_id, msg_id);
+        if(base == nullptr || find(key) == EMPTY_KEY){
+            return 0;                                   // never journaled, nothing to cancel
+        }
+
+        // compaction drops the frame itself, the tombstone is still written after it, then the COMMIT with a zero durability interval
+        if(reserve(record_size(0) + COMMIT_RECORD_SIZE) != 0){
+            return -1;
+        }
+
+        erase(key);
+        write_record(RECORD_TOMBSTONE, dest_id, msg_id, nullptr, 0);
+
+        if(cfg.durability_interval.count() == 0){
+            return commit();
+        }
+        return 0;
+    }
+
+
+    int outboundJournal::commit()
+    {
+        if(base == nullptr || !dirty){
+            return 0;
+        }
+        if(reserve(COMMIT_RECORD_SIZE) != 0){
+            return -1;
+        }
+        if(!dirty){
+            return 0;                                   // compaction synced everything
+        }
+
+        uint32_t sequence = static_cast<uint32_t>(commitCount);
+        write_record(RECORD_COMMIT, 0, 0, &sequence, sizeof(sequence));
+
+        size_t page = sysconf(_SC_PAGESIZE);
+        size_t start = syncedOffset & ~(page - 1);
+        if(msync(base + start, writeOffset - start, MS_SYNC) != 0){
+            fprintf(stderr, "error, %s, msync: %s\n", __func__, strerror(errno));
+            return -1;
+        }
+
+        syncedOffset = writeOffset;
+        dirty = false;
+        ++commitCount;
+        return 0;
+    }
+
+
+    void outboundJournal::service()
+    {
+        if(dirty && clock_now() - firstDirty >= cfg.durability_interval){
+            commit();
+        }
+    }
+
+
+    bool outboundJournal::last_msg_id(uint8_t dest_id, uint16_t* msg_id) const
+    {
+        if(!seenDest.contains(dest_id)){
+            return false;
+        }
+        *msg_id = lastMsgId[dest_id];
+        return true;
+    }
+
+
+    /**
+     * The live frames are copied in append order to a new file of the same
+     * size and generation + 1, which is synced and renamed over the journal.
+     * The index slots are pointed at the new offsets as the frames are copied.
+     */
+    int outboundJournal::compact()
+    {
+        std::string tmp = filePath + ".compact";
+        int new_fd;
+        uint8_t* new_base;
+        if(create_file(tmp.c_str(), mapLength, generation + 1, &new_fd, &new_base) != 0){
+            return -1;
+        }
+
+        uint32_t new_generation = static_cast<uint32_t>(generation + 1);
+        size_t out = HEADER_SIZE;
+        size_t offset = HEADER_SIZE;
+        while(offset < writeOffset){
+            const record_header_t* rec = reinterpret_cast<const record_header_t*>(base + offset);
+            size_t size = record_size(rec->length);
+            uint32_t key = key_of(rec->dest_id, rec->msg_id);
+
+            if(rec->type == RECORD_FRAME && find(key) == offset){
+                uint8_t* p = new_base + out;
+                memcpy(p, rec, size);
+                record_header_t* copy = reinterpret_cast<record_header_t*>(p);
+                copy->generation = new_generation;
+                copy->crc = crc32(p + sizeof(copy->crc), sizeof(record_header_t) - sizeof(copy->crc) + copy->length);
+                insert(key, static_cast<uint32_t>(out));
+                out += size;
+            }
+            offset += size;
+        }
+
+        if(msync(new_base, out, MS_SYNC) != 0 || fsync(new_fd) != 0 || rename(tmp.c_str(), filePath.c_str()) != 0){
+            fprintf(stderr, "error, %s, %s: %s\n", __func__, tmp.c_str(), strerror(errno));
+            munmap(new_base, mapLength);
+            ::close(new_fd);
+            unlink(tmp.c_str());
+            return -1;
+        }
+
+        // the rename itself is durable once the directory is synced
+        std::string dir_path = filePath;
+        int dir_fd = ::open(dirname(&dir_path[0]), O_RDONLY | O_DIRECTORY);
+        if(dir_fd >= 0){
+            fsync(dir_fd);
+            ::close(dir_fd);
+        }
+
+        munmap(base, mapLength);
+        ::close(fd);
+        base = new_base;
+        fd = new_fd;
+        generation = new_generation;
+        writeOffset = out;
+        syncedOffset = out;
+        dirty = false;
+        ++compactionCount;
+        return 0;
+    }
+
+
+    uint32_t outboundJournal::find(uint32_t key) const
+    {
+        size_t mask = index.size() - 1;
+        for(size_t i = (key * 0x9E3779B1u) & mask; ; i = (i + 1) & mask){
+            if(index[i].key == key){
+                return index[i].offset;
+            }
+            if(index[i].key == EMPTY_KEY){
+                return EMPTY_KEY;
+            }
+        }
+    }
+
+
+    bool outboundJournal::insert(uint32_t key, uint32_t offset)
+    {
+        size_t mask = index.size() - 1;
+        size_t i = (key * 0x9E3779B1u) & mask;
+        while(index[i].key != EMPTY_KEY && index[i].key != key){
+            i = (i + 1) & mask;
+        }
+        if(index[i].key == EMPTY_KEY){
+            if(liveCount >= cfg.max_live){
+                return false;
+            }
+            index[i].key = key;
+            ++liveCount;
+        }
+        index[i].offset = offset;
+        return true;
+    }
+
+
+    // linear probing, later entries of the probe run move back into the hole
+    void outboundJournal::erase(uint32_t key)
+    {
+        size_t mask = index.size() - 1;
+        size_t i = (key * 0x9E3779B1u) & mask;
+        while(index[i].key != key){
+            if(index[i].key == EMPTY_KEY){
+                return;
+            }
+            i = (i + 1) & mask;
+        }
+
+        index[i].key = EMPTY_KEY;
+        --liveCount;
+
+        for(size_t j = (i + 1) & mask; index[j].key != EMPTY_KEY; j = (j + 1) & mask){
+            size_t home = (index[j].key * 0x9E3779B1u) & mask;
+            bool stays = i <= j ? (i < home && home <= j) : (i < home || home <= j);
+            if(!stays){
+                index[i] = index[j];
+                index[j].key = EMPTY_KEY;
+                i = j;
+            }
+        }
+    }
+
+}
@@ -0,0 +1,246 @@
+/**
+ * @brief Declares outboundJournal, a crash safe record of the ack wait list
+ *
+ * message900 keeps unacknowledged messages in memory, a restart loses every
+ * one of them. With a journal attached (message900::attach_journal) each
+ * message added to the ack wait list is appended to a fixed size file
+ * mapped with mmap, and each message leaving it, acknowledged, removed or
+ * expired, appends a tombstone. At startup the journal is scanned and the
+ * messages without a tombstone go back into the ack wait list.
+ *
+ * Records are appended and never rewritten:
+ *      FRAME       destination, msg_id, type, expiry, group ackers and the frame
+ *      TOMBSTONE   destination and msg_id of a message that left the list
+ *      COMMIT      everything before it has been synced to the disk
+ *
+ * Each record carries a CRC32 and the file's generation. The scan stops at
+ * the first record that fails either, a record torn by a crash, and clears
+ * it so later appends are not mistaken for it.
+ *
+ * Group commit: appends only copy into the mapping. commit() writes a
+ * COMMIT record and syncs the bytes appended since the last one with msync.
+ * service(), called from the retransmission scan and after each append,
+ * commits once durability_interval has passed since the first uncommitted
+ * append, so a burst of messages costs one sync. A durability interval of
+ * zero commits every record. A process crash loses nothing, the appended
+ * records are in the page cache; a power loss loses at most the records of
+ * one interval.
+ *
+ * When the file is full it is compacted: the live frames are written to a
+ * new file, synced, and renamed over the old one, so a crash during
+ * compaction leaves one complete journal or the other.
+ *
+ * Live frames are found through an open addressed index of max_live entries
+ * allocated by open(), appends and tombstones never allocate.
+ *
+ * Expiry times are stored as wall clock time, the steady clock restarts
+ * with the process. A message that expired while the process was down is
+ * not restored.
+ *
+ */
+
+#ifndef OUTBOUND_JOURNAL_INCLUDED_H
+#define OUTBOUND_JOURNAL_INCLUDED_H
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "message900.h"
+
+
+namespace rfd900comm{
+
+    struct outboundJournalConfig{
+        size_t capacity_bytes = 4 * 1024 * 1024;            // file size, fixed when the file is created
+        std::chrono::milliseconds durability_interval{50};
+        size_t max_live = 4096;                             // frames waiting for an ACK at once
+    };
+
+    struct journalFrame{
+        uint8_t dest_id;
+        uint16_t msg_id;
+        uint8_t msg_type;
+        bool group;
+        nodeSet ackers;                                     // group frames, the original ackers
+        int64_t expires_ns;                                 // wall clock, INT64_MAX for none
+        const uint8_t* data;
+        size_t length;
+    };
+
+
+    class outboundJournal{
+
+        public:
+
+        static constexpr uint32_t MAGIC = 0x4A444652;       // "RFDJ"
+        static constexpr uint32_t VERSION = 1;
+        static constexpr size_t MAX_FRAME_LENGTH = 1024;
+        static constexpr int64_t NO_EXPIRY = INT64_MAX;
+
+        outboundJournal();
+        ~outboundJournal();
+
+        // disable copy constructor
+        outboundJournal(const outboundJournal&) = delete;
+
+        // disable assignment
+        outboundJournal& operator=(const outboundJournal&) = delete;
+
+        // opens and scans the journal at path, creating it when missing, returns 0 or -1
+        int open(const char* path, const outboundJournalConfig& config = outboundJournalConfig());
+
+        // commits and unmaps, the records stay for the next open
+        void close();
+
+        bool is_open() const { return base != nullptr; }
+
+        // returns 0, or -1 when the frame does not fit even after compaction or the index is full
+        int append(const journalFrame& frame);
+
+        // the frame of dest_id and msg_id left the ack wait list
+        int tombstone(uint8_t dest_id, uint16_t msg_id);
+
+        // appends a COMMIT record and syncs every record before it, returns 0 or -1
+        int commit();
+
+        // commits when the durability interval has passed since the first uncommitted record
+        void service();
+
+        // calls f(const journalFrame&) for every live frame in append order
+        template<typename F>
+        void for_each_live(F f) const;
+
+        // the last msg_id journaled to dest_id, so a restarted sender does not reuse ids
+        bool last_msg_id(uint8_t dest_id, uint16_t* msg_id) const;
+
+        size_t live() const { return liveCount; }
+        size_t used_bytes() const { return writeOffset; }
+        size_t capacity() const { return mapLength; }
+        uint64_t commits() const { return commitCount; }
+        uint64_t compactions() const { return compactionCount; }
+
+        // what the last open found
+        size_t recovered_records() const { return recoveredRecords; }
+        size_t uncommitted_records() const { return uncommittedRecords; }    // after the last COMMIT, kept
+        size_t discarded_bytes() const { return discardedBytes; }            // a torn record at the end
+
+
+        private:
+
+        using steady = std::chrono::steady_clock;
+
+        enum recordType : uint8_t{
+            RECORD_NONE = 0,
+            RECORD_FRAME = 1,
+            RECORD_TOMBSTONE = 2,
+            RECORD_COMMIT = 3
+        };
+
+        struct file_header_t{
+            uint32_t magic;
+            uint32_t version;
+            uint64_t capacity;
+            uint64_t generation;
+            uint32_t crc;
+            uint32_t reserved;
+        };
+
+        struct record_header_t{
+            uint32_t crc;                       // CRC32 of the rest of the header and the body
+            uint32_t generation;
+            uint8_t type;
+            uint8_t dest_id;
+            uint16_t msg_id;
+            uint32_t length;                    // body bytes
+        };
+
+        struct frame_body_t{
+            int64_t expires_ns;
+            nodeSet ackers;
+            uint8_t msg_type;
+            uint8_t group;
+            uint8_t reserved[6];
+        };
+
+        struct index_slot_t{
+            uint32_t key;                       // dest_id << 16 | msg_id, EMPTY_KEY when free
+            uint32_t offset;                    // the key's FRAME record
+        };
+
+        static constexpr size_t HEADER_SIZE = 64;
+        static constexpr size_t ALIGNMENT = 8;
+        static constexpr uint32_t EMPTY_KEY = UINT32_MAX;
+
+        // a COMMIT record, its body is the commit sequence number
+        static constexpr size_t COMMIT_RECORD_SIZE = (sizeof(record_header_t) + sizeof(uint32_t) + ALIGNMENT - 1) & ~(ALIGNMENT - 1);
+
+        std::string filePath;
+        outboundJournalConfig cfg;
+        int fd;
+        uint8_t* base;
+        size_t mapLength;
+        uint64_t generation;
+        size_t writeOffset;
+        size_t syncedOffset;
+        bool dirty;
+        steady::time_point firstDirty;
+
+        std::vector<index_slot_t> index;
+        size_t liveCount;
+        uint16_t lastMsgId[UINT8_MAX + 1];
+        nodeSet seenDest;
+
+        uint64_t commitCount;
+        uint64_t compactionCount;
+        size_t recoveredRecords;
+        size_t uncommittedRecords;
+        size_t discardedBytes;
+
+        static uint32_t crc32(const uint8_t* data, size_t length, uint32_t crc = 0);
+        static size_t record_size(size_t body_length);
+        static uint32_t key_of(uint8_t dest_id, uint16_t msg_id) { return (uint32_t(dest_id) << 16) | msg_id; }
+
+        int create_file(const char* path, size_t capacity, uint64_t file_generation, int* file_fd, uint8_t** map);
+        void scan();
+        bool valid_record(size_t offset) const;
+        int reserve(size_t bytes);
+        size_t write_record(uint8_t type, uint8_t dest_id, uint16_t msg_id, const void* body, size_t body_length,
+                    const uint8_t* data = nullptr, size_t data_length = 0);
+        int compact();
+        void mark_dirty();
+
+        uint32_t find(uint32_t key) const;
+        bool insert(uint32_t key, uint32_t offset);
+        void erase(uint32_t key);
+    };
+
+
+    template<typename F>
+    void outboundJournal::for_each_live(F f) const
+    {
+        size_t offset = HEADER_SIZE;
+        while(offset < writeOffset){
+            const record_header_t* rec = reinterpret_cast<const record_header_t*>(base + offset);
+            if(rec->type == RECORD_FRAME && find(key_of(rec->dest_id, rec->msg_id)) == offset){
+                const frame_body_t* body = reinterpret_cast<const frame_body_t*>(rec + 1);
+                journalFrame frame;
+                frame.dest_id = rec->dest_id;
+                frame.msg_id = rec->msg_id;
+                frame.msg_type = body->msg_type;
+                frame.group = body->group != 0;
+                frame.ackers = body->ackers;
+                frame.expires_ns = body->expires_ns;
+                frame.data = reinterpret_cast<const uint8_t*>(body + 1);
+                frame.length = rec->length - sizeof(frame_body_t);
+                f(frame);
+            }
+            offset += record_size(rec->length);
+        }
+    }
+
+}
+
+
+#endif
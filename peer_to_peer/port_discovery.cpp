@@ -0,0 +1,117 @@
+/**
+ * Purpose:
+ *  Check serial port discovery against emulated radios, no hardware needed.
+ *
+ *  Starts four pseudo terminals: a serial device that is not a radio, a
+ *  radio at 115200 baud, a radio at 57600 baud and a radio left in command
+ *  mode at 38400. Discovery probes them all at once and opens the first
+ *  radio that answers, then probes again to find every radio. The guard
+ *  time is the silence the emulated radios need after "+++"; real SiK
+ *  firmware needs about a second.
+ *
+ *  With "system" discovery probes /dev/ttyUSB* and /dev/ttyACM* instead,
+ *  with the full guard time.
+ *
+ * Optional Command line arguments
+ *  argv[1] - guard time, milliseconds, default 100, or system
+ *
+ */
+
+#include <cstdio>
+#include <cstdlib>                  // atoi
+#include <cstring>                  // strcmp
+#include <unistd.h>                 // usleep
+
+#include "at_modem_emulator.h"
+#include "modem_discovery.h"
+#include "rfd900_modem.h"
+
+
+static void print_result(const char* title, const rfd900comm::modemDiscoveryResult& result)
+{
+    fprintf(stdout, "%s: %lu radios on %lu ports in %.1f ms\n", title, result.modems.size(), result.candidates,
+                result.elapsed.count() / 1000.0);
+    for(const rfd900comm::discoveredModem& found : result.modems){
+        fprintf(stdout, "    %s at %6d baud, %s\n", found.path.c_str(), found.baud_rate, found.banner.c_str());
+    }
+}
+
+
+int main(int argc, char **argv)
+{
+    rfd900comm::modemDiscoveryConfig config;
+    rfd900comm::modemDiscoveryResult result;
+    rfd900comm::rfd900Modem radio;
+
+    if(argc > 1 && strcmp(argv[1], "system") == 0){
+        if(rfd900comm::discover_modem(radio, config, &result) != 0){
+            print_result("system", result);
+            return 1;
+        }
+        print_result("system", result);
+        return 0;
+    }
+
+    int guard_ms = argc > 1 ? atoi(argv[1]) : 100;
+
+    rfd900comm::atModemEmulatorConfig other;
+    other.radio = false;
+    rfd900comm::atModemEmulatorConfig fast;
+    fast.baud_rate = 115200;
+    fast.banner = "RFD SiK 3.54 on RFD900x 115200";
+    rfd900comm::atModemEmulatorConfig standard;
+    standard.banner = "RFD SiK 3.54 on RFD900x 57600";
+    rfd900comm::atModemEmulatorConfig waiting;
+    waiting.baud_rate = 38400;
+    waiting.banner = "RFD SiK 2.65 on RFD900A";
+
+    rfd900comm::atModemEmulatorConfig* configs[] = {&other, &fast, &standard, &waiting};
+    rfd900comm::atModemEmulator emulators[4];
+    for(size_t i = 0; i < 4; ++i){
+        configs[i]->guard_time = std::chrono::milliseconds(guard_ms);
+        if(emulators[i].start(*configs[i]) != 0){
+            fprintf(stderr, "error, %s, emulator start failure\n", __func__);
+            return 1;
+        }
+        config.candidates.push_back(emulators[i].port_name());
+    }
+    config.scan_system = false;
+    config.guard_time = std::chrono::milliseconds(guard_ms);
+    config.response_timeout = std::chrono::milliseconds(50);
+
+    // the 38400 radio enters command mode, as a program that crashed mid configuration leaves it
+    {
+        rfd900comm::rfd900Modem setup;
+        if(setup.init(emulators[3].port_name(), 38400) != 0){
+            return 1;
+        }
+        setup.send_message("+++", 3);
+        for(int i = 0; i < 100 && !emulators[3].command_mode(); ++i){
+            usleep(guard_ms * 100);
+        }
+    }
+
+    fprintf(stdout, "guard time %d ms, %s in command mode\n", guard_ms,
+                emulators[3].command_mode() ? "38400 radio" : "no radio");
+
+    // the first radio, opened ready for use
+    if(rfd900comm::discover_modem(radio, config, &result) != 0){
+        print_result("first", result);
+        return 1;
+    }
+    print_result("first", result);
+    fprintf(stdout, "    opened %s at %d baud\n", radio.get_device_path(), radio.get_baud_rate());
+
+    // every radio, the ports are probed together so the total is the slowest port, not the sum
+    config.first_only = false;
+    rfd900comm::probe_modems(config, &result);
+    print_result("all", result);
+
+    size_t commands = 0;
+    for(size_t i = 0; i < 4; ++i){
+        commands += emulators[i].commands();
+    }
+    fprintf(stdout, "AT commands run %lu, the other device answered %lu\n", commands, emulators[0].commands());
+
+    return result.modems.size() == 3 && emulators[0].commands() == 0 ? 0 : 1;
+}
@@ -0,0 +1,178 @@
+/**
+ * Purpose:
+ *  Compare FIFO queueing with latest value wins slots for robot position streams.
+ *
+ *  ANCHOR_STATION relays the poses of several robots to BASE_STATION over a
+ *  linkEmulator running at the air rate of a 57600 baud link. The robots
+ *  together produce more poses than the link carries.
+ *
+ *  FIFO   - every pose is queued, the backlog and the pose age grow without bound
+ *  LATEST - one txScheduler slot per robot, a new pose replaces the waiting one
+ *
+ *  For each mode the program reports poses delivered, superseded and left
+ *  queued, the peak tx queue depth and the age of the poses on arrival.
+ *
+ * Optional Command line arguments
+ *  argv[1] - number of robots, at most 4
+ *  argv[2] - poses per second per robot
+ *  argv[3] - seconds per mode
+ *  argv[4] - air bytes per second
+ *
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>                  // atoi
+#include <string>
+#include <vector>
+
+#include "link_emulator.h"
+#include "rfd900_modem.h"
+#include "simulation_constants.h"
+#include "sim_artifact_message.h"
+#include "time_sync.h"
+#include "tx_scheduler.h"
+
+
+using rfd900sim::SimConstants;
+using steady = std::chrono::steady_clock;
+
+constexpr size_t SERIAL_RX_BUFFER_LENGTH = 256;
+constexpr long POLL_TIMEOUT = 500L;             // units, microseconds
+
+const uint8_t robots[] = {
+    SimConstants::GROUND01, SimConstants::AERIAL01, SimConstants::AERIAL02, SimConstants::ANCHOR_STATION
+};
+
+
+static void summarize(const char* label, std::vector<double>& ms)
+{
+    if(ms.empty()){
+        fprintf(stdout, "    %-10s none\n", label);
+        return;
+    }
+
+    std::sort(ms.begin(), ms.end());
+    fprintf(stdout, "    %-10s n: %5lu  p50: %8.1f ms  p95: %8.1f ms  max: %8.1f ms\n",
+                label, ms.size(), ms[ms.size() / 2], ms[(ms.size() * 95) / 100], ms[ms.size() - 1]);
+}
+
+
+static int run(bool latest, const rfd900comm::linkEmulatorConfig& config, int robotCount, int pose_hz, int seconds)
+{
+    const size_t SERIAL_POSITION_BUFFER_LENGTH = sizeof(rfd900sim::robot_position_message_t)
+                        + SimConstants::MESSAGE_900_START_INDICATOR_LENGTH
+                        + SimConstants::MESSAGE_900_END_INDICATOR_LENGTH;
+
+    rfd900comm::linkEmulator emulator;
+    rfd900comm::rfd900Modem anchor_radio;
+    rfd900comm::rfd900Modem base_radio;
+    rfd900comm::txScheduler scheduler(config.air_bytes_per_sec);
+
+    if(emulator.start(config) != 0){
+        return -1;
+    }
+    if(anchor_radio.init(emulator.port_name(0)) != 0 || base_radio.init(emulator.port_name(1)) != 0){
+        fprintf(stderr, "error, %s radio init failure\n", __func__);
+        return -1;
+    }
+
+    std::vector<uint8_t> serial_tx_buffer(SERIAL_POSITION_BUFFER_LENGTH);
+    uint8_t serial_rx_buffer[SERIAL_RX_BUFFER_LENGTH];
+    std::string temp_rx_storage;
+    std::string extracted_rx_data;
+    std::vector<double> age_ms;
+
+    size_t generated = 0;
+    size_t peak_depth = 0;
+    auto interval = std::chrono::microseconds(1000000 / pose_hz);
+    auto start = steady::now();
+    auto next_pose = start;
+
+    while(steady::now() - start < std::chrono::seconds(seconds)){
+
+        while(steady::now() >= next_pose){
+            for(int r = 0; r < robotCount; ++r){
+                rfd900sim::robot_position_message_t pos;
+                rfd900sim::simulate_robot_position_message(&pos, SimConstants::BASE_STATION, robots[r],
+                            static_cast<uint32_t>(rfd900comm::timeSync::steady_now_us()));
+                rfd900sim::serialize_robot_position_for_900MHz(&pos, serial_tx_buffer.data(), SERIAL_POSITION_BUFFER_LENGTH);
+
+                if(latest){
+                    scheduler.enqueue_latest(rfd900comm::txPriority::NORMAL,
+                                rfd900comm::txScheduler::latest_key(robots[r], SimConstants::ROBOT_POSITION),
+                                serial_tx_buffer.data(), SERIAL_POSITION_BUFFER_LENGTH);
+                }
+                else{
+                    scheduler.enqueue(rfd900comm::txPriority::NORMAL, serial_tx_buffer.data(), SERIAL_POSITION_BUFFER_LENGTH);
+                }
+                ++generated;
+            }
+            next_pose += interval;
+        }
+
+        peak_depth = std::max(peak_depth, scheduler.queued());
+        scheduler.service(anchor_radio);
+
+        // base station, both nodes share this process's clock as their timebase
+        ssize_t bytesRead = base_radio.read_serial(serial_rx_buffer, SERIAL_RX_BUFFER_LENGTH, POLL_TIMEOUT);
+        if(bytesRead > 0){
+            temp_rx_storage.append((const char*)serial_rx_buffer, bytesRead);
+        }
+        while(rfd900sim::extract_rx_message(temp_rx_storage, extracted_rx_data)){
+            rfd900sim::ack_message_t unused;
+            if(rfd900sim::process_rx_message(extracted_rx_data, &unused) != SimConstants::NO_ACK
+                        || extracted_rx_data[2] != SimConstants::ROBOT_POSITION){
+                continue;
+            }
+
+            rfd900sim::robot_position_message_t pos;
+            rfd900sim::deserialize_robot_position_for_900MHz(&pos, (const uint8_t*)extracted_rx_data.data());
+            uint32_t age_us = static_cast<uint32_t>(rfd900comm::timeSync::steady_now_us()) - pos.stamp_us;
+            age_ms.push_back(age_us / 1000.0);
+        }
+    }
+
+    fprintf(stdout, "%s: generated: %lu, delivered: %lu, superseded: %lu, left queued: %lu, peak queue depth: %lu\n",
+                latest ? "latest value wins" : "fifo             ", generated, age_ms.size(),
+                scheduler.superseded(), scheduler.queued(), peak_depth);
+    summarize("pose age", age_ms);
+
+    return 0;
+}
+
+
+int main(int argc, char **argv)
+{
+    int robotCount = 4;
+    int pose_hz = 50;
+    int seconds = 5;
+    rfd900comm::linkEmulatorConfig config;
+    config.air_bytes_per_sec = 57600 / 10;          // 8N1 serial framing
+    config.latency = std::chrono::milliseconds(10);
+
+    if(argc > 1){
+        robotCount = std::min(std::max(atoi(argv[1]), 1), 4);
+    }
+    if(argc > 2){
+        pose_hz = std::max(atoi(argv[2]), 1);
+    }
+    if(argc > 3){
+        seconds = atoi(argv[3]);
+    }
+    if(argc > 4){
+        config.air_bytes_per_sec = atoi(argv[4]);
+    }
+
+    size_t frame_length = sizeof(rfd900sim::robot_position_message_t)
+                        + SimConstants::MESSAGE_900_START_INDICATOR_LENGTH
+                        + SimConstants::MESSAGE_900_END_INDICATOR_LENGTH;
+    fprintf(stdout, "robots: %d at %d Hz, offered: %lu B/s, link: %u B/s\n",
+                robotCount, pose_hz, robotCount * pose_hz * frame_length, config.air_bytes_per_sec);
+
+    if(run(false, config, robotCount, pose_hz, seconds) != 0 || run(true, config, robotCount, pose_hz, seconds) != 0){
+        return 1;
+    }
+
+    return 0;
+}
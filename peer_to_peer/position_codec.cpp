@@ -0,0 +1,336 @@
+/**
+ * @brief positionEncoder and positionDecoder function definitions.
+ *
+ */
+
+#include <cmath>                    // llround
+#include <cstdio>
+#include <cstring>                  // memset, memcpy
+
+#include "position_codec.h"
+#include "simulation_constants.h"
+
+
+namespace rfd900sim
+{
+    size_t varint_encode(uint32_t value, uint8_t* out)
+    {
+        size_t n = 0;
+        while(value >= 0x80){
+            out[n++] = static_cast<uint8_t>(value | 0x80);
+            value >>= 7;
+        }
+        out[n++] = static_cast<uint8_t>(value);
+        return n;
+    }
+
+
+    size_t varint_decode(const uint8_t* in, size_t length, uint32_t* value)
+    {
+        uint32_t result = 0;
+        for(size_t n = 0; n < length && n < 5; ++n){
+            result |= static_cast<uint32_t>(in[n] & 0x7F) << (7 * n);
+            if(!(in[n] & 0x80)){
+                *value = result;
+                return n + 1;
+            }
+        }
+        return 0;
+    }
+
+
+    int32_t to_fixed_point(double v)
+    {
+        double scaled = v * POSITION_FIXED_POINT_SCALE;
+        if(scaled >= INT32_MAX){
+            return INT32_MAX;
+        }
+        if(scaled <= INT32_MIN){
+            return INT32_MIN;
+        }
+        return static_cast<int32_t>(llround(scaled));
+    }
+
+
+    double from_fixed_point(int32_t v)
+    {
+        return v / POSITION_FIXED_POINT_SCALE;
+    }
+
+
+    // bits needed for the largest of the three values, at least 1
+    static inline uint8_t packed_width(uint32_t a, uint32_t b, uint32_t c)
+    {
+        return static_cast<uint8_t>(32 - __builtin_clz(a | b | c | 1));
+    }
+
+
+
+    /**************** ENCODER ********************/
+    positionEncoder::positionEncoder(int keyframe_interval) :
+        keyframeInterval(keyframe_interval), nextKeyframeId(0),
+        keyframeCount(0), deltaCount(0), varintCount(0), absoluteCount(0)
+    {
+        // intentionally blank
+    }
+
+
+    size_t positionEncoder::encode(const robot_position_message_t* pos, uint8_t *serial_buffer, size_t serial_buffer_length, bool* keyframe)
+    {
+        const size_t framing = SimConstants::MESSAGE_900_START_INDICATOR_LENGTH + SimConstants::MESSAGE_900_END_INDICATOR_LENGTH;
+
+        auto inserted = streams.try_emplace(stream_key(pos->dest_id, pos->src_id));
+        stream_t& s = inserted.first->second;
+        if(inserted.second){
+            memset(&s, 0, sizeof(s));
+            s.since_keyframe = keyframeInterval;        // the first pose is a keyframe
+        }
+
+        int32_t x = to_fixed_point(pos->position.x);
+        int32_t y = to_fixed_point(pos->position.y);
+        int32_t z = to_fixed_point(pos->position.z);
+        *keyframe = false;
+
+        // the decoder still holds the acknowledged keyframe
+        bool reference = s.acked.valid && s.keyframes_sent - s.acked.sequence <= POSITION_KEYFRAME_HISTORY;
+
+        if(s.since_keyframe >= keyframeInterval){
+            position_keyframe_message_t key;
+            size_t framed_length = sizeof(key) + framing;
+            if(framed_length > serial_buffer_length){
+                fprintf(stderr, "error, %s, serial buffer of %lu bytes too short\n", __func__, serial_buffer_length);
+                return 0;
+            }
+
+            memset(&key, 0, sizeof(key));                  // no stray padding bytes on the air
+            key.dest_id = pos->dest_id;
+            key.src_id = pos->src_id;
+            key.msg_type = SimConstants::ROBOT_POSITION_KEYFRAME;
+            key.msg_id = nextKeyframeId++;
+            key.stamp_us = pos->stamp_us;
+            key.x = x;
+            key.y = y;
+            key.z = z;
+            frame_for_900MHz(&key, sizeof(key), serial_buffer, framed_length);
+
+            s.sent[s.keyframes_sent % POSITION_KEYFRAME_HISTORY] = keyframe_t{true, key.msg_id, s.keyframes_sent, key.stamp_us, x, y, z};
+            ++s.keyframes_sent;
+            s.since_keyframe = 0;
+            ++keyframeCount;
+            *keyframe = true;
+            return framed_length;
+        }
+
+        ++s.since_keyframe;
+
+        if(reference){
+            size_t framed_length = encode_delta(pos, &s, x, y, z, serial_buffer, serial_buffer_length);
+            if(framed_length > 0){
+                return framed_length;
+            }
+        }
+
+        // no usable reference, send the pose uncompressed
+        size_t framed_length = sizeof(robot_position_message_t) + framing;
+        if(framed_length > serial_buffer_length){
+            fprintf(stderr, "error, %s, serial buffer of %lu bytes too short\n", __func__, serial_buffer_length);
+            return 0;
+        }
+        serialize_robot_position_for_900MHz(pos, serial_buffer, framed_length);
+        ++absoluteCount;
+        return framed_length;
+    }
+
+
+    // returns 0 when the pose cannot be sent as a delta
+    size_t positionEncoder::encode_delta(const robot_position_message_t* pos, const stream_t* s, int32_t x, int32_t y, int32_t z,
+                uint8_t *serial_buffer, size_t serial_buffer_length)
+    {
+        const size_t framing = SimConstants::MESSAGE_900_START_INDICATOR_LENGTH + SimConstants::MESSAGE_900_END_INDICATOR_LENGTH;
+
+        int64_t dx = static_cast<int64_t>(x) - s->acked.x;
+        int64_t dy = static_cast<int64_t>(y) - s->acked.y;
+        int64_t dz = static_cast<int64_t>(z) - s->acked.z;
+        if(dx != static_cast<int32_t>(dx) || dy != static_cast<int32_t>(dy) || dz != static_cast<int32_t>(dz)){
+            return 0;
+        }
+
+        uint8_t msg[POSITION_DELTA_MAX_LENGTH];
+        uint8_t* p = msg;
+
+        *p++ = pos->dest_id;
+        *p++ = pos->src_id;
+        *p++ = SimConstants::ROBOT_POSITION_DELTA;
+        *p++ = static_cast<uint8_t>(s->acked.msg_id);
+        p += varint_encode((pos->stamp_us - s->acked.stamp_us) / 1000, p);
+
+        uint32_t zx = zigzag_encode(static_cast<int32_t>(dx));
+        uint32_t zy = zigzag_encode(static_cast<int32_t>(dy));
+        uint32_t zz = zigzag_encode(static_cast<int32_t>(dz));
+        uint8_t width = packed_width(zx, zy, zz);
+
+        if(width <= POSITION_MAX_PACKED_WIDTH){
+            // little endian host: the low bytes of the word are the first bytes in memory
+            uint64_t packed = zx | (static_cast<uint64_t>(zy) << width) | (static_cast<uint64_t>(zz) << (2 * width));
+            *p++ = width;
+            memcpy(p, &packed, sizeof(packed));
+            p += (3 * width + 7) / 8;
+        }
+        else{
+            *p++ = POSITION_VARINT_WIDTH;
+            p += varint_encode(zx, p);
+            p += varint_encode(zy, p);
+            p += varint_encode(zz, p);
+        }
+
+        size_t framed_length = (p - msg) + framing;
+        if(framed_length > serial_buffer_length){
+            fprintf(stderr, "error, %s, serial buffer of %lu bytes too short\n", __func__, serial_buffer_length);
+            return 0;
+        }
+
+        frame_for_900MHz(msg, p - msg, serial_buffer, framed_length);
+        if(!frame_is_clean(serial_buffer, framed_length)){
+            return 0;
+        }
+
+        ++deltaCount;
+        varintCount += width > POSITION_MAX_PACKED_WIDTH ? 1 : 0;
+        return framed_length;
+    }
+
+
+    void positionEncoder::process_ack(uint8_t dest_id, uint16_t msg_id)
+    {
+        for(auto& entry : streams){
+            if((entry.first >> 8) != dest_id){
+                continue;
+            }
+
+            stream_t& s = entry.second;
+            for(const keyframe_t& k : s.sent){
+                if(k.valid && k.msg_id == msg_id){
+                    if(!s.acked.valid || k.sequence > s.acked.sequence){
+                        s.acked = k;
+                    }
+                    return;
+                }
+            }
+        }
+    }
+
+
+
+    /**************** DECODER ********************/
+    int positionDecoder::decode(const std::string& rx_string, robot_position_message_t* pos)
+    {
+        const uint8_t* in = (const uint8_t*)rx_string.data();
+        size_t length = rx_string.length();
+
+        if(length < 4){
+            return -1;
+        }
+
+        memset(pos, 0, sizeof(robot_position_message_t));
+        pos->dest_id = in[0];
+        pos->src_id = in[1];
+        pos->msg_type = SimConstants::ROBOT_POSITION;
+
+        auto inserted = robots.try_emplace(pos->src_id);
+        robot_t& robot = inserted.first->second;
+        if(inserted.second){
+            memset(&robot, 0, sizeof(robot));
+        }
+
+        if(in[2] == SimConstants::ROBOT_POSITION){
+            if(length != sizeof(robot_position_message_t)){
+                return -1;
+            }
+            deserialize_robot_position_for_900MHz(pos, in);
+            return 0;
+        }
+
+        if(in[2] == SimConstants::ROBOT_POSITION_KEYFRAME){
+            position_keyframe_message_t key;
+            if(length != sizeof(key)){
+                return -1;
+            }
+            memcpy(&key, in, sizeof(key));
+
+            // a retransmitted keyframe is stored once
+            bool known = false;
+            for(const keyframe_t& k : robot.keyframes){
+                known = known || (k.valid && k.msg_id == key.msg_id);
+            }
+            if(!known){
+                robot.keyframes[robot.next] = keyframe_t{true, key.msg_id, key.stamp_us, key.x, key.y, key.z};
+                robot.next = (robot.next + 1) % POSITION_KEYFRAME_HISTORY;
+            }
+
+            pos->msg_id = key.msg_id;
+            pos->stamp_us = key.stamp_us;
+            pos->position.x = from_fixed_point(key.x);
+            pos->position.y = from_fixed_point(key.y);
+            pos->position.z = from_fixed_point(key.z);
+            return 0;
+        }
+
+        if(in[2] != SimConstants::ROBOT_POSITION_DELTA){
+            return -1;
+        }
+
+        const keyframe_t* key = nullptr;
+        for(const keyframe_t& k : robot.keyframes){
+            if(k.valid && static_cast<uint8_t>(k.msg_id) == in[3]){
+                key = &k;
+            }
+        }
+        if(key == nullptr){
+            return -1;
+        }
+
+        size_t offset = 4;
+        uint32_t stamp_ms;
+        size_t n = varint_decode(in + offset, length - offset, &stamp_ms);
+        if(n == 0 || offset + n >= length){
+            return -1;
+        }
+        offset += n;
+
+        uint8_t width = in[offset++];
+        uint32_t zx, zy, zz;
+
+        if(width >= 1 && width <= POSITION_MAX_PACKED_WIDTH){
+            size_t packed_length = (3 * width + 7) / 8;
+            if(length - offset != packed_length){
+                return -1;
+            }
+
+            uint64_t packed = 0;
+            memcpy(&packed, in + offset, packed_length);
+            uint64_t mask = (1ULL << width) - 1;
+            zx = static_cast<uint32_t>(packed & mask);
+            zy = static_cast<uint32_t>((packed >> width) & mask);
+            zz = static_cast<uint32_t>((packed >> (2 * width)) & mask);
+        }
+        else if(width == POSITION_VARINT_WIDTH){
+            size_t nx = varint_decode(in + offset, length - offset, &zx);
+            size_t ny = nx ? varint_decode(in + offset + nx, length - offset - nx, &zy) : 0;
+            size_t nz = ny ? varint_decode(in + offset + nx + ny, length - offset - nx - ny, &zz) : 0;
+            if(nz == 0 || offset + nx + ny + nz != length){
+                return -1;
+            }
+        }
+        else{
+            return -1;
+        }
+
+        pos->msg_id = key->msg_id;
+        pos->stamp_us = key->stamp_us + stamp_ms * 1000;
+        pos->position.x = from_fixed_point(static_cast<int32_t>(key->x + static_cast<int64_t>(zigzag_decode(zx))));
+        pos->position.y = from_fixed_point(static_cast<int32_t>(key->y + static_cast<int64_t>(zigzag_decode(zy))));
+        pos->position.z = from_fixed_point(static_cast<int32_t>(key->z + static_cast<int64_t>(zigzag_decode(zz))));
+        return 0;
+    }
+
+}
@@ -0,0 +1,169 @@
+/**
+ * @brief Declares the ROBOT_POSITION codec, keyframes plus compressed deltas
+ *
+ * A robot_position_message_t is 40 bytes, three doubles of position. Poses
+ * of a robot differ by centimetres, so most of those bytes repeat.
+ *
+ * Coordinates are converted to fixed point millimetres. The encoder sends
+ *      ROBOT_POSITION_KEYFRAME - absolute fixed point pose, acknowledged
+ *      ROBOT_POSITION_DELTA    - pose relative to the last keyframe the receiver
+ *                                acknowledged, so a lost delta never corrupts later ones
+ *
+ * A keyframe is sent every keyframe_interval poses. Until the receiver
+ * acknowledges one, and for the rare delta that overflows 32 bits or whose
+ * frame would contain a frame indicator, the pose goes out as a plain
+ * ROBOT_POSITION message. The decoder keeps the last POSITION_KEYFRAME_HISTORY
+ * keyframes of each robot, the encoder only refers to a keyframe that is
+ * still among them.
+ *
+ * Delta wire format, no struct padding:
+ *      dest_id, src_id, msg_type, keyframe id (low byte of the keyframe msg_id)
+ *      stamp - keyframe stamp, milliseconds, varint
+ *      width byte, then the zig-zag encoded dx, dy, dz
+ *
+ * Fast path, width 1 to 21: the three values are bit packed, width bits each,
+ * into the low 3 * width bits of one little endian 64 bit word, and only
+ * the bytes holding those bits are sent. Encode and decode are a handful of
+ * shifts and masks with no per byte branches.
+ * General path, width byte VARINT_WIDTH: three zig-zag varints.
+ *
+ */
+
+#ifndef POSITION_CODEC_INCLUDED_H
+#define POSITION_CODEC_INCLUDED_H
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+
+#include "sim_artifact_message.h"
+
+
+namespace rfd900sim
+{
+    constexpr double POSITION_FIXED_POINT_SCALE = 1000.0;          // millimetres
+    constexpr uint8_t POSITION_MAX_PACKED_WIDTH = 21;              // 3 * 21 bits fit one 64 bit word
+    constexpr uint8_t POSITION_VARINT_WIDTH = 0xFF;
+    constexpr int POSITION_KEYFRAME_HISTORY = 4;
+
+
+    struct position_keyframe_message_t{
+        uint8_t dest_id;
+        uint8_t src_id;
+        uint8_t msg_type;
+        uint16_t msg_id;
+        uint32_t stamp_us;                  // shared timebase
+        int32_t x;                          // fixed point, millimetres
+        int32_t y;
+        int32_t z;
+    };
+
+    // header 4, stamp varint 5, width 1, three varints 15
+    constexpr size_t POSITION_DELTA_MAX_LENGTH = 25;
+
+
+    /**************** PRIMITIVES ********************/
+    inline uint32_t zigzag_encode(int32_t v) { return (static_cast<uint32_t>(v) << 1) ^ static_cast<uint32_t>(v >> 31); }
+    inline int32_t zigzag_decode(uint32_t v) { return static_cast<int32_t>(v >> 1) ^ -static_cast<int32_t>(v & 1); }
+
+    // returns bytes written, at most 5
+    size_t varint_encode(uint32_t value, uint8_t* out);
+    // returns bytes read, 0 when the input ends first or the value is longer than 5 bytes
+    size_t varint_decode(const uint8_t* in, size_t length, uint32_t* value);
+
+    int32_t to_fixed_point(double v);
+    double from_fixed_point(int32_t v);
+
+
+    class positionEncoder{
+
+        public:
+
+        static constexpr int DEFAULT_KEYFRAME_INTERVAL = 50;
+
+        explicit positionEncoder(int keyframe_interval = DEFAULT_KEYFRAME_INTERVAL);
+
+        /**
+         * Encodes pos as a keyframe or a delta and frames it into serial_buffer.
+         * returns the framed length, 0 when the buffer is too short
+         * keyframe is set when the frame is a keyframe, which must be acknowledged
+         */
+        size_t encode(const robot_position_message_t* pos, uint8_t *serial_buffer, size_t serial_buffer_length, bool* keyframe);
+
+        // ACK for a keyframe from dest_id, later deltas are relative to it
+        void process_ack(uint8_t dest_id, uint16_t msg_id);
+
+        uint64_t keyframes() const { return keyframeCount; }
+        uint64_t deltas() const { return deltaCount; }
+        uint64_t varint_deltas() const { return varintCount; }
+        uint64_t absolutes() const { return absoluteCount; }
+
+
+        private:
+
+        struct keyframe_t{
+            bool valid;
+            uint16_t msg_id;
+            uint32_t sequence;                  // keyframes sent on the stream before this one
+            uint32_t stamp_us;
+            int32_t x, y, z;
+        };
+
+        struct stream_t{
+            keyframe_t acked;                   // reference for deltas
+            keyframe_t sent[POSITION_KEYFRAME_HISTORY];     // recent keyframes, ACKs may arrive late
+            uint32_t keyframes_sent;
+            int since_keyframe;
+        };
+
+        int keyframeInterval;
+        uint16_t nextKeyframeId;
+        std::unordered_map<uint32_t, stream_t> streams;     // per (dest, robot)
+
+        uint64_t keyframeCount;
+        uint64_t deltaCount;
+        uint64_t varintCount;
+        uint64_t absoluteCount;
+
+        size_t encode_delta(const robot_position_message_t* pos, const stream_t* s, int32_t x, int32_t y, int32_t z,
+                    uint8_t *serial_buffer, size_t serial_buffer_length);
+
+        static uint32_t stream_key(uint8_t dest_id, uint8_t robot_id) { return (uint32_t(dest_id) << 8) | robot_id; }
+    };
+
+
+    class positionDecoder{
+
+        public:
+
+        positionDecoder() = default;
+
+        /**
+         * rx_string is an extracted ROBOT_POSITION, ROBOT_POSITION_KEYFRAME or ROBOT_POSITION_DELTA message.
+         * Fills pos with the absolute pose. returns 0, or -1 when the message is malformed
+         * or refers to a keyframe this decoder has not received.
+         */
+        int decode(const std::string& rx_string, robot_position_message_t* pos);
+
+
+        private:
+
+        struct keyframe_t{
+            bool valid;
+            uint16_t msg_id;
+            uint32_t stamp_us;
+            int32_t x, y, z;
+        };
+
+        struct robot_t{
+            keyframe_t keyframes[POSITION_KEYFRAME_HISTORY];
+            int next;
+        };
+
+        std::unordered_map<uint8_t, robot_t> robots;
+    };
+
+}
+
+
+#endif
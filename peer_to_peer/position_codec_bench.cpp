@@ -0,0 +1,147 @@
+/**
+ * Purpose:
+ *  Measure the ROBOT_POSITION codec: compression ratio, encode and decode
+ *  cost, and the pose rate each supported baud rate carries.
+ *
+ *  Several simulated robots produce poses at 50 Hz, each a random walk of up
+ *  to 5 cm per axis. Every pose is encoded with positionEncoder, keyframes are
+ *  acknowledged ack_delay poses later (as a round trip on the radio would),
+ *  and every frame is decoded with positionDecoder and checked against the
+ *  original to within the fixed point resolution.
+ *
+ *  No radio is used, the baud rate table divides the serial byte rate
+ *  (8N1, 10 bits per byte) by the mean framed bytes per pose.
+ *
+ * Optional Command line arguments
+ *  argv[1] - number of poses
+ *  argv[2] - keyframe interval, poses per robot
+ *  argv[3] - ack delay, poses
+ *
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>                    // fabs
+#include <cstddef>                  // offsetof
+#include <cstdlib>                  // atoi
+#include <cstring>                  // memcpy
+#include <deque>
+#include <string>
+#include <vector>
+
+#include "position_codec.h"
+#include "rfd900_modem.h"
+#include "simulation_constants.h"
+#include "sim_artifact_message.h"
+
+
+using rfd900sim::SimConstants;
+using steady = std::chrono::steady_clock;
+
+const uint8_t robots[] = {
+    SimConstants::GROUND01, SimConstants::AERIAL01, SimConstants::AERIAL02, SimConstants::ANCHOR_STATION
+};
+constexpr int ROBOT_COUNT = sizeof(robots) / sizeof(robots[0]);
+constexpr uint32_t POSE_INTERVAL_US = 20000;
+
+
+struct pending_ack_t{
+    size_t due;
+    uint16_t msg_id;
+};
+
+
+int main(int argc, char **argv)
+{
+    size_t poseCount = 200000;
+    int keyframe_interval = rfd900sim::positionEncoder::DEFAULT_KEYFRAME_INTERVAL;
+    size_t ack_delay = 20;
+
+    if(argc > 1){
+        poseCount = atoi(argv[1]);
+    }
+    if(argc > 2){
+        keyframe_interval = atoi(argv[2]);
+    }
+    if(argc > 3){
+        ack_delay = atoi(argv[3]);
+    }
+
+    const size_t framing = SimConstants::MESSAGE_900_START_INDICATOR_LENGTH + SimConstants::MESSAGE_900_END_INDICATOR_LENGTH;
+    const size_t raw_length = sizeof(rfd900sim::robot_position_message_t) + framing;
+
+    std::vector<rfd900sim::robot_position_message_t> poses(poseCount);
+    for(size_t i = 0; i < poseCount; ++i){
+        uint32_t stamp_us = static_cast<uint32_t>((i / ROBOT_COUNT) * POSE_INTERVAL_US);
+        rfd900sim::simulate_robot_position_message(&poses[i], SimConstants::BASE_STATION, robots[i % ROBOT_COUNT], stamp_us);
+    }
+
+    /************* encode *************/
+    rfd900sim::positionEncoder encoder(keyframe_interval);
+    std::vector<std::string> frames(poseCount);
+    std::deque<pending_ack_t> acks;
+    uint8_t serial_buffer[64];
+    size_t coded_bytes = 0;
+
+    auto start = steady::now();
+    for(size_t i = 0; i < poseCount; ++i){
+        while(!acks.empty() && acks.front().due <= i){
+            encoder.process_ack(SimConstants::BASE_STATION, acks.front().msg_id);
+            acks.pop_front();
+        }
+
+        bool keyframe;
+        size_t length = encoder.encode(&poses[i], serial_buffer, sizeof(serial_buffer), &keyframe);
+        frames[i].assign((const char*)serial_buffer + SimConstants::MESSAGE_900_START_INDICATOR_LENGTH, length - framing);
+        coded_bytes += length;
+
+        if(keyframe){
+            uint16_t msg_id;
+            memcpy(&msg_id, frames[i].data() + offsetof(rfd900sim::position_keyframe_message_t, msg_id), sizeof(msg_id));
+            acks.push_back(pending_ack_t{i + ack_delay, msg_id});
+        }
+    }
+    double encode_ns = std::chrono::duration<double, std::nano>(steady::now() - start).count() / poseCount;
+
+    /************* decode *************/
+    rfd900sim::positionDecoder decoder;
+    size_t failures = 0;
+    double max_error_mm = 0.0;
+    uint32_t max_stamp_error_us = 0;
+
+    start = steady::now();
+    std::vector<rfd900sim::robot_position_message_t> decoded(poseCount);
+    for(size_t i = 0; i < poseCount; ++i){
+        if(decoder.decode(frames[i], &decoded[i]) != 0){
+            ++failures;
+        }
+    }
+    double decode_ns = std::chrono::duration<double, std::nano>(steady::now() - start).count() / poseCount;
+
+    for(size_t i = 0; i < poseCount; ++i){
+        const rfd900sim::point_t& a = poses[i].position;
+        const rfd900sim::point_t& b = decoded[i].position;
+        max_error_mm = std::max({max_error_mm, fabs(a.x - b.x) * 1000.0, fabs(a.y - b.y) * 1000.0, fabs(a.z - b.z) * 1000.0});
+        max_stamp_error_us = std::max(max_stamp_error_us, poses[i].stamp_us - decoded[i].stamp_us);
+    }
+
+    double coded_length = static_cast<double>(coded_bytes) / poseCount;
+
+    fprintf(stdout, "poses: %lu from %d robots, keyframe interval: %d, ack delay: %lu poses\n",
+                poseCount, ROBOT_COUNT, keyframe_interval, ack_delay);
+    fprintf(stdout, "keyframes: %lu  packed deltas: %lu  varint deltas: %lu  uncompressed: %lu  decode failures: %lu\n",
+                encoder.keyframes(), encoder.deltas() - encoder.varint_deltas(), encoder.varint_deltas(),
+                encoder.absolutes(), failures);
+    fprintf(stdout, "max error  position: %.3f mm  stamp: %u us\n", max_error_mm, max_stamp_error_us);
+    fprintf(stdout, "framed bytes per pose  raw: %lu  coded: %.2f  compression ratio: %.2f\n",
+                raw_length, coded_length, raw_length / coded_length);
+    fprintf(stdout, "encode: %.1f ns/pose  decode: %.1f ns/pose\n\n", encode_ns, decode_ns);
+
+    fprintf(stdout, "%8s %14s %16s\n", "baud", "raw poses/s", "coded poses/s");
+    for(int baud : rfd900comm::rfd900Modem::SUPPORTED_BAUD_RATES){
+        double bytes_per_sec = baud / 10.0;
+        fprintf(stdout, "%8d %14.0f %16.0f\n", baud, bytes_per_sec / raw_length, bytes_per_sec / coded_length);
+    }
+
+    return failures == 0 ? 0 : 1;
+}
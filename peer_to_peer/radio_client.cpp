@@ -0,0 +1,259 @@
+/**
+ * @brief radioClient class function definitions.
+ *
+ */
+
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>                     // ppoll
+#include <stdio.h>
+#include <string.h>                     // strerror, strncpy
+#include <unistd.h>
+
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "radio_client.h"
+
+namespace rfd900comm{
+
+    radioClient::radioClient()
+    {
+        socketFd = -1;
+        txEvent = -1;
+        rxEvent = -1;
+        channel = nullptr;
+        reserved = nullptr;
+    }
+
+    radioClient::~radioClient()
+    {
+        close();
+    }
+
+
+    int radioClient::connect(const char* name, txPriority priority, uint32_t rx_types, const char* socket_path)
+    {
+        struct sockaddr_un addr;
+
+        close();
+
+        if(strlen(socket_path) >= sizeof(addr.sun_path)){
+            fprintf(stderr, "error, %s, socket path %s too long\n", __func__, socket_path);
+            return -1;
+        }
+
+        socketFd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+        if(socketFd < 0){
+            fprintf(stderr, "error, %s, socket: %s\n", __func__, strerror(errno));
+            return -1;
+        }
+
+        memset(&addr, 0, sizeof(addr));
+        addr.sun_family = AF_UNIX;
+        strncpy(addr.sun_path, socket_path, sizeof(addr.sun_path) - 1);
+        if(::connect(socketFd, (struct sockaddr*)&addr, sizeof(addr)) != 0){
+            fprintf(stderr, "error, %s, connect %s: %s\n", __func__, socket_path, strerror(errno));
+            close();
+            return -1;
+        }
+
+        radioHello hello;
+        memset(&hello, 0, sizeof(hello));
+        hello.magic = radioHello::MAGIC;
+        hello.version = radioHello::VERSION;
+        hello.priority = static_cast<uint8_t>(priority);
+        hello.rx_types = rx_types;
+        strncpy(hello.name, name, sizeof(hello.name) - 1);
+
+        if(::send(socketFd, &hello, sizeof(hello), MSG_NOSIGNAL) != sizeof(hello)){
+            fprintf(stderr, "error, %s, send hello: %s\n", __func__, strerror(errno));
+            close();
+            return -1;
+        }
+
+        // the reply is a status byte carrying the channel memfd and the two eventfds
+        struct msghdr msg;
+        struct iovec iov;
+        uint8_t status = 1;
+        char control[CMSG_SPACE(3 * sizeof(int))];
+
+        memset(&msg, 0, sizeof(msg));
+        iov.iov_base = &status;
+        iov.iov_len = sizeof(status);
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+
+        if(recvmsg(socketFd, &msg, MSG_CMSG_CLOEXEC) != sizeof(status) || status != 0){
+            fprintf(stderr, "error, %s, daemon refused %s\n", __func__, name);
+            close();
+            return -1;
+        }
+
+        struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+        if(cmsg == nullptr || cmsg->cmsg_type != SCM_RIGHTS || cmsg->cmsg_len != CMSG_LEN(3 * sizeof(int))){
+            fprintf(stderr, "error, %s, no channel descriptors\n", __func__);
+            close();
+            return -1;
+        }
+
+        int fds[3];
+        memcpy(fds, CMSG_DATA(cmsg), sizeof(fds));
+        txEvent = fds[1];
+        rxEvent = fds[2];
+
+        void* addr_mapped = mmap(nullptr, sizeof(radioChannel), PROT_READ | PROT_WRITE, MAP_SHARED, fds[0], 0);
+        ::close(fds[0]);                                // the mapping keeps the channel alive
+        if(addr_mapped == MAP_FAILED){
+            fprintf(stderr, "error, %s, mmap: %s\n", __func__, strerror(errno));
+            close();
+            return -1;
+        }
+
+        channel = static_cast<radioChannel*>(addr_mapped);
+        if(channel->magic != radioChannel::MAGIC || channel->version != radioChannel::VERSION){
+            fprintf(stderr, "error, %s, not a version %u radio channel\n", __func__, radioChannel::VERSION);
+            close();
+            return -1;
+        }
+
+        return 0;
+    }
+
+
+    void radioClient::close()
+    {
+        if(channel != nullptr){
+            munmap(channel, sizeof(radioChannel));
+            channel = nullptr;
+        }
+        reserved = nullptr;
+
+        int* fds[] = {&socketFd, &txEvent, &rxEvent};
+        for(int* fd : fds){
+            if(*fd >= 0){
+                ::close(*fd);
+                *fd = -1;
+            }
+        }
+    }
+
+
+    uint8_t* radioClient::tx_reserve()
+    {
+        if(channel == nullptr){
+            return nullptr;
+        }
+
+        reserved = channel->tx.reserve();
+        return reserved != nullptr ? reserved->data : nullptr;
+    }
+
+
+    void radioClient::tx_commit(size_t length, txPriority priority)
+    {
+        if(reserved == nullptr){
+            fprintf(stderr, "error, %s, no slot reserved\n", __func__);
+            return;
+        }
+
+        reserved->length = static_cast<uint16_t>(length);
+        reserved->priority = static_cast<uint8_t>(priority);
+        reserved->flags = 0;
+        reserved = nullptr;
+
+        if(channel->tx.commit()){
+            uint64_t one = 1;
+            ssize_t w = write(txEvent, &one, sizeof(one));
+            (void)w;
+        }
+    }
+
+
+    int radioClient::send(txPriority priority, const uint8_t* frame, size_t length)
+    {
+        if(length > SHM_SLOT_DATA_LENGTH){
+            fprintf(stderr, "error, %s, frame of %lu bytes exceeds %lu\n", __func__, length, SHM_SLOT_DATA_LENGTH);
+            return -1;
+        }
+
+        uint8_t* data = tx_reserve();
+        if(data == nullptr){
+            return -1;
+        }
+
+        memcpy(data, frame, length);
+        tx_commit(length, priority);
+        return 0;
+    }
+
+
+    const uint8_t* radioClient::rx_peek(size_t* length) const
+    {
+        const shmSlot* slot = channel != nullptr ? channel->rx.peek() : nullptr;
+        if(slot == nullptr){
+            return nullptr;
+        }
+
+        *length = slot->length;
+        return slot->data;
+    }
+
+
+    void radioClient::rx_release()
+    {
+        channel->rx.release();
+    }
+
+
+    int radioClient::wait(long timeout_us)
+    {
+        if(channel == nullptr){
+            return -1;
+        }
+
+        // clear the eventfd before checking, a message committed after the check writes it again
+        uint64_t count;
+        ssize_t r = read(rxEvent, &count, sizeof(count));
+        (void)r;
+
+        if(!channel->rx.empty() || timeout_us == 0){
+            return channel->rx.empty() ? 0 : 1;
+        }
+
+        struct pollfd pfd;
+        pfd.fd = rxEvent;
+        pfd.events = POLLIN;
+        pfd.revents = 0;
+
+        struct timespec ts;
+        ts.tv_sec = timeout_us / 1000000L;
+        ts.tv_nsec = (timeout_us % 1000000L) * 1000L;
+        ppoll(&pfd, 1, &ts, nullptr);
+
+        return channel->rx.empty() ? 0 : 1;
+    }
+
+
+    ssize_t radioClient::receive(uint8_t* buffer, size_t length, long timeout_us)
+    {
+        size_t message_length;
+        const uint8_t* message = rx_peek(&message_length);
+
+        if(message == nullptr){
+            if(wait(timeout_us) <= 0){
+                return 0;
+            }
+            message = rx_peek(&message_length);
+        }
+
+        size_t n = message_length < length ? message_length : length;
+        memcpy(buffer, message, n);
+        rx_release();
+        return n;
+    }
+
+}
@@ -0,0 +1,84 @@
+/**
+ * @brief Declares radioClient, a process's connection to the radioDaemon
+ *
+ * connect() sends the hello and maps the shared memory channel the daemon
+ * passes back. Frames are framed as for rfd900Modem::send_message.
+ *
+ * Zero copy transmission: tx_reserve() returns the data of a free TX slot,
+ * the caller serializes its frame into it and tx_commit() publishes it.
+ * send() is the copying shortcut. Both fail when the TX ring is full, the
+ * daemon has not taken the client's earlier frames yet.
+ *
+ * Reception: rx_peek() returns the oldest received message, unframed and in
+ * place in its RX slot, until rx_release(). wait() sleeps until the RX ring
+ * holds a message. get_fd() is readable when it may, for callers with
+ * their own poll loop, who call wait(0) before rx_peek().
+ *
+ */
+
+#ifndef RADIO_CLIENT_INCLUDED_H
+#define RADIO_CLIENT_INCLUDED_H
+
+#include <cstdint>
+#include <sys/types.h>              // ssize_t
+
+#include "radio_daemon.h"
+
+
+namespace rfd900comm{
+
+    class radioClient{
+
+        public:
+
+        radioClient();
+        ~radioClient();
+
+        // disable copy constructor
+        radioClient(const radioClient&) = delete;
+
+        // disable assignment
+        radioClient& operator=(const radioClient&) = delete;
+
+        // priority is the most urgent class the daemon accepts from this client
+        int connect(const char* name, txPriority priority, uint32_t rx_types = RADIO_RX_ALL_TYPES,
+                    const char* socket_path = RADIO_DAEMON_DEFAULT_SOCKET);
+
+        void close();
+
+        // data of the next TX slot, SHM_SLOT_DATA_LENGTH bytes, nullptr when the ring is full
+        uint8_t* tx_reserve();
+
+        // publishes the slot from tx_reserve
+        void tx_commit(size_t length, txPriority priority);
+
+        // copies the frame into the TX ring, -1 when it is full or the frame too long
+        int send(txPriority priority, const uint8_t* frame, size_t length);
+
+        // the oldest received message and its length, nullptr when none is waiting
+        const uint8_t* rx_peek(size_t* length) const;
+        void rx_release();
+
+        // waits up to timeout_us for a received message, returns 1 when one is waiting, 0 on timeout
+        int wait(long timeout_us);
+
+        // copies the next received message, waiting up to timeout_us, returns its length, 0 on timeout
+        ssize_t receive(uint8_t* buffer, size_t length, long timeout_us);
+
+        int get_fd() const { return rxEvent; }
+        const radioChannel* channel_state() const { return channel; }
+
+
+        private:
+
+        int socketFd;
+        int txEvent;
+        int rxEvent;
+        radioChannel* channel;
+        shmSlot* reserved;
+    };
+
+}
+
+
+#endif
@@ -0,0 +1,430 @@
+/**
+ * @brief radioDaemon class function definitions.
+ *
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>                     // ppoll
+#include <stdio.h>
+#include <string.h>                     // strerror, strncpy
+#include <unistd.h>
+
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "radio_daemon.h"
+#include "sim_artifact_message.h"
+
+namespace rfd900comm{
+
+    constexpr size_t SERIAL_RX_BUFFER_LENGTH = 256;
+
+
+    static int send_descriptors(int socket_fd, const int* fds, size_t count, uint8_t status);
+
+
+    void radioChannel::reset()
+    {
+        magic = MAGIC;
+        version = VERSION;
+        tx_frames.store(0);
+        tx_rejected.store(0);
+        rx_frames.store(0);
+        rx_dropped.store(0);
+        tx.reset();
+        rx.reset();
+    }
+
+
+    radioDaemon::radioDaemon(rfd900Modem& modem, size_t air_bytes_per_sec, size_t max_queued_per_class) :
+        radio(modem), scheduler(air_bytes_per_sec), maxQueuedPerClass(max_queued_per_class),
+        listenFd(-1), nextClient(0)
+    {
+        clients.reserve(MAX_CLIENTS);
+        pending.reserve(MAX_PENDING);
+        rfd900sim::reserve_rx_storage(rxStorage, extracted);
+        memset(&stats, 0, sizeof(stats));
+    }
+
+    radioDaemon::~radioDaemon()
+    {
+        close();
+    }
+
+
+    int radioDaemon::open(const char* socket_path)
+    {
+        struct sockaddr_un addr;
+
+        if(strlen(socket_path) >= sizeof(addr.sun_path)){
+            fprintf(stderr, "error, %s, socket path %s too long\n", __func__, socket_path);
+            return -1;
+        }
+
+        listenFd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if(listenFd < 0){
+            fprintf(stderr, "error, %s, socket: %s\n", __func__, strerror(errno));
+            return -1;
+        }
+
+        memset(&addr, 0, sizeof(addr));
+        addr.sun_family = AF_UNIX;
+        strncpy(addr.sun_path, socket_path, sizeof(addr.sun_path) - 1);
+        unlink(socket_path);                            // left behind by a daemon that did not exit cleanly
+
+        if(bind(listenFd, (struct sockaddr*)&addr, sizeof(addr)) != 0 || listen(listenFd, MAX_CLIENTS) != 0){
+            fprintf(stderr, "error, %s, bind/listen %s: %s\n", __func__, socket_path, strerror(errno));
+            ::close(listenFd);
+            listenFd = -1;
+            return -1;
+        }
+
+        socketPath = socket_path;
+        return 0;
+    }
+
+
+    void radioDaemon::close()
+    {
+        while(!clients.empty()){
+            release_client(&clients.back());
+            clients.pop_back();
+        }
+        for(const pending_t& p : pending){
+            ::close(p.socket_fd);
+        }
+        pending.clear();
+
+        if(listenFd >= 0){
+            ::close(listenFd);
+            listenFd = -1;
+            unlink(socketPath.c_str());
+        }
+    }
+
+
+    int radioDaemon::service(long timeout_us)
+    {
+        struct pollfd pfds[2 + 2 * MAX_CLIENTS + MAX_PENDING];
+
+        take_tx_frames();
+        scheduler.service(radio);
+
+        // a waiting frame wakes the loop when pacing allows it or the port takes bytes again
+        bool frame_pending = scheduler.pending();
+        long wait_us = timeout_us;
+        if(frame_pending){
+            long delay = static_cast<long>(scheduler.next_service_delay(&radio).count());
+            wait_us = delay < wait_us ? delay : wait_us;
+        }
+        for(const pending_t& p : pending){
+            long left = static_cast<long>(std::chrono::duration_cast<std::chrono::microseconds>(
+                        p.deadline - std::chrono::steady_clock::now()).count());
+            left = left < 0 ? 0 : left;
+            wait_us = left < wait_us ? left : wait_us;
+        }
+
+        size_t n = 0;
+        pfds[n].fd = listenFd;
+        pfds[n++].events = POLLIN;
+        pfds[n].fd = radio.get_fd();
+        pfds[n++].events = POLLIN | (frame_pending && wait_us == 0 ? POLLOUT : 0);
+        for(const client_t& client : clients){
+            pfds[n].fd = client.socket_fd;
+            pfds[n++].events = POLLIN;
+            pfds[n].fd = client.tx_event;
+            pfds[n++].events = POLLIN;
+        }
+        size_t first_pending = n;
+        for(const pending_t& p : pending){
+            pfds[n].fd = p.socket_fd;
+            pfds[n++].events = POLLIN;
+        }
+        for(size_t i = 0; i < n; ++i){
+            pfds[i].revents = 0;
+        }
+
+        // with POLLOUT requested the poll itself is the wait
+        struct timespec ts;
+        long poll_us = frame_pending && wait_us == 0 ? timeout_us : wait_us;
+        ts.tv_sec = poll_us / 1000000L;
+        ts.tv_nsec = (poll_us % 1000000L) * 1000L;
+
+        int rv = ppoll(pfds, n, &ts, nullptr);
+        if(rv < 0){
+            if(errno == EINTR){
+                return 0;
+            }
+            fprintf(stderr, "error, %s, ppoll: %s\n", __func__, strerror(errno));
+            return -1;
+        }
+
+        if(pfds[1].revents & POLLIN){
+            receive();
+        }
+
+        // clear the eventfds before the rings are read, a later commit wakes the next poll
+        for(size_t c = clients.size(); c-- > 0;){
+            const struct pollfd& sock = pfds[2 + 2 * c];
+            const struct pollfd& event = pfds[3 + 2 * c];
+
+            if(sock.revents & (POLLIN | POLLHUP | POLLERR)){
+                release_client(&clients[c]);
+                clients.erase(clients.begin() + c);
+                ++stats.clients_closed;
+                continue;
+            }
+
+            if(event.revents & POLLIN){
+                uint64_t count;
+                ssize_t r = read(clients[c].tx_event, &count, sizeof(count));
+                (void)r;
+            }
+        }
+
+        // hellos that arrived, and connections that sent none in time
+        auto now = std::chrono::steady_clock::now();
+        size_t polled = pending.size();
+        for(size_t p = polled; p-- > 0;){
+            int fd = pending[p].socket_fd;
+            bool ready = pfds[first_pending + p].revents != 0;
+            if(!ready && now < pending[p].deadline){
+                continue;
+            }
+            pending.erase(pending.begin() + p);
+            if(ready){
+                finish_handshake(fd);
+            }
+            else{
+                fprintf(stderr, "error, %s, client sent no hello within %ld ms\n", __func__,
+                            static_cast<long>(HELLO_TIMEOUT.count()));
+                send_descriptors(fd, nullptr, 0, 1);
+                ::close(fd);
+            }
+        }
+
+        if(pfds[0].revents & POLLIN){
+            accept_clients();
+        }
+
+        take_tx_frames();
+        scheduler.service(radio);
+        return 0;
+    }
+
+
+    static int send_descriptors(int socket_fd, const int* fds, size_t count, uint8_t status)
+    {
+        struct msghdr msg;
+        struct iovec iov;
+        char control[CMSG_SPACE(3 * sizeof(int))];
+
+        memset(&msg, 0, sizeof(msg));
+        iov.iov_base = &status;
+        iov.iov_len = sizeof(status);
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+
+        if(count > 0){
+            memset(control, 0, sizeof(control));
+            msg.msg_control = control;
+            msg.msg_controllen = CMSG_SPACE(count * sizeof(int));
+
+            struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+            cmsg->cmsg_level = SOL_SOCKET;
+            cmsg->cmsg_type = SCM_RIGHTS;
+            cmsg->cmsg_len = CMSG_LEN(count * sizeof(int));
+            memcpy(CMSG_DATA(cmsg), fds, count * sizeof(int));
+        }
+
+        return sendmsg(socket_fd, &msg, MSG_NOSIGNAL) == sizeof(status) ? 0 : -1;
+    }
+
+
+    // a client sends its hello as soon as it connects, service() drops one that does not within HELLO_TIMEOUT
+    void radioDaemon::accept_clients()
+    {
+        int fd;
+        while((fd = accept4(listenFd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0){
+            if(pending.size() >= MAX_PENDING){
+                fprintf(stderr, "error, %s, %lu connections already waiting for their hello\n", __func__, MAX_PENDING);
+                send_descriptors(fd, nullptr, 0, 1);
+                ::close(fd);
+                continue;
+            }
+            pending.push_back(pending_t{fd, std::chrono::steady_clock::now() + HELLO_TIMEOUT});
+        }
+    }
+
+
+    void radioDaemon::finish_handshake(int fd)
+    {
+        radioHello hello;
+        if(recv(fd, &hello, sizeof(hello), MSG_DONTWAIT) != sizeof(hello)
+                || hello.magic != radioHello::MAGIC || hello.version != radioHello::VERSION){
+            fprintf(stderr, "error, %s, client sent no version %u hello\n", __func__, radioHello::VERSION);
+            send_descriptors(fd, nullptr, 0, 1);
+            ::close(fd);
+            return;
+        }
+
+        if(clients.size() >= MAX_CLIENTS){
+            fprintf(stderr, "error, %s, %lu clients already connected\n", __func__, MAX_CLIENTS);
+            send_descriptors(fd, nullptr, 0, 1);
+            ::close(fd);
+            return;
+        }
+
+        client_t client;
+        client.socket_fd = fd;
+        client.memory_fd = memfd_create("rfd900_channel", MFD_CLOEXEC);
+        client.tx_event = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        client.rx_event = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        client.channel = nullptr;
+        client.priority = hello.priority <= static_cast<uint8_t>(txPriority::BULK) ?
+                    static_cast<txPriority>(hello.priority) : txPriority::BULK;
+        client.rx_types = hello.rx_types;
+        client.name.assign(hello.name, strnlen(hello.name, sizeof(hello.name)));
+
+        if(client.memory_fd < 0 || client.tx_event < 0 || client.rx_event < 0
+                || ftruncate(client.memory_fd, sizeof(radioChannel)) != 0){
+            fprintf(stderr, "error, %s, channel for %s: %s\n", __func__, client.name.c_str(), strerror(errno));
+            send_descriptors(fd, nullptr, 0, 1);
+            release_client(&client);
+            return;
+        }
+
+        void* addr = mmap(nullptr, sizeof(radioChannel), PROT_READ | PROT_WRITE, MAP_SHARED, client.memory_fd, 0);
+        if(addr == MAP_FAILED){
+            fprintf(stderr, "error, %s, mmap: %s\n", __func__, strerror(errno));
+            send_descriptors(fd, nullptr, 0, 1);
+            release_client(&client);
+            return;
+        }
+        client.channel = static_cast<radioChannel*>(addr);
+        client.channel->reset();
+
+        int fds[3] = {client.memory_fd, client.tx_event, client.rx_event};
+        if(send_descriptors(fd, fds, 3, 0) != 0){
+            fprintf(stderr, "error, %s, sendmsg to %s: %s\n", __func__, client.name.c_str(), strerror(errno));
+            release_client(&client);
+            return;
+        }
+
+        clients.push_back(client);
+        ++stats.clients_accepted;
+    }
+
+
+    void radioDaemon::release_client(client_t* client)
+    {
+        if(client->channel != nullptr){
+            munmap(client->channel, sizeof(radioChannel));
+            client->channel = nullptr;
+        }
+
+        int* fds[] = {&client->socket_fd, &client->memory_fd, &client->tx_event, &client->rx_event};
+        for(int* fd : fds){
+            if(*fd >= 0){
+                ::close(*fd);
+                *fd = -1;
+            }
+        }
+    }
+
+
+    // one frame per client in turn while its class has room in the scheduler
+    void radioDaemon::take_tx_frames()
+    {
+        size_t count = clients.size();
+        bool taken = true;
+
+        while(taken && count > 0){
+            taken = false;
+
+            for(size_t k = 0; k < count; ++k){
+                client_t& client = clients[(nextClient + k) % count];
+                const shmSlot* slot = client.channel->tx.peek();
+                if(slot == nullptr){
+                    continue;
+                }
+
+                uint8_t p = slot->priority > static_cast<uint8_t>(client.priority) ? slot->priority : static_cast<uint8_t>(client.priority);
+                txPriority priority = p <= static_cast<uint8_t>(txPriority::BULK) ? static_cast<txPriority>(p) : txPriority::BULK;
+                if(scheduler.queued(priority) >= maxQueuedPerClass){
+                    continue;
+                }
+
+                if(slot->length == 0 || scheduler.enqueue(priority, slot->data, slot->length) == 0){
+                    client.channel->tx_rejected.fetch_add(1, std::memory_order_relaxed);
+                }
+                else{
+                    client.channel->tx_frames.fetch_add(1, std::memory_order_relaxed);
+                    ++stats.tx_frames;
+                }
+
+                client.channel->tx.release();
+                taken = true;
+            }
+
+            nextClient = (nextClient + 1) % count;
+        }
+    }
+
+
+    void radioDaemon::receive()
+    {
+        uint8_t serial_rx_buffer[SERIAL_RX_BUFFER_LENGTH];
+        ssize_t bytesRead;
+
+        while((bytesRead = radio.read_serial(serial_rx_buffer, SERIAL_RX_BUFFER_LENGTH, 0L)) > 0){
+            rfd900sim::append_rx_data(rxStorage, serial_rx_buffer, bytesRead);
+            while(rfd900sim::extract_rx_message(rxStorage, extracted)){
+                ++stats.rx_messages;
+                deliver(extracted);
+            }
+        }
+    }
+
+
+    void radioDaemon::deliver(const std::string& message)
+    {
+        if(message.length() < 3){
+            return;
+        }
+
+        uint8_t type = message[2];
+        uint32_t bit = type < 32 ? (1u << type) : 0;
+
+        for(client_t& client : clients){
+            if((client.rx_types & bit) == 0){
+                continue;
+            }
+
+            shmSlot* slot = message.length() <= SHM_SLOT_DATA_LENGTH ? client.channel->rx.reserve() : nullptr;
+            if(slot == nullptr){
+                client.channel->rx_dropped.fetch_add(1, std::memory_order_relaxed);
+                ++stats.rx_dropped;
+                continue;
+            }
+
+            memcpy(slot->data, message.data(), message.length());
+            slot->length = static_cast<uint16_t>(message.length());
+            slot->priority = 0;
+            slot->flags = 0;
+            client.channel->rx_frames.fetch_add(1, std::memory_order_relaxed);
+            ++stats.rx_deliveries;
+
+            if(client.channel->rx.commit()){
+                uint64_t one = 1;
+                ssize_t w = write(client.rx_event, &one, sizeof(one));
+                (void)w;
+            }
+        }
+    }
+
+}
@@ -0,0 +1,175 @@
+/**
+ * @brief Declares radioDaemon, one process owning the modem for several client processes
+ *
+ * Only one process can own the serial port. radioDaemon opens it and serves
+ * client processes such as perception, planner and telemetry through shared
+ * memory:
+ *
+ *      a client connects to the daemon's Unix socket and sends a
+ *      radioHello with its name, its priority class and the message types
+ *      it wants to receive; the connection waits in the poll set until the
+ *      hello arrives, so a silent client never stalls the others
+ *      the daemon creates a radioChannel in a memfd and two eventfds and
+ *      passes the three descriptors back (SCM_RIGHTS)
+ *      the client writes frames straight into TX ring slots, the daemon
+ *      writes received messages straight into RX ring slots (shmRing)
+ *      each side writes the other's eventfd only when the other may be
+ *      asleep on an empty ring
+ *
+ * The socket carries nothing after the handshake, it only tells the daemon
+ * when a client exits. The daemon then releases the channel.
+ *
+ * Arbitration: frames from the TX rings go through a txScheduler. A frame
+ * keeps the priority class set in its slot, but never a more urgent class
+ * than the client registered with. The daemon takes at most
+ * max_queued_per_class frames of a class into the scheduler, one frame per
+ * client in turn, so a flooding BULK client fills its own ring and cannot
+ * delay another client's CONTROL frame.
+ *
+ * Received bytes are extracted into messages (extract_rx_message). Every
+ * client subscribed to the message type, byte 2, gets a copy, unframed. A
+ * full RX ring drops the message for that client only and counts it in
+ * rx_dropped.
+ *
+ */
+
+#ifndef RADIO_DAEMON_INCLUDED_H
+#define RADIO_DAEMON_INCLUDED_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "rfd900_modem.h"
+#include "shm_ring.h"
+#include "tx_scheduler.h"
+
+
+namespace rfd900comm{
+
+    constexpr const char* RADIO_DAEMON_DEFAULT_SOCKET = "/tmp/rfd900d.sock";
+    constexpr uint32_t RADIO_RX_ALL_TYPES = 0xFFFFFFFF;
+
+
+    struct radioHello{
+        static constexpr uint32_t MAGIC = 0x52464448;           // "RFDH"
+        static constexpr uint32_t VERSION = 1;
+
+        uint32_t magic;
+        uint32_t version;
+        uint8_t priority;                                       // most urgent txPriority the client may use
+        uint32_t rx_types;                                      // bit n set receives message type n
+        char name[16];
+    };
+
+
+    // the shared memory of one client, TX from the client, RX to the client
+    struct radioChannel{
+        static constexpr uint32_t MAGIC = 0x52464443;           // "RFDC"
+        static constexpr uint32_t VERSION = 1;
+
+        uint32_t magic;
+        uint32_t version;
+
+        std::atomic<uint64_t> tx_frames;                        // taken from the TX ring
+        std::atomic<uint64_t> tx_rejected;                      // longer than a scheduler frame
+        std::atomic<uint64_t> rx_frames;                        // written to the RX ring
+        std::atomic<uint64_t> rx_dropped;                       // RX ring full
+
+        shmRing tx;
+        shmRing rx;
+
+        void reset();
+    };
+
+    static_assert(std::atomic<uint64_t>::is_always_lock_free, "radioChannel requires lock free 64 bit atomics in shared memory");
+
+
+    struct radioDaemonStats{
+        uint64_t clients_accepted;
+        uint64_t clients_closed;
+        uint64_t tx_frames;
+        uint64_t rx_messages;
+        uint64_t rx_deliveries;
+        uint64_t rx_dropped;
+    };
+
+
+    class radioDaemon{
+
+        public:
+
+        static constexpr size_t MAX_CLIENTS = 16;
+        static constexpr size_t MAX_PENDING = 16;               // connected, hello not yet received
+        static constexpr auto HELLO_TIMEOUT = std::chrono::milliseconds(100);
+        static constexpr size_t DEFAULT_MAX_QUEUED_PER_CLASS = 8;
+
+        // air_bytes_per_sec paces the scheduler as txScheduler does, zero writes frames as they come
+        explicit radioDaemon(rfd900Modem& modem, size_t air_bytes_per_sec = 0,
+                    size_t max_queued_per_class = DEFAULT_MAX_QUEUED_PER_CLASS);
+        ~radioDaemon();
+
+        // disable copy constructor
+        radioDaemon(const radioDaemon&) = delete;
+
+        // disable assignment
+        radioDaemon& operator=(const radioDaemon&) = delete;
+
+        // creates the listening socket, replacing a stale socket file
+        int open(const char* socket_path = RADIO_DAEMON_DEFAULT_SOCKET);
+
+        // waits up to timeout_us for clients, frames and received bytes and handles them, -1 on error
+        int service(long timeout_us);
+
+        void close();
+
+        size_t client_count() const { return clients.size(); }
+        radioDaemonStats get_stats() const { return stats; }
+
+
+        private:
+
+        struct client_t{
+            int socket_fd;
+            int memory_fd;
+            int tx_event;                       // client to daemon
+            int rx_event;                       // daemon to client
+            radioChannel* channel;
+            txPriority priority;
+            uint32_t rx_types;
+            std::string name;
+        };
+
+        struct pending_t{
+            int socket_fd;
+            std::chrono::steady_clock::time_point deadline;     // dropped without a hello by then
+        };
+
+        rfd900Modem& radio;
+        txScheduler scheduler;
+        size_t maxQueuedPerClass;
+
+        int listenFd;
+        std::string socketPath;
+        std::vector<client_t> clients;
+        std::vector<pending_t> pending;
+        size_t nextClient;                      // round robin start
+
+        std::string rxStorage;
+        std::string extracted;
+        radioDaemonStats stats;
+
+        void accept_clients();
+        void finish_handshake(int fd);
+        void release_client(client_t* client);
+        void take_tx_frames();
+        void receive();
+        void deliver(const std::string& message);
+    };
+
+}
+
+
+#endif
@@ -0,0 +1,92 @@
+/**
+ * Purpose:
+ *  Radio daemon. Owns the rfd900x serial port and lets several processes
+ *  send and receive through it with radioClient, over per client shared
+ *  memory rings (see radio_daemon.h). Runs until interrupted.
+ *
+ * Optional Command line arguments
+ *  argv[1] - serial device path, default auto, found by port discovery
+ *  argv[2] - baud rate
+ *  argv[3] - client socket path, default /tmp/rfd900d.sock
+ *  argv[4] - air rate for pacing, bytes/s, 0 writes frames as they arrive
+ *
+ */
+
+#include <errno.h>
+#include <signal.h>
+#include <cstdio>
+#include <cstdlib>                  // atoi
+#include <cstring>                  // memset, strerror, strcmp
+
+#include "modem_discovery.h"
+#include "radio_daemon.h"
+#include "rfd900_modem.h"
+
+
+static volatile sig_atomic_t exitRequest = 0;
+
+
+static void signal_handler_term(int sig)
+{
+    if(sig == SIGINT || sig == SIGTERM){
+        exitRequest = 1;
+    }
+}
+
+
+int main(int argc, char **argv)
+{
+    const char* serialDevicePath = nullptr;
+    int baudRate = rfd900comm::rfd900Modem::DEFAULT_BAUD_RATE;
+    const char* socketPath = rfd900comm::RADIO_DAEMON_DEFAULT_SOCKET;
+    size_t airBytesPerSec = 64000 / 8;
+
+    if(argc > 1 && strcmp(argv[1], "auto") != 0){
+        serialDevicePath = argv[1];
+    }
+    if(argc > 2){
+        baudRate = atoi(argv[2]);
+    }
+    if(argc > 3){
+        socketPath = argv[3];
+    }
+    if(argc > 4){
+        airBytesPerSec = atoi(argv[4]);
+    }
+
+    rfd900comm::rfd900Modem radio;
+    if(rfd900comm::open_radio(radio, serialDevicePath, baudRate) != 0){
+        fprintf(stderr, "error, %s radio init failure, serialDevicePath: %s\n", __func__,
+                    serialDevicePath != nullptr ? serialDevicePath : "auto");
+        return 1;
+    }
+
+    rfd900comm::radioDaemon daemon(radio, airBytesPerSec);
+    if(daemon.open(socketPath) != 0){
+        return 1;
+    }
+
+    struct sigaction saterm;
+    memset(&saterm, 0, sizeof(saterm));
+    saterm.sa_handler = signal_handler_term;
+    if(sigaction(SIGINT, &saterm, NULL) < 0 || sigaction(SIGTERM, &saterm, NULL) < 0){
+        fprintf(stderr, "sigaction saterm, errno: %s", strerror(errno));
+        return 1;
+    }
+
+    fprintf(stdout, "radiod, %s at %d baud, clients on %s\n", radio.get_device_path(), radio.get_baud_rate(), socketPath);
+
+    while(exitRequest == 0){
+        if(daemon.service(100000L) != 0){
+            break;
+        }
+    }
+
+    rfd900comm::radioDaemonStats stats = daemon.get_stats();
+    fprintf(stdout, "clients: %lu accepted, %lu closed\n", stats.clients_accepted, stats.clients_closed);
+    fprintf(stdout, "tx frames: %lu, rx messages: %lu, delivered: %lu, dropped: %lu\n",
+                stats.tx_frames, stats.rx_messages, stats.rx_deliveries, stats.rx_dropped);
+
+    daemon.close();
+    return 0;
+}
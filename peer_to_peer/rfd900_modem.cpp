@@ -16,18 +16,40 @@
 
 #include <errno.h>
 #include <fcntl.h>
+#include <libgen.h>                     // basename
+#include <limits.h>                     // PATH_MAX
+#include <poll.h>
 #include <stdio.h>
+#include <stdlib.h>                     // realpath
 #include <string.h>                     // memset
 #include <termios.h>
 #include <unistd.h>
 
+#include <linux/serial.h>               // serial_struct, ASYNC_LOW_LATENCY
+#include <sys/ioctl.h>
 #include <sys/time.h>
 
 
+#include "link_stats.h"
 #include "rfd900_modem.h"
+#include "trace.h"
+#include "virtual_clock.h"
 
 namespace rfd900comm{
 
+    const char* serial_profile_name(serialProfile profile)
+    {
+        switch(profile)
+        {
+        case serialProfile::LOW_LATENCY:
+            return "low-latency";
+        case serialProfile::THROUGHPUT:
+            return "throughput";
+        }
+        return "unknown";
+    }
+
+
     /**
      * \fn rfd900Modem(const char* devicePath)
      * 
@@ -39,6 +61,15 @@ namespace rfd900comm{
     {
         baudRate = 0;
         serialfd = -1;
+        serialTuning = serialProfile::LOW_LATENCY;
+        flowMode = flowControl::NONE;
+
+        airBytesPerSec = 0;
+        modemBufferBytes = DEFAULT_MODEM_BUFFER_BYTES;
+        bytesWritten = 0;
+        bytesIntoModem = 0;
+        modemLevel = 0.0;
+        overflowBytes = 0;
     }
 
     rfd900Modem::~rfd900Modem()
@@ -48,14 +79,18 @@ namespace rfd900comm{
         }
     }
 
-    int rfd900Modem::init(const char* devicePath, int baud_rate){
+    int rfd900Modem::init(const char* devicePath, int baud_rate, serialProfile profile, flowControl flow){
         
         serialDeviceName = devicePath;
-        serialfd = initialize_serial(baud_rate);
+        serialfd = initialize_serial(baud_rate, profile, flow);
         if(serialfd == -1){
             return -1;
         }
 
+        baudRate = baud_rate;
+        serialTuning = profile;
+        flowMode = flow;
+
         return 0;
     }
 
@@ -63,11 +98,12 @@ namespace rfd900comm{
    
 
     /**
-    *\fn int initialize_serial(int baud_rate)
+    *\fn int initialize_serial(int baud_rate, serialProfile profile, flowControl flow)
     *
     *\param[in]
-    *   	serial_device_name - example: "/dev/ttyS1"
     *   	baud_rate - baud rate in bits per second
+    *   	profile - latency / throughput tuning, see serialProfile
+    *   	flow - hardware flow control, see flowControl
     *
     *\return
     *       Success - returns the serial port file descriptor.
@@ -75,7 +111,7 @@ namespace rfd900comm{
     *
     *
     */
-    int rfd900Modem::initialize_serial(int baud_rate)
+    int rfd900Modem::initialize_serial(int baud_rate, serialProfile profile, flowControl flow)
     {
         int serial_port_fd;
         int serial_speed = set_baud_speed(baud_rate);
@@ -95,48 +131,60 @@ namespace rfd900comm{
 
         // New port settings
         memset(&newtio, 0, sizeof(newtio));           // set all struct values to zero
+
+        /* Raw mode, same as cfmakeraw:
+        *  no input processing (no CR/NL mapping, no parity marking, no flow control characters)
+        *  no output processing
+        *  non-canonical input, no echo, no signal characters
+        *  8 data bits, no parity
+        *
+        *  The payload is binary, any translation corrupts it.
+        */
+        cfmakeraw(&newtio);
+
         /* Set Control mode
-        *  CS8      - 8 data bits, no parity, 1 stop bit
+        *  CS8      - 8 data bits, no parity, 1 stop bit (set by cfmakeraw)
         *  CLOCAL   - local connnection, no modem control
         *  CREAD    - enable receiving characters
-        *  IGNBRK   - ignore break condition
         */
-        newtio.c_cflag = serial_speed | CS8 | CLOCAL | CREAD; //  | IGNBRK;
+        newtio.c_cflag |= CLOCAL | CREAD;
 
-        /* IGNPAR - ignore bytes with parity errors
-        *  ICRNL -  map CR to NL (otherwise a CR input on the other computer
-                        will not terminate input)
-        *
+        /* CRTSCTS  - transmit only while the modem asserts CTS, assert RTS while
+        *            there is room to receive. CLOCAL still ignores DCD.
         */
-        newtio.c_iflag = IGNPAR | ICRNL;
-        newtio.c_oflag = 0;                     // raw output
-        /*
-        * ICANON  : enable canonical input
-        *           disable all echo functionality, and don't send signals to calling program
+        if(flow == flowControl::RTS_CTS){
+            newtio.c_cflag |= CRTSCTS;
+        }
+        else{
+            newtio.c_cflag &= ~CRTSCTS;
+        }
+
+        cfsetispeed(&newtio, serial_speed);
+        cfsetospeed(&newtio, serial_speed);
+
+        /* The port is nonblocking, read returns whatever has arrived and VMIN / VTIME
+        *  are never consulted. Both profiles clear them, the profiles differ only in
+        *  the adapter settings apply_latency_settings makes.
         */
-        newtio.c_lflag = ~ICANON;
-        newtio.c_cc[VMIN] = 1;
+        newtio.c_cc[VMIN] = 0;
         newtio.c_cc[VTIME] = 0;
 
         // Load new settings
         if( tcsetattr(serial_port_fd, TCSAFLUSH, &newtio) < 0){
             fprintf(stderr, "error, %s, set term attributes: %s\n", __func__, strerror(errno));
-            close_serial();
+            close(serial_port_fd);
             return -1;
         }
 
-        // clear data from both input/output buffers
-        /* When using a usb serial port, the USB driver does not
-        know if there is data in the internal shift register, FIFO
-        or USB subsystem. As a workaround, to ensure the data
-        is flushed, add a sleep delay here to suspend program
-        execution. This allows time for data to arrive and be
-        stored in the buffers. A call to flush will then work.
+        apply_latency_settings(serial_port_fd, profile);
 
-        May need to experiment with sleep time.
+        /* A USB serial adapter can still hold bytes received before the port
+        was configured, in its FIFO or in the USB subsystem, and deliver them
+        after a flush. Rather than sleeping a fixed time, read and discard until
+        the port has been quiet for SETTLE_QUIET, bounded by SETTLE_LIMIT, then
+        flush both buffers. A quiet port is ready after one quiet period.
         */
-        usleep(10000);                                  // 10 ms
-        tcflush(serial_port_fd, TCIOFLUSH);
+        settle_serial(serial_port_fd);
 
         fprintf(stderr, "info, %s success\n", __func__);
 
@@ -144,6 +192,28 @@ namespace rfd900comm{
     }
 
 
+    void rfd900Modem::settle_serial(int fd)
+    {
+        uint8_t discard[256];
+        auto limit = std::chrono::steady_clock::now() + SETTLE_LIMIT;
+
+        tcflush(fd, TCIOFLUSH);
+        while(std::chrono::steady_clock::now() < limit){
+            struct pollfd pfd;
+            pfd.fd = fd;
+            pfd.events = POLLIN;
+            pfd.revents = 0;
+            if(poll(&pfd, 1, SETTLE_QUIET.count()) <= 0 || !(pfd.revents & POLLIN)){
+                break;
+            }
+            if(read(fd, discard, sizeof(discard)) <= 0){
+                break;
+            }
+        }
+        tcflush(fd, TCIOFLUSH);
+    }
+
+
     int  rfd900Modem::set_baud_speed(int baud_rate)
     {
         switch(baud_rate)
@@ -161,7 +231,59 @@ namespace rfd900comm{
         default:
             fprintf(stderr, "warning: %s, argument baud_rate: %d not supported, setting to default %d\n",
                         __func__, baud_rate, DEFAULT_BAUD_RATE);
-            return DEFAULT_BAUD_RATE;
+            return B57600;
+        }
+    }
+
+
+    /**
+     * USB serial adapters (FTDI and similar) hold received bytes until their
+     * latency timer expires or a USB packet fills, 16 ms by default. The low
+     * latency profile sets ASYNC_LOW_LATENCY on the tty and shortens the
+     * adapter latency timer through sysfs.
+     *
+     * Neither setting exists on every device (ptys, native UARTs), so failure
+     * to apply them is reported and otherwise ignored.
+     */
+    void rfd900Modem::apply_latency_settings(int fd, serialProfile profile)
+    {
+        struct serial_struct serinfo;
+        bool low_latency = (profile == serialProfile::LOW_LATENCY);
+
+        if(ioctl(fd, TIOCGSERIAL, &serinfo) == 0){
+            if(low_latency){
+                serinfo.flags |= ASYNC_LOW_LATENCY;
+            }
+            else{
+                serinfo.flags &= ~ASYNC_LOW_LATENCY;
+            }
+
+            if(ioctl(fd, TIOCSSERIAL, &serinfo) != 0){
+                fprintf(stderr, "warning, %s, TIOCSSERIAL: %s\n", __func__, strerror(errno));
+            }
+        }
+        else{
+            fprintf(stderr, "info, %s, %s has no serial_struct, ASYNC_LOW_LATENCY not applied\n",
+                        __func__, serialDeviceName.c_str());
+        }
+
+        // /dev/ttyUSB0 may be a udev symlink, the sysfs entry is named after the real device
+        char resolved[PATH_MAX];
+        if(realpath(serialDeviceName.c_str(), resolved) == nullptr){
+            return;
+        }
+
+        char sysfs_path[PATH_MAX + 64];
+        snprintf(sysfs_path, sizeof(sysfs_path), "/sys/bus/usb-serial/devices/%s/latency_timer", basename(resolved));
+
+        FILE* fp = fopen(sysfs_path, "w");
+        if(fp == nullptr){
+            return;                                     // not a usb-serial adapter
+        }
+
+        fprintf(fp, "%d", low_latency ? LOW_LATENCY_TIMER_MS : DEFAULT_LATENCY_TIMER_MS);
+        if(fclose(fp) != 0){
+            fprintf(stderr, "warning, %s, write %s: %s\n", __func__, sysfs_path, strerror(errno));
         }
     }
 
@@ -203,7 +325,10 @@ namespace rfd900comm{
             int select(int nfds, fd_set *readfds, fd_set *writefds, fd_set *exceptfds, struct timeval *timeout);
         */
 
-        rv = select(serialfd+1, &read_set, NULL, NULL, &timeout);
+        {
+            RFD900_TRACE_SCOPE(trace, traceEvent::SERIAL_SELECT, 0);
+            rv = select(serialfd+1, &read_set, NULL, NULL, &timeout);
+        }
 
         if(rv > 0){
             if(FD_ISSET(serialfd, &read_set))    // input from source available
@@ -215,8 +340,14 @@ namespace rfd900comm{
                     On error, -1 is returned and errno is set appropriately
                     */
 
+                    RFD900_TRACE_SCOPE(trace, traceEvent::SERIAL_READ, 0);
                     memset(readbuffer, 0, numbytes);
-                    return read(serialfd,readbuffer,numbytes);
+                    ssize_t bytesRead = read(serialfd,readbuffer,numbytes);
+                    RFD900_TRACE_SET_ID(trace, bytesRead);
+                    if(bytesRead > 0){
+                        linkStats::add(link_stats().bytes_in, bytesRead);
+                    }
+                    return bytesRead;
             }
             else{
                 // Because our file descriptor was the only one in the read set, it is highly unlikey that
@@ -261,6 +392,7 @@ namespace rfd900comm{
          ssize_t totalBytesSent = 0;
          ssize_t bytesSent;
          ssize_t bytesRemaining = length - totalBytesSent;
+         RFD900_TRACE_SCOPE(trace, traceEvent::SERIAL_WRITE, length);
 
          while(bytesRemaining > 0){
              bytesSent = write(serialfd, &msg[totalBytesSent], bytesRemaining);
@@ -276,11 +408,132 @@ namespace rfd900comm{
              bytesRemaining = length - totalBytesSent;
          }
 
+         bytesWritten += totalBytesSent;
+         linkStats::add(link_stats().bytes_out, totalBytesSent);
+         if(bytesRemaining == 0){
+             linkStats::add(link_stats().frames_out);
+         }
+
          return totalBytesSent;
      }
 
 
 
+    /**
+    *\fn ssize_t rfd900Modem::write_serial(const uint8_t* data, size_t length)
+    *
+    *\param[in]
+    *   	data - bytes to write
+    *   	length - number of bytes to write
+    *
+    *\return
+    *       returns number of bytes written, which may be less than length.
+    *       returns -1 on error. errno EAGAIN means the port cannot accept
+    *       more data right now; wait for the fd to become writable.
+    *
+    */
+    ssize_t rfd900Modem::write_serial(const uint8_t* data, size_t length)
+    {
+        RFD900_TRACE_SCOPE(trace, traceEvent::SERIAL_WRITE, length);
+        ssize_t bytesSent = write(serialfd, data, length);
+        RFD900_TRACE_SET_ID(trace, bytesSent);
+        if(bytesSent > 0){
+            bytesWritten += bytesSent;
+            linkStats::add(link_stats().bytes_out, bytesSent);
+        }
+        return bytesSent;
+    }
+
+
+
+    void rfd900Modem::set_modem_model(uint32_t air_bytes_per_sec, size_t modem_buffer_bytes)
+    {
+        airBytesPerSec = air_bytes_per_sec;
+        modemBufferBytes = modem_buffer_bytes;
+
+        // bytes written before the model starts are assumed to be on the air
+        ssize_t queued = kernel_tx_queued();
+        bytesIntoModem = bytesWritten - (queued > 0 ? queued : 0);
+        modemLevel = 0.0;
+        lastModelUpdate = clock_now();
+    }
+
+
+    ssize_t rfd900Modem::kernel_tx_queued() const
+    {
+        int queued = 0;
+        if(ioctl(serialfd, TIOCOUTQ, &queued) != 0){
+            return -1;
+        }
+        return queued;
+    }
+
+
+    /**
+     * Bytes that left the kernel queue since the last update entered the modem,
+     * the air drained airBytesPerSec * elapsed from it. Without flow control
+     * the modem accepts bytes it has no room for and drops them.
+     */
+    void rfd900Modem::update_tx_model()
+    {
+        auto now = clock_now();
+        double elapsed = std::chrono::duration<double>(now - lastModelUpdate).count();
+        lastModelUpdate = now;
+
+        ssize_t queued = kernel_tx_queued();
+        uint64_t into_modem = bytesWritten - (queued > 0 ? queued : 0);
+        uint64_t arrived = into_modem > bytesIntoModem ? into_modem - bytesIntoModem : 0;
+        bytesIntoModem = into_modem > bytesIntoModem ? into_modem : bytesIntoModem;
+
+        modemLevel -= elapsed * airBytesPerSec;
+        if(modemLevel < 0.0){
+            modemLevel = 0.0;
+        }
+        modemLevel += arrived;
+
+        if(modemLevel > modemBufferBytes){
+            if(flowMode == flowControl::NONE){
+                overflowBytes += static_cast<uint64_t>(modemLevel - modemBufferBytes);
+            }
+            modemLevel = static_cast<double>(modemBufferBytes);
+        }
+    }
+
+
+    size_t rfd900Modem::modem_buffered()
+    {
+        if(airBytesPerSec == 0){
+            return 0;
+        }
+        update_tx_model();
+        return static_cast<size_t>(modemLevel);
+    }
+
+
+    size_t rfd900Modem::tx_room()
+    {
+        if(airBytesPerSec == 0){
+            return SIZE_MAX;
+        }
+
+        update_tx_model();
+        ssize_t queued = kernel_tx_queued();
+        double used = modemLevel + (queued > 0 ? queued : 0);
+        return used >= modemBufferBytes ? 0 : static_cast<size_t>(modemBufferBytes - used);
+    }
+
+
+    std::chrono::microseconds rfd900Modem::tx_room_delay(size_t length)
+    {
+        size_t room = tx_room();
+        if(room >= length || airBytesPerSec == 0){
+            return std::chrono::microseconds::zero();
+        }
+        return std::chrono::microseconds(static_cast<int64_t>((length - room) * 1e6 / airBytesPerSec) + 1);
+    }
+
+
+
     void rfd900Modem::close_serial(){
 
         if( close(serialfd) != -1){
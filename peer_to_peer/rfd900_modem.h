@@ -19,16 +19,50 @@
 #ifndef RFD900_MODEM_INCLUDED_H
 #define RFD900_MODEM_INCLUDED_H
 
+#include <chrono>
 #include <cstdint>          // uint8_t
 #include <string>           // std::string
 
 
 namespace rfd900comm{
+
+    /**
+     * Serial port tuning profiles. Both put the port in raw, nonblocking mode
+     * and only change how a usb-serial adapter delivers bytes, the reads are
+     * the same.
+     *
+     * LOW_LATENCY - sets ASYNC_LOW_LATENCY and drops the usb-serial latency timer
+     *               to 1 ms so single bytes are delivered as soon as they arrive
+     * THROUGHPUT  - leaves the adapter batching bytes (16 ms latency timer),
+     *               fewer USB transfers and wakeups per byte at high load
+     */
+    enum class serialProfile{
+        LOW_LATENCY,
+        THROUGHPUT
+    };
+
+    const char* serial_profile_name(serialProfile profile);
+
+
+    /**
+     * NONE    - the modem buffer overflows silently when the host writes faster
+     *           than the air rate drains it
+     * RTS_CTS - CRTSCTS, the modem deasserts CTS when its buffer fills and the
+     *           kernel holds further bytes. The radio's RTSCTS parameter must be
+     *           enabled as well.
+     */
+    enum class flowControl{
+        NONE,
+        RTS_CTS
+    };
+
+
     class rfd900Modem{
 
         public:
         
         static constexpr int DEFAULT_BAUD_RATE = 57600;
+        static constexpr int SUPPORTED_BAUD_RATES[] = {9600, 19200, 38400, 57600, 115200};
 
         public:
 
@@ -43,24 +77,81 @@ namespace rfd900comm{
 
          
 
-        int init(const char* devicePath = "/dev/ttyUSB0", int baud_rate = DEFAULT_BAUD_RATE);
+        static constexpr int LOW_LATENCY_TIMER_MS = 1;
+        static constexpr int DEFAULT_LATENCY_TIMER_MS = 16;
+        static constexpr auto SETTLE_QUIET = std::chrono::milliseconds(2);
+        static constexpr auto SETTLE_LIMIT = std::chrono::milliseconds(50);
+
+        int init(const char* devicePath = "/dev/ttyUSB0", int baud_rate = DEFAULT_BAUD_RATE,
+                    serialProfile profile = serialProfile::LOW_LATENCY, flowControl flow = flowControl::NONE);
 
         ssize_t send_message(const char* msg, size_t length);
 
         ssize_t read_serial(uint8_t* readbuffer, size_t numbytes, long int delay_time);
 
+        // single nonblocking write attempt, returns -1 with errno EAGAIN when the port is busy
+        ssize_t write_serial(const uint8_t* data, size_t length);
+
+        // serial file descriptor, used by event loops to wait for readiness
+        int get_fd() const { return serialfd; }
+
+        serialProfile get_profile() const { return serialTuning; }
+        flowControl get_flow_control() const { return flowMode; }
+        const char* get_device_path() const { return serialDeviceName.c_str(); }
+        int get_baud_rate() const { return baudRate; }
+
+
+        /**
+         * Transmit occupancy model. Bytes written leave the kernel TX queue
+         * (TIOCOUTQ) for the modem buffer, which drains at the air rate.
+         *
+         *      modem_buffered  - estimated bytes in the modem buffer
+         *      tx_room         - bytes that can be written without overflowing it,
+         *                        counting what the kernel still holds
+         *      tx_room_delay   - time until length bytes of room drain free
+         *
+         * Without flow control, bytes pushed beyond the buffer are counted in
+         * modem_overflow as the estimate of bytes the modem dropped.
+         * An air rate of zero disables the model, tx_room is then unlimited.
+         */
+        static constexpr size_t DEFAULT_MODEM_BUFFER_BYTES = 2048;
+
+        void set_modem_model(uint32_t air_bytes_per_sec, size_t modem_buffer_bytes = DEFAULT_MODEM_BUFFER_BYTES);
+        bool modem_model_enabled() const { return airBytesPerSec != 0; }
+
+        // bytes written but still in the kernel TX queue, -1 on error
+        ssize_t kernel_tx_queued() const;
+
+        size_t modem_buffered();
+        size_t tx_room();
+        std::chrono::microseconds tx_room_delay(size_t length);
+        uint64_t modem_overflow() const { return overflowBytes; }
 
 
         private:
 
         int serialfd;               // serial file descriptor
         int baudRate;
+        serialProfile serialTuning;
+        flowControl flowMode;
         std::string serialDeviceName;
 
+        // transmit occupancy model
+        uint32_t airBytesPerSec;
+        size_t modemBufferBytes;
+        uint64_t bytesWritten;
+        uint64_t bytesIntoModem;
+        double modemLevel;
+        uint64_t overflowBytes;
+        std::chrono::steady_clock::time_point lastModelUpdate;
+
 
         // serial functions
-        int initialize_serial(int baud_rate);
+        int initialize_serial(int baud_rate, serialProfile profile, flowControl flow);
+        void update_tx_model();
         int set_baud_speed(int baud_rate);
+        void apply_latency_settings(int fd, serialProfile profile);
+        void settle_serial(int fd);
         void close_serial();
         
     };
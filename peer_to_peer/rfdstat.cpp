@@ -0,0 +1,117 @@
+/**
+ * Purpose:
+ *  Display the link statistics of a running radio program.
+ *
+ *  Maps the program's shared memory statistics segment read only and prints
+ *  the counters, with per second rates, once per interval. The radio process
+ *  and its serial port are never touched.
+ *
+ * Optional Command line arguments
+ *  argv[1] - segment name, default /rfd900_link_stats
+ *            txspeed: /rfd900_txspeed, rxspeed: /rfd900_rxspeed, txasync: /rfd900_txasync
+ *  argv[2] - interval, milliseconds
+ *  argv[3] - number of reports, 0 runs until interrupted
+ *
+ */
+
+#include <cstdlib>                  // atoi
+#include <cstdio>
+#include <unistd.h>                 // usleep
+
+#include "link_stats.h"
+
+
+struct snapshot_t{
+    uint64_t bytes_in;
+    uint64_t bytes_out;
+    uint64_t frames_in;
+    uint64_t frames_out;
+};
+
+
+static void take_snapshot(const rfd900comm::linkStats* s, snapshot_t* snap)
+{
+    using rfd900comm::linkStats;
+    snap->bytes_in = linkStats::get(s->bytes_in);
+    snap->bytes_out = linkStats::get(s->bytes_out);
+    snap->frames_in = linkStats::get(s->frames_in);
+    snap->frames_out = linkStats::get(s->frames_out);
+}
+
+
+static void print_report(const rfd900comm::linkStats* s, const snapshot_t* prev, const snapshot_t* cur, double seconds)
+{
+    using rfd900comm::linkStats;
+
+    uint64_t rtt_count = linkStats::get(s->ack_rtt_count);
+    double rtt_mean_ms = rtt_count ? linkStats::get(s->ack_rtt_sum_us) / 1000.0 / rtt_count : 0.0;
+
+    printf("pid %d\n", s->pid);
+    printf("  bytes   in: %12lu (%8.0f/s)   out: %12lu (%8.0f/s)\n",
+            cur->bytes_in, (cur->bytes_in - prev->bytes_in) / seconds,
+            cur->bytes_out, (cur->bytes_out - prev->bytes_out) / seconds);
+    printf("  frames  in: %12lu (%8.1f/s)   out: %12lu (%8.1f/s)\n",
+            cur->frames_in, (cur->frames_in - prev->frames_in) / seconds,
+            cur->frames_out, (cur->frames_out - prev->frames_out) / seconds);
+    printf("  resyncs: %lu  crc failures: %lu  sequence gaps: %lu  dedup hits: %lu\n",
+            linkStats::get(s->framing_resyncs), linkStats::get(s->crc_failures),
+            linkStats::get(s->sequence_gaps), linkStats::get(s->dedup_hits));
+    printf("  retransmits: %lu  acks: %lu\n",
+            linkStats::get(s->retransmits), linkStats::get(s->acks_received));
+    printf("  ack rtt ms  last: %.1f  mean: %.1f  min: %.1f  max: %.1f\n",
+            linkStats::get(s->ack_rtt_last_us) / 1000.0, rtt_mean_ms,
+            linkStats::get(s->ack_rtt_min_us) / 1000.0, linkStats::get(s->ack_rtt_max_us) / 1000.0);
+    printf("  queue depth  tx: %lu  rx: %lu  ack wait: %lu  superseded: %lu\n",
+            linkStats::get(s->tx_queue_depth), linkStats::get(s->rx_queue_depth),
+            linkStats::get(s->ack_wait_depth), linkStats::get(s->superseded));
+    printf("  air utilization: %.1f %%  admission degraded: %lu  rejected: %lu  expired: %lu\n",
+            linkStats::get(s->air_utilization_permille) / 10.0,
+            linkStats::get(s->admission_degraded), linkStats::get(s->admission_rejected),
+            linkStats::get(s->expired_drops));
+    printf("  radio  L/R rssi: %lu/%lu  L/R noise: %lu/%lu  rx errors: %lu\n",
+            linkStats::get(s->radio_rssi_local), linkStats::get(s->radio_rssi_remote),
+            linkStats::get(s->radio_noise_local), linkStats::get(s->radio_noise_remote),
+            linkStats::get(s->radio_rx_errors));
+    fflush(stdout);
+}
+
+
+int main(int argc, char **argv)
+{
+    const char* name = rfd900comm::linkStatsSegment::DEFAULT_NAME;
+    int interval_ms = 1000;
+    int reports = 0;
+
+    rfd900comm::linkStatsSegment segment;
+    snapshot_t prev, cur;
+
+    if(argc > 1){
+        name = argv[1];
+    }
+    if(argc > 2){
+        interval_ms = atoi(argv[2]);
+    }
+    if(argc > 3){
+        reports = atoi(argv[3]);
+    }
+
+    if(interval_ms <= 0){
+        fprintf(stderr, "usage: %s [segment name] [interval ms] [reports]\n", argv[0]);
+        return 1;
+    }
+
+    if(segment.attach(name) != 0){
+        return 1;
+    }
+
+    take_snapshot(segment.stats(), &prev);
+
+    for(int count = 0; reports == 0 || count < reports; ++count){
+        usleep(interval_ms * 1000);
+        take_snapshot(segment.stats(), &cur);
+        print_report(segment.stats(), &prev, &cur, interval_ms / 1000.0);
+        prev = cur;
+    }
+
+    return 0;
+}
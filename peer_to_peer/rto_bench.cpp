@@ -0,0 +1,214 @@
+/**
+ * Purpose:
+ *  Compare loss recovery latency with the fixed and the adaptive retransmission timeout.
+ *
+ *  Two radios are connected through a linkEmulator with latency and loss.
+ *  The sender transmits artifact messages at a fixed interval and runs
+ *  message900 retransmission scans, the receiver acknowledges every artifact.
+ *
+ *  For each rtoMode the program reports
+ *      delivery latency of all messages (first transmission to ACK)
+ *      recovery latency of the messages that needed a retransmission
+ *      the number of retransmissions
+ *
+ * Optional Command line arguments
+ *  argv[1] - number of messages
+ *  argv[2] - milliseconds between messages
+ *  argv[3] - one way latency, milliseconds
+ *  argv[4] - loss probability per chunk
+ *
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>                  // atoi, atof
+#include <cstring>                  // memcpy
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "ack_responder.h"
+#include "link_emulator.h"
+#include "message900.h"
+#include "rfd900_modem.h"
+#include "simulation_constants.h"
+#include "sim_artifact_message.h"
+
+
+using steady = std::chrono::steady_clock;
+
+constexpr size_t SERIAL_RX_BUFFER_LENGTH = 256;
+
+static std::atomic<bool> receiverRunning;
+
+
+struct tracked_t{
+    steady::time_point first_tx;
+    bool retransmitted;
+};
+
+
+static void summarize(const char* label, std::vector<double>& ms)
+{
+    if(ms.empty()){
+        fprintf(stdout, "    %-10s none\n", label);
+        return;
+    }
+
+    std::sort(ms.begin(), ms.end());
+    double sum = 0.0;
+    for(double v : ms){
+        sum += v;
+    }
+
+    size_t n = ms.size();
+    fprintf(stdout, "    %-10s n: %4lu  mean: %8.1f ms  p50: %8.1f ms  p95: %8.1f ms  max: %8.1f ms\n",
+                label, n, sum / n, ms[n / 2], ms[(n * 95) / 100], ms[n - 1]);
+}
+
+
+static int run_mode(rfd900comm::rtoMode mode, const rfd900comm::linkEmulatorConfig& config,
+            int messageCount, int tx_millis)
+{
+    const size_t SERIAL_ARTIFACT_BUFFER_LENGTH = sizeof(rfd900sim::artifact_message_t)
+                        + rfd900sim::SimConstants::MESSAGE_900_START_INDICATOR_LENGTH
+                        + rfd900sim::SimConstants::MESSAGE_900_END_INDICATOR_LENGTH;
+
+    rfd900comm::linkEmulator emulator;
+    rfd900comm::rfd900Modem tx_radio;
+    rfd900comm::rfd900Modem rx_radio;
+    rfd900comm::message900 msg900(mode);
+
+    std::vector<uint8_t> serial_tx_buffer(SERIAL_ARTIFACT_BUFFER_LENGTH);
+    uint8_t serial_rx_buffer[SERIAL_RX_BUFFER_LENGTH];
+    std::string temp_rx_storage;
+    std::string extracted_rx_data;
+
+    std::unordered_map<uint16_t, tracked_t> tracked;
+    std::vector<double> delivery_ms;
+    std::vector<double> recovery_ms;
+    size_t retransmissions = 0;
+
+    if(emulator.start(config) != 0){
+        return -1;
+    }
+
+    if(tx_radio.init(emulator.port_name(0)) != 0 || rx_radio.init(emulator.port_name(1)) != 0){
+        fprintf(stderr, "error, %s radio init failure\n", __func__);
+        return -1;
+    }
+
+    receiverRunning = true;
+    std::thread rx_thread(rfd900comm::ack_responder, &rx_radio, &receiverRunning);
+
+    auto retransmit = [&](const rfd900comm::message900_t& msg){
+        tx_radio.send_message((const char*)msg.data, msg.data_length);
+        auto it = tracked.find(msg.message_id);
+        if(it != tracked.end()){
+            it->second.retransmitted = true;
+        }
+    };
+
+    int txcount = 0;
+    auto next_tx = steady::now();
+    auto give_up = steady::time_point::max();
+
+    while(txcount < messageCount || (msg900.ack_wait_list_size() > 0 && steady::now() < give_up)){
+
+        if(txcount < messageCount && steady::now() >= next_tx){
+            rfd900sim::artifact_message_t artmsg;
+            rfd900sim::simulate_artifact_message(&artmsg, rfd900sim::SimConstants::BASE_STATION,
+                        rfd900sim::SimConstants::AERIAL01);
+            rfd900sim::serialize_artifact_for_900MHz(&artmsg, serial_tx_buffer.data(), SERIAL_ARTIFACT_BUFFER_LENGTH);
+
+            tx_radio.send_message((const char*)serial_tx_buffer.data(), SERIAL_ARTIFACT_BUFFER_LENGTH);
+            msg900.add_to_ack_wait_list(artmsg.dest_id, artmsg.msg_id, artmsg.msg_type,
+                        serial_tx_buffer.data(), SERIAL_ARTIFACT_BUFFER_LENGTH);
+            tracked[artmsg.msg_id] = tracked_t{steady::now(), false};
+
+            ++txcount;
+            next_tx += std::chrono::milliseconds(tx_millis);
+            if(txcount == messageCount){
+                give_up = steady::now() + std::chrono::seconds(30);
+            }
+        }
+
+        ssize_t bytesRead = tx_radio.read_serial(serial_rx_buffer, SERIAL_RX_BUFFER_LENGTH, 1000L);
+        if(bytesRead > 0){
+            temp_rx_storage.append((const char*)serial_rx_buffer, bytesRead);
+            while(rfd900sim::extract_rx_message(temp_rx_storage, extracted_rx_data)){
+                if(extracted_rx_data.length() != sizeof(rfd900sim::ack_message_t)
+                        || extracted_rx_data[2] != rfd900sim::SimConstants::ACK){
+                    continue;
+                }
+
+                rfd900sim::ack_message_t ack;
+                memcpy(&ack, extracted_rx_data.data(), sizeof(ack));
+                if(msg900.process_received_ack(ack.src_id, ack.msg_id) != 0){
+                    continue;                           // duplicate ACK
+                }
+
+                auto it = tracked.find(ack.msg_id);
+                if(it != tracked.end()){
+                    double ms = std::chrono::duration<double, std::milli>(steady::now() - it->second.first_tx).count();
+                    delivery_ms.push_back(ms);
+                    if(it->second.retransmitted){
+                        recovery_ms.push_back(ms);
+                    }
+                    tracked.erase(it);
+                }
+            }
+        }
+
+        retransmissions += msg900.scan_list_for_retransmission(retransmit);
+    }
+
+    receiverRunning = false;
+    rx_thread.join();
+
+    fprintf(stdout, "%s rto, final rto to base station: %.1f ms, retransmissions: %lu, undelivered: %lu\n",
+                mode == rfd900comm::rtoMode::FIXED ? "fixed" : "adaptive",
+                msg900.retransmission_timeout(rfd900sim::SimConstants::BASE_STATION).count() / 1000.0,
+                retransmissions, msg900.ack_wait_list_size());
+    summarize("delivery", delivery_ms);
+    summarize("recovery", recovery_ms);
+    return 0;
+}
+
+
+int main(int argc, char **argv)
+{
+    int messageCount = 200;
+    int tx_millis = 50;
+    rfd900comm::linkEmulatorConfig config;
+    config.latency = std::chrono::milliseconds(30);
+    config.loss_probability = 0.1;
+
+    if(argc > 1){
+        messageCount = atoi(argv[1]);
+    }
+    if(argc > 2){
+        tx_millis = atoi(argv[2]);
+    }
+    if(argc > 3){
+        config.latency = std::chrono::milliseconds(atoi(argv[3]));
+    }
+    if(argc > 4){
+        config.loss_probability = atof(argv[4]);
+    }
+
+    fprintf(stdout, "messages: %d, interval: %d ms, one way latency: %ld ms, loss: %.2f\n",
+                messageCount, tx_millis, (long)std::chrono::duration_cast<std::chrono::milliseconds>(config.latency).count(),
+                config.loss_probability);
+
+    if(run_mode(rfd900comm::rtoMode::FIXED, config, messageCount, tx_millis) != 0){
+        return 1;
+    }
+    if(run_mode(rfd900comm::rtoMode::ADAPTIVE, config, messageCount, tx_millis) != 0){
+        return 1;
+    }
+
+    return 0;
+}
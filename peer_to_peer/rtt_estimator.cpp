@@ -0,0 +1,91 @@
+/**
+ * @brief rttEstimator class function definitions.
+ *
+ */
+
+#include <cstdlib>                  // llabs
+
+#include "rtt_estimator.h"
+
+namespace rfd900comm{
+
+    rttEstimator::rttEstimator(duration initial_rto, duration min_rto, duration max_rto)
+    {
+        minRtoUs = min_rto.count();
+        maxRtoUs = max_rto.count();
+
+        for(node_state_t& node : nodes){
+            node.has_sample = false;
+            node.backoffs = 0;
+            node.srtt_us = 0;
+            node.rttvar_us = 0;
+            node.rto_us = clamp(initial_rto.count());
+            node.last_backoff = time_point::min();
+        }
+    }
+
+
+    void rttEstimator::add_sample(uint8_t dest_id, duration rtt)
+    {
+        node_state_t& node = nodes[dest_id];
+        int64_t r = rtt.count();
+
+        if(!node.has_sample){
+            node.srtt_us = r;
+            node.rttvar_us = r / 2;
+            node.has_sample = true;
+        }
+        else{
+            // integer form of the 1/4 and 1/8 gains
+            node.rttvar_us = (3 * node.rttvar_us + llabs(node.srtt_us - r)) / 4;
+            node.srtt_us = (7 * node.srtt_us + r) / 8;
+        }
+
+        int64_t variance_term = 4 * node.rttvar_us;
+        if(variance_term < CLOCK_GRANULARITY.count()){
+            variance_term = CLOCK_GRANULARITY.count();
+        }
+
+        node.rto_us = clamp(node.srtt_us + variance_term);
+        node.backoffs = 0;
+    }
+
+
+    void rttEstimator::backoff(uint8_t dest_id, time_point now)
+    {
+        node_state_t& node = nodes[dest_id];
+
+        // timeouts of messages sent in the same RTO interval are one loss event
+        if(node.last_backoff != time_point::min() && now - node.last_backoff < duration(node.rto_us)){
+            return;
+        }
+
+        node.last_backoff = now;
+        node.rto_us = clamp(node.rto_us * 2);
+        if(node.backoffs < UINT8_MAX){
+            ++node.backoffs;
+        }
+    }
+
+
+    void rttEstimator::set_min_rto(duration min_rto)
+    {
+        minRtoUs = min_rto.count();
+        for(node_state_t& node : nodes){
+            node.rto_us = clamp(node.rto_us);
+        }
+    }
+
+
+    int64_t rttEstimator::clamp(int64_t rto_us) const
+    {
+        if(rto_us < minRtoUs){
+            return minRtoUs;
+        }
+        if(rto_us > maxRtoUs){
+            return maxRtoUs;
+        }
+        return rto_us;
+    }
+
+}
@@ -0,0 +1,76 @@
+/**
+ * @brief Declares rttEstimator, per destination retransmission timeout calculation
+ *
+ * Jacobson/Karels estimation as specified in RFC 6298:
+ *      first sample R:   SRTT = R, RTTVAR = R/2
+ *      later samples:    RTTVAR = 3/4 RTTVAR + 1/4 |SRTT - R|
+ *                        SRTT   = 7/8 SRTT   + 1/8 R
+ *      RTO = SRTT + max(G, 4 RTTVAR), clamped to [min_rto, max_rto]
+ *
+ * Each timeout doubles the RTO (exponential backoff) until a new sample
+ * arrives. Every outstanding message has its own timer, so a burst of
+ * timeouts to one destination only doubles the RTO once per RTO interval.
+ *
+ * Callers apply Karn's rule: only messages transmitted exactly once produce
+ * a sample, an ACK for a retransmitted message is ambiguous.
+ *
+ */
+
+#ifndef RTT_ESTIMATOR_INCLUDED_H
+#define RTT_ESTIMATOR_INCLUDED_H
+
+#include <chrono>
+#include <cstdint>
+
+
+namespace rfd900comm{
+
+    class rttEstimator{
+
+        public:
+
+        using duration = std::chrono::microseconds;
+        using time_point = std::chrono::steady_clock::time_point;
+
+        static constexpr int MAX_NODES = 256;                       // node ids are uint8_t
+        static constexpr duration CLOCK_GRANULARITY = std::chrono::milliseconds(1);
+        static constexpr duration DEFAULT_MIN_RTO = std::chrono::milliseconds(100);
+        static constexpr duration DEFAULT_MAX_RTO = std::chrono::seconds(60);
+
+        explicit rttEstimator(duration initial_rto = std::chrono::seconds(3),
+                    duration min_rto = DEFAULT_MIN_RTO, duration max_rto = DEFAULT_MAX_RTO);
+
+        void add_sample(uint8_t dest_id, duration rtt);
+        void backoff(uint8_t dest_id, time_point now);
+
+        duration rto(uint8_t dest_id) const { return duration(nodes[dest_id].rto_us); }
+        duration srtt(uint8_t dest_id) const { return duration(nodes[dest_id].srtt_us); }
+        duration rttvar(uint8_t dest_id) const { return duration(nodes[dest_id].rttvar_us); }
+        int backoff_count(uint8_t dest_id) const { return nodes[dest_id].backoffs; }
+
+        // lower bound used by link adaptive code, e.g. when the modem reports a poor link
+        void set_min_rto(duration min_rto);
+
+
+        private:
+
+        struct node_state_t{
+            bool has_sample;
+            uint8_t backoffs;
+            int64_t srtt_us;
+            int64_t rttvar_us;
+            int64_t rto_us;
+            time_point last_backoff;
+        };
+
+        node_state_t nodes[MAX_NODES];
+        int64_t minRtoUs;
+        int64_t maxRtoUs;
+
+        int64_t clamp(int64_t rto_us) const;
+    };
+
+}
+
+
+#endif
@@ -0,0 +1,134 @@
+/**
+ * Purpose:
+ *  Measure byte arrival latency for each serialProfile.
+ *
+ *  For every profile, one radio writes a single byte and the other radio
+ *  times how long it takes to come out of read_serial. Results are reported
+ *  in microseconds.
+ *
+ *  Without device arguments the radios are the two ports of a linkEmulator,
+ *  with the channel running at baud/10 bytes per second. Give two device
+ *  paths to measure a real pair of radios instead; the latency timer and
+ *  ASYNC_LOW_LATENCY only have an effect on real usb-serial adapters.
+ *
+ * Optional Command line arguments
+ *  argv[1] - number of samples per profile
+ *  argv[2] - transmitting serial device path
+ *  argv[3] - receiving serial device path
+ *
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>                  // atoi
+#include <vector>
+
+#include "link_emulator.h"
+#include "rfd900_modem.h"
+
+
+constexpr long READ_TIMEOUT = 1000000L;         // units, microseconds
+
+
+static int measure_profile(rfd900comm::serialProfile profile, const char* tx_path, const char* rx_path,
+            int samples, std::vector<double>* latency_us)
+{
+    int baudRate = rfd900comm::rfd900Modem::DEFAULT_BAUD_RATE;
+    rfd900comm::rfd900Modem tx_radio;
+    rfd900comm::rfd900Modem rx_radio;
+    uint8_t rx_byte;
+
+    if(tx_radio.init(tx_path, baudRate, profile) != 0 || rx_radio.init(rx_path, baudRate, profile) != 0){
+        fprintf(stderr, "error, %s radio init failure\n", __func__);
+        return -1;
+    }
+
+    for(int i = 0; i < samples; ++i){
+        uint8_t tx_byte = static_cast<uint8_t>(i);
+
+        auto start = std::chrono::steady_clock::now();
+        if(tx_radio.write_serial(&tx_byte, 1) != 1){
+            fprintf(stderr, "error, %s, write failure\n", __func__);
+            return -1;
+        }
+
+        ssize_t bytesRead = rx_radio.read_serial(&rx_byte, 1, READ_TIMEOUT);
+        auto end = std::chrono::steady_clock::now();
+
+        if(bytesRead != 1){
+            fprintf(stderr, "warning, %s, sample %d lost\n", __func__, i);
+            continue;
+        }
+
+        latency_us->push_back(std::chrono::duration<double, std::micro>(end - start).count());
+    }
+
+    return 0;
+}
+
+
+static void report(rfd900comm::serialProfile profile, std::vector<double>& latency_us)
+{
+    if(latency_us.empty()){
+        fprintf(stdout, "%-12s no samples\n", rfd900comm::serial_profile_name(profile));
+        return;
+    }
+
+    std::sort(latency_us.begin(), latency_us.end());
+
+    double sum = 0.0;
+    for(double v : latency_us){
+        sum += v;
+    }
+
+    size_t n = latency_us.size();
+    fprintf(stdout, "%-12s samples: %5lu  min: %9.1f  mean: %9.1f  p50: %9.1f  p99: %9.1f  max: %9.1f\n",
+                rfd900comm::serial_profile_name(profile), n, latency_us[0], sum / n,
+                latency_us[n / 2], latency_us[(n * 99) / 100], latency_us[n - 1]);
+}
+
+
+int main(int argc, char **argv)
+{
+    int samples = 200;
+    const rfd900comm::serialProfile profiles[] = {
+        rfd900comm::serialProfile::LOW_LATENCY,
+        rfd900comm::serialProfile::THROUGHPUT
+    };
+
+    if(argc > 1){
+        samples = atoi(argv[1]);
+    }
+
+    if(argc == 3 || argc > 4){
+        fprintf(stderr, "usage: %s [samples] [tx device rx device]\n", argv[0]);
+        return 1;
+    }
+
+    fprintf(stdout, "byte arrival latency, microseconds\n");
+
+    for(rfd900comm::serialProfile profile : profiles){
+        std::vector<double> latency_us;
+        rfd900comm::linkEmulator emulator;
+
+        if(argc == 4){
+            if(measure_profile(profile, argv[2], argv[3], samples, &latency_us) != 0){
+                return 1;
+            }
+        }
+        else{
+            rfd900comm::linkEmulatorConfig config;
+            config.air_bytes_per_sec = rfd900comm::rfd900Modem::DEFAULT_BAUD_RATE / 10;
+            if(emulator.start(config) != 0){
+                return 1;
+            }
+            if(measure_profile(profile, emulator.port_name(0), emulator.port_name(1), samples, &latency_us) != 0){
+                return 1;
+            }
+        }
+
+        report(profile, latency_us);
+    }
+
+    return 0;
+}
@@ -0,0 +1,106 @@
+/**
+ * @brief Declares shmRing, a single producer single consumer ring of frame slots for shared memory
+ *
+ * The ring holds SHM_RING_SLOTS fixed size slots and two free running
+ * indices, each on its own cache line: the producer owns tail, the consumer
+ * owns head. A slot is written in place, the producer reserves the slot at
+ * tail, fills it and commits, the consumer peeks the slot at head, uses it
+ * and releases it. Neither side copies a frame through an intermediate
+ * buffer and neither takes a lock, so the ring works between processes that
+ * map the same memory.
+ *
+ * Wakeups: a consumer with an empty ring sleeps on an eventfd. commit()
+ * returns true only when the consumer may have found the ring empty, the
+ * producer then writes the eventfd. A busy ring hands frames over without a
+ * system call. Both indices are sequentially consistent, so a consumer that
+ * checks the ring after clearing its eventfd never misses a commit.
+ *
+ */
+
+#ifndef SHM_RING_INCLUDED_H
+#define SHM_RING_INCLUDED_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+
+namespace rfd900comm{
+
+    constexpr size_t SHM_RING_SLOTS = 64;                  // power of two
+    constexpr size_t SHM_SLOT_DATA_LENGTH = 256;            // a complete frame
+
+
+    struct shmSlot{
+        uint16_t length;
+        uint8_t priority;                                   // txPriority on the TX ring
+        uint8_t flags;
+        uint32_t sequence;                                  // per ring count, for the consumer's loss accounting
+        uint8_t data[SHM_SLOT_DATA_LENGTH];
+    };
+
+
+    struct shmRing{
+
+        alignas(64) std::atomic<uint32_t> head;             // next slot to consume
+        alignas(64) std::atomic<uint32_t> tail;             // next slot to produce
+        alignas(64) shmSlot slots[SHM_RING_SLOTS];
+
+        // called once by the process that creates the shared memory
+        void reset()
+        {
+            head.store(0);
+            tail.store(0);
+        }
+
+        // producer: the slot to fill, nullptr when the ring is full
+        shmSlot* reserve()
+        {
+            uint32_t t = tail.load(std::memory_order_relaxed);
+            if(t - head.load(std::memory_order_acquire) >= SHM_RING_SLOTS){
+                return nullptr;
+            }
+            shmSlot* slot = &slots[t % SHM_RING_SLOTS];
+            slot->sequence = t;
+            return slot;
+        }
+
+        // producer: publishes the reserved slot, true when the consumer has to be woken
+        bool commit()
+        {
+            uint32_t t = tail.load(std::memory_order_relaxed);
+            tail.store(t + 1);
+            return head.load() == t;
+        }
+
+        // consumer: the oldest committed slot, nullptr when the ring is empty
+        const shmSlot* peek() const
+        {
+            uint32_t h = head.load(std::memory_order_relaxed);
+            if(tail.load() == h){
+                return nullptr;
+            }
+            return &slots[h % SHM_RING_SLOTS];
+        }
+
+        // consumer: returns the peeked slot to the producer
+        void release()
+        {
+            head.store(head.load(std::memory_order_relaxed) + 1);
+        }
+
+        size_t size() const
+        {
+            return tail.load(std::memory_order_acquire) - head.load(std::memory_order_acquire);
+        }
+
+        bool empty() const { return size() == 0; }
+    };
+
+    static_assert(std::atomic<uint32_t>::is_always_lock_free, "shmRing requires lock free 32 bit atomics in shared memory");
+    static_assert((SHM_RING_SLOTS & (SHM_RING_SLOTS - 1)) == 0, "SHM_RING_SLOTS must be a power of two");
+
+}
+
+
+#endif
@@ -1,28 +1,32 @@
-#include <cstdlib>              // rand
+#include <algorithm>            // std::search
 #include <cstdio>
 #include <cstring>              // memset, memcpy
 #include <chrono>
 #include <iostream>
 
 
+#include "link_stats.h"
 #include "message900.h"
+#include "position_codec.h"
 #include "sim_artifact_message.h"
+#include "sim_random.h"
+#include "trace.h"
+#include "virtual_clock.h"
 
 
 namespace rfd900sim
 {
     double random_double(int max ){
         double value;
-        value = double(rand())/double(RAND_MAX);        // fractional portion
-        value += double(rand() % max);                  // integer portion
+        value = sim_random().uniform();                 // fractional portion
+        value += double(sim_random().below(max));       // integer portion
         return value;
     }
 
     // returns time since epoch
     void get_timestamp(timestamp_t *ts){
     
-        uint64_t nsec = std::chrono::duration_cast<std::chrono::nanoseconds>
-              (std::chrono::high_resolution_clock::now().time_since_epoch()).count();
+        uint64_t nsec = rfd900comm::clock_epoch_ns();
 
         ts->sec = nsec / 1000000000UL;
         ts->nsec = nsec - (ts->sec * 1000000000UL);
@@ -34,7 +38,11 @@ namespace rfd900sim
         static uint32_t seqID = 0;
         hm->seq = seqID;
         get_timestamp(&hm->stamp);
+#ifdef RFD900_EMBEDDED
+        snprintf(hm->frame_id, sizeof(hm->frame_id), "sim");
+#else
         hm->frame_id = "sim";
+#endif
         ++seqID;
     }
 
@@ -54,8 +62,13 @@ namespace rfd900sim
 
     void print_point_stamped_message(const point_stamped_message_t *psm)
     {
+#ifdef RFD900_EMBEDDED
+        const char* frame_id = psm->hdr.frame_id;
+#else
+        const char* frame_id = psm->hdr.frame_id.c_str();
+#endif
         fprintf(stdout, "seq: %5d\nstamp\n\tsec: %lu\n\tnsec: %lu\nframe id: %s\n",
-                    psm->hdr.seq, psm->hdr.stamp.sec, psm->hdr.stamp.nsec, psm->hdr.frame_id.c_str());
+                    psm->hdr.seq, psm->hdr.stamp.sec, psm->hdr.stamp.nsec, frame_id);
         
         fprintf(stdout, "point\n\tx: %12f\n\ty: %12f\n\tz: %12f\n", psm->p.x, psm->p.y, psm->p.z);
     }
@@ -74,7 +87,7 @@ namespace rfd900sim
         art->msg_type = SimConstants::ARTIFACT_POSITION;
         
         // randomly choose artifact and position
-        art->artifact = static_cast<uint8_t>(rand() % SimConstants::NUM_ARTIFACT_CATEGORIES);
+        art->artifact = static_cast<uint8_t>(sim_random().below(SimConstants::NUM_ARTIFACT_CATEGORIES));
         random_point(&art->position);
         // record time 
         get_timestamp(&art->stamp);
@@ -109,26 +122,7 @@ namespace rfd900sim
      */
     void serialize_artifact_for_900MHz(const artifact_message_t* art, uint8_t *serial_buffer, size_t serial_buffer_length)
     {
-        uint8_t *current_ptr = serial_buffer;
-        memset(serial_buffer, 0, serial_buffer_length);
-
-        memcpy(current_ptr, SimConstants::MESSAGE_900_START_INDICATOR, SimConstants::MESSAGE_900_START_INDICATOR_LENGTH*sizeof(char));
-        current_ptr += SimConstants::MESSAGE_900_START_INDICATOR_LENGTH*sizeof(char);
-
-        // copy contents of artifact message
-        memcpy(current_ptr, art, sizeof(artifact_message_t));
-        current_ptr += sizeof(artifact_message_t);
-
-        memcpy(current_ptr, SimConstants::MESSAGE_900_END_INDICATOR, 
-                    sizeof(SimConstants::MESSAGE_900_END_INDICATOR_LENGTH));
-        current_ptr += SimConstants::MESSAGE_900_END_INDICATOR_LENGTH * sizeof(char);
-
-        if(current_ptr != serial_buffer + (serial_buffer_length*sizeof(uint8_t))) {
-            fprintf(stderr, "warning: %s, current_ptr address: %p, serial_buffer address: %p, serial_buffer_length: %lx\n",
-            __func__, current_ptr, serial_buffer, serial_buffer_length);
-
-        }
-
+        frame_for_900MHz(art, sizeof(artifact_message_t), serial_buffer, serial_buffer_length);
     }
 
     /**
@@ -265,34 +259,85 @@ namespace rfd900sim
      * 
      */
 
-    int process_rx_message(const std::string& rx_string, ack_message_t* ack, bool ack_required)
+    // The following is simply for testing that all packets arrive.
+    // An id behind the expected one is a retransmission whose ACK was lost,
+    // it is acknowledged again but not counted as a gap.
+    static void track_artifact_sequence(uint16_t msg_id)
     {
         static uint16_t expectedMessageId = 0;
         static uint16_t messageIdMismatch = 0;
 
-         // assuming string contains minimum number required bytes (quick and dirty proof of concept code)
+        if(expectedMessageId != msg_id){
+            if(static_cast<int16_t>(msg_id - expectedMessageId) < 0){
+                rfd900comm::linkStats::add(rfd900comm::link_stats().dedup_hits);
+            }
+            else{
+                ++messageIdMismatch;
+                rfd900comm::linkStats::add(rfd900comm::link_stats().sequence_gaps);
+                expectedMessageId = static_cast<uint16_t>(msg_id + 1);
+            }
+        }
+        else{
+            ++expectedMessageId;
+        }
+    }
+
+
+    // a node acknowledges a group message with its own id, the sender tracks it among the ackers
+    static uint8_t ack_source(uint8_t dest_id, uint8_t my_id)
+    {
+        return dest_id == SimConstants::BROADCAST ? my_id : dest_id;
+    }
+
+
+    int process_rx_message(const std::string& rx_string, ack_message_t* ack, bool ack_required, uint8_t my_id)
+    {
+        // dest_id, src_id, msg_type are the minimum for any message
+        if(rx_string.length() < 3){
+            rfd900comm::linkStats::add(rfd900comm::link_stats().crc_failures);
+            return -1;
+        }
+        RFD900_TRACE_SCOPE(trace, rfd900comm::traceEvent::PROCESS_RX, static_cast<uint8_t>(rx_string[2]));
+
         switch(rx_string[2])
         {
             case SimConstants::ROBOT_POSITION:
-                fprintf(stderr, "message type is robot position, time to deserialize, publish and ack\n");
-            break;
+                // newer poses supersede lost ones, positions are never acknowledged
+                if(rx_string.length() != sizeof(robot_position_message_t)){
+                    rfd900comm::linkStats::add(rfd900comm::link_stats().crc_failures);
+                    return -1;
+                }
+                return SimConstants::NO_ACK;
+            case SimConstants::ROBOT_POSITION_KEYFRAME:
+            {
+                // deltas refer to the keyframe once its ACK reaches the sender, positionDecoder decodes both
+                position_keyframe_message_t key;
+                if(rx_string.length() != sizeof(position_keyframe_message_t)){
+                    rfd900comm::linkStats::add(rfd900comm::link_stats().crc_failures);
+                    return -1;
+                }
+                memcpy(&key, rx_string.data(), sizeof(key));
+                if(ack_required){
+                    populate_ack_message(ack, key.src_id, ack_source(key.dest_id, my_id), key.msg_id);
+                    return SimConstants::SEND_ACK;
+                }
+                return SimConstants::NO_ACK;
+            }
+            case SimConstants::ROBOT_POSITION_DELTA:
+                if(rx_string.length() < 6){
+                    rfd900comm::linkStats::add(rfd900comm::link_stats().crc_failures);
+                    return -1;
+                }
+                return SimConstants::NO_ACK;
             case SimConstants::ARTIFACT_POSITION:
                 //fprintf(stderr, "message type is artifact position, time to deserialize, publish, and ack\n");
                 artifact_message_t art;
-                deserialize_artifact_for_900MHz(&art, (const uint8_t*)rx_string.c_str());
-
-                // The following is simply for testing that all pack
-                if(expectedMessageId != art.msg_id){
-                    fprintf(stdout, "message id mismatch, expected: %hu, received: %hu\n", expectedMessageId, art.msg_id);
-                    ++messageIdMismatch;
-                    expectedMessageId = static_cast<uint16_t>(art.msg_id + 1);
-                }
-                else{
-                    if(expectedMessageId % 20 == 0){
-                        fprintf(stderr, "processed message %hu\n", expectedMessageId);
-                    }
-                    ++expectedMessageId;
+                if(rx_string.length() != sizeof(artifact_message_t)){
+                    rfd900comm::linkStats::add(rfd900comm::link_stats().crc_failures);
+                    return -1;
                 }
+                deserialize_artifact_for_900MHz(&art, (const uint8_t*)rx_string.c_str());
+                track_artifact_sequence(art.msg_id);
 
                 //fprintf(stderr, "Deserialized artifact message\n");
                 //print_artifact_message(&art);
@@ -300,7 +345,7 @@ namespace rfd900sim
                 if(ack_required){
                     //fprintf(stderr, "next step is sending an ack\n");
                     //fprintf(stderr, "if this were ROS, this is time to PUBLISH ARTIFACT POSITION topic\n");
-                    populate_ack_message(ack, art.src_id, art.dest_id, art.msg_id);
+                    populate_ack_message(ack, art.src_id, ack_source(art.dest_id, my_id), art.msg_id);
                     return SimConstants::SEND_ACK;
                 }
                 else{
@@ -308,9 +353,53 @@ namespace rfd900sim
                 }
                 
             break;
+            case SimConstants::ARTIFACT_POSITION_COMPACT:
+            {
+                // the stamp is in the shared timebase, the caller's timeSync converts it
+                artifact_compact_message_t compact;
+                if(rx_string.length() != sizeof(artifact_compact_message_t)){
+                    rfd900comm::linkStats::add(rfd900comm::link_stats().crc_failures);
+                    return -1;
+                }
+                deserialize_compact_artifact_for_900MHz(&compact, (const uint8_t*)rx_string.c_str());
+                track_artifact_sequence(compact.msg_id);
+
+                if(ack_required){
+                    populate_ack_message(ack, compact.src_id, ack_source(compact.dest_id, my_id), compact.msg_id);
+                    return SimConstants::SEND_ACK;
+                }
+                return SimConstants::NO_ACK;
+            }
+            case SimConstants::TIME_SYNC_REQUEST:
+            case SimConstants::TIME_SYNC_RESPONSE:
+                if(rx_string.length() != sizeof(time_sync_message_t)){
+                    rfd900comm::linkStats::add(rfd900comm::link_stats().crc_failures);
+                    return -1;
+                }
+                return SimConstants::TIME_SYNC;
+            case SimConstants::FRAGMENT:
+            case SimConstants::FRAGMENT_STATUS:
+                // length and CRC are checked by fragmentReassembler and fragmentSender
+                return SimConstants::FRAGMENTATION;
+            case SimConstants::BONDED:
+            case SimConstants::BOND_STATUS:
+                // lengths are checked by bondedLink
+                return SimConstants::BONDING;
+            case SimConstants::DATAGRAM:
+                // records are checked by udpGateway
+                return SimConstants::GATEWAY;
             case SimConstants::ACK:
-                fprintf(stderr, "message type is ACK, record the received ack\n");
-            break;
+                if(rx_string.length() != sizeof(ack_message_t)){
+                    rfd900comm::linkStats::add(rfd900comm::link_stats().crc_failures);
+                    return -1;
+                }
+                return SimConstants::PROCESS_ACK;
+            case SimConstants::ACK_BITMAP:
+                if(rx_string.length() != sizeof(ack_bitmap_message_t)){
+                    rfd900comm::linkStats::add(rfd900comm::link_stats().crc_failures);
+                    return -1;
+                }
+                return SimConstants::PROCESS_ACK;
             case SimConstants::REPORT_TO_ANCHOR:
                 fprintf(stderr, "message type is report to anchor, time to deserialize, publish, and ack\n");
             break;
@@ -332,18 +421,107 @@ namespace rfd900sim
 
     void serialize_acknowledgement_for_900MHz(const ack_message_t* ack, uint8_t *serial_buffer, size_t serial_buffer_length)
     {
+        frame_for_900MHz(ack, sizeof(ack_message_t), serial_buffer, serial_buffer_length);
+    }
+
+
+    void serialize_ack_bitmap_for_900MHz(const ack_bitmap_message_t* ack, uint8_t *serial_buffer, size_t serial_buffer_length)
+    {
+        frame_for_900MHz(ack, sizeof(ack_bitmap_message_t), serial_buffer, serial_buffer_length);
+    }
+
+
+    /**************** ROBOT POSITION MESSAGE FUNCTIONS ********************/
+    // each robot takes a random walk of up to 5 cm per axis between poses
+    void simulate_robot_position_message(robot_position_message_t *pos, uint8_t dest, uint8_t src, uint32_t stamp_us)
+    {
+        static uint16_t message_id = 0;
+        static point_t robot_position[UINT8_MAX + 1];
+        static bool robot_started[UINT8_MAX + 1] = {};
+
+        if(!robot_started[src]){
+            random_point(&robot_position[src]);
+            robot_started[src] = true;
+        }
+        else{
+            robot_position[src].x += (static_cast<int>(sim_random().below(101)) - 50) / 1000.0;
+            robot_position[src].y += (static_cast<int>(sim_random().below(101)) - 50) / 1000.0;
+            robot_position[src].z += (static_cast<int>(sim_random().below(101)) - 50) / 1000.0;
+        }
+
+        memset(pos, 0, sizeof(robot_position_message_t));         // no stray padding bytes on the air
+        pos->dest_id = dest;
+        pos->src_id = src;
+        pos->msg_type = SimConstants::ROBOT_POSITION;
+        pos->msg_id = message_id;
+        ++message_id;
+        pos->stamp_us = stamp_us;
+        pos->position = robot_position[src];
+    }
+
+    void serialize_robot_position_for_900MHz(const robot_position_message_t* pos, uint8_t *serial_buffer, size_t serial_buffer_length)
+    {
+        frame_for_900MHz(pos, sizeof(robot_position_message_t), serial_buffer, serial_buffer_length);
+    }
+
+    void deserialize_robot_position_for_900MHz(robot_position_message_t* pos, const uint8_t *serial_buffer)
+    {
+        memcpy(pos, serial_buffer, sizeof(robot_position_message_t));
+    }
+
+
+    /**************** COMPACT ARTIFACT AND TIME SYNC MESSAGES ********************/
+    void compact_artifact_message(const artifact_message_t* art, uint32_t stamp_us, artifact_compact_message_t* compact)
+    {
+        memset(compact, 0, sizeof(artifact_compact_message_t));       // no stray padding bytes on the air
+        compact->dest_id = art->dest_id;
+        compact->src_id = art->src_id;
+        compact->msg_type = SimConstants::ARTIFACT_POSITION_COMPACT;
+        compact->msg_id = art->msg_id;
+        compact->artifact = art->artifact;
+        compact->stamp_us = stamp_us;
+        compact->position = art->position;
+    }
+
+    void serialize_compact_artifact_for_900MHz(const artifact_compact_message_t* art, uint8_t *serial_buffer, size_t serial_buffer_length)
+    {
+        frame_for_900MHz(art, sizeof(artifact_compact_message_t), serial_buffer, serial_buffer_length);
+    }
+
+    void deserialize_compact_artifact_for_900MHz(artifact_compact_message_t* art, const uint8_t *serial_buffer)
+    {
+        memcpy(art, serial_buffer, sizeof(artifact_compact_message_t));
+    }
+
+    void serialize_time_sync_for_900MHz(const time_sync_message_t* ts, uint8_t *serial_buffer, size_t serial_buffer_length)
+    {
+        frame_for_900MHz(ts, sizeof(time_sync_message_t), serial_buffer, serial_buffer_length);
+    }
+
+    void deserialize_time_sync_for_900MHz(time_sync_message_t* ts, const uint8_t *serial_buffer)
+    {
+        memcpy(ts, serial_buffer, sizeof(time_sync_message_t));
+    }
+
+
+    /**
+     * Copies msg between the start and end indicators.
+     * serial_buffer_length must be msg_length + MESSAGE_900_START_INDICATOR_LENGTH + MESSAGE_900_END_INDICATOR_LENGTH
+     */
+    void frame_for_900MHz(const void* msg, size_t msg_length, uint8_t *serial_buffer, size_t serial_buffer_length)
+    {
+        RFD900_TRACE_SCOPE(trace, rfd900comm::traceEvent::FRAME, msg_length > 2 ? static_cast<const uint8_t*>(msg)[2] : 0);
         uint8_t *current_ptr = serial_buffer;
         memset(serial_buffer, 0, serial_buffer_length);
 
         memcpy(current_ptr, SimConstants::MESSAGE_900_START_INDICATOR, SimConstants::MESSAGE_900_START_INDICATOR_LENGTH*sizeof(char));
         current_ptr += SimConstants::MESSAGE_900_START_INDICATOR_LENGTH*sizeof(char);
 
-        // copy contents of artifact message
-        memcpy(current_ptr, ack, sizeof(ack_message_t));
-        current_ptr += sizeof(ack_message_t);
+        memcpy(current_ptr, msg, msg_length);
+        current_ptr += msg_length;
 
         memcpy(current_ptr, SimConstants::MESSAGE_900_END_INDICATOR, 
-                    sizeof(SimConstants::MESSAGE_900_END_INDICATOR_LENGTH));
+                    SimConstants::MESSAGE_900_END_INDICATOR_LENGTH*sizeof(char));
         current_ptr += SimConstants::MESSAGE_900_END_INDICATOR_LENGTH * sizeof(char);
 
         if(current_ptr != serial_buffer + (serial_buffer_length*sizeof(uint8_t))) {
@@ -354,8 +532,67 @@ namespace rfd900sim
     }
 
 
+    // true when neither indicator appears inside the frame, so extract_rx_message finds its real end
+    bool frame_is_clean(const uint8_t* frame, size_t length)
+    {
+        const uint8_t* start = (const uint8_t*)SimConstants::MESSAGE_900_START_INDICATOR;
+        const uint8_t* end = (const uint8_t*)SimConstants::MESSAGE_900_END_INDICATOR;
+        const uint8_t* body = frame + SimConstants::MESSAGE_900_START_INDICATOR_LENGTH;
+        const uint8_t* body_end = frame + length - SimConstants::MESSAGE_900_END_INDICATOR_LENGTH;
+
+        // the end indicator search runs into the real end indicator, which must be the first match
+        if(std::search(body, frame + length, end, end + SimConstants::MESSAGE_900_END_INDICATOR_LENGTH) != body_end){
+            return false;
+        }
+        return std::search(body, body_end, start, start + SimConstants::MESSAGE_900_START_INDICATOR_LENGTH) == body_end;
+    }
+
+
+    void reserve_rx_storage(std::string& rx_data, std::string& extracted_rx_data)
+    {
+        rx_data.reserve(RX_STORAGE_CAPACITY);
+        extracted_rx_data.reserve(RX_STORAGE_CAPACITY);
+    }
+
+
+    /**
+     * In the RFD900_EMBEDDED build rx_data never grows past its reserved
+     * capacity. Bytes that do not fit push out the oldest bytes, which belong
+     * to a frame that never completed, and count as framing resyncs.
+     */
+    void append_rx_data(std::string& rx_data, const uint8_t* data, size_t length)
+    {
+#ifdef RFD900_EMBEDDED
+        size_t capacity = rx_data.capacity();
+        if(length > capacity){
+            rfd900comm::linkStats::add(rfd900comm::link_stats().framing_resyncs, length - capacity);
+            data += length - capacity;
+            length = capacity;
+        }
+        if(rx_data.size() + length > capacity){
+            size_t drop = rx_data.size() + length - capacity;
+            rfd900comm::linkStats::add(rfd900comm::link_stats().framing_resyncs, drop);
+            rx_data.erase(0, drop);
+        }
+#endif
+        rx_data.append((const char*)data, length);
+    }
+
+
+    /**
+     * Rewrites the destination of a framed message, used to send a group
+     * message again to one node that did not acknowledge it. dest_id is the
+     * first byte after the start indicator in every message type.
+     */
+    void address_frame(uint8_t* serial_buffer, uint8_t dest_id)
+    {
+        serial_buffer[SimConstants::MESSAGE_900_START_INDICATOR_LENGTH] = dest_id;
+    }
+
+
       bool extract_rx_message(std::string& rx_data, std::string& extracted_rx_data)
      {
+         RFD900_TRACE_SCOPE(trace, rfd900comm::traceEvent::EXTRACT, 0);
          std::size_t foundStart, foundEnd;
 
          // find start of message
@@ -376,14 +613,22 @@ namespace rfd900sim
             fprintf(stderr, "%s, warning: foundEnd: %lu <= foundStart: %lu\n", __func__, foundEnd, foundStart);
             return false;
         }
+
+        // bytes ahead of the start indicator belong to a partial or corrupted frame
+        if(foundStart > 0){
+            rfd900comm::linkStats::add(rfd900comm::link_stats().framing_resyncs, foundStart);
+        }
+        rfd900comm::linkStats::add(rfd900comm::link_stats().frames_in);
       
         // extract the first character after the start indicator
         // string length is foundend - (foundStart+MESSAGE_900_START_INDICATOR_LENGTH,)
-        extracted_rx_data = rx_data.substr(foundStart + SimConstants::MESSAGE_900_START_INDICATOR_LENGTH, 
+        // assign and erase work within the existing capacity, substr would allocate new strings
+        extracted_rx_data.assign(rx_data, foundStart + SimConstants::MESSAGE_900_START_INDICATOR_LENGTH,
                 foundEnd-foundStart - SimConstants::MESSAGE_900_START_INDICATOR_LENGTH);
        
         // remove chararacters from string, including the end indicator
-        rx_data = rx_data.substr(foundEnd + SimConstants::MESSAGE_900_END_INDICATOR_LENGTH);
+        rx_data.erase(0, foundEnd + SimConstants::MESSAGE_900_END_INDICATOR_LENGTH);
+        RFD900_TRACE_SET_ID(trace, extracted_rx_data.length());
  
         return true;
 
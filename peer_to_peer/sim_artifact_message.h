@@ -22,11 +22,17 @@ namespace rfd900sim
         uint64_t nsec;
     };
 
+    constexpr size_t HEADER_FRAME_ID_LENGTH = 16;
+
     // simulate ROS std_msgs/header.msg
     struct header_msg_t{
         uint32_t seq;           // sequence id
         timestamp_t stamp;
+#ifdef RFD900_EMBEDDED
+        char frame_id[HEADER_FRAME_ID_LENGTH];          // fixed length, no allocation
+#else
         std::string frame_id;   // frame this data is associated with
+#endif
     };
 
    
@@ -68,6 +74,48 @@ namespace rfd900sim
                 + sizeof(((artifact_message_t*)0)->position.z);
 
 
+    /**
+     * Same content as artifact_message_t with a 32 bit compact timestamp in the
+     * shared timebase (see rfd900comm::timeSync) instead of the 16 byte local
+     * epoch time. 8 bytes shorter on the air.
+     */
+    struct artifact_compact_message_t{
+        uint8_t dest_id;
+        uint8_t src_id;
+        uint8_t msg_type;
+        uint16_t msg_id;
+        uint8_t artifact;
+        uint32_t stamp_us;
+        point_t position;
+    };
+
+
+    /**************** ROBOT POSITION MESSAGES **********************/
+    // a stream where only the newest pose matters, not acknowledged
+    // stamp_us is in the shared timebase, see rfd900comm::timeSync
+    struct robot_position_message_t{
+        uint8_t dest_id;
+        uint8_t src_id;
+        uint8_t msg_type;
+        uint16_t msg_id;
+        uint32_t stamp_us;
+        point_t position;
+    };
+
+
+    /**************** TIME SYNC MESSAGES **********************/
+    // request carries t1, response echoes t1 and adds t2, t3 (microseconds, sender clock)
+    struct time_sync_message_t{
+        uint8_t dest_id;
+        uint8_t src_id;
+        uint8_t msg_type;
+        uint16_t msg_id;
+        int64_t t1;
+        int64_t t2;
+        int64_t t3;
+    };
+
+
     /**************** ACK MESSAGES **********************/
     struct ack_message_t{
         uint8_t dest_id;
@@ -76,6 +124,20 @@ namespace rfd900sim
         uint16_t msg_id;
     };
 
+    /**
+     * Coalesced ACK from rfd900sim::ackCoalescer, covers
+     *      every msg_id in (cumulative - run, cumulative]
+     *      cumulative + 1 + i for every bit i set in bitmap
+     */
+    struct ack_bitmap_message_t{
+        uint8_t dest_id;
+        uint8_t src_id;
+        uint8_t msg_type;
+        uint16_t cumulative;
+        uint16_t run;
+        uint64_t bitmap;
+    };
+
     
     // general simulation functions
     
@@ -96,15 +158,38 @@ namespace rfd900sim
 
     void serialize_artifact_for_900MHz(const artifact_message_t* art, uint8_t *serial_buffer, size_t msg_length);
     void deserialize_artifact_for_900MHz(artifact_message_t* art, const uint8_t *serial_buffer);
+
+    void compact_artifact_message(const artifact_message_t* art, uint32_t stamp_us, artifact_compact_message_t* compact);
+    void serialize_compact_artifact_for_900MHz(const artifact_compact_message_t* art, uint8_t *serial_buffer, size_t serial_buffer_length);
+    void deserialize_compact_artifact_for_900MHz(artifact_compact_message_t* art, const uint8_t *serial_buffer);
+
+    // robot position functions
+    void simulate_robot_position_message(robot_position_message_t *pos, uint8_t dest, uint8_t src, uint32_t stamp_us);
+    void serialize_robot_position_for_900MHz(const robot_position_message_t* pos, uint8_t *serial_buffer, size_t serial_buffer_length);
+    void deserialize_robot_position_for_900MHz(robot_position_message_t* pos, const uint8_t *serial_buffer);
+
+    void serialize_time_sync_for_900MHz(const time_sync_message_t* ts, uint8_t *serial_buffer, size_t serial_buffer_length);
+    void deserialize_time_sync_for_900MHz(time_sync_message_t* ts, const uint8_t *serial_buffer);
     
 
-    int process_rx_message(const std::string& rx_string, ack_message_t* ack, bool ack_required = false);
+    // messages to SimConstants::BROADCAST are acknowledged from my_id, group receivers must pass it
+    int process_rx_message(const std::string& rx_string, ack_message_t* ack, bool ack_required = false,
+                uint8_t my_id = SimConstants::BROADCAST);
     void populate_ack_message(ack_message_t* ack, uint8_t dest_id, uint8_t src_id, uint16_t msg_id);
+    void serialize_acknowledgement_for_900MHz(const ack_message_t* ack, uint8_t *serial_buffer, size_t serial_buffer_length);
+    void serialize_ack_bitmap_for_900MHz(const ack_bitmap_message_t* ack, uint8_t *serial_buffer, size_t serial_buffer_length);
 
 
 
     // general message functions
+    constexpr size_t RX_STORAGE_CAPACITY = 1024;         // bytes reserved for received data awaiting extraction
+
+    void reserve_rx_storage(std::string& rx_data, std::string& extracted_rx_data);
+    void append_rx_data(std::string& rx_data, const uint8_t* data, size_t length);
     bool extract_rx_message(std::string& rx_data, std::string& extracted_rx_data);
+    void frame_for_900MHz(const void* msg, size_t msg_length, uint8_t *serial_buffer, size_t serial_buffer_length);
+    bool frame_is_clean(const uint8_t* frame, size_t length);
+    void address_frame(uint8_t* serial_buffer, uint8_t dest_id);
 
 
 } // marblecomm
@@ -0,0 +1,24 @@
+/**
+ * @brief Per thread simulation random number generator function definitions.
+ *
+ */
+
+#include "sim_random.h"
+
+namespace rfd900sim
+{
+    static thread_local xoshiro256 threadRandom;
+
+
+    xoshiro256& sim_random()
+    {
+        return threadRandom;
+    }
+
+
+    void seed_simulation(uint64_t seed)
+    {
+        threadRandom.reseed(seed);
+    }
+
+}
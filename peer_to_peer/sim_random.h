@@ -0,0 +1,109 @@
+/**
+ * @brief Declares the seeded random number generator used by the simulation
+ *
+ * xoshiro256** (Blackman and Vigna), 256 bits of state seeded through
+ * splitmix64. It is a few times faster than rand(), has no hidden global
+ * state and gives the same sequence for the same seed on every platform,
+ * so simulated traffic reproduces bit for bit.
+ *
+ * The simulate_* message functions draw from sim_random(), a generator per
+ * thread. Every thread's generator starts from DEFAULT_SIM_SEED,
+ * seed_simulation() reseeds the calling thread's.
+ *
+ */
+
+#ifndef SIM_RANDOM_INCLUDED_H
+#define SIM_RANDOM_INCLUDED_H
+
+#include <cmath>                    // log
+#include <cstdint>
+
+
+namespace rfd900sim
+{
+    constexpr uint64_t DEFAULT_SIM_SEED = 0x900;
+
+
+    class xoshiro256{
+
+        public:
+
+        explicit xoshiro256(uint64_t seed = DEFAULT_SIM_SEED)
+        {
+            reseed(seed);
+        }
+
+        void reseed(uint64_t seed)
+        {
+            // splitmix64 spreads any seed, zero included, over the whole state
+            for(uint64_t& word : s){
+                seed += 0x9E3779B97F4A7C15ULL;
+                uint64_t z = seed;
+                z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+                z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+                word = z ^ (z >> 31);
+            }
+        }
+
+        uint64_t next()
+        {
+            uint64_t result = rotl(s[1] * 5, 7) * 9;
+            uint64_t t = s[1] << 17;
+
+            s[2] ^= s[0];
+            s[3] ^= s[1];
+            s[1] ^= s[2];
+            s[0] ^= s[3];
+            s[2] ^= t;
+            s[3] = rotl(s[3], 45);
+            return result;
+        }
+
+        // [0, 1) with 53 random bits
+        double uniform()
+        {
+            return (next() >> 11) * 0x1.0p-53;
+        }
+
+        // [0, n) without modulo bias (Lemire), products whose low half falls under 2^32 mod n are drawn again
+        uint32_t below(uint32_t n)
+        {
+            uint64_t m = (next() >> 32) * n;
+            uint32_t low = static_cast<uint32_t>(m);
+            if(low < n){
+                uint32_t threshold = static_cast<uint32_t>(-n) % n;
+                while(low < threshold){
+                    m = (next() >> 32) * n;
+                    low = static_cast<uint32_t>(m);
+                }
+            }
+            return static_cast<uint32_t>(m >> 32);
+        }
+
+        // exponentially distributed with the given mean
+        double exponential(double mean)
+        {
+            return -mean * std::log(1.0 - uniform());
+        }
+
+
+        private:
+
+        static uint64_t rotl(uint64_t x, int k)
+        {
+            return (x << k) | (x >> (64 - k));
+        }
+
+        uint64_t s[4];
+    };
+
+
+    // the calling thread's generator for the simulate_* functions
+    xoshiro256& sim_random();
+
+    void seed_simulation(uint64_t seed);
+
+}
+
+
+#endif
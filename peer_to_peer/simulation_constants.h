@@ -16,6 +16,7 @@ namespace rfd900sim {
         static constexpr uint8_t AERIAL02 = 2;
         static constexpr uint8_t ANCHOR_STATION = 3;
         static constexpr uint8_t BASE_STATION = 4;
+        static constexpr uint8_t BROADCAST = 255;          // group address, every node that hears the frame
 
         // Message Type constants
         static constexpr uint8_t ROBOT_POSITION = 0;
@@ -23,6 +24,17 @@ namespace rfd900sim {
         static constexpr uint8_t ACK = 2;
         static constexpr uint8_t REPORT_TO_ANCHOR = 3;
         static constexpr uint8_t NO_ACK = 4;
+        static constexpr uint8_t TIME_SYNC_REQUEST = 5;
+        static constexpr uint8_t TIME_SYNC_RESPONSE = 6;
+        static constexpr uint8_t ARTIFACT_POSITION_COMPACT = 7;
+        static constexpr uint8_t FRAGMENT = 8;
+        static constexpr uint8_t FRAGMENT_STATUS = 9;
+        static constexpr uint8_t ROBOT_POSITION_KEYFRAME = 10;
+        static constexpr uint8_t ROBOT_POSITION_DELTA = 11;
+        static constexpr uint8_t ACK_BITMAP = 12;
+        static constexpr uint8_t BONDED = 13;
+        static constexpr uint8_t BOND_STATUS = 14;
+        static constexpr uint8_t DATAGRAM = 15;
 
         // artifact types
         static constexpr uint8_t SURVIVOR = 1;
@@ -35,6 +47,12 @@ namespace rfd900sim {
 
         // actions
         static constexpr int SEND_ACK = 1;
+        static constexpr int TIME_SYNC = 2;                 // pass the message to timeSync
+        static constexpr int FRAGMENTATION = 3;             // pass the message to the fragment sender or reassembler
+        static constexpr int SEND_FRAGMENT_STATUS = 5;
+        static constexpr int PROCESS_ACK = 6;               // pass the ACK to message900
+        static constexpr int BONDING = 7;                   // pass the message to bondedLink
+        static constexpr int GATEWAY = 8;                   // pass the message to udpGateway
 
 
         // define const that are not constexpr
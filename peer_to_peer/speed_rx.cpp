@@ -4,8 +4,7 @@
  *  Uses rfd900Modem class to receive
  *  
  * 
- *  Default serial path is /dev/ttyUSB0
- *  Default baud rate is 57600
+ *  The radio is found by port discovery, 57600 baud is tried first
  *  
  * Optional Command line arguments
  *  argv[1] - loopCount
@@ -22,6 +21,8 @@
 #include <sstream>
 #include <unistd.h>             // sleep
 
+#include "link_stats.h"
+#include "modem_discovery.h"
 #include "rfd900_modem.h"
 #include "message900.h"
 #include "simulation_constants.h"
@@ -61,15 +62,19 @@ int main(int argc, char **argv)
     struct sigaction saint;             // SIGINT caused by ctrl + c
 
     // serial
-    std::string serialDevicePath = "/dev/ttyUSB0";
     int baudRate = rfd900comm::rfd900Modem::DEFAULT_BAUD_RATE;
     rfd900comm::rfd900Modem radio;
 
     // comm node identification
     uint8_t myCommId = rfd900sim::SimConstants::BASE_STATION;
 
+    // constant buffer lengths
+    const size_t SERIAL_ACK_BUFFER_LENGTH = sizeof(rfd900sim::ack_message_t)
+                        + rfd900sim::SimConstants::MESSAGE_900_START_INDICATOR_LENGTH 
+                        + rfd900sim::SimConstants::MESSAGE_900_END_INDICATOR_LENGTH;
+
     // allocate serial buffer
-    //uint8_t serial_tx_buffer[SERIAL_ARTIFACT_BUFFER_LENGTH];
+    uint8_t serial_ack_buffer[SERIAL_ACK_BUFFER_LENGTH];
     uint8_t serial_rx_buffer[SERIAL_RX_BUFFER_LENGTH];
 
     std::string temp_rx_storage;
@@ -81,6 +86,9 @@ int main(int argc, char **argv)
     // 900 MHz message tracking
     rfd900comm::message900 msg900;
 
+    // live statistics for rfdstat
+    rfd900comm::linkStatsSegment statsSegment;
+
     int rxcount = 0;
     int loopCount = 0;
 
@@ -91,13 +99,19 @@ int main(int argc, char **argv)
 
     parse_command_line(argv, &loopCount);
 
+    // sized once, extraction reuses the capacity for every frame
+    rfd900sim::reserve_rx_storage(temp_rx_storage, extracted_rx_data);
+
     // initialize radio serial connection
-    if( radio.init(serialDevicePath.c_str(), baudRate) != 0){
-        fprintf(stderr, "error, %s radio init failure, serialDevicePath: %s\n", __func__,
-            serialDevicePath.c_str());
+    if( rfd900comm::open_radio(radio, nullptr, baudRate) != 0){
+        fprintf(stderr, "error, %s radio init failure\n", __func__);
         return 1;
     }
 
+    if(statsSegment.create("/rfd900_rxspeed") != 0){
+        fprintf(stderr, "warning, %s, link statistics not shared\n", __func__);
+    }
+
 
     // register the SIGINT signal handler function
     memset(&saint, 0, sizeof(saint));
@@ -113,7 +127,7 @@ int main(int argc, char **argv)
         bytesRead = radio.read_serial(serial_rx_buffer, SERIAL_RX_BUFFER_LENGTH, 10000000 );
         //fprintf(stderr, "bytesRead: %lu\n", bytesRead);
         if(bytesRead > 0){
-            temp_rx_storage.append((const char*)serial_rx_buffer, bytesRead);
+            rfd900sim::append_rx_data(temp_rx_storage, serial_rx_buffer, bytesRead);
             
             extracted_rx_data.clear();
 
@@ -123,7 +137,11 @@ int main(int argc, char **argv)
                 if(extracted_rx_data[0] == myCommId){
                     rfd900sim::ack_message_t ackmsg;
                     if( rfd900sim::process_rx_message(extracted_rx_data, &ackmsg, true) == rfd900sim::SimConstants::SEND_ACK){
-                        //fprintf(stderr, "%s, SEND_ACK returned\n", __func__);
+                        rfd900sim::serialize_acknowledgement_for_900MHz(&ackmsg, serial_ack_buffer, SERIAL_ACK_BUFFER_LENGTH);
+                        if(radio.send_message((const char*)serial_ack_buffer, SERIAL_ACK_BUFFER_LENGTH)
+                                    != static_cast<ssize_t>(SERIAL_ACK_BUFFER_LENGTH)){
+                            fprintf(stderr, "error, %s, ack send failure\n", __func__);
+                        }
                     }
                     else{
                         fprintf(stderr, "%s, NO_ACK returned\n", __func__);
@@ -4,12 +4,22 @@
  *  Uses rfd900Modem class to transmit
  *  
  * 
- *  Default serial path is /dev/ttyUSB0
- *  Default baud rate is 57600
+ *  The radio is found by port discovery, 57600 baud is tried first
  *  
  * Required Command line arguments
  *  argv[1] - number of loop iterations
- *  argv[2] - time period between transmission
+ *  argv[2] - time period between transmission, milliseconds, mean per source
+ *
+ * Optional Command line arguments
+ *  argv[3] - arrivals: constant (default), poisson or bursty
+ *  argv[4] - number of simulated source nodes, ids from AERIAL01 on
+ *  argv[5] - seed, the same seed sends the same bytes
+ *  argv[6] - message mix artifact:robot:ack:bulk, default 1:0:0:0
+ *  argv[7] - radio air speed, kbit/s, default 64
+ *
+ *  Messages pass airtime admission control: robot positions and bulk are
+ *  thinned and then refused as the channel approaches its utilization
+ *  budget, ACKs always go.
  * 
  * Author: Diane Williams
  * Date: 4/7/2019
@@ -17,15 +27,22 @@
  */
 
 #include <signal.h>
+#include <cstdio>                   // sscanf
+#include <cstdlib>                  // atoi, strtoull
 #include <cstring>
 
 #include <string>
 #include <sstream>
 #include <unistd.h>             // sleep
 #include <chrono>               
+#include <thread>
 
 
 
+#include "airtime_accountant.h"
+#include "link_stats.h"
+#include "load_generator.h"
+#include "modem_discovery.h"
 #include "rfd900_modem.h"
 #include "message900.h"
 #include "simulation_constants.h"
@@ -53,10 +70,44 @@ static void signal_handler_term(int sig)
 
 
 
-void parse_command_line(char **argv, int* loopCount, int* tx_millis)
+static rfd900comm::txPriority traffic_class(uint8_t msg_type)
+{
+    switch(msg_type)
+    {
+        case rfd900sim::SimConstants::ACK: return rfd900comm::txPriority::CONTROL;
+        case rfd900sim::SimConstants::ARTIFACT_POSITION: return rfd900comm::txPriority::HIGH;
+        case rfd900sim::SimConstants::ROBOT_POSITION: return rfd900comm::txPriority::NORMAL;
+        default: return rfd900comm::txPriority::BULK;
+    }
+}
+
+
+void parse_command_line(int argc, char **argv, int* loopCount, int* tx_millis, rfd900sim::loadGeneratorConfig* load,
+            rfd900comm::airtimeConfig* air)
 {
     *loopCount = atoi(argv[1]);
     *tx_millis = atoi(argv[2]);
+
+    if(argc > 3){
+        if(strcmp(argv[3], "poisson") == 0){
+            load->arrivals = rfd900sim::arrivalProcess::POISSON;
+        }
+        else if(strcmp(argv[3], "bursty") == 0){
+            load->arrivals = rfd900sim::arrivalProcess::BURSTY;
+        }
+    }
+    if(argc > 4){
+        load->source_count = atoi(argv[4]);
+    }
+    if(argc > 5){
+        load->seed = strtoull(argv[5], nullptr, 0);
+    }
+    if(argc > 6){
+        sscanf(argv[6], "%lf:%lf:%lf:%lf", &load->mix.artifact, &load->mix.robot_position, &load->mix.ack, &load->mix.bulk);
+    }
+    if(argc > 7){
+        air->air_speed_kbps = atoi(argv[7]);
+    }
 }
 
 
@@ -72,7 +123,6 @@ int main(int argc, char **argv)
                         + rfd900sim::SimConstants::MESSAGE_900_END_INDICATOR_LENGTH;
 
     // serial
-    std::string serialDevicePath = "/dev/ttyUSB0";
     int baudRate = rfd900comm::rfd900Modem::DEFAULT_BAUD_RATE;
     rfd900comm::rfd900Modem radio;
 
@@ -81,12 +131,24 @@ int main(int argc, char **argv)
     // comm node identification
     uint8_t myCommId = rfd900sim::SimConstants::AERIAL01;
 
-    // allocate serial buffer
-    uint8_t serial_tx_buffer[SERIAL_ARTIFACT_BUFFER_LENGTH];
+    // synthetic traffic, by default one source sending artifact messages at a fixed interval
+    rfd900sim::loadGeneratorConfig loadConfig;
+    loadConfig.arrivals = rfd900sim::arrivalProcess::CONSTANT;
+    loadConfig.first_source = myCommId;
+    rfd900sim::generated_message_t txmsg;
+
+    // airtime budget of the channel
+    rfd900comm::airtimeConfig airConfig;
+    uint64_t thinned = 0;
+    uint64_t refused = 0;
+    bool skipDegraded = false;
 
     // 900 MHz message tracking
     rfd900comm::message900 msg900;
 
+    // live statistics for rfdstat
+    rfd900comm::linkStatsSegment statsSegment;
+
     // milliseconds between transmission
     int tx_milliseconds = 1000;
 
@@ -99,22 +161,34 @@ int main(int argc, char **argv)
     auto diff = end - start;
 
     if(argc < 3){
-       fprintf(stderr, "usage: %s <loop iterations> <milliseconds between transmission>\n", argv[0]);
+       fprintf(stderr, "usage: %s <loop iterations> <milliseconds between transmission>"
+                    " [constant|poisson|bursty] [sources] [seed] [artifact:robot:ack:bulk] [air kbit/s]\n", argv[0]);
        return 1;
     }
 
-    parse_command_line(argv, &loopCount, &tx_milliseconds);
+    parse_command_line(argc, argv, &loopCount, &tx_milliseconds, &loadConfig, &airConfig);
+    loadConfig.rate = tx_milliseconds > 0 ? 1000.0 / tx_milliseconds : 0.0;
+    rfd900sim::loadGenerator load(loadConfig);
+    rfd900comm::airtimeAccountant airtime(airConfig);
 
-    // 10 bits per byte: 1 start bit, 8 data bits, 1 stop bit
+    // 10 bits per byte: 1 start bit, 8 data bits, 1 stop bit, and the air carries packet overhead and ACKs as well
+    double serialMessages = (baudRate / 10.0) / SERIAL_ARTIFACT_BUFFER_LENGTH;
+    double airMessages = airtime.max_frames_per_second(SERIAL_ARTIFACT_BUFFER_LENGTH, true);
     fprintf(stderr, "SERIAL_ARTIFACT_BUFFER_LENGTH: %lu\n", SERIAL_ARTIFACT_BUFFER_LENGTH);
-    fprintf(stderr, "Max bytes per second: %d\n", baudRate/10);
-    fprintf(stderr, "Max messages per second: %lu\n", (baudRate/10)/SERIAL_ARTIFACT_BUFFER_LENGTH);
+    fprintf(stderr, "Max bytes per second: serial %d, air %u\n", baudRate/10, airConfig.air_speed_kbps * 1000 / 8);
+    fprintf(stderr, "Max artifact messages per second: serial %.1f, air with ACKs %.1f, within the %.0f %% budget %.1f\n",
+                serialMessages, airMessages, 100.0 * airConfig.budget,
+                airConfig.budget * (serialMessages < airMessages ? serialMessages : airMessages));
 
     // initialize radio serial connection
-    if( radio.init(serialDevicePath.c_str(), baudRate) != 0){
+    if( rfd900comm::open_radio(radio, nullptr, baudRate) != 0){
         fprintf(stderr, "error, %s radio init failure\n", __func__);
         return 1;
     }
+
+    if(statsSegment.create("/rfd900_txspeed") != 0){
+        fprintf(stderr, "warning, %s, link statistics not shared\n", __func__);
+    }
     
 
     // register the SIGINT signal handler function
@@ -126,36 +200,47 @@ int main(int argc, char **argv)
     }
     
 
+    start = std::chrono::steady_clock::now();
+
     while(txcount < loopCount && exitRequest == 0){
 
-        start = std::chrono::steady_clock::now();
+        // each message goes at its due time, with no interval every message goes at once
+        load.next(&txmsg);
+        if(tx_milliseconds > 0){
+            std::this_thread::sleep_until(start + std::chrono::nanoseconds(txmsg.due_ns));
+        }
 
-        rfd900sim::artifact_message_t artmsg;
+        // positions and bulk are thinned to every other message while degraded
+        rfd900comm::txPriority priority = traffic_class(txmsg.msg_type);
+        rfd900comm::airtimeAdmission admission = airtime.admit(priority, txmsg.length);
+        if(admission == rfd900comm::airtimeAdmission::DEGRADE && priority != rfd900comm::txPriority::HIGH){
+            skipDegraded = !skipDegraded;
+            if(skipDegraded){
+                ++thinned;
+                ++txcount;
+                continue;
+            }
+        }
+        if(admission == rfd900comm::airtimeAdmission::REJECT){
+            ++refused;
+            ++txcount;
+            continue;
+        }
+        airtime.charge(priority, txmsg.length);
 
-        simulate_artifact_message(&artmsg, rfd900sim::SimConstants::BASE_STATION, myCommId);
-        serialize_artifact_for_900MHz(&artmsg, serial_tx_buffer, SERIAL_ARTIFACT_BUFFER_LENGTH);
-        
-        bytesSent = radio.send_message((const char*)serial_tx_buffer, SERIAL_ARTIFACT_BUFFER_LENGTH);
+        bytesSent = radio.send_message((const char*)txmsg.frame, txmsg.length);
         if(bytesSent == -1){
             fprintf(stderr, "error, %s, bytesSent: %ld\n", __func__, bytesSent);
             break;
         }
         
          ++txcount;
-        // print every so often to inform user of progress
-        //if( (txcount % 25) == 0){
-            fprintf(stdout, "sending message number %d\n", txcount);
-        //}
-        
-        end = std::chrono::steady_clock::now();
-        diff = end - start;
-        while(std::chrono::duration_cast<std::chrono::milliseconds>(diff).count() < tx_milliseconds){
-            end = std::chrono::steady_clock::now();
-            diff = end - start;
-        }
+        // progress is in the link statistics segment, view with: rfdstat /rfd900_txspeed
 
     }
 
+    double utilization = airtime.utilization();
+
     // do not close serial connection immediately as all data may not have been transmitted
     // at end of loop
     start = std::chrono::steady_clock::now();
@@ -167,7 +252,9 @@ int main(int argc, char **argv)
     }
 
     
-    fprintf(stderr, "program terminating, tx_count: %d\n", txcount);
+    fprintf(stderr, "program terminating, tx_count: %d, thinned: %llu, refused: %llu, air utilization: %.1f %%, digest: %016llx\n",
+                txcount, (unsigned long long)thinned, (unsigned long long)refused, 100.0 * utilization,
+                (unsigned long long)load.digest());
     return 0;
 
 }
\ No newline at end of file
@@ -0,0 +1,179 @@
+/**
+ * @brief timeSync class function definitions.
+ *
+ */
+
+#include <chrono>
+#include <cstring>                  // memset
+
+#include "time_sync.h"
+#include "virtual_clock.h"
+
+namespace rfd900comm{
+
+    int64_t timeSync::steady_now_us()
+    {
+        return std::chrono::duration_cast<std::chrono::microseconds>
+                    (clock_now().time_since_epoch()).count();
+    }
+
+
+    timeSync::timeSync(uint8_t my_id, uint8_t timebase_id, clock_function clock) :
+        myId(my_id), timebaseId(timebase_id), localClock(clock)
+    {
+        // intentionally blank
+    }
+
+
+    void timeSync::add_exchange(uint8_t peer_id, int64_t t1, int64_t t2, int64_t t3, int64_t t4)
+    {
+        sample_t s;
+        s.local_us = t4;
+        s.offset_us = ((t2 - t1) + (t3 - t4)) / 2;
+        s.delay_us = (t4 - t1) - (t3 - t2);
+
+        if(s.delay_us < 0){
+            return;                                     // clocks stepped mid exchange, discard
+        }
+
+        auto inserted = peers.try_emplace(peer_id);
+        peer_state_t& peer = inserted.first->second;
+        if(inserted.second){
+            memset(&peer, 0, sizeof(peer));
+        }
+
+        peer.samples[peer.next_sample] = s;
+        peer.next_sample = (peer.next_sample + 1) % FILTER_SAMPLES;
+        if(peer.sample_count < FILTER_SAMPLES){
+            ++peer.sample_count;
+        }
+
+        // clock filter: lowest delay sample has the least queueing asymmetry
+        const sample_t* best = &peer.samples[0];
+        for(int i = 1; i < peer.sample_count; ++i){
+            if(peer.samples[i].delay_us < best->delay_us){
+                best = &peer.samples[i];
+            }
+        }
+
+        // add to the drift fit only when the filter selects a new sample
+        if(peer.point_count == 0 || best->local_us != peer.best.local_us){
+            peer.points[peer.next_point] = *best;
+            peer.next_point = (peer.next_point + 1) % DRIFT_POINTS;
+            if(peer.point_count < DRIFT_POINTS){
+                ++peer.point_count;
+            }
+        }
+
+        peer.best = *best;
+        fit_drift(&peer);
+    }
+
+
+    // least squares slope of offset against local time
+    void timeSync::fit_drift(peer_state_t* peer)
+    {
+        if(peer->point_count < 2){
+            peer->drift = 0.0;
+            return;
+        }
+
+        // center on the first point so the sums stay well conditioned
+        double t0 = static_cast<double>(peer->points[0].local_us);
+        double o0 = static_cast<double>(peer->points[0].offset_us);
+        double sum_t = 0.0, sum_o = 0.0, sum_tt = 0.0, sum_to = 0.0;
+        int n = peer->point_count;
+
+        for(int i = 0; i < n; ++i){
+            double t = peer->points[i].local_us - t0;
+            double o = peer->points[i].offset_us - o0;
+            sum_t += t;
+            sum_o += o;
+            sum_tt += t * t;
+            sum_to += t * o;
+        }
+
+        double denominator = n * sum_tt - sum_t * sum_t;
+        if(denominator <= 0.0){
+            peer->drift = 0.0;
+            return;
+        }
+
+        peer->drift = (n * sum_to - sum_t * sum_o) / denominator;
+    }
+
+
+    const timeSync::peer_state_t* timeSync::find_peer(uint8_t peer_id) const
+    {
+        auto it = peers.find(peer_id);
+        if(it == peers.end()){
+            return nullptr;
+        }
+        return &it->second;
+    }
+
+
+    bool timeSync::synchronized(uint8_t peer_id) const
+    {
+        return find_peer(peer_id) != nullptr;
+    }
+
+
+    int64_t timeSync::offset_us(uint8_t peer_id, int64_t local_us) const
+    {
+        const peer_state_t* peer = find_peer(peer_id);
+        if(peer == nullptr){
+            return 0;
+        }
+
+        // extrapolate from the filtered sample along the drift line
+        double elapsed = static_cast<double>(local_us - peer->best.local_us);
+        return peer->best.offset_us + static_cast<int64_t>(peer->drift * elapsed);
+    }
+
+
+    double timeSync::drift_ppm(uint8_t peer_id) const
+    {
+        const peer_state_t* peer = find_peer(peer_id);
+        return peer ? peer->drift * 1e6 : 0.0;
+    }
+
+
+    int64_t timeSync::delay_us(uint8_t peer_id) const
+    {
+        const peer_state_t* peer = find_peer(peer_id);
+        return peer ? peer->best.delay_us : -1;
+    }
+
+
+    bool timeSync::synchronized_to_timebase() const
+    {
+        return myId == timebaseId || synchronized(timebaseId);
+    }
+
+
+    int64_t timeSync::to_shared_us(int64_t local_us) const
+    {
+        if(myId == timebaseId){
+            return local_us;
+        }
+        return local_us + offset_us(timebaseId, local_us);
+    }
+
+
+    int64_t timeSync::expand_compact(uint32_t stamp) const
+    {
+        int64_t now = shared_now_us();
+
+        // the wrapped difference is the stamp's age, negative for slightly future stamps
+        int32_t age = static_cast<int32_t>(static_cast<uint32_t>(now) - stamp);
+        return now - age;
+    }
+
+
+    int64_t timeSync::one_way_latency_us(uint32_t stamp) const
+    {
+        return shared_now_us() - expand_compact(stamp);
+    }
+
+}
@@ -0,0 +1,109 @@
+/**
+ * @brief Declares timeSync, NTP style clock synchronization between radio nodes
+ *
+ * Node clocks are not synchronized, so absolute timestamps from another node
+ * cannot be compared with the local clock. timeSync estimates, for every peer,
+ * the offset between the peer clock and the local clock and how fast that
+ * offset changes (drift).
+ *
+ * Two way exchange, all times in microseconds:
+ *      t1  requester sends request         (requester clock)
+ *      t2  responder receives request      (responder clock)
+ *      t3  responder sends response        (responder clock)
+ *      t4  requester receives response     (requester clock)
+ *
+ *      offset = ((t2 - t1) + (t3 - t4)) / 2        peer clock - local clock
+ *      delay  = (t4 - t1) - (t3 - t2)              round trip on the air
+ *
+ * Queueing in the modem makes some exchanges asymmetric. As in the NTP clock
+ * filter, the sample with the lowest delay of the last few exchanges is used.
+ * Drift is the least squares slope of the filtered offsets over time.
+ *
+ * The shared timebase is the clock of one node (timebase_id, normally the base
+ * station). Messages carry a 32 bit compact timestamp: shared time in
+ * microseconds modulo 2^32. It wraps every 71.6 minutes; the receiver expands
+ * it to the value nearest its own estimate of shared time, so any stamp less
+ * than 35 minutes old is unambiguous.
+ *
+ */
+
+#ifndef TIME_SYNC_INCLUDED_H
+#define TIME_SYNC_INCLUDED_H
+
+#include <cstdint>
+#include <unordered_map>
+
+
+namespace rfd900comm{
+
+    class timeSync{
+
+        public:
+
+        using clock_function = int64_t (*)();
+
+        static constexpr int FILTER_SAMPLES = 8;        // exchanges considered by the clock filter
+        static constexpr int DRIFT_POINTS = 8;          // filtered offsets used to fit drift
+
+        // local monotonic clock, microseconds
+        static int64_t steady_now_us();
+
+        timeSync(uint8_t my_id, uint8_t timebase_id, clock_function clock = steady_now_us);
+
+        int64_t now_us() const { return localClock(); }
+        uint8_t get_timebase_id() const { return timebaseId; }
+
+        // requester side, called with the local receive time t4 of the response
+        void add_exchange(uint8_t peer_id, int64_t t1, int64_t t2, int64_t t3, int64_t t4);
+
+        bool synchronized(uint8_t peer_id) const;
+        int64_t offset_us(uint8_t peer_id, int64_t local_us) const;        // peer clock - local clock
+        double drift_ppm(uint8_t peer_id) const;
+        int64_t delay_us(uint8_t peer_id) const;
+
+        // shared timebase
+        bool synchronized_to_timebase() const;
+        int64_t to_shared_us(int64_t local_us) const;
+        int64_t shared_now_us() const { return to_shared_us(localClock()); }
+
+        uint32_t compact_timestamp() const { return static_cast<uint32_t>(shared_now_us()); }
+        int64_t expand_compact(uint32_t stamp) const;
+        int64_t one_way_latency_us(uint32_t stamp) const;
+
+
+        private:
+
+        struct sample_t{
+            int64_t local_us;           // t4
+            int64_t offset_us;
+            int64_t delay_us;
+        };
+
+        struct peer_state_t{
+            sample_t samples[FILTER_SAMPLES];
+            int sample_count;
+            int next_sample;
+
+            // filtered offsets, input to the drift fit
+            sample_t points[DRIFT_POINTS];
+            int point_count;
+            int next_point;
+
+            sample_t best;              // current filtered sample
+            double drift;               // offset change per local microsecond
+        };
+
+        uint8_t myId;
+        uint8_t timebaseId;
+        clock_function localClock;
+
+        std::unordered_map<uint8_t, peer_state_t> peers;
+
+        const peer_state_t* find_peer(uint8_t peer_id) const;
+        static void fit_drift(peer_state_t* peer);
+    };
+
+}
+
+
+#endif
@@ -0,0 +1,225 @@
+/**
+ * Purpose:
+ *  Demonstrate over the radio clock synchronization and compact timestamps.
+ *
+ *  Two nodes are connected through a linkEmulator:
+ *      BASE_STATION - the shared timebase
+ *      AERIAL01     - a clock that is offset by several seconds and drifts
+ *
+ *  AERIAL01 runs two way time sync exchanges with the base station, then the
+ *  base station sends artifacts carrying 32 bit compact timestamps. AERIAL01
+ *  converts each stamp to a one way latency, which is compared with the
+ *  latency measured directly (both nodes run in this process).
+ *
+ * Optional Command line arguments
+ *  argv[1] - number of time sync exchanges
+ *  argv[2] - number of artifacts
+ *  argv[3] - one way latency, milliseconds
+ *  argv[4] - clock drift of AERIAL01, ppm
+ *
+ */
+
+#include <chrono>
+#include <cmath>                    // fabs
+#include <cstdlib>                  // atoi, atof
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "link_emulator.h"
+#include "rfd900_modem.h"
+#include "simulation_constants.h"
+#include "sim_artifact_message.h"
+#include "time_sync.h"
+
+
+using rfd900sim::SimConstants;
+
+constexpr size_t SERIAL_RX_BUFFER_LENGTH = 256;
+constexpr long POLL_TIMEOUT = 1000L;            // units, microseconds
+constexpr int64_t AERIAL_CLOCK_OFFSET_US = 5250000;
+
+static int64_t aerialClockStart;
+static double aerialDriftPpm = 200.0;
+
+
+// the aerial node's clock runs offset from, and slightly faster than, the base station clock
+static int64_t aerial_clock_us()
+{
+    int64_t now = rfd900comm::timeSync::steady_now_us();
+    return now + AERIAL_CLOCK_OFFSET_US + static_cast<int64_t>((now - aerialClockStart) * aerialDriftPpm / 1e6);
+}
+
+
+struct node_t{
+    rfd900comm::rfd900Modem radio;
+    rfd900comm::timeSync sync;
+    std::string temp_rx_storage;
+
+    node_t(uint8_t id, rfd900comm::timeSync::clock_function clock) :
+        sync(id, SimConstants::BASE_STATION, clock) {}
+};
+
+
+// returns true with the next complete frame, rx_time is the local clock when its bytes were read
+static bool poll_node(node_t* node, std::string* frame, int64_t* rx_time)
+{
+    uint8_t serial_rx_buffer[SERIAL_RX_BUFFER_LENGTH];
+
+    if(rfd900sim::extract_rx_message(node->temp_rx_storage, *frame)){
+        return true;
+    }
+
+    ssize_t bytesRead = node->radio.read_serial(serial_rx_buffer, SERIAL_RX_BUFFER_LENGTH, POLL_TIMEOUT);
+    *rx_time = node->sync.now_us();
+    if(bytesRead > 0){
+        node->temp_rx_storage.append((const char*)serial_rx_buffer, bytesRead);
+    }
+
+    return rfd900sim::extract_rx_message(node->temp_rx_storage, *frame);
+}
+
+
+static void send_time_sync(node_t* node, rfd900sim::time_sync_message_t* ts)
+{
+    std::vector<uint8_t> buffer(sizeof(rfd900sim::time_sync_message_t)
+                        + SimConstants::MESSAGE_900_START_INDICATOR_LENGTH
+                        + SimConstants::MESSAGE_900_END_INDICATOR_LENGTH);
+
+    rfd900sim::serialize_time_sync_for_900MHz(ts, buffer.data(), buffer.size());
+    node->radio.send_message((const char*)buffer.data(), buffer.size());
+}
+
+
+int main(int argc, char **argv)
+{
+    int exchanges = 20;
+    int artifacts = 50;
+    rfd900comm::linkEmulatorConfig config;
+    config.latency = std::chrono::milliseconds(40);
+
+    if(argc > 1){
+        exchanges = atoi(argv[1]);
+    }
+    if(argc > 2){
+        artifacts = atoi(argv[2]);
+    }
+    if(argc > 3){
+        config.latency = std::chrono::milliseconds(atoi(argv[3]));
+    }
+    if(argc > 4){
+        aerialDriftPpm = atof(argv[4]);
+    }
+
+    aerialClockStart = rfd900comm::timeSync::steady_now_us();
+
+    rfd900comm::linkEmulator emulator;
+    node_t base(SimConstants::BASE_STATION, rfd900comm::timeSync::steady_now_us);
+    node_t aerial(SimConstants::AERIAL01, aerial_clock_us);
+
+    if(emulator.start(config) != 0){
+        return 1;
+    }
+    if(base.radio.init(emulator.port_name(0)) != 0 || aerial.radio.init(emulator.port_name(1)) != 0){
+        fprintf(stderr, "error, %s radio init failure\n", __func__);
+        return 1;
+    }
+
+    std::string frame;
+    int64_t rx_time = 0;
+
+    /************* time sync exchanges, aerial requests, base responds *************/
+    for(uint16_t seq = 0; seq < exchanges; ++seq){
+        rfd900sim::time_sync_message_t request = {};
+        request.dest_id = SimConstants::BASE_STATION;
+        request.src_id = SimConstants::AERIAL01;
+        request.msg_type = SimConstants::TIME_SYNC_REQUEST;
+        request.msg_id = seq;
+        request.t1 = aerial.sync.now_us();
+        send_time_sync(&aerial, &request);
+
+        bool answered = false;
+        auto give_up = std::chrono::steady_clock::now() + std::chrono::seconds(1);
+        while(!answered && std::chrono::steady_clock::now() < give_up){
+
+            if(poll_node(&base, &frame, &rx_time) && frame[2] == SimConstants::TIME_SYNC_REQUEST){
+                rfd900sim::time_sync_message_t response;
+                rfd900sim::deserialize_time_sync_for_900MHz(&response, (const uint8_t*)frame.data());
+                response.dest_id = response.src_id;
+                response.src_id = SimConstants::BASE_STATION;
+                response.msg_type = SimConstants::TIME_SYNC_RESPONSE;
+                response.t2 = rx_time;
+                response.t3 = base.sync.now_us();
+                send_time_sync(&base, &response);
+            }
+
+            if(poll_node(&aerial, &frame, &rx_time) && frame[2] == SimConstants::TIME_SYNC_RESPONSE){
+                rfd900sim::time_sync_message_t response;
+                rfd900sim::deserialize_time_sync_for_900MHz(&response, (const uint8_t*)frame.data());
+                if(response.msg_id == seq){
+                    aerial.sync.add_exchange(SimConstants::BASE_STATION, response.t1, response.t2, response.t3, rx_time);
+                    answered = true;
+                }
+            }
+        }
+    }
+
+    int64_t true_offset = rfd900comm::timeSync::steady_now_us() - aerial_clock_us();
+    int64_t estimated_offset = aerial.sync.offset_us(SimConstants::BASE_STATION, aerial.sync.now_us());
+
+    fprintf(stdout, "clock offset  true: %ld us  estimated: %ld us  error: %ld us\n",
+                true_offset, estimated_offset, estimated_offset - true_offset);
+    fprintf(stdout, "clock drift   true: %.1f ppm  estimated: %.1f ppm  best round trip: %ld us\n",
+                -aerialDriftPpm / (1.0 + aerialDriftPpm / 1e6),
+                aerial.sync.drift_ppm(SimConstants::BASE_STATION), aerial.sync.delay_us(SimConstants::BASE_STATION));
+
+    /************* compact timestamped artifacts, base to aerial *************/
+    const size_t SERIAL_COMPACT_BUFFER_LENGTH = sizeof(rfd900sim::artifact_compact_message_t)
+                        + SimConstants::MESSAGE_900_START_INDICATOR_LENGTH
+                        + SimConstants::MESSAGE_900_END_INDICATOR_LENGTH;
+    std::vector<uint8_t> serial_tx_buffer(SERIAL_COMPACT_BUFFER_LENGTH);
+
+    std::unordered_map<uint16_t, int64_t> sent_at;          // base station clock
+    double error_sum = 0.0, error_max = 0.0;
+    int received = 0;
+
+    for(int i = 0; i < artifacts; ++i){
+        rfd900sim::artifact_message_t artmsg;
+        rfd900sim::artifact_compact_message_t compact;
+
+        rfd900sim::simulate_artifact_message(&artmsg, SimConstants::AERIAL01, SimConstants::BASE_STATION);
+        sent_at[artmsg.msg_id] = base.sync.now_us();
+        rfd900sim::compact_artifact_message(&artmsg, base.sync.compact_timestamp(), &compact);
+        rfd900sim::serialize_compact_artifact_for_900MHz(&compact, serial_tx_buffer.data(), SERIAL_COMPACT_BUFFER_LENGTH);
+        base.radio.send_message((const char*)serial_tx_buffer.data(), SERIAL_COMPACT_BUFFER_LENGTH);
+
+        auto give_up = std::chrono::steady_clock::now() + std::chrono::seconds(1);
+        while(std::chrono::steady_clock::now() < give_up){
+            if(!poll_node(&aerial, &frame, &rx_time)){
+                continue;
+            }
+
+            rfd900sim::artifact_compact_message_t rx;
+            rfd900sim::deserialize_compact_artifact_for_900MHz(&rx, (const uint8_t*)frame.data());
+
+            // aerial knows only its own clock, the stamp and the sync estimate
+            int64_t estimated = aerial.sync.shared_now_us() - aerial.sync.expand_compact(rx.stamp_us);
+            int64_t measured = rfd900comm::timeSync::steady_now_us() - sent_at[rx.msg_id];
+            double error = fabs(static_cast<double>(estimated - measured));
+
+            error_sum += error;
+            if(error > error_max){
+                error_max = error;
+            }
+            ++received;
+            break;
+        }
+    }
+
+    fprintf(stdout, "one way latency over %d artifacts, mean error: %.0f us, max error: %.0f us\n",
+                received, received ? error_sum / received : 0.0, error_max);
+    fprintf(stdout, "artifact bytes on the air  epoch timestamp: %lu  compact timestamp: %lu\n",
+                sizeof(rfd900sim::artifact_message_t), sizeof(rfd900sim::artifact_compact_message_t));
+
+    return 0;
+}
@@ -0,0 +1,247 @@
+/**
+ * @brief Tracepoint ring registration and Chrome trace export function definitions.
+ *
+ */
+
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>                     // atexit
+#include <string.h>                     // strncpy, strlen
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "trace.h"
+
+namespace rfd900comm{
+
+    thread_local traceRing* traceThreadRing __attribute__((tls_model("initial-exec"))) = nullptr;
+
+    static std::atomic<traceRing*> ringList{nullptr};
+
+    static const char* event_names[] = {
+        "serial_select", "serial_read", "serial_write", "frame", "extract", "process_rx",
+        "ack_wait_add", "ack_received", "retransmit", "tx_enqueue", "tx_service", "expired"
+    };
+
+    static_assert(sizeof(event_names) / sizeof(event_names[0]) == static_cast<size_t>(traceEvent::NUM_EVENTS),
+                "a name for every trace event");
+
+
+    // ticks and CLOCK_MONOTONIC at load, the dump measures the tick rate against them
+    struct calibration_t{
+        uint64_t ticks;
+        uint64_t mono_ns;
+    };
+
+    static uint64_t monotonic_ns()
+    {
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return static_cast<uint64_t>(ts.tv_sec) * 1000000000ULL + ts.tv_nsec;
+    }
+
+    static const calibration_t loadCalibration = {trace_ticks(), monotonic_ns()};
+
+    static char signalDumpPath[256];
+    static char exitDumpPath[256];
+    static struct sigaction previousAction;
+    static int dumpSignal;
+
+
+    const char* trace_event_name(traceEvent event)
+    {
+        size_t e = static_cast<size_t>(event);
+        return e < static_cast<size_t>(traceEvent::NUM_EVENTS) ? event_names[e] : "unknown";
+    }
+
+
+    traceRing* trace_thread_init()
+    {
+        if(traceThreadRing != nullptr){
+            return traceThreadRing;
+        }
+
+        traceRing* ring = new traceRing;
+        ring->head.store(0, std::memory_order_relaxed);
+        ring->tid = static_cast<int32_t>(syscall(SYS_gettid));
+
+        // rings are never freed, the records of a finished thread stay for the dump
+        ring->next = ringList.load(std::memory_order_relaxed);
+        while(!ringList.compare_exchange_weak(ring->next, ring, std::memory_order_release, std::memory_order_relaxed)){
+        }
+
+        traceThreadRing = ring;
+        return ring;
+    }
+
+
+    // async signal safe output: a static buffer, integer formatting and write
+    struct jsonWriter{
+        int fd;
+        size_t used;
+        bool failed;
+        char buffer[16384];
+
+        void flush()
+        {
+            size_t done = 0;
+            while(done < used && !failed){
+                ssize_t n = write(fd, buffer + done, used - done);
+                failed = n <= 0;
+                done += n > 0 ? n : 0;
+            }
+            used = 0;
+        }
+
+        void text(const char* s)
+        {
+            size_t n = strlen(s);
+            if(used + n > sizeof(buffer)){
+                flush();
+            }
+            memcpy(buffer + used, s, n);
+            used += n;
+        }
+
+        void number(uint64_t v)
+        {
+            char digits[24];
+            size_t n = 0;
+            do{
+                digits[n++] = '0' + v % 10;
+                v /= 10;
+            }while(v != 0);
+
+            if(used + n > sizeof(buffer)){
+                flush();
+            }
+            while(n > 0){
+                buffer[used++] = digits[--n];
+            }
+        }
+
+        // nanoseconds as microseconds with three decimals, the trace format's unit
+        void microseconds(uint64_t ns)
+        {
+            char fraction[5] = {'.', char('0' + ns / 100 % 10), char('0' + ns / 10 % 10), char('0' + ns % 10), '\0'};
+            number(ns / 1000);
+            text(fraction);
+        }
+    };
+
+    static jsonWriter writer;
+
+
+    long trace_dump(const char* path)
+    {
+        writer.fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if(writer.fd < 0){
+            return -1;
+        }
+        writer.used = 0;
+        writer.failed = false;
+
+        // ticks per nanosecond over the whole run, at least 10 ms of it
+        uint64_t now_ticks = trace_ticks();
+        uint64_t now_ns = monotonic_ns();
+        if(now_ns - loadCalibration.mono_ns < 10000000ULL){
+            struct timespec pause = {0, 10000000L};
+            nanosleep(&pause, nullptr);
+            now_ticks = trace_ticks();
+            now_ns = monotonic_ns();
+        }
+        double ns_per_tick = static_cast<double>(now_ns - loadCalibration.mono_ns) / (now_ticks - loadCalibration.ticks);
+
+        long events = 0;
+        uint64_t pid = getpid();
+
+        writer.text("{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+
+        for(traceRing* ring = ringList.load(std::memory_order_acquire); ring != nullptr; ring = ring->next){
+            uint64_t head = ring->head.load(std::memory_order_acquire);
+            uint64_t first = head > TRACE_RING_RECORDS ? head - TRACE_RING_RECORDS : 0;
+
+            for(uint64_t i = first; i < head; ++i){
+                const traceRecord& r = ring->records[i & (TRACE_RING_RECORDS - 1)];
+                int64_t since_load = static_cast<int64_t>(r.start - loadCalibration.ticks);
+                uint64_t start_ns = loadCalibration.mono_ns + static_cast<int64_t>(since_load * ns_per_tick);
+                uint64_t duration_ns = static_cast<uint64_t>((r.end - r.start) * ns_per_tick);
+
+                writer.text(events == 0 ? "{\"name\":\"" : ",\n{\"name\":\"");
+                writer.text(trace_event_name(static_cast<traceEvent>(r.event)));
+                writer.text(r.instant ? "\",\"cat\":\"rfd900\",\"ph\":\"i\",\"s\":\"t\",\"ts\":" : "\",\"cat\":\"rfd900\",\"ph\":\"X\",\"ts\":");
+                writer.microseconds(start_ns);
+                if(!r.instant){
+                    writer.text(",\"dur\":");
+                    writer.microseconds(duration_ns);
+                }
+                writer.text(",\"pid\":");
+                writer.number(pid);
+                writer.text(",\"tid\":");
+                writer.number(ring->tid);
+                writer.text(",\"args\":{\"id\":");
+                writer.number(r.id);
+                writer.text("}}");
+                ++events;
+            }
+        }
+
+        writer.text("\n]}\n");
+        writer.flush();
+        close(writer.fd);
+        return writer.failed ? -1 : events;
+    }
+
+
+    static void dump_on_signal(int sig)
+    {
+        trace_dump(signalDumpPath);
+
+        // the signal is blocked in its handler, it is delivered again to the previous disposition on return
+        sigaction(sig, &previousAction, nullptr);
+        raise(sig);
+    }
+
+
+    int trace_dump_on_signal(int sig, const char* path)
+    {
+        struct sigaction action;
+
+        if(strlen(path) >= sizeof(signalDumpPath)){
+            fprintf(stderr, "error, %s, path %s too long\n", __func__, path);
+            return -1;
+        }
+        strncpy(signalDumpPath, path, sizeof(signalDumpPath) - 1);
+        dumpSignal = sig;
+
+        memset(&action, 0, sizeof(action));
+        action.sa_handler = dump_on_signal;
+        if(sigaction(dumpSignal, &action, &previousAction) != 0){
+            fprintf(stderr, "error, %s, sigaction %d failed\n", __func__, sig);
+            return -1;
+        }
+        return 0;
+    }
+
+
+    static void dump_at_exit()
+    {
+        long events = trace_dump(exitDumpPath);
+        if(events >= 0){
+            fprintf(stderr, "info, %s, %ld trace events written to %s\n", __func__, events, exitDumpPath);
+        }
+    }
+
+
+    int trace_dump_at_exit(const char* path)
+    {
+        if(strlen(path) >= sizeof(exitDumpPath)){
+            fprintf(stderr, "error, %s, path %s too long\n", __func__, path);
+            return -1;
+        }
+        strncpy(exitDumpPath, path, sizeof(exitDumpPath) - 1);
+        return atexit(dump_at_exit);
+    }
+
+}
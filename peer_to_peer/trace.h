@@ -0,0 +1,172 @@
+/**
+ * @brief Declares the hot path tracepoints and their Chrome trace export
+ *
+ * When a message is late the tracepoints show where the time went: queueing,
+ * the serial write, the select wakeup, extraction or processing. They are
+ * compiled in only with RFD900_TRACE defined (cmake -DRFD900_TRACE=ON), the
+ * macros are empty otherwise.
+ *
+ *      RFD900_TRACE_SCOPE(name, event, id)   a span from here to the end of
+ *                                            the enclosing block
+ *      RFD900_TRACE_SET_ID(name, id)         an id learned inside the span,
+ *                                            such as the bytes read
+ *      RFD900_TRACE_INSTANT(event, id)       a point event
+ *
+ * Each event writes one fixed size traceRecord, timestamps in TSC ticks on
+ * x86-64 and CLOCK_MONOTONIC nanoseconds elsewhere, into a ring owned by the
+ * writing thread. The writer never locks or waits, a full ring overwrites
+ * its oldest records, so the rings keep the latest TRACE_RING_RECORDS
+ * events of every thread. A thread's ring is allocated at its first event,
+ * trace_thread_init() does it at startup for threads that must not allocate
+ * later.
+ *
+ * trace_dump writes the rings as Chrome trace JSON, for chrome://tracing or
+ * Perfetto, using only open and write so it can run in a signal handler.
+ * trace_dump_on_signal and trace_dump_at_exit arrange the dump.
+ *
+ */
+
+#ifndef TRACE_INCLUDED_H
+#define TRACE_INCLUDED_H
+
+#include <atomic>
+#include <cstdint>
+#include <ctime>
+
+#if defined(__x86_64__)
+#include <x86intrin.h>              // __rdtsc
+#endif
+
+
+namespace rfd900comm{
+
+    enum class traceEvent : uint16_t{
+        SERIAL_SELECT,              // read_serial waiting in select, id: bytes read
+        SERIAL_READ,                // id: bytes read
+        SERIAL_WRITE,               // id: bytes written
+        FRAME,                      // frame_for_900MHz, id: message type
+        EXTRACT,                    // extract_rx_message, id: message length, 0 when none
+        PROCESS_RX,                 // process_rx_message, id: message type
+        ACK_WAIT_ADD,               // id: msg_id
+        ACK_RECEIVED,               // id: msg_id
+        RETRANSMIT,                 // id: msg_id
+        TX_ENQUEUE,                 // txScheduler, id: priority
+        TX_SERVICE,                 // txScheduler::service, id: frames completed
+        EXPIRED,                    // message or queued frame dropped at its deadline, id: msg_id or message type
+        NUM_EVENTS
+    };
+
+    const char* trace_event_name(traceEvent event);
+
+    constexpr size_t TRACE_RING_RECORDS = 1 << 14;          // per thread, power of two
+
+    struct traceRecord{
+        uint64_t start;                                     // ticks
+        uint64_t end;                                       // ticks, equal to start for an instant
+        uint32_t id;
+        uint16_t event;
+        uint16_t instant;
+    };
+
+    struct traceRing{
+        std::atomic<uint64_t> head;                         // records written, the writer's only shared state
+        int32_t tid;
+        traceRing* next;                                    // every ring ever registered
+        traceRecord records[TRACE_RING_RECORDS];
+    };
+
+
+    // the calling thread's ring, allocated and registered on first use
+    traceRing* trace_thread_init();
+
+    // writes the rings as Chrome trace JSON, returns the events written or -1
+    long trace_dump(const char* path);
+
+    // dump when sig arrives, the previous disposition then handles it; path is copied
+    int trace_dump_on_signal(int sig, const char* path);
+
+    // dump when the program exits through exit or a return from main
+    int trace_dump_at_exit(const char* path);
+
+
+    extern thread_local traceRing* traceThreadRing __attribute__((tls_model("initial-exec")));
+
+    inline uint64_t trace_ticks()
+    {
+#if defined(__x86_64__)
+        return __rdtsc();
+#else
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return static_cast<uint64_t>(ts.tv_sec) * 1000000000ULL + ts.tv_nsec;
+#endif
+    }
+
+    inline void trace_write(traceEvent event, uint64_t start, uint64_t end, uint32_t id, bool instant)
+    {
+        traceRing* ring = traceThreadRing;
+        if(__builtin_expect(ring == nullptr, 0)){
+            ring = trace_thread_init();
+        }
+
+        // only this thread writes the ring, the release publishes the record to a dump
+        uint64_t h = ring->head.load(std::memory_order_relaxed);
+        traceRecord& r = ring->records[h & (TRACE_RING_RECORDS - 1)];
+        r.start = start;
+        r.end = instant ? start : end;
+        r.id = id;
+        r.event = static_cast<uint16_t>(event);
+        r.instant = instant;
+        ring->head.store(h + 1, std::memory_order_release);
+    }
+
+    class traceScope{
+
+        public:
+
+        traceScope(traceEvent trace_event, uint32_t trace_id) : event(trace_event), id(trace_id), start(trace_ticks())
+        {
+            // intentionally blank
+        }
+
+        ~traceScope()
+        {
+            trace_write(event, start, trace_ticks(), id, false);
+        }
+
+        // disable copy constructor
+        traceScope(const traceScope&) = delete;
+
+        // disable assignment
+        traceScope& operator=(const traceScope&) = delete;
+
+        void set_id(uint32_t trace_id) { id = trace_id; }
+
+
+        private:
+
+        traceEvent event;
+        uint32_t id;
+        uint64_t start;
+    };
+
+}
+
+
+#ifdef RFD900_TRACE
+
+#define RFD900_TRACE_SCOPE(name, event, id)     rfd900comm::traceScope name((event), static_cast<uint32_t>(id))
+#define RFD900_TRACE_SET_ID(name, id)           (name).set_id(static_cast<uint32_t>(id))
+#define RFD900_TRACE_INSTANT(event, id)         rfd900comm::trace_write((event), rfd900comm::trace_ticks(), 0, \
+                                                        static_cast<uint32_t>(id), true)
+
+#else
+
+#define RFD900_TRACE_SCOPE(name, event, id)     ((void)0)
+#define RFD900_TRACE_SET_ID(name, id)           ((void)0)
+#define RFD900_TRACE_INSTANT(event, id)         ((void)0)
+
+#endif
+
+
+#endif
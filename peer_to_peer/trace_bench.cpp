@@ -0,0 +1,194 @@
+/**
+ * Purpose:
+ *  Measure the cost of the hot path tracepoints and write a Chrome trace of
+ *  a short artifact exchange.
+ *
+ *  The program sends artifact messages over a linkEmulator with loss, the
+ *  receiver acknowledges them and the sender retransmits, so the trace
+ *  holds the serial, framing, extraction, ACK and retransmit events of both
+ *  threads. The trace is written as Chrome trace JSON for chrome://tracing
+ *  or Perfetto, SIGUSR1 during the run writes it early. Then it times a
+ *  loop of instant events and a loop of scopes against the same loop
+ *  without them and reports nanoseconds per event. An event costs about
+ *  one read of the TSC, or of CLOCK_MONOTONIC off x86-64, plus a 24 byte
+ *  store; a scope reads the clock twice.
+ *
+ *  Build with cmake -DRFD900_TRACE=ON, without it the tracepoints are
+ *  compiled out and the trace is empty.
+ *
+ * Optional Command line arguments
+ *  argv[1] - trace output path, default /tmp/rfd900_trace.json
+ *  argv[2] - number of artifact messages
+ *  argv[3] - loss probability per chunk
+ *
+ */
+
+#include <signal.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>                  // atoi, atof
+#include <cstring>                  // memcpy
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "ack_responder.h"
+#include "link_emulator.h"
+#include "message900.h"
+#include "rfd900_modem.h"
+#include "simulation_constants.h"
+#include "sim_artifact_message.h"
+#include "trace.h"
+
+
+using steady = std::chrono::steady_clock;
+
+constexpr size_t SERIAL_RX_BUFFER_LENGTH = 256;
+constexpr uint32_t OVERHEAD_ITERATIONS = 10000000;
+
+static std::atomic<bool> receiverRunning;
+
+
+// the barrier keeps the compiler from removing or merging the empty loop
+static double loop_ns(bool instant, bool scope)
+{
+    auto start = steady::now();
+    for(uint32_t i = 0; i < OVERHEAD_ITERATIONS; ++i){
+        if(instant){
+            RFD900_TRACE_INSTANT(rfd900comm::traceEvent::TX_ENQUEUE, i);
+        }
+        if(scope){
+            RFD900_TRACE_SCOPE(trace, rfd900comm::traceEvent::TX_SERVICE, i);
+            asm volatile("" ::: "memory");
+        }
+        asm volatile("" ::: "memory");
+    }
+    return std::chrono::duration<double, std::nano>(steady::now() - start).count() / OVERHEAD_ITERATIONS;
+}
+
+
+static int exchange(int messageCount, double loss)
+{
+    const size_t SERIAL_ARTIFACT_BUFFER_LENGTH = sizeof(rfd900sim::artifact_message_t) + 6;
+
+    rfd900comm::linkEmulator emulator;
+    rfd900comm::linkEmulatorConfig config;
+    config.latency = std::chrono::milliseconds(20);
+    config.loss_probability = loss;
+
+    rfd900comm::rfd900Modem tx_radio;
+    rfd900comm::rfd900Modem rx_radio;
+    rfd900comm::message900 msg900;
+
+    uint8_t serial_tx_buffer[SERIAL_ARTIFACT_BUFFER_LENGTH];
+    uint8_t serial_rx_buffer[SERIAL_RX_BUFFER_LENGTH];
+    std::string temp_rx_storage;
+    std::string extracted_rx_data;
+
+    if(emulator.start(config) != 0){
+        return -1;
+    }
+    if(tx_radio.init(emulator.port_name(0)) != 0 || rx_radio.init(emulator.port_name(1)) != 0){
+        fprintf(stderr, "error, %s radio init failure\n", __func__);
+        return -1;
+    }
+
+    receiverRunning = true;
+    std::thread rx_thread(rfd900comm::ack_responder, &rx_radio, &receiverRunning);
+
+    auto retransmit = [&](const rfd900comm::message900_t& msg){
+        tx_radio.send_message((const char*)msg.data, msg.data_length);
+    };
+
+    int txcount = 0;
+    size_t retransmissions = 0;
+    auto next_tx = steady::now();
+    auto give_up = steady::now() + std::chrono::seconds(30);
+
+    while((txcount < messageCount || msg900.ack_wait_list_size() > 0) && steady::now() < give_up){
+
+        if(txcount < messageCount && steady::now() >= next_tx){
+            rfd900sim::artifact_message_t artmsg;
+            rfd900sim::simulate_artifact_message(&artmsg, rfd900sim::SimConstants::BASE_STATION,
+                        rfd900sim::SimConstants::AERIAL01);
+            rfd900sim::serialize_artifact_for_900MHz(&artmsg, serial_tx_buffer, SERIAL_ARTIFACT_BUFFER_LENGTH);
+
+            tx_radio.send_message((const char*)serial_tx_buffer, SERIAL_ARTIFACT_BUFFER_LENGTH);
+            msg900.add_to_ack_wait_list(artmsg.dest_id, artmsg.msg_id, artmsg.msg_type,
+                        serial_tx_buffer, SERIAL_ARTIFACT_BUFFER_LENGTH);
+            ++txcount;
+            next_tx += std::chrono::milliseconds(20);
+        }
+
+        ssize_t bytesRead = tx_radio.read_serial(serial_rx_buffer, SERIAL_RX_BUFFER_LENGTH, 1000L);
+        if(bytesRead > 0){
+            temp_rx_storage.append((const char*)serial_rx_buffer, bytesRead);
+            while(rfd900sim::extract_rx_message(temp_rx_storage, extracted_rx_data)){
+                if(extracted_rx_data.length() != sizeof(rfd900sim::ack_message_t)
+                        || extracted_rx_data[2] != rfd900sim::SimConstants::ACK){
+                    continue;
+                }
+                rfd900sim::ack_message_t ack;
+                memcpy(&ack, extracted_rx_data.data(), sizeof(ack));
+                msg900.process_received_ack(ack.src_id, ack.msg_id);
+            }
+        }
+
+        retransmissions += msg900.scan_list_for_retransmission(retransmit);
+    }
+
+    receiverRunning = false;
+    rx_thread.join();
+
+    fprintf(stdout, "exchange, messages: %d, retransmissions: %lu, undelivered: %lu\n",
+                txcount, retransmissions, msg900.ack_wait_list_size());
+    return 0;
+}
+
+
+int main(int argc, char **argv)
+{
+    const char* tracePath = "/tmp/rfd900_trace.json";
+    int messageCount = 100;
+    double loss = 0.1;
+
+    if(argc > 1){
+        tracePath = argv[1];
+    }
+    if(argc > 2){
+        messageCount = atoi(argv[2]);
+    }
+    if(argc > 3){
+        loss = atof(argv[3]);
+    }
+
+#ifdef RFD900_TRACE
+    fprintf(stdout, "tracepoints compiled in, %lu records per thread ring\n", rfd900comm::TRACE_RING_RECORDS);
+#else
+    fprintf(stdout, "tracepoints compiled out, build with -DRFD900_TRACE=ON to record them\n");
+#endif
+
+    if(rfd900comm::trace_dump_on_signal(SIGUSR1, tracePath) != 0){
+        return 1;
+    }
+    if(exchange(messageCount, loss) != 0){
+        return 1;
+    }
+
+    long events = rfd900comm::trace_dump(tracePath);
+    if(events < 0){
+        fprintf(stderr, "error, %s, trace dump to %s failed\n", __func__, tracePath);
+        return 1;
+    }
+    fprintf(stdout, "%ld trace events written to %s\n", events, tracePath);
+
+    // after the dump, the timing loops would fill the ring
+    double empty_ns = loop_ns(false, false);
+    double instant_ns = loop_ns(true, false);
+    double scope_ns = loop_ns(false, true);
+    fprintf(stdout, "empty loop: %.2f ns, instant: %.2f ns/event, scope: %.2f ns/event\n",
+                empty_ns, instant_ns - empty_ns, scope_ns - empty_ns);
+    return 0;
+}
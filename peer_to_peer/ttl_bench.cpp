@@ -0,0 +1,145 @@
+/**
+ * Purpose:
+ *  Check message deadlines in message900 and txScheduler and measure the
+ *  cost of dropping expired entries, no radio needed. Runs on the virtual
+ *  clock, so an hour of deadlines takes no real time.
+ *
+ *  For ack wait lists of growing size the program adds messages with time to
+ *  live spread over a minute, steps the clock past them 100 ms at a time and
+ *  reports the cost per expired message, which should not grow with the
+ *  list. It then queues frames with random deadlines in a txScheduler,
+ *  checks they are written earliest deadline first, and times the expiry of
+ *  a queue whose deadlines have all passed.
+ *
+ * Optional Command line arguments
+ *  argv[1] - largest ack wait list, default 16384
+ *  argv[2] - seed
+ *
+ */
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>                  // atoi, strtoull
+#include <cstring>                  // memcpy
+
+#include "message900.h"
+#include "sim_random.h"
+#include "tx_scheduler.h"
+#include "virtual_clock.h"
+
+
+using steady = std::chrono::steady_clock;
+
+constexpr uint8_t BENCH_MSG_TYPE = 1;
+constexpr size_t FRAME_LENGTH = 48;
+
+
+// records the deadline order of written frames, the deadline is in the first bytes of each frame
+class orderSink : public rfd900comm::txSink{
+
+    public:
+
+    size_t tx_room() override { return SIZE_MAX; }
+
+    ssize_t write_serial(const uint8_t* data, size_t length) override
+    {
+        int64_t deadline_ns;
+        memcpy(&deadline_ns, data, sizeof(deadline_ns));
+        if(deadline_ns < last){
+            ++inversions;
+        }
+        last = deadline_ns;
+        ++frames;
+        return length;
+    }
+
+    int64_t last = 0;
+    uint64_t inversions = 0;
+    uint64_t frames = 0;
+};
+
+
+static double wall_ns(steady::time_point start)
+{
+    return std::chrono::duration<double, std::nano>(steady::now() - start).count();
+}
+
+
+static void ack_wait_list_expiry(size_t entries, rfd900sim::xoshiro256& random, steady::time_point* now)
+{
+    rfd900comm::message900 arq(rfd900comm::rtoMode::FIXED, entries, FRAME_LENGTH);
+    arq.set_send_window(rfd900comm::message900::MAX_WINDOW_FRAMES, SIZE_MAX);
+    uint8_t frame[FRAME_LENGTH] = {0};
+
+    // destinations 0 to 249, msg_ids counting up per destination
+    for(size_t i = 0; i < entries; ++i){
+        auto ttl = std::chrono::milliseconds(1000 + random.below(59000));
+        arq.add_to_ack_wait_list(static_cast<uint8_t>(i % 250), static_cast<uint16_t>(i / 250), BENCH_MSG_TYPE,
+                    frame, sizeof(frame), *now + ttl);
+    }
+
+    size_t dropped = 0;
+    auto start = steady::now();
+    for(int step = 0; step < 610; ++step){
+        *now += std::chrono::milliseconds(100);
+        dropped += arq.expire_messages();
+    }
+    double ns = wall_ns(start);
+
+    fprintf(stdout, "ack wait list %6lu: %6lu expired, %lu left, %6.1f ns per expired message, counted %llu\n",
+                entries, dropped, arq.ack_wait_list_size(), ns / (dropped > 0 ? dropped : 1),
+                (unsigned long long)arq.expired(BENCH_MSG_TYPE));
+}
+
+
+int main(int argc, char **argv)
+{
+    size_t max_entries = 16384;
+    uint64_t seed = rfd900sim::DEFAULT_SIM_SEED;
+
+    if(argc > 1){
+        max_entries = atoi(argv[1]);
+    }
+    if(argc > 2){
+        seed = strtoull(argv[2], nullptr, 0);
+    }
+
+    steady::time_point now = steady::time_point() + std::chrono::hours(1);
+    rfd900comm::set_virtual_clock(&now);
+    rfd900sim::xoshiro256 random(seed);
+
+    for(size_t entries = 256; entries <= max_entries; entries *= 8){
+        ack_wait_list_expiry(entries, random, &now);
+    }
+
+    // earliest deadline first, a quarter of the frames have no deadline and go last in their order
+    const size_t FRAMES = 4096;
+    rfd900comm::txScheduler scheduler(0, rfd900comm::txScheduler::DEFAULT_MAX_BACKLOG, FRAMES);
+    uint8_t frame[FRAME_LENGTH] = {0};
+    for(size_t i = 0; i < FRAMES; ++i){
+        steady::time_point deadline = i % 4 == 0 ? steady::time_point::max()
+                    : now + std::chrono::milliseconds(100 + random.below(10000));
+        int64_t deadline_ns = deadline.time_since_epoch().count();
+        memcpy(frame, &deadline_ns, sizeof(deadline_ns));
+        scheduler.enqueue(rfd900comm::txPriority::HIGH, frame, sizeof(frame), deadline, BENCH_MSG_TYPE);
+    }
+    orderSink sink;
+    scheduler.service(sink);
+    fprintf(stdout, "scheduler: %llu frames written, %llu deadline inversions\n",
+                (unsigned long long)sink.frames, (unsigned long long)sink.inversions);
+
+    // the whole queue expires
+    for(size_t i = 0; i < FRAMES; ++i){
+        scheduler.enqueue(rfd900comm::txPriority::BULK, frame, sizeof(frame),
+                    now + std::chrono::milliseconds(10 + random.below(5000)), BENCH_MSG_TYPE);
+    }
+    now += std::chrono::seconds(6);
+    auto start = steady::now();
+    size_t dropped = scheduler.expire_frames();
+    double ns = wall_ns(start);
+    fprintf(stdout, "scheduler: %lu of %lu queued frames expired, %lu left, %.1f ns per frame\n",
+                dropped, FRAMES, scheduler.queued(), ns / (dropped > 0 ? dropped : 1));
+
+    rfd900comm::set_virtual_clock(nullptr);
+    return sink.inversions == 0 && scheduler.queued() == 0 ? 0 : 1;
+}
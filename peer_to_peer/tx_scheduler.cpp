@@ -0,0 +1,493 @@
+/**
+ * @brief txScheduler class function definitions.
+ *
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>                     // strerror, memcpy
+
+#include "airtime_accountant.h"
+#include "link_stats.h"
+#include "tx_scheduler.h"
+#include "trace.h"
+#include "virtual_clock.h"
+
+namespace rfd900comm{
+
+    txScheduler::txScheduler(size_t air_bytes_per_sec, size_t max_backlog_bytes, size_t max_queued_frames) :
+        queues(), latestSlots(), framePool(max_queued_frames), freeFrame(NO_FRAME),
+        nextOrder(0), supersededCount(0), frameExpiry(max_queued_frames, EXPIRY_TICK), expiredCount(),
+        currentLength(0), currentOffset(0), currentPriority(-1), currentTicketed(false), currentTicket(0),
+        airBytesPerSec(air_bytes_per_sec), maxBacklog(max_backlog_bytes),
+        backlogBytes(0.0), airtime(nullptr), lastAdmission(airtimeAdmission::ADMIT), lastDrain(clock_now())
+    {
+        for(queue_t& q : queues){
+            q.frames_head = NO_FRAME;
+            q.frames_tail = NO_FRAME;
+            q.oldest = UINT64_MAX;
+        }
+
+        for(size_t i = framePool.size(); i > 0; --i){
+            framePool[i - 1].next = freeFrame;
+            freeFrame = i - 1;
+        }
+    }
+
+
+    uint64_t txScheduler::enqueue(txPriority priority, const uint8_t* frame, size_t length)
+    {
+        return enqueue(priority, frame, length, steady::time_point::max());
+    }
+
+
+    uint64_t txScheduler::enqueue(txPriority priority, const uint8_t* frame, size_t length, steady::time_point deadline, uint8_t msg_type)
+    {
+        lastAdmission = airtimeAdmission::ADMIT;
+        if(length > MAX_FRAME_LENGTH){
+            fprintf(stderr, "error: %s, frame of %lu bytes exceeds %lu\n", __func__, length, MAX_FRAME_LENGTH);
+            return 0;
+        }
+
+        // a frame without a slot is refused before its airtime is charged
+#ifdef RFD900_EMBEDDED
+        if(freeFrame == NO_FRAME){
+            fprintf(stderr, "error: %s, all %lu frame slots in use\n", __func__, framePool.size());
+            return 0;
+        }
+#endif
+
+        if(!admit(priority, length)){
+            return 0;
+        }
+
+#ifndef RFD900_EMBEDDED
+        if(freeFrame == NO_FRAME){
+            framePool.emplace_back();
+            framePool.back().next = NO_FRAME;
+            freeFrame = framePool.size() - 1;
+            frameExpiry.resize(framePool.size());
+        }
+#endif
+
+        uint32_t index = freeFrame;
+        queued_frame_t& f = framePool[index];
+        freeFrame = f.next;
+
+        queue_t& q = queues[static_cast<int>(priority)];
+        f.order = nextOrder++;
+        f.ticket = ++q.enqueued;
+        f.deadline = deadline;
+        f.msg_type = msg_type;
+        f.priority = static_cast<int>(priority);
+        f.length = length;
+        memcpy(f.frame, frame, length);
+        if(q.oldest == UINT64_MAX && !q.oldest_stale){
+            q.oldest = f.ticket;
+        }
+
+        // after every frame due no later, frames without a deadline simply append
+        uint32_t after = q.frames_tail;
+        while(after != NO_FRAME && framePool[after].deadline > deadline){
+            after = framePool[after].prev;
+        }
+        f.prev = after;
+        f.next = after == NO_FRAME ? q.frames_head : framePool[after].next;
+        if(after == NO_FRAME){
+            q.frames_head = index;
+        }
+        else{
+            framePool[after].next = index;
+        }
+        if(f.next == NO_FRAME){
+            q.frames_tail = index;
+        }
+        else{
+            framePool[f.next].prev = index;
+        }
+        ++q.frames_count;
+
+        if(deadline != steady::time_point::max()){
+            frameExpiry.schedule(index, deadline);
+        }
+        RFD900_TRACE_INSTANT(traceEvent::TX_ENQUEUE, static_cast<int>(priority));
+
+        update_queue_depth();
+        return f.ticket;
+    }
+
+
+    bool txScheduler::sent(txPriority priority, uint64_t ticket) const
+    {
+        const queue_t& q = queues[static_cast<int>(priority)];
+        if(ticket > q.enqueued){
+            return false;
+        }
+
+        // recomputed only after the oldest ticket left, frames leave out of order with deadlines
+        if(q.oldest_stale){
+            q.oldest = UINT64_MAX;
+            for(uint32_t i = q.frames_head; i != NO_FRAME; i = framePool[i].next){
+                if(framePool[i].ticket < q.oldest){
+                    q.oldest = framePool[i].ticket;
+                }
+            }
+            if(currentPriority == static_cast<int>(priority) && currentTicketed && currentTicket < q.oldest){
+                q.oldest = currentTicket;
+            }
+            q.oldest_stale = false;
+        }
+        return ticket < q.oldest;
+    }
+
+
+    void txScheduler::ticket_done(int priority, uint64_t ticket)
+    {
+        queue_t& q = queues[priority];
+        if(ticket == q.oldest){
+            q.oldest_stale = true;
+        }
+    }
+
+
+    void txScheduler::unlink_frame(uint32_t index)
+    {
+        queued_frame_t& f = framePool[index];
+        queue_t& q = queues[f.priority];
+
+        if(f.prev == NO_FRAME){
+            q.frames_head = f.next;
+        }
+        else{
+            framePool[f.prev].next = f.next;
+        }
+        if(f.next == NO_FRAME){
+            q.frames_tail = f.prev;
+        }
+        else{
+            framePool[f.next].prev = f.prev;
+        }
+        --q.frames_count;
+        frameExpiry.cancel(index);
+
+        f.next = freeFrame;
+        freeFrame = index;
+    }
+
+
+    size_t txScheduler::expire_frames()
+    {
+        if(frameExpiry.size() == 0){
+            return 0;
+        }
+
+        size_t dropped = frameExpiry.expire(clock_now(), [this](uint32_t index){
+            const queued_frame_t& f = framePool[index];
+            ++expiredCount[f.msg_type];
+            RFD900_TRACE_INSTANT(traceEvent::EXPIRED, f.msg_type);
+            ticket_done(f.priority, f.ticket);
+            unlink_frame(index);
+        });
+
+        if(dropped > 0){
+            linkStats::add(link_stats().expired_drops, dropped);
+            update_queue_depth();
+        }
+        return dropped;
+    }
+
+
+    // asks the accountant and charges an admitted frame, false when refused
+    bool txScheduler::admit(txPriority priority, size_t length)
+    {
+        if(airtime == nullptr){
+            return true;
+        }
+        lastAdmission = airtime->admit_and_charge(priority, length);
+        return lastAdmission != airtimeAdmission::REJECT;
+    }
+
+
+    int txScheduler::enqueue_latest(txPriority priority, uint32_t key, const uint8_t* frame, size_t length)
+    {
+        lastAdmission = airtimeAdmission::ADMIT;
+        if(length > MAX_LATEST_FRAME_LENGTH){
+            fprintf(stderr, "error: %s, frame of %lu bytes exceeds slot length %lu\n", __func__, length, MAX_LATEST_FRAME_LENGTH);
+            return -1;
+        }
+
+        latest_slot_t* slot = nullptr;
+        latest_slot_t* free_slot = nullptr;
+        for(latest_slot_t& s : latestSlots){
+            if(s.in_use && s.key == key){
+                slot = &s;
+                break;
+            }
+            if(!s.in_use && free_slot == nullptr){
+                free_slot = &s;
+            }
+        }
+
+        if(slot == nullptr && free_slot == nullptr){
+            fprintf(stderr, "error: %s, all %lu latest value slots in use\n", __func__, MAX_LATEST_SLOTS);
+            return -1;
+        }
+
+        // replacing a waiting value adds no airtime, a refused first value does not take a slot
+        if((slot == nullptr || !slot->pending) && !admit(priority, length)){
+            return -1;
+        }
+
+        if(slot == nullptr){
+            slot = free_slot;
+            slot->in_use = true;
+            slot->pending = false;
+            slot->key = key;
+            slot->priority = static_cast<int>(priority);
+        }
+
+        if(slot->pending){
+            ++supersededCount;
+            linkStats::add(link_stats().superseded);
+        }
+        else{
+            queue_t& q = queues[slot->priority];
+            q.latest_ring[(q.latest_head + q.latest_count) % MAX_LATEST_SLOTS] = static_cast<uint8_t>(slot - latestSlots);
+            ++q.latest_count;
+            slot->pending = true;
+            slot->order = nextOrder++;
+        }
+
+        memcpy(slot->frame, frame, length);
+        slot->length = length;
+        RFD900_TRACE_INSTANT(traceEvent::TX_ENQUEUE, slot->priority);
+
+        update_queue_depth();
+        return 0;
+    }
+
+
+    size_t txScheduler::queued(txPriority priority) const
+    {
+        const queue_t& q = queues[static_cast<int>(priority)];
+        return q.frames_count + q.latest_count;
+    }
+
+
+    size_t txScheduler::queued() const
+    {
+        size_t total = 0;
+        for(int p = 0; p < NUM_TX_PRIORITIES; ++p){
+            total += queued(static_cast<txPriority>(p));
+        }
+        return total;
+    }
+
+
+    void txScheduler::drain_backlog(steady::time_point now)
+    {
+        if(airBytesPerSec == 0){
+            backlogBytes = 0.0;
+            return;
+        }
+
+        double elapsed = std::chrono::duration<double>(now - lastDrain).count();
+        backlogBytes -= elapsed * airBytesPerSec;
+        if(backlogBytes < 0.0){
+            backlogBytes = 0.0;
+        }
+        lastDrain = now;
+    }
+
+
+    int txScheduler::next_priority() const
+    {
+        if(currentPriority >= 0){
+            return currentPriority;
+        }
+
+        for(int p = 0; p < NUM_TX_PRIORITIES; ++p){
+            if(queues[p].frames_count > 0 || queues[p].latest_count > 0){
+                return p;
+            }
+        }
+        return -1;
+    }
+
+
+    // within a class frames with deadlines go first, the rest and latest slots in the order they were queued
+    bool txScheduler::next_is_latest(int priority) const
+    {
+        const queue_t& q = queues[priority];
+        if(q.latest_count == 0){
+            return false;
+        }
+        if(q.frames_count == 0){
+            return true;
+        }
+        const queued_frame_t& f = framePool[q.frames_head];
+        return f.deadline == steady::time_point::max() && latestSlots[q.latest_ring[q.latest_head]].order < f.order;
+    }
+
+
+    size_t txScheduler::next_length(int priority) const
+    {
+        if(priority == currentPriority){
+            return currentLength - currentOffset;
+        }
+        if(next_is_latest(priority)){
+            return latestSlots[queues[priority].latest_ring[queues[priority].latest_head]].length;
+        }
+        return framePool[queues[priority].frames_head].length;
+    }
+
+
+    void txScheduler::take_next(int priority)
+    {
+        queue_t& q = queues[priority];
+
+        if(next_is_latest(priority)){
+            latest_slot_t& slot = latestSlots[q.latest_ring[q.latest_head]];
+            q.latest_head = (q.latest_head + 1) % MAX_LATEST_SLOTS;
+            --q.latest_count;
+
+            memcpy(current, slot.frame, slot.length);
+            currentLength = slot.length;
+            slot.pending = false;
+            currentTicketed = false;
+        }
+        else{
+            uint32_t index = q.frames_head;
+            const queued_frame_t& f = framePool[index];
+            memcpy(current, f.frame, f.length);
+            currentLength = f.length;
+            currentTicket = f.ticket;
+            currentTicketed = true;
+            unlink_frame(index);
+        }
+
+        currentPriority = priority;
+        currentOffset = 0;
+    }
+
+
+    std::chrono::microseconds txScheduler::next_service_delay(rfd900Modem* modem)
+    {
+        int p = next_priority();
+        if(p < 0){
+            return std::chrono::microseconds::zero();
+        }
+
+        std::chrono::microseconds modem_delay = std::chrono::microseconds::zero();
+        if(modem != nullptr && modem->modem_model_enabled()){
+            size_t length = currentPriority >= 0 ? currentLength - currentOffset : next_length(p);
+            modem_delay = modem->tx_room_delay(length);
+        }
+
+        if(airBytesPerSec == 0){
+            return modem_delay;
+        }
+
+        drain_backlog(clock_now());
+
+        // an empty backlog always admits one frame, even one longer than maxBacklog
+        double excess = backlogBytes + next_length(p) - maxBacklog;
+        if(backlogBytes == 0.0 || excess <= 0.0){
+            return modem_delay;
+        }
+
+        auto pacing_delay = std::chrono::microseconds(static_cast<int64_t>(excess * 1e6 / airBytesPerSec) + 1);
+        return pacing_delay > modem_delay ? pacing_delay : modem_delay;
+    }
+
+
+    // the modem's own tx_room and write_serial, tx_room is unlimited when its model is off
+    class modemSink : public txSink{
+
+        public:
+
+        explicit modemSink(rfd900Modem& modem) : radio(modem)
+        {
+            // intentionally blank
+        }
+
+        size_t tx_room() override { return radio.tx_room(); }
+        ssize_t write_serial(const uint8_t* data, size_t length) override { return radio.write_serial(data, length); }
+
+
+        private:
+
+        rfd900Modem& radio;
+    };
+
+
+    size_t txScheduler::service(rfd900Modem& modem)
+    {
+        modemSink sink(modem);
+        return service(sink);
+    }
+
+
+    size_t txScheduler::service(txSink& modem)
+    {
+        RFD900_TRACE_SCOPE(trace, traceEvent::TX_SERVICE, 0);
+        size_t completed = 0;
+        int p;
+
+        expire_frames();
+
+        while((p = next_priority()) >= 0){
+
+            // pace before taking the frame, a latest value can still be replaced while it waits
+            if(airBytesPerSec != 0){
+                drain_backlog(clock_now());
+                if(backlogBytes > 0.0 && backlogBytes + next_length(p) > maxBacklog){
+                    break;
+                }
+            }
+
+            // a frame is started only when the modem buffer has room for all of it
+            size_t room = modem.tx_room();
+            if(currentPriority < 0 && room < next_length(p)){
+                break;
+            }
+
+            if(currentPriority < 0){
+                take_next(p);
+            }
+
+            size_t remaining = currentLength - currentOffset;
+            ssize_t written = modem.write_serial(current + currentOffset, remaining < room ? remaining : room);
+            if(written < 0){
+                if(errno != EAGAIN && errno != EWOULDBLOCK){
+                    fprintf(stderr, "error: %s, write: %s\n", __func__, strerror(errno));
+                }
+                break;
+            }
+
+            backlogBytes += written;
+            currentOffset += written;
+            if(static_cast<size_t>(written) < remaining){
+                break;                                  // port or modem full, finish this frame before any other
+            }
+
+            if(currentTicketed){
+                ticket_done(p, currentTicket);
+            }
+            currentPriority = -1;
+            ++completed;
+            linkStats::add(link_stats().frames_out);
+        }
+
+        update_queue_depth();
+        RFD900_TRACE_SET_ID(trace, completed);
+        return completed;
+    }
+
+
+    void txScheduler::update_queue_depth() const
+    {
+        linkStats::set(link_stats().tx_queue_depth, queued() + (currentPriority >= 0 ? 1 : 0));
+    }
+
+}
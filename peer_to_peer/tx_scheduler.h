@@ -0,0 +1,254 @@
+/**
+ * @brief Declares txScheduler, priority ordered and paced transmission of serialized frames
+ *
+ * Frames are queued in one FIFO per priority class and written to the modem
+ * highest class first:
+ *      CONTROL - ACKs, fragment status, time sync
+ *      HIGH    - artifact reports
+ *      NORMAL  - routine telemetry
+ *      BULK    - fragments of large transfers
+ *
+ * Strict priority alone is not enough. Once a frame is written it waits in the
+ * tty and modem buffers behind everything written before it, so writing a
+ * whole bulk transfer at once would delay the next ACK by seconds. With
+ * air_bytes_per_sec set the scheduler models the bytes still waiting to go on
+ * the air and only writes while that backlog is under max_backlog_bytes, so a
+ * CONTROL frame never waits behind more than about one backlog of bulk data.
+ *
+ * Latest value wins: streams where only the newest value matters, such as
+ * robot positions, use enqueue_latest with a key per robot and topic. Each key
+ * has one slot with inline storage. A new frame overwrites the waiting one in
+ * place, without allocating, and keeps its place in the class. Queue depth
+ * and the age of a transmitted value stay bounded however fast values arrive.
+ *
+ * When the modem's occupancy model is enabled (rfd900Modem::set_modem_model)
+ * service() also keeps within the modem's tx_room: a frame is only started
+ * when it fits in the modem buffer beside what the kernel and the modem
+ * already hold, so bytes are never written into a full buffer and lost.
+ *
+ * A frame is never interleaved with another: a partially written frame is
+ * finished before anything else is written, whatever its priority.
+ *
+ * Deadlines: a frame queued with a deadline goes out earliest deadline first
+ * within its class, ahead of frames and latest values without one, and is
+ * dropped unsent when the deadline passes rather than taking airtime from
+ * fresh data. Frames without a deadline keep their FIFO order. Expired frames
+ * leave the queue through an expiryWheel in O(1) each at the start of every
+ * service() and are counted per message type. A partly written frame is
+ * always finished.
+ *
+ * Admission: with an airtimeAccountant set, enqueue and enqueue_latest refuse
+ * frames the accountant rejects and charge the airtime of the others, so low
+ * priority traffic is turned away before the channel saturates rather than
+ * queueing behind it. A latest value replacing a waiting one costs nothing.
+ * last_admission() returns the accountant's answer for the last frame
+ * offered, so a caller told DEGRADE can thin its stream. A frame refused for
+ * another reason (too long, no free slot) is never charged.
+ *
+ * service() writes to an rfd900Modem, or to any txSink: the network
+ * simulator's radio model is one, so simulated nodes run this scheduler.
+ *
+ * Queued frames are copied into a pool of max_queued_frames slots of
+ * MAX_FRAME_LENGTH bytes allocated by the constructor. The pool grows when it
+ * runs out, except in the RFD900_EMBEDDED build where enqueue fails instead,
+ * so the scheduler never allocates after construction.
+ *
+ */
+
+#ifndef TX_SCHEDULER_INCLUDED_H
+#define TX_SCHEDULER_INCLUDED_H
+
+#include <chrono>
+#include <cstdint>
+#include <vector>
+
+#include "expiry_wheel.h"
+#include "rfd900_modem.h"
+
+
+namespace rfd900comm{
+
+    enum class txPriority{
+        CONTROL = 0,
+        HIGH,
+        NORMAL,
+        BULK
+    };
+
+    constexpr int NUM_TX_PRIORITIES = 4;
+
+
+    class airtimeAccountant;
+    enum class airtimeAdmission;
+
+
+    // a radio service() can write to other than rfd900Modem
+    class txSink{
+
+        public:
+
+        virtual ~txSink() = default;
+
+        // bytes the radio accepts now
+        virtual size_t tx_room() = 0;
+
+        // single nonblocking write, returns the bytes accepted, or -1 with errno EAGAIN when it accepts none
+        virtual ssize_t write_serial(const uint8_t* data, size_t length) = 0;
+    };
+
+
+    class txScheduler{
+
+        public:
+
+        static constexpr size_t DEFAULT_MAX_BACKLOG = 256;
+        static constexpr size_t MAX_LATEST_SLOTS = 64;
+        static constexpr size_t MAX_LATEST_FRAME_LENGTH = 128;
+        static constexpr size_t MAX_FRAME_LENGTH = 256;
+        static constexpr size_t DEFAULT_MAX_QUEUED_FRAMES = 256;
+        static constexpr auto EXPIRY_TICK = std::chrono::milliseconds(10);
+
+        // air_bytes_per_sec of zero disables pacing, service() writes every queued frame
+        explicit txScheduler(size_t air_bytes_per_sec = 0, size_t max_backlog_bytes = DEFAULT_MAX_BACKLOG,
+                    size_t max_queued_frames = DEFAULT_MAX_QUEUED_FRAMES);
+
+        // disable copy constructor
+        txScheduler(const txScheduler&) = delete;
+
+        // disable assignment
+        txScheduler& operator=(const txScheduler&) = delete;
+
+        // copies the frame, returns a ticket for sent(), 0 when the frame is too long, the pool is full or admission refuses it
+        uint64_t enqueue(txPriority priority, const uint8_t* frame, size_t length);
+
+        // as enqueue, sent earliest deadline first within the class and dropped once the deadline passes
+        uint64_t enqueue(txPriority priority, const uint8_t* frame, size_t length,
+                    std::chrono::steady_clock::time_point deadline, uint8_t msg_type = 0);
+
+        // true once the frame with this ticket, and every frame of the class queued before it, has been written or dropped
+        bool sent(txPriority priority, uint64_t ticket) const;
+
+        // drops queued frames whose deadlines have passed, returns the number dropped, service() calls it
+        size_t expire_frames();
+        uint64_t expired(uint8_t msg_type) const { return expiredCount[msg_type]; }
+
+        /**
+         * Copies the frame into the slot for key, replacing a frame still waiting there.
+         * The first use of a key takes a free slot, a key stays in its priority class.
+         * returns 0, or -1 when the frame is too long, all slots are in use or admission refuses it
+         */
+        int enqueue_latest(txPriority priority, uint32_t key, const uint8_t* frame, size_t length);
+
+        static uint32_t latest_key(uint8_t node_id, uint8_t topic) { return (uint32_t(node_id) << 8) | topic; }
+
+        // writes queued frames in priority order while the backlog allows, returns frames completed
+        size_t service(rfd900Modem& modem);
+        size_t service(txSink& sink);
+
+        // time until service() can write the next frame, zero when it can write now or nothing is queued
+        std::chrono::microseconds next_service_delay(rfd900Modem* modem = nullptr);
+
+        size_t queued(txPriority priority) const;
+        size_t queued() const;
+
+        // true while a frame is queued or partly written
+        bool pending() const { return next_priority() >= 0; }
+
+        // latest value frames overwritten before they were written
+        uint64_t superseded() const { return supersededCount; }
+
+        void set_air_rate(size_t air_bytes_per_sec) { airBytesPerSec = air_bytes_per_sec; }
+        size_t air_rate() const { return airBytesPerSec; }
+
+        // bytes written ahead of the air, smaller on a poor link
+        void set_max_backlog(size_t max_backlog_bytes) { maxBacklog = max_backlog_bytes; }
+
+        // frames are admitted and charged by accountant, nullptr admits every frame
+        void set_airtime_accountant(airtimeAccountant* accountant) { airtime = accountant; }
+
+        // the accountant's answer for the last enqueue, ADMIT without an accountant or before admission was asked
+        airtimeAdmission last_admission() const { return lastAdmission; }
+
+
+        private:
+
+        using steady = std::chrono::steady_clock;
+
+        static constexpr uint32_t NO_FRAME = UINT32_MAX;
+
+        struct queued_frame_t{
+            uint64_t order;                     // enqueue order across frames and slots
+            uint64_t ticket;
+            steady::time_point deadline;        // max() for none
+            uint32_t prev;
+            uint32_t next;                      // next frame in the class, or on the free list
+            uint8_t msg_type;
+            int priority;
+            size_t length;
+            uint8_t frame[MAX_FRAME_LENGTH];
+        };
+
+        struct latest_slot_t{
+            bool in_use;
+            bool pending;                       // holds a frame not yet written
+            uint32_t key;
+            int priority;
+            uint64_t order;                     // when the slot became pending
+            size_t length;
+            uint8_t frame[MAX_LATEST_FRAME_LENGTH];
+        };
+
+        struct queue_t{
+            uint32_t frames_head;               // queued frames by deadline, then enqueue order
+            uint32_t frames_tail;
+            size_t frames_count;
+            uint64_t enqueued;                  // tickets issued
+            mutable uint64_t oldest;            // oldest ticket not yet written or dropped, UINT64_MAX for none
+            mutable bool oldest_stale;
+
+            // pending latest slots in the order they became pending
+            uint8_t latest_ring[MAX_LATEST_SLOTS];
+            size_t latest_head;
+            size_t latest_count;
+        };
+
+        queue_t queues[NUM_TX_PRIORITIES];
+        latest_slot_t latestSlots[MAX_LATEST_SLOTS];
+        std::vector<queued_frame_t> framePool;
+        uint32_t freeFrame;
+        uint64_t nextOrder;
+        uint64_t supersededCount;
+
+        expiryWheel frameExpiry;                // frames with deadlines, by pool index
+        uint64_t expiredCount[UINT8_MAX + 1];
+
+        // frame being written, taken off its queue when the first byte is written
+        uint8_t current[MAX_FRAME_LENGTH];
+        size_t currentLength;
+        size_t currentOffset;
+        int currentPriority;
+        bool currentTicketed;
+        uint64_t currentTicket;
+
+        size_t airBytesPerSec;
+        size_t maxBacklog;
+        double backlogBytes;                    // written but, by the model, not yet on the air
+        airtimeAccountant* airtime;
+        airtimeAdmission lastAdmission;
+        steady::time_point lastDrain;
+
+        void drain_backlog(steady::time_point now);
+        int next_priority() const;
+        bool next_is_latest(int priority) const;
+        size_t next_length(int priority) const;
+        void take_next(int priority);
+        void unlink_frame(uint32_t index);
+        void ticket_done(int priority, uint64_t ticket);
+        void update_queue_depth() const;
+        bool admit(txPriority priority, size_t length);
+    };
+
+}
+
+
+#endif
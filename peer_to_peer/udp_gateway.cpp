@@ -0,0 +1,388 @@
+/**
+ * @brief udpGateway class function definitions.
+ *
+ */
+
+#include <arpa/inet.h>                  // htons, htonl
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>                     // ppoll
+#include <stdio.h>
+#include <string.h>                     // strerror, memcpy
+#include <unistd.h>
+
+#include "udp_gateway.h"
+#include "simulation_constants.h"
+#include "sim_artifact_message.h"
+
+namespace rfd900comm{
+
+    using rfd900sim::SimConstants;
+
+    constexpr size_t SERIAL_RX_BUFFER_LENGTH = 256;
+    constexpr size_t FRAME_START = 3;                           // start indicator length
+    constexpr size_t FRAME_END = 3;                             // end indicator length
+
+    static const uint8_t gateway_nodes[] = {
+        SimConstants::GROUND01, SimConstants::AERIAL01, SimConstants::AERIAL02,
+        SimConstants::ANCHOR_STATION, SimConstants::BASE_STATION, SimConstants::BROADCAST
+    };
+
+
+    udpGateway::udpGateway(rfd900Modem& modem) :
+        radio(modem), opened(false), txCount(0), txPort(nullptr)
+    {
+        rfd900sim::reserve_rx_storage(rxStorage, extracted);
+        memset(&stats, 0, sizeof(stats));
+
+        for(size_t i = 0; i < GATEWAY_BATCH; ++i){
+            rxIov[i].iov_base = rxBuffers[i];
+            rxIov[i].iov_len = sizeof(rxBuffers[i]);
+            memset(&rxMsgs[i], 0, sizeof(rxMsgs[i]));
+            rxMsgs[i].msg_hdr.msg_iov = &rxIov[i];
+            rxMsgs[i].msg_hdr.msg_iovlen = 1;
+            rxMsgs[i].msg_hdr.msg_name = &rxAddr[i];
+
+            txIov[i].iov_base = txBuffers[i];
+            memset(&txMsgs[i], 0, sizeof(txMsgs[i]));
+            txMsgs[i].msg_hdr.msg_iov = &txIov[i];
+            txMsgs[i].msg_hdr.msg_iovlen = 1;
+            txMsgs[i].msg_hdr.msg_name = &txAddr[i];
+            txMsgs[i].msg_hdr.msg_namelen = sizeof(txAddr[i]);
+        }
+    }
+
+    udpGateway::~udpGateway()
+    {
+        close();
+    }
+
+
+    int udpGateway::open(const udpGatewayConfig& config)
+    {
+        close();
+
+        cfg = config;
+        scheduler.set_air_rate(cfg.air_bytes_per_sec);
+        ports.reserve(sizeof(gateway_nodes));
+
+        for(uint8_t node : gateway_nodes){
+            if(node == cfg.my_id){
+                continue;
+            }
+
+            ports.emplace_back();
+            node_port_t& port = ports.back();
+            port.node_id = node;
+            port.have_peer = false;
+            port.frame_length = 0;
+            port.records = 0;
+
+            port.fd = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+            if(port.fd < 0){
+                fprintf(stderr, "error, %s, socket: %s\n", __func__, strerror(errno));
+                close();
+                return -1;
+            }
+
+            struct sockaddr_in addr;
+            memset(&addr, 0, sizeof(addr));
+            addr.sin_family = AF_INET;
+            addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+            addr.sin_port = htons(cfg.base_port + node);
+            if(bind(port.fd, (struct sockaddr*)&addr, sizeof(addr)) != 0){
+                fprintf(stderr, "error, %s, bind port %u: %s\n", __func__, cfg.base_port + node, strerror(errno));
+                close();
+                return -1;
+            }
+        }
+
+        opened = true;
+        return 0;
+    }
+
+
+    void udpGateway::close()
+    {
+        for(node_port_t& port : ports){
+            if(port.fd >= 0){
+                ::close(port.fd);
+            }
+        }
+        ports.clear();
+        txCount = 0;
+        txPort = nullptr;
+        opened = false;
+    }
+
+
+    int udpGateway::service(long timeout_us)
+    {
+        struct pollfd pfds[1 + sizeof(gateway_nodes)];
+
+        if(!opened){
+            fprintf(stderr, "error, %s, gateway not open\n", __func__);
+            return -1;
+        }
+
+        // open frames go as soon as the radio has nothing left to write
+        scheduler.service(radio);
+        if(!scheduler.pending()){
+            for(node_port_t& port : ports){
+                flush_frame(&port);
+            }
+            scheduler.service(radio);
+        }
+
+        bool pending = scheduler.pending();
+        long wait_us = timeout_us;
+        if(pending){
+            long delay = static_cast<long>(scheduler.next_service_delay(&radio).count());
+            wait_us = delay < wait_us ? delay : wait_us;
+        }
+
+        // the sockets are left unread while enough frames wait for the radio
+        bool room = scheduler.queued() < cfg.max_queued_frames;
+
+        pfds[0].fd = radio.get_fd();
+        pfds[0].events = POLLIN | (pending && wait_us == 0 ? POLLOUT : 0);
+        pfds[0].revents = 0;
+        for(size_t i = 0; i < ports.size(); ++i){
+            pfds[1 + i].fd = ports[i].fd;
+            pfds[1 + i].events = room ? POLLIN : 0;
+            pfds[1 + i].revents = 0;
+        }
+
+        long poll_us = pending && wait_us == 0 ? timeout_us : wait_us;
+        struct timespec ts;
+        ts.tv_sec = poll_us / 1000000L;
+        ts.tv_nsec = (poll_us % 1000000L) * 1000L;
+
+        int rv = ppoll(pfds, 1 + ports.size(), &ts, nullptr);
+        if(rv < 0){
+            if(errno == EINTR){
+                return 0;
+            }
+            fprintf(stderr, "error, %s, ppoll: %s\n", __func__, strerror(errno));
+            return -1;
+        }
+
+        if(pfds[0].revents & POLLIN){
+            receive();
+        }
+
+        for(size_t i = 0; i < ports.size(); ++i){
+            if(pfds[1 + i].revents & POLLIN){
+                read_port(&ports[i]);
+            }
+        }
+
+        scheduler.service(radio);
+        return 0;
+    }
+
+
+    udpGateway::node_port_t* udpGateway::port_for(uint8_t node_id)
+    {
+        for(node_port_t& port : ports){
+            if(port.node_id == node_id){
+                return &port;
+            }
+        }
+        return nullptr;
+    }
+
+
+    void udpGateway::read_port(node_port_t* port)
+    {
+        int n;
+
+        do{
+            for(size_t i = 0; i < GATEWAY_BATCH; ++i){
+                rxMsgs[i].msg_hdr.msg_namelen = sizeof(rxAddr[i]);
+            }
+
+            n = recvmmsg(port->fd, rxMsgs, GATEWAY_BATCH, MSG_DONTWAIT, nullptr);
+            if(n <= 0){
+                return;
+            }
+            ++stats.recvmmsg_calls;
+
+            for(int i = 0; i < n; ++i){
+                ++stats.datagrams_in;
+
+                if(cfg.deliver_base_port == 0){
+                    port->peer = rxAddr[i];
+                    port->have_peer = true;
+                }
+
+                // the buffer is one byte longer than the longest datagram that fits a frame
+                if(rxMsgs[i].msg_len > GATEWAY_MAX_DATAGRAM_LENGTH || (rxMsgs[i].msg_hdr.msg_flags & MSG_TRUNC)){
+                    ++stats.dropped_too_long;
+                    continue;
+                }
+
+                add_record(port, rxBuffers[i], rxMsgs[i].msg_len);
+            }
+
+        }while(n == static_cast<int>(GATEWAY_BATCH) && scheduler.queued() < cfg.max_queued_frames);
+    }
+
+
+    void udpGateway::start_frame(node_port_t* port)
+    {
+        memcpy(port->frame, SimConstants::MESSAGE_900_START_INDICATOR, FRAME_START);
+        port->frame[FRAME_START] = port->node_id;
+        port->frame[FRAME_START + 1] = cfg.my_id;
+        port->frame[FRAME_START + 2] = SimConstants::DATAGRAM;
+        port->frame[FRAME_START + 3] = 0;
+        port->frame_length = FRAME_START + GATEWAY_HEADER_LENGTH;
+        port->records = 0;
+    }
+
+
+    void udpGateway::add_record(node_port_t* port, const uint8_t* data, size_t length)
+    {
+        // the record goes in the open frame when it fits and keeps the frame clean, else in a frame of its own
+        for(int attempt = 0; attempt < 2; ++attempt){
+            if(port->records > 0 && (port->frame_length + 1 + length + FRAME_END > GATEWAY_FRAME_LENGTH
+                        || port->records == UINT8_MAX)){
+                flush_frame(port);
+            }
+            if(port->records == 0){
+                start_frame(port);
+            }
+
+            size_t record_end = port->frame_length + 1 + length;
+            port->frame[port->frame_length] = static_cast<uint8_t>(length);
+            memcpy(port->frame + port->frame_length + 1, data, length);
+            memcpy(port->frame + record_end, SimConstants::MESSAGE_900_END_INDICATOR, FRAME_END);
+
+            if(rfd900sim::frame_is_clean(port->frame, record_end + FRAME_END)){
+                port->frame_length = record_end;
+                ++port->records;
+                stats.payload_bytes_out += length;
+                if(!cfg.aggregate){
+                    flush_frame(port);
+                }
+                return;
+            }
+
+            if(port->records == 0){
+                break;
+            }
+            flush_frame(port);
+        }
+
+        ++stats.dropped_unframeable;
+    }
+
+
+    void udpGateway::flush_frame(node_port_t* port)
+    {
+        if(port->records == 0){
+            return;
+        }
+
+        port->frame[FRAME_START + 3] = port->records;
+        memcpy(port->frame + port->frame_length, SimConstants::MESSAGE_900_END_INDICATOR, FRAME_END);
+        size_t length = port->frame_length + FRAME_END;
+
+        if(scheduler.enqueue(txPriority::NORMAL, port->frame, length) != 0){
+            ++stats.frames_out;
+            stats.radio_bytes_out += length;
+        }
+        port->records = 0;
+        port->frame_length = 0;
+    }
+
+
+    void udpGateway::receive()
+    {
+        uint8_t serial_rx_buffer[SERIAL_RX_BUFFER_LENGTH];
+        ssize_t bytesRead;
+
+        while((bytesRead = radio.read_serial(serial_rx_buffer, SERIAL_RX_BUFFER_LENGTH, 0L)) > 0){
+            rfd900sim::append_rx_data(rxStorage, serial_rx_buffer, bytesRead);
+            while(rfd900sim::extract_rx_message(rxStorage, extracted)){
+                unpack(extracted);
+            }
+        }
+
+        send_datagrams();
+    }
+
+
+    void udpGateway::unpack(const std::string& message)
+    {
+        const uint8_t* m = (const uint8_t*)message.data();
+        size_t length = message.length();
+
+        if(length < GATEWAY_HEADER_LENGTH || m[2] != SimConstants::DATAGRAM
+                || (m[0] != cfg.my_id && m[0] != SimConstants::BROADCAST)){
+            return;
+        }
+
+        node_port_t* port = port_for(m[1]);
+        if(port == nullptr){
+            return;
+        }
+        ++stats.frames_in;
+
+        size_t pos = GATEWAY_HEADER_LENGTH;
+        for(uint8_t r = 0; r < m[3] && pos < length; ++r){
+            size_t record_length = m[pos];
+            if(pos + 1 + record_length > length){
+                fprintf(stderr, "error, %s, record overruns the frame from node %hhu\n", __func__, m[1]);
+                return;
+            }
+            queue_datagram(port, m + pos + 1, record_length);
+            pos += 1 + record_length;
+        }
+    }
+
+
+    void udpGateway::queue_datagram(node_port_t* port, const uint8_t* data, size_t length)
+    {
+        if(port != txPort || txCount == GATEWAY_BATCH){
+            send_datagrams();
+            txPort = port;
+        }
+
+        struct sockaddr_in* addr = &txAddr[txCount];
+        if(cfg.deliver_base_port != 0){
+            memset(addr, 0, sizeof(*addr));
+            addr->sin_family = AF_INET;
+            addr->sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+            addr->sin_port = htons(cfg.deliver_base_port + port->node_id);
+        }
+        else if(port->have_peer){
+            *addr = port->peer;
+        }
+        else{
+            ++stats.dropped_no_peer;
+            return;
+        }
+
+        memcpy(txBuffers[txCount], data, length);
+        txIov[txCount].iov_len = length;
+        ++txCount;
+    }
+
+
+    void udpGateway::send_datagrams()
+    {
+        if(txCount == 0){
+            return;
+        }
+
+        // a tool that is not reading loses datagrams, as it would on any UDP path
+        int n = sendmmsg(txPort->fd, txMsgs, txCount, MSG_DONTWAIT);
+        ++stats.sendmmsg_calls;
+        if(n > 0){
+            stats.datagrams_out += n;
+        }
+        txCount = 0;
+    }
+
+}
@@ -0,0 +1,155 @@
+/**
+ * @brief Declares udpGateway, the radio link as localhost UDP endpoints
+ *
+ * Tools that do not link librfd900 send and receive over the radio with
+ * plain UDP. The gateway binds one localhost port per radio node,
+ * base_port + node id (SimConstants ids, BROADCAST included):
+ *
+ *      a datagram sent to base_port + n goes over the radio to node n
+ *      a datagram received over the radio from node n leaves from
+ *      base_port + n, to the address that last sent to that port, or to
+ *      deliver_base_port + n when it is set
+ *
+ * Datagrams are read in batches with recvmmsg. Datagrams for the same node
+ * are packed into one DATAGRAM frame, records of a length byte and the
+ * datagram, as long as the frame is open:
+ *
+ *      a frame is handed to the txScheduler when it is full, or as soon as
+ *      the scheduler has nothing left to write
+ *
+ * so an idle radio sends a datagram at once and a busy radio sends frames
+ * as full as the datagrams allow. While max_queued_frames are waiting the
+ * gateway stops reading the sockets, the kernel's socket buffers take the
+ * excess and drop what does not fit, as UDP does.
+ *
+ * Received frames are unpacked and the datagrams sent with one sendmmsg
+ * per port and batch.
+ *
+ * The frame format has no escaping. A datagram that would put a frame
+ * indicator inside the frame is sent in a frame of its own, and dropped
+ * when it contains one itself. Datagrams longer than
+ * GATEWAY_MAX_DATAGRAM_LENGTH are dropped.
+ *
+ */
+
+#ifndef UDP_GATEWAY_INCLUDED_H
+#define UDP_GATEWAY_INCLUDED_H
+
+#include <netinet/in.h>                 // sockaddr_in
+#include <sys/socket.h>                 // mmsghdr
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "rfd900_modem.h"
+#include "tx_scheduler.h"
+
+
+namespace rfd900comm{
+
+    constexpr size_t GATEWAY_FRAME_LENGTH = txScheduler::MAX_FRAME_LENGTH;
+    constexpr size_t GATEWAY_HEADER_LENGTH = 4;                 // dest_id, src_id, msg_type, record count
+    constexpr size_t GATEWAY_MAX_DATAGRAM_LENGTH = GATEWAY_FRAME_LENGTH - 6 - GATEWAY_HEADER_LENGTH - 1;
+    constexpr size_t GATEWAY_BATCH = 32;                        // datagrams per recvmmsg and sendmmsg
+
+
+    struct udpGatewayConfig{
+        uint8_t my_id;
+        uint16_t base_port = 14900;
+        uint16_t deliver_base_port = 0;                         // zero delivers to the last sender only
+        size_t air_bytes_per_sec = 0;                           // paces the scheduler, zero writes at once
+        size_t max_queued_frames = 16;
+        bool aggregate = true;                                  // false sends one datagram per frame
+    };
+
+
+    struct udpGatewayStats{
+        uint64_t datagrams_in;                                  // from the UDP ports
+        uint64_t datagrams_out;                                 // to the UDP ports
+        uint64_t frames_out;                                    // to the radio
+        uint64_t frames_in;                                     // from the radio, DATAGRAM frames for this node
+        uint64_t payload_bytes_out;
+        uint64_t radio_bytes_out;
+        uint64_t recvmmsg_calls;
+        uint64_t sendmmsg_calls;
+        uint64_t dropped_too_long;
+        uint64_t dropped_unframeable;
+        uint64_t dropped_no_peer;                               // received before any tool used the port
+    };
+
+
+    class udpGateway{
+
+        public:
+
+        explicit udpGateway(rfd900Modem& modem);
+        ~udpGateway();
+
+        // disable copy constructor
+        udpGateway(const udpGateway&) = delete;
+
+        // disable assignment
+        udpGateway& operator=(const udpGateway&) = delete;
+
+        // binds the ports of every node but my_id
+        int open(const udpGatewayConfig& config);
+
+        // waits up to timeout_us for datagrams and radio bytes and moves them, -1 on error
+        int service(long timeout_us);
+
+        void close();
+
+        udpGatewayStats get_stats() const { return stats; }
+
+
+        private:
+
+        struct node_port_t{
+            uint8_t node_id;
+            int fd;
+            bool have_peer;
+            struct sockaddr_in peer;            // where datagrams from node_id are delivered
+
+            // the open DATAGRAM frame for node_id, framed in place
+            uint8_t frame[GATEWAY_FRAME_LENGTH];
+            size_t frame_length;                // start indicator, header and records so far
+            uint8_t records;
+        };
+
+        rfd900Modem& radio;
+        udpGatewayConfig cfg;
+        txScheduler scheduler;
+        std::vector<node_port_t> ports;
+        bool opened;
+
+        std::string rxStorage;
+        std::string extracted;
+        udpGatewayStats stats;
+
+        // recvmmsg and sendmmsg buffers
+        struct mmsghdr rxMsgs[GATEWAY_BATCH];
+        struct iovec rxIov[GATEWAY_BATCH];
+        struct sockaddr_in rxAddr[GATEWAY_BATCH];
+        uint8_t rxBuffers[GATEWAY_BATCH][GATEWAY_MAX_DATAGRAM_LENGTH + 1];
+        struct mmsghdr txMsgs[GATEWAY_BATCH];
+        struct iovec txIov[GATEWAY_BATCH];
+        struct sockaddr_in txAddr[GATEWAY_BATCH];
+        uint8_t txBuffers[GATEWAY_BATCH][GATEWAY_MAX_DATAGRAM_LENGTH];
+        size_t txCount;
+        node_port_t* txPort;                    // the port the batch leaves from
+
+        node_port_t* port_for(uint8_t node_id);
+        void read_port(node_port_t* port);
+        void add_record(node_port_t* port, const uint8_t* data, size_t length);
+        void start_frame(node_port_t* port);
+        void flush_frame(node_port_t* port);
+        void receive();
+        void unpack(const std::string& message);
+        void queue_datagram(node_port_t* port, const uint8_t* data, size_t length);
+        void send_datagrams();
+    };
+
+}
+
+
+#endif
@@ -0,0 +1,103 @@
+/**
+ * Purpose:
+ *  UDP gateway. Owns the rfd900x serial port and carries localhost UDP
+ *  datagrams over the radio, port base_port + node id for each SimConstants
+ *  node (see udp_gateway.h). Runs until interrupted.
+ *
+ * Optional Command line arguments
+ *  argv[1] - serial device path, default auto, found by port discovery
+ *  argv[2] - this node's id, default BASE_STATION
+ *  argv[3] - base UDP port
+ *  argv[4] - delivery base port, 0 delivers to the last sender on each port
+ *  argv[5] - air rate for pacing, bytes/s
+ *  argv[6] - baud rate
+ *
+ */
+
+#include <errno.h>
+#include <signal.h>
+#include <cstdio>
+#include <cstdlib>                  // atoi
+#include <cstring>                  // memset, strerror, strcmp
+
+#include "modem_discovery.h"
+#include "rfd900_modem.h"
+#include "simulation_constants.h"
+#include "udp_gateway.h"
+
+
+static volatile sig_atomic_t exitRequest = 0;
+
+
+static void signal_handler_term(int sig)
+{
+    if(sig == SIGINT || sig == SIGTERM){
+        exitRequest = 1;
+    }
+}
+
+
+int main(int argc, char **argv)
+{
+    const char* serialDevicePath = nullptr;
+    int baudRate = rfd900comm::rfd900Modem::DEFAULT_BAUD_RATE;
+    rfd900comm::udpGatewayConfig config;
+    config.my_id = rfd900sim::SimConstants::BASE_STATION;
+    config.air_bytes_per_sec = 64000 / 8;
+
+    if(argc > 1 && strcmp(argv[1], "auto") != 0){
+        serialDevicePath = argv[1];
+    }
+    if(argc > 2){
+        config.my_id = atoi(argv[2]);
+    }
+    if(argc > 3){
+        config.base_port = atoi(argv[3]);
+    }
+    if(argc > 4){
+        config.deliver_base_port = atoi(argv[4]);
+    }
+    if(argc > 5){
+        config.air_bytes_per_sec = atoi(argv[5]);
+    }
+    if(argc > 6){
+        baudRate = atoi(argv[6]);
+    }
+
+    rfd900comm::rfd900Modem radio;
+    if(rfd900comm::open_radio(radio, serialDevicePath, baudRate) != 0){
+        fprintf(stderr, "error, %s radio init failure, serialDevicePath: %s\n", __func__,
+                    serialDevicePath != nullptr ? serialDevicePath : "auto");
+        return 1;
+    }
+
+    rfd900comm::udpGateway gateway(radio);
+    if(gateway.open(config) != 0){
+        return 1;
+    }
+
+    struct sigaction saterm;
+    memset(&saterm, 0, sizeof(saterm));
+    saterm.sa_handler = signal_handler_term;
+    if(sigaction(SIGINT, &saterm, NULL) < 0 || sigaction(SIGTERM, &saterm, NULL) < 0){
+        fprintf(stderr, "sigaction saterm, errno: %s", strerror(errno));
+        return 1;
+    }
+
+    fprintf(stdout, "udpgateway, node %u on %s, udp ports %u + node id\n", config.my_id, radio.get_device_path(), config.base_port);
+
+    while(exitRequest == 0){
+        if(gateway.service(100000L) != 0){
+            break;
+        }
+    }
+
+    rfd900comm::udpGatewayStats stats = gateway.get_stats();
+    fprintf(stdout, "datagrams in: %lu, out: %lu, frames out: %lu, in: %lu\n",
+                stats.datagrams_in, stats.datagrams_out, stats.frames_out, stats.frames_in);
+    fprintf(stdout, "dropped, too long: %lu, unframeable: %lu, no peer: %lu\n",
+                stats.dropped_too_long, stats.dropped_unframeable, stats.dropped_no_peer);
+
+    gateway.close();
+    return 0;
+}
@@ -0,0 +1,19 @@
+/**
+ * @brief Virtual clock selection function definitions.
+ *
+ */
+
+#include "virtual_clock.h"
+
+namespace rfd900comm{
+
+    thread_local const std::chrono::steady_clock::time_point* threadVirtualNow
+                __attribute__((tls_model("initial-exec"))) = nullptr;
+
+
+    void set_virtual_clock(const std::chrono::steady_clock::time_point* now)
+    {
+        threadVirtualNow = now;
+    }
+
+}
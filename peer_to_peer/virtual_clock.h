@@ -0,0 +1,49 @@
+/**
+ * @brief Declares the clock the library reads, replaceable by a virtual clock
+ *
+ * Every timing decision of the stack, retransmission deadlines, RTT samples,
+ * pacing, reassembly timeouts, message timestamps, reads clock_now() or
+ * clock_epoch_ns() rather than a std::chrono clock directly. Normally they
+ * are steady_clock and the system clock.
+ *
+ * A discrete event simulator (see net_simulator.h) points the calling
+ * thread at its own time with set_virtual_clock, and the stacks it runs on
+ * that thread then see virtual time: an hour of traffic runs as fast as the
+ * events can be processed. Other threads keep the real clocks. On a virtual
+ * clock clock_epoch_ns counts from the virtual clock's zero.
+ *
+ */
+
+#ifndef VIRTUAL_CLOCK_INCLUDED_H
+#define VIRTUAL_CLOCK_INCLUDED_H
+
+#include <chrono>
+#include <cstdint>
+
+
+namespace rfd900comm{
+
+    extern thread_local const std::chrono::steady_clock::time_point* threadVirtualNow
+                __attribute__((tls_model("initial-exec")));
+
+    // now points at the simulator's current time, nullptr restores the real clocks
+    void set_virtual_clock(const std::chrono::steady_clock::time_point* now);
+
+    inline std::chrono::steady_clock::time_point clock_now()
+    {
+        const std::chrono::steady_clock::time_point* now = threadVirtualNow;
+        return now == nullptr ? std::chrono::steady_clock::now() : *now;
+    }
+
+    // nanoseconds since the epoch, for message timestamps
+    inline uint64_t clock_epoch_ns()
+    {
+        const std::chrono::steady_clock::time_point* now = threadVirtualNow;
+        auto since = now == nullptr ? std::chrono::high_resolution_clock::now().time_since_epoch() : now->time_since_epoch();
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(since).count();
+    }
+
+}
+
+
+#endif
@@ -0,0 +1,177 @@
+/**
+ * Purpose:
+ *  Measure acknowledged throughput against the message900 send window size
+ *  at several round trip times.
+ *
+ *  Two radios are connected through a linkEmulator. The sender transmits
+ *  artifact messages whenever the send window to the base station is open
+ *  (backpressure, a message waits while it is closed) and runs message900
+ *  retransmission scans, the receiver acknowledges every artifact.
+ *
+ *  A window of 1 is stop-and-wait, one message per round trip. Throughput
+ *  grows with the window until the radio channel is full.
+ *
+ *  msg_id keeps counting across the runs and wraps through 65535.
+ *
+ * Optional Command line arguments
+ *  argv[1] - seconds per run
+ *  argv[2] - loss probability per chunk
+ *
+ */
+
+#include <atomic>
+#include <chrono>
+#include <cstdlib>                  // atoi, atof
+#include <cstring>                  // memcpy
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "ack_responder.h"
+#include "link_emulator.h"
+#include "message900.h"
+#include "rfd900_modem.h"
+#include "simulation_constants.h"
+#include "sim_artifact_message.h"
+
+
+using rfd900sim::SimConstants;
+using steady = std::chrono::steady_clock;
+
+constexpr size_t SERIAL_RX_BUFFER_LENGTH = 256;
+
+const int round_trip_ms[] = {20, 100, 300};
+const size_t window_frames[] = {1, 2, 4, 8, 16, 32, 64};
+
+static std::atomic<bool> receiverRunning;
+
+
+// returns acknowledged messages per second, -1 on failure
+static double run_window(const rfd900comm::linkEmulatorConfig& config, size_t frames, int seconds,
+            size_t* retransmissions, size_t* stalls)
+{
+    const size_t SERIAL_ARTIFACT_BUFFER_LENGTH = sizeof(rfd900sim::artifact_message_t)
+                        + SimConstants::MESSAGE_900_START_INDICATOR_LENGTH
+                        + SimConstants::MESSAGE_900_END_INDICATOR_LENGTH;
+
+    rfd900comm::linkEmulator emulator;
+    rfd900comm::rfd900Modem tx_radio;
+    rfd900comm::rfd900Modem rx_radio;
+    rfd900comm::message900 msg900;
+
+    std::vector<uint8_t> serial_tx_buffer(SERIAL_ARTIFACT_BUFFER_LENGTH);
+    uint8_t serial_rx_buffer[SERIAL_RX_BUFFER_LENGTH];
+    std::string temp_rx_storage;
+    std::string extracted_rx_data;
+
+    msg900.set_send_window(frames, frames * SERIAL_ARTIFACT_BUFFER_LENGTH);
+
+    if(emulator.start(config) != 0){
+        return -1;
+    }
+
+    if(tx_radio.init(emulator.port_name(0)) != 0 || rx_radio.init(emulator.port_name(1)) != 0){
+        fprintf(stderr, "error, %s radio init failure\n", __func__);
+        return -1;
+    }
+
+    receiverRunning = true;
+    std::thread rx_thread(rfd900comm::ack_responder, &rx_radio, &receiverRunning);
+
+    auto retransmit = [&](const rfd900comm::message900_t& msg){
+        tx_radio.send_message((const char*)msg.data, msg.data_length);
+    };
+
+    rfd900sim::artifact_message_t artmsg;
+    bool held = false;                          // artmsg waits for the window
+    size_t acked = 0;
+    *retransmissions = 0;
+    *stalls = 0;
+
+    auto start = steady::now();
+    auto end = start + std::chrono::seconds(seconds);
+
+    while(steady::now() < end){
+
+        if(!held){
+            rfd900sim::simulate_artifact_message(&artmsg, SimConstants::BASE_STATION, SimConstants::AERIAL01);
+            rfd900sim::serialize_artifact_for_900MHz(&artmsg, serial_tx_buffer.data(), SERIAL_ARTIFACT_BUFFER_LENGTH);
+        }
+
+        if(msg900.window_open(artmsg.dest_id, artmsg.msg_id, SERIAL_ARTIFACT_BUFFER_LENGTH)){
+            tx_radio.send_message((const char*)serial_tx_buffer.data(), SERIAL_ARTIFACT_BUFFER_LENGTH);
+            msg900.add_to_ack_wait_list(artmsg.dest_id, artmsg.msg_id, artmsg.msg_type,
+                        serial_tx_buffer.data(), SERIAL_ARTIFACT_BUFFER_LENGTH);
+            held = false;
+        }
+        else if(!held){
+            held = true;
+            ++*stalls;
+        }
+
+        ssize_t bytesRead = tx_radio.read_serial(serial_rx_buffer, SERIAL_RX_BUFFER_LENGTH, held ? 1000L : 0L);
+        if(bytesRead > 0){
+            temp_rx_storage.append((const char*)serial_rx_buffer, bytesRead);
+            while(rfd900sim::extract_rx_message(temp_rx_storage, extracted_rx_data)){
+                rfd900sim::ack_message_t ack;
+                if(rfd900sim::process_rx_message(extracted_rx_data, &ack) != SimConstants::PROCESS_ACK
+                        || extracted_rx_data[2] != SimConstants::ACK){
+                    continue;
+                }
+
+                memcpy(&ack, extracted_rx_data.data(), sizeof(ack));
+                if(msg900.process_received_ack(ack.src_id, ack.msg_id) == 0){
+                    ++acked;
+                }
+            }
+        }
+
+        *retransmissions += msg900.scan_list_for_retransmission(retransmit);
+    }
+
+    double elapsed = std::chrono::duration<double>(steady::now() - start).count();
+
+    receiverRunning = false;
+    rx_thread.join();
+
+    return acked / elapsed;
+}
+
+
+int main(int argc, char **argv)
+{
+    int seconds = 2;
+    rfd900comm::linkEmulatorConfig config;
+
+    if(argc > 1){
+        seconds = atoi(argv[1]);
+    }
+    if(argc > 2){
+        config.loss_probability = atof(argv[2]);
+    }
+
+    const size_t framed_length = sizeof(rfd900sim::artifact_message_t)
+                        + SimConstants::MESSAGE_900_START_INDICATOR_LENGTH
+                        + SimConstants::MESSAGE_900_END_INDICATOR_LENGTH;
+
+    fprintf(stdout, "air rate: %u bytes/s, artifact frame: %lu bytes, channel limit: %.0f msgs/s, loss: %.2f, %d s per run\n\n",
+                config.air_bytes_per_sec, framed_length, (double)config.air_bytes_per_sec / framed_length,
+                config.loss_probability, seconds);
+
+    fprintf(stdout, "%8s %8s %12s %14s %10s\n", "rtt ms", "window", "msgs/s", "retransmits", "stalls");
+    for(int rtt : round_trip_ms){
+        config.latency = std::chrono::milliseconds(rtt / 2);
+
+        for(size_t frames : window_frames){
+            size_t retransmissions;
+            size_t stalls;
+            double rate = run_window(config, frames, seconds, &retransmissions, &stalls);
+            if(rate < 0){
+                return 1;
+            }
+            fprintf(stdout, "%8d %8lu %12.1f %14lu %10lu\n", rtt, frames, rate, retransmissions, stalls);
+        }
+    }
+
+    return 0;
+}